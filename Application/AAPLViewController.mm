@@ -300,6 +300,42 @@ Implementation of the cross-platform view controller
             case 'f':
                 _renderer->switchFrustrumLock();
                 break;
+            case 'r':
+                _renderer->switchDepthReduction();
+                break;
+            case 'g':
+                _renderer->switchCascadeConstruction();
+                break;
+            case 'c':
+                _renderer->switchAutoCascadeCount();
+                break;
+            case '=':
+                _renderer->changeCascadeCountBy(1);
+                break;
+            case '-':
+                _renderer->changeCascadeCountBy(-1);
+                break;
+            case 'l':
+                _renderer->switchLayeredShadows();
+                break;
+            case 'k':
+                _renderer->switchShadowCaching();
+                break;
+            case 'u':
+                _renderer->switchAmortizedCascades();
+                break;
+            case 'p':
+                _renderer->switchCoarseDepthReduction();
+                break;
+            case 'h':
+                _renderer->switchSparseReduction();
+                break;
+            case 'y':
+                _renderer->switchAsyncReduction();
+                break;
+            case 'm':
+                _renderer->switchMotionPrediction();
+                break;
         }
 
     }
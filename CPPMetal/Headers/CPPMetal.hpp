@@ -16,6 +16,7 @@ Header for C++ Metal wrapper
 #include "CPPMetalDevice.hpp"
 #include "CPPMetalDepthStencil.hpp"
 #include "CPPMetalDrawable.hpp"
+#include "CPPMetalEvent.hpp"
 #include "CPPMetalLibrary.hpp"
 #include "CPPMetalPixelFormat.hpp"
 #include "CPPMetalRenderPass.hpp"
@@ -23,6 +23,7 @@ class RenderPassDescriptor;
 class RenderCommandEncoder;
 class ComputeCommandEncoder;
 class Drawable;
+class Event;
 
 struct CommandBufferHandler
 {
@@ -67,6 +68,9 @@ public:
 
     void addScheduledHandler(CommandBufferHandler & scheduledHandler);
 
+    void encodeSignalEvent(const Event & event, uint64_t value) API_AVAILABLE(macos(10.14), ios(12.0));
+    void encodeWaitForEvent(const Event & event, uint64_t value) API_AVAILABLE(macos(10.14), ios(12.0));
+
 private:
 
     CPPMetalInternal::CommandBuffer m_objCObj;
@@ -42,6 +42,8 @@ public:
 
     void setTexture(const Texture &texture, UInteger index);
 
+    void setBytes(const void *bytes, UInteger length, UInteger index);
+
     void dispatchThreads(MTL::Size, MTL::Size);
 
 private:
@@ -66,6 +68,11 @@ inline void ComputeCommandEncoder::setTexture(const Texture &texture, UInteger i
     m_dispatch->setTexture(m_objCObj, CPPMetalInternal::setTextureSel, texture.objCObj(), index);
 }
 
+inline void ComputeCommandEncoder::setBytes(const void *bytes, UInteger length, UInteger index)
+{
+    m_dispatch->setBytes(m_objCObj, CPPMetalInternal::setBytesSel, bytes, length, index);
+}
+
 }
 
 #endif /* CPPMetalComputeCommandEncoder_h */
@@ -22,14 +22,17 @@ namespace CPPMetalInternal
 
 static const SEL setBufferSel          = sel_registerName("setBuffer:offset:atIndex:");
 static const SEL setTextureSel = sel_registerName("setTexture:atIndex:");
+static const SEL setBytesSel = sel_registerName("setBytes:length:atIndex:");
 
 typedef void (*setBufferType)         (id, SEL, CPPMetalInternal::Buffer buffer, MTL::UInteger offset, MTL::UInteger index);
 typedef void (*setTextureType)(id, SEL, CPPMetalInternal::Texture texture, MTL::UInteger index);
+typedef void (*setBytesType)(id, SEL, const void * bytes, MTL::UInteger length, MTL::UInteger index);
 
 struct ComputeCommandEncoderDispatchTable
 {
     CPP_METAL_DECLARE_FUNCTION_POINTER( setBuffer );
     CPP_METAL_DECLARE_FUNCTION_POINTER( setTexture );
+    CPP_METAL_DECLARE_FUNCTION_POINTER( setBytes );
 
     ComputeCommandEncoderDispatchTable(CPPMetalInternal::ObjCObj *objCObj);
 };
@@ -31,9 +31,11 @@ class ComputePipelineState;
 class ComputePipelineDescriptor;
 class RenderPipelineState;
 class RenderPipelineDescriptor;
+class TileRenderPipelineDescriptor;
 class DepthStencilState;
 class DepthStencilDescriptor;
 class CommandQueue;
+class Event;
 class Resource;
 
 
@@ -92,6 +94,9 @@ public:
     RenderPipelineState makeRenderPipelineState(const RenderPipelineDescriptor & descriptor,
                                                 CFErrorRef *error = nullptr);
 
+    RenderPipelineState makeRenderPipelineState(const TileRenderPipelineDescriptor & descriptor,
+                                                CFErrorRef *error = nullptr) API_AVAILABLE(macos(11.0), ios(11.0));
+
     ComputePipelineState *newComputePipelineWithFunction(const Function &function,
                                                          CFErrorRef *error = nullptr);
 
@@ -104,6 +109,9 @@ public:
     CommandQueue *newCommandQueue();
     CommandQueue makeCommandQueue();
 
+    Event *newEvent() API_AVAILABLE(macos(10.14), ios(12.0));
+    Event makeEvent() API_AVAILABLE(macos(10.14), ios(12.0));
+
     Buffer *newBufferWithLength(UInteger length, ResourceOptions options = ResourceOptionsDefault);
     Buffer makeBuffer(UInteger length, ResourceOptions options = ResourceOptionsDefault);
 
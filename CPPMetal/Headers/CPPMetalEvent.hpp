@@ -0,0 +1,75 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Header for C++ Metal event class wrapper
+*/
+
+#ifndef CPPMetalEvent_hpp
+#define CPPMetalEvent_hpp
+
+#include "CPPMetalImplementation.hpp"
+#include "CPPMetalTypes.hpp"
+#include "CPPMetalDevice.hpp"
+
+
+namespace MTL
+{
+
+
+class Device;
+
+class Event
+{
+public:
+
+    Event();
+
+    Event(const Event & rhs);
+
+    Event(Event && rhs);
+
+    Event & operator=(const Event & rhs);
+
+    Event & operator=(Event && rhs);
+
+    CPP_METAL_VIRTUAL ~Event();
+
+    bool operator==(const Event & rhs) const;
+
+    const char *label() const;
+    void        label(const char *string);
+    void        label(const CFStringRef string);
+
+    Device device() const;
+
+private:
+
+    CPPMetalInternal::Event m_objCObj;
+
+    Device *m_device;
+
+public: // Public methods for CPPMetal internal implementation
+
+    Event(CPPMetalInternal::Event objCObj, Device & device);
+
+    CPPMetalInternal::Event objCObj() const;
+
+};
+
+
+//=================================================
+#pragma mark - Event inline method implementations
+
+CPP_METAL_MOVE_CONSTRUCTOR_AND_OPERATOR_OVERLOAD_IMPLEMENTATION(Event);
+
+CPP_METAL_OBJCOBJ_GETTER_IMPLEMENATATION(Event);
+
+inline void Event::label(const char* string)
+{
+    CPP_METAL_PROCESS_LABEL(string, label);
+}
+
+} // namespace MTL
+
+#endif // CPPMetalEvent_hpp
@@ -103,6 +103,7 @@ CPP_METAL_PROTOCOL_ALIAS( ComputePipelineState );
 CPP_METAL_PROTOCOL_ALIAS( DepthStencilState );
 CPP_METAL_PROTOCOL_ALIAS( Device );
 CPP_METAL_PROTOCOL_ALIAS( Drawable );
+CPP_METAL_PROTOCOL_ALIAS( Event );
 CPP_METAL_PROTOCOL_ALIAS( Library );
 CPP_METAL_PROTOCOL_ALIAS( Function );
 CPP_METAL_PROTOCOL_ALIAS( RenderCommandEncoder );
@@ -121,6 +122,7 @@ CPP_METAL_CLASS_ALIAS( RenderPassDescriptor );
 CPP_METAL_CLASS_ALIAS( RenderPipelineDescriptor );
 CPP_METAL_CLASS_ALIAS( RenderPipelineColorAttachmentDescriptor );
 CPP_METAL_CLASS_ALIAS( RenderPipelineColorAttachmentDescriptorArray );
+CPP_METAL_CLASS_ALIAS( TileRenderPipelineDescriptor );
 CPP_METAL_CLASS_ALIAS( TextureDescriptor );
 CPP_METAL_CLASS_ALIAS( VertexBufferLayoutDescriptor );
 CPP_METAL_CLASS_ALIAS( VertexAttributeDescriptor );
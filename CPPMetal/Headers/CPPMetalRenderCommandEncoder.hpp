@@ -92,6 +92,8 @@ public:
 
     void setViewport(const Viewport & viewport);
 
+    void setViewports(const Viewport viewports[], UInteger count) API_AVAILABLE(macos(10.13), ios(12.0));
+
     void setFrontFacingWinding(Winding winding);
 
     void setCullMode(CullMode cullMode);
@@ -102,6 +104,8 @@ public:
 
     void setScissorRect(const ScissorRect & scissorRect);
 
+    void setScissorRects(const ScissorRect scissorRects[], UInteger count) API_AVAILABLE(macos(10.13), ios(12.0));
+
     void setTriangleFillMode(TriangleFillMode fillMode);
 
     // Fragment Resources
@@ -147,6 +151,18 @@ public:
                                UInteger instanceCount,
                                UInteger baseVertex,
                                UInteger baseInstance) API_AVAILABLE(macos(10.11), ios(9.0));
+
+    // Tile Shading
+
+    UInteger tileWidth() const API_AVAILABLE(macos(11.0), ios(11.0));
+    UInteger tileHeight() const API_AVAILABLE(macos(11.0), ios(11.0));
+
+    void setTileBuffer(const Buffer & buffer, UInteger offset, UInteger index) API_AVAILABLE(macos(11.0), ios(11.0));
+
+    void setThreadgroupMemoryLength(UInteger length, UInteger offset, UInteger index) API_AVAILABLE(macos(11.0), ios(11.0));
+
+    void dispatchThreadsPerTile(Size threadsPerTile) API_AVAILABLE(macos(11.0), ios(11.0));
+
 private:
 
     CPPMetalInternal::RenderCommandEncoderDispatchTable *m_dispatch;
@@ -254,6 +254,18 @@ public:
 
     RenderPassStencilAttachmentDescriptor stencilAttachment;
 
+    UInteger renderTargetArrayLength() const API_AVAILABLE(macos(10.11), ios(12.0));
+    void     renderTargetArrayLength(UInteger length) API_AVAILABLE(macos(10.11), ios(12.0));
+
+    UInteger tileWidth() const API_AVAILABLE(macos(11.0), ios(11.0));
+    void     tileWidth(UInteger width) API_AVAILABLE(macos(11.0), ios(11.0));
+
+    UInteger tileHeight() const API_AVAILABLE(macos(11.0), ios(11.0));
+    void     tileHeight(UInteger height) API_AVAILABLE(macos(11.0), ios(11.0));
+
+    UInteger threadgroupMemoryLength() const API_AVAILABLE(macos(11.0), ios(11.0));
+    void     threadgroupMemoryLength(UInteger length) API_AVAILABLE(macos(11.0), ios(11.0));
+
 public: // Public methods for CPPMetal internal implementation
 
     explicit RenderPassDescriptor(CPPMetalInternal::RenderPassDescriptor objCObj);
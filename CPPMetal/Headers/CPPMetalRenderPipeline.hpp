@@ -54,6 +54,14 @@ typedef enum
     BlendOperationMax = 4,
 } BlendOperation API_AVAILABLE(macos(10.11), ios(8.0));
 
+typedef enum
+{
+    PrimitiveTopologyClassUnspecified = 0,
+    PrimitiveTopologyClassPoint = 1,
+    PrimitiveTopologyClassLine = 2,
+    PrimitiveTopologyClassTriangle = 3,
+} PrimitiveTopologyClass API_AVAILABLE(macos(10.11), ios(12.0));
+
 class RenderPipelineColorAttachmentDescriptorArray;
 
 struct RenderPipelineColorAttachmentDescriptor
@@ -194,6 +202,9 @@ public:
     PixelFormat stencilAttachmentPixelFormat() const;
     void        stencilAttachmentPixelFormat(PixelFormat format);
 
+    PrimitiveTopologyClass inputPrimitiveTopology() const API_AVAILABLE(macos(10.11), ios(12.0));
+    void                   inputPrimitiveTopology(PrimitiveTopologyClass topology) API_AVAILABLE(macos(10.11), ios(12.0));
+
     RenderPipelineColorAttachmentDescriptorArray colorAttachments;
 
 private:
@@ -210,6 +221,50 @@ public: // Public methods for CPPMetal internal implementation
 
 };
 
+struct TileRenderPipelineDescriptor
+{
+public:
+
+    TileRenderPipelineDescriptor();
+
+    TileRenderPipelineDescriptor(const TileRenderPipelineDescriptor & rhs);
+
+    TileRenderPipelineDescriptor & operator=(const TileRenderPipelineDescriptor & rhs);
+
+    CPP_METAL_VIRTUAL ~TileRenderPipelineDescriptor();
+
+    bool operator==(const TileRenderPipelineDescriptor & rhs) const;
+
+    const char* label() const;
+    void        label(const CFStringRef string);
+    void        label(const char* string);
+
+    const Function *tileFunction() const;
+    void            tileFunction(const Function * function);
+
+    UInteger rasterSampleCount() const;
+    void     rasterSampleCount(UInteger count);
+
+    bool threadgroupSizeMatchesTileSize() const;
+    void threadgroupSizeMatchesTileSize(bool matches);
+
+    // The tile pipeline's color attachments only carry a pixel format, so they are set by index
+    // instead of through a descriptor array
+    PixelFormat colorAttachmentPixelFormat(UInteger index) const;
+    void        colorAttachmentPixelFormat(UInteger index, PixelFormat format);
+
+private:
+
+    CPPMetalInternal::TileRenderPipelineDescriptor m_objCObj;
+
+    Function m_tileFunction;
+
+public: // Public methods for CPPMetal internal implementation
+
+    CPPMetalInternal::TileRenderPipelineDescriptor objCObj() const;
+
+};
+
 class Device;
 
 class RenderPipelineState
@@ -290,6 +345,20 @@ inline CPPMetalInternal::RenderPipelineDescriptor RenderPipelineDescriptor::objC
 }
 
 
+//================================================================
+#pragma mark - TileRenderPipelineDescriptor inline implementations
+
+inline void TileRenderPipelineDescriptor::label(const char* string)
+{
+    CPP_METAL_PROCESS_LABEL(string, label);
+}
+
+inline CPPMetalInternal::TileRenderPipelineDescriptor TileRenderPipelineDescriptor::objCObj() const
+{
+    return m_objCObj;
+}
+
+
 //=======================================================
 #pragma mark - RenderPipelineState inline implementations
 
@@ -156,6 +156,11 @@ public:
                   const Region & sourceRegion,
                   UInteger mipmapLevel);
 
+    Texture makeTextureView(PixelFormat pixelFormat,
+                            TextureType textureType,
+                            const Range & levels,
+                            const Range & slices);
+
     Device device() const;
 
 public: // Public methods for CPPMetal internal implementation
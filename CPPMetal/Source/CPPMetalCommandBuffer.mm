@@ -12,6 +12,7 @@ Implementation of C++ Metal command buffer class wrapper
 #include "CPPMetalRenderPass.hpp"
 #include "CPPMetalDevice.hpp"
 #include "CPPMetalDrawable.hpp"
+#include "CPPMetalEvent.hpp"
 #include <Metal/Metal.h>
 
 using namespace MTL;
@@ -98,3 +99,17 @@ void CommandBuffer::addScheduledHandler(CommandBufferHandler & scheduledHandler)
         scheduledHandler(commandBuffer);
     }];
 }
+
+void CommandBuffer::encodeSignalEvent(const Event & event, uint64_t value)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    [m_objCObj encodeSignalEvent:event.objCObj() value:value];
+}
+
+void CommandBuffer::encodeWaitForEvent(const Event & event, uint64_t value)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    [m_objCObj encodeWaitForEvent:event.objCObj() value:value];
+}
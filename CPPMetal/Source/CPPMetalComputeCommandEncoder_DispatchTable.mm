@@ -18,5 +18,6 @@ ComputeCommandEncoderDispatchTable::ComputeCommandEncoderDispatchTable(NSObject
 {
     CPP_METAL_SET_IMPLEMENTATION( setBuffer );
     CPP_METAL_SET_IMPLEMENTATION( setTexture );
+    CPP_METAL_SET_IMPLEMENTATION( setBytes );
 }
 
@@ -9,6 +9,7 @@ Implementation of C++ Metal device class wrapper
 #include "CPPMetalDevice.hpp"
 #include "CPPMetalBuffer.hpp"
 #include "CPPMetalCommandQueue.hpp"
+#include "CPPMetalEvent.hpp"
 #include "CPPMetalDepthStencil.hpp"
 #include "CPPMetalLibrary.hpp"
 #include "CPPMetalRenderPipeline.hpp"
@@ -246,6 +247,27 @@ RenderPipelineState Device::makeRenderPipelineState(const RenderPipelineDescript
     return RenderPipelineState(objCObj, *this);
 }
 
+RenderPipelineState Device::makeRenderPipelineState(const TileRenderPipelineDescriptor & descriptor,
+                                                    CFErrorRef *error)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    NSError *nserror;
+    const id<MTLRenderPipelineState> objCObj = [m_objCObj newRenderPipelineStateWithTileDescriptor:descriptor.objCObj()
+                                                                                           options:MTLPipelineOptionNone
+                                                                                        reflection:nil
+                                                                                             error:&nserror];
+    if(!objCObj)
+    {
+        if(error)
+        {
+            *error = (__bridge CFErrorRef)nserror;
+        }
+    }
+
+    return RenderPipelineState(objCObj, *this);
+}
+
 ComputePipelineState *Device::newComputePipelineWithFunction(const Function & function,
                                                          CFErrorRef *error)
 {
@@ -337,6 +359,31 @@ CommandQueue Device::makeCommandQueue()
     return CommandQueue(objCObj, *this);
 }
 
+Event *Device::newEvent()
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    id<MTLEvent> objCObj = [m_objCObj newEvent];
+
+    if(!objCObj)
+    {
+        return nullptr;
+    }
+
+    Event *event = construct<Event>(allocator(), objCObj, *this);
+
+    return event;
+}
+
+Event Device::makeEvent()
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    id<MTLEvent> objCObj = [m_objCObj newEvent];
+
+    return Event(objCObj, *this);
+}
+
 Buffer *Device::newBufferWithLength(UInteger length, ResourceOptions options)
 {
     CPP_METAL_VALIDATE_WRAPPED_NIL();
@@ -0,0 +1,33 @@
+/*
+See LICENSE folder for this sample’s licensing information.
+
+Abstract:
+Implementation of C++ Metal event class wrapper
+*/
+
+#include "CPPMetalEvent.hpp"
+#include "CPPMetalInternalMacros.h"
+#include "CPPMetalDevice.hpp"
+#include <Metal/Metal.h>
+
+using namespace MTL;
+
+CPP_METAL_CONSTRUCTOR_IMPLEMENTATION(Event);
+
+CPP_METAL_NULL_REFERENCE_CONSTRUCTOR_IMPLEMENATATION(Event);
+
+CPP_METAL_COPY_CONSTRUCTOR_AND_OPERATOR_OVERLOAD_IMPLEMENTATION(Event);
+
+Event::~Event()
+{
+    m_objCObj = nil;
+}
+
+bool Event::operator==(const Event & rhs) const
+{
+    return [m_objCObj isEqual:rhs.objCObj()];
+}
+
+CPP_METAL_READWRITE_LABEL_PROPERTY_IMPLEMENTATION(Event);
+
+CPP_METAL_DEVICE_GETTER_IMPLEMENTATION(Event);
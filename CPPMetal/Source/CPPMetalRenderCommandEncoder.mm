@@ -79,6 +79,12 @@ void RenderCommandEncoder::setViewport(const Viewport & viewport)
     [((id<MTLRenderCommandEncoder>)m_objCObj) setViewport:*viewportPtr];
 }
 
+void RenderCommandEncoder::setViewports(const Viewport viewports[], UInteger count)
+{
+    const MTLViewport *viewportsPtr = (const MTLViewport*)viewports;
+    [((id<MTLRenderCommandEncoder>)m_objCObj) setViewports:viewportsPtr count:count];
+}
+
 void RenderCommandEncoder::setFrontFacingWinding(Winding winding)
 {
     [((id<MTLRenderCommandEncoder>)m_objCObj) setFrontFacingWinding:(MTLWinding)winding];
@@ -105,6 +111,12 @@ void RenderCommandEncoder::setScissorRect(const ScissorRect & scissorRect)
     [((id<MTLRenderCommandEncoder>)m_objCObj) setScissorRect:*scissorPtr];
 }
 
+void RenderCommandEncoder::setScissorRects(const ScissorRect scissorRects[], UInteger count)
+{
+    const MTLScissorRect *scissorRectsPtr = (const MTLScissorRect*)scissorRects;
+    [((id<MTLRenderCommandEncoder>)m_objCObj) setScissorRects:scissorRectsPtr count:count];
+}
+
 void RenderCommandEncoder::setTriangleFillMode(TriangleFillMode fillMode)
 {
     [((id<MTLRenderCommandEncoder>)m_objCObj) setTriangleFillMode:(MTLTriangleFillMode) fillMode];
@@ -218,3 +230,32 @@ CPP_METAL_VALIDATE_STRUCT_ALIAS( ScissorRect, y );
 CPP_METAL_VALIDATE_STRUCT_ALIAS( ScissorRect, width );
 CPP_METAL_VALIDATE_STRUCT_ALIAS( ScissorRect, height );
 
+UInteger RenderCommandEncoder::tileWidth() const
+{
+    return ((id<MTLRenderCommandEncoder>)m_objCObj).tileWidth;
+}
+
+UInteger RenderCommandEncoder::tileHeight() const
+{
+    return ((id<MTLRenderCommandEncoder>)m_objCObj).tileHeight;
+}
+
+void RenderCommandEncoder::setTileBuffer(const Buffer & buffer, UInteger offset, UInteger index)
+{
+    [((id<MTLRenderCommandEncoder>)m_objCObj) setTileBuffer:buffer.objCObj()
+                                                     offset:offset
+                                                    atIndex:index];
+}
+
+void RenderCommandEncoder::setThreadgroupMemoryLength(UInteger length, UInteger offset, UInteger index)
+{
+    [((id<MTLRenderCommandEncoder>)m_objCObj) setThreadgroupMemoryLength:length
+                                                                  offset:offset
+                                                                 atIndex:index];
+}
+
+void RenderCommandEncoder::dispatchThreadsPerTile(Size threadsPerTile)
+{
+    [((id<MTLRenderCommandEncoder>)m_objCObj)
+        dispatchThreadsPerTile:MTLSizeMake(threadsPerTile.width, threadsPerTile.height, threadsPerTile.depth)];
+}
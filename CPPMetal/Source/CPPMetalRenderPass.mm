@@ -380,3 +380,43 @@ RenderPassDescriptor::~RenderPassDescriptor()
 {
     m_objCObj = nil;
 }
+
+UInteger RenderPassDescriptor::renderTargetArrayLength() const
+{
+    return m_objCObj.renderTargetArrayLength;
+}
+
+void RenderPassDescriptor::renderTargetArrayLength(UInteger length)
+{
+    m_objCObj.renderTargetArrayLength = length;
+}
+
+UInteger RenderPassDescriptor::tileWidth() const
+{
+    return m_objCObj.tileWidth;
+}
+
+void RenderPassDescriptor::tileWidth(UInteger width)
+{
+    m_objCObj.tileWidth = width;
+}
+
+UInteger RenderPassDescriptor::tileHeight() const
+{
+    return m_objCObj.tileHeight;
+}
+
+void RenderPassDescriptor::tileHeight(UInteger height)
+{
+    m_objCObj.tileHeight = height;
+}
+
+UInteger RenderPassDescriptor::threadgroupMemoryLength() const
+{
+    return m_objCObj.threadgroupMemoryLength;
+}
+
+void RenderPassDescriptor::threadgroupMemoryLength(UInteger length)
+{
+    m_objCObj.threadgroupMemoryLength = length;
+}
@@ -42,6 +42,11 @@ CPP_METAL_VALIDATE_ENUM_ALIAS( BlendOperationReverseSubtract );
 CPP_METAL_VALIDATE_ENUM_ALIAS( BlendOperationMin );
 CPP_METAL_VALIDATE_ENUM_ALIAS( BlendOperationMax );
 
+CPP_METAL_VALIDATE_ENUM_ALIAS( PrimitiveTopologyClassUnspecified );
+CPP_METAL_VALIDATE_ENUM_ALIAS( PrimitiveTopologyClassPoint );
+CPP_METAL_VALIDATE_ENUM_ALIAS( PrimitiveTopologyClassLine );
+CPP_METAL_VALIDATE_ENUM_ALIAS( PrimitiveTopologyClassTriangle );
+
 #pragma mark - RenderPipelineColorAttachmentDescriptor
 
 RenderPipelineColorAttachmentDescriptor::RenderPipelineColorAttachmentDescriptor() :
@@ -292,12 +297,100 @@ CPP_METAL_READWRITE_MTL_ENUM_PROPERTY_IMPLEMENTATION(RenderPipelineDescriptor, P
 
 CPP_METAL_READWRITE_MTL_ENUM_PROPERTY_IMPLEMENTATION(RenderPipelineDescriptor, PixelFormat, stencilAttachmentPixelFormat)
 
+CPP_METAL_READWRITE_MTL_ENUM_PROPERTY_IMPLEMENTATION(RenderPipelineDescriptor, PrimitiveTopologyClass, inputPrimitiveTopology);
+
 bool RenderPipelineDescriptor::operator==(const RenderPipelineDescriptor & rhs) const
 {
     return [m_objCObj isEqual:rhs.objCObj()];
 }
 
 
+//========================================================
+#pragma mark - TileRenderPipelineDescriptor Implementation
+
+TileRenderPipelineDescriptor::TileRenderPipelineDescriptor()
+: m_objCObj([MTLTileRenderPipelineDescriptor new])
+{
+    // Member initialization only
+}
+
+TileRenderPipelineDescriptor::TileRenderPipelineDescriptor(const TileRenderPipelineDescriptor & rhs)
+: m_objCObj([rhs.m_objCObj copyWithZone:nil])
+, m_tileFunction(rhs.m_tileFunction)
+{
+    // Member initialization only
+}
+
+TileRenderPipelineDescriptor & TileRenderPipelineDescriptor::operator=(const TileRenderPipelineDescriptor & rhs)
+{
+    m_objCObj = [rhs.m_objCObj copyWithZone:nil];
+    m_tileFunction = rhs.m_tileFunction;
+
+    return *this;
+}
+
+TileRenderPipelineDescriptor::~TileRenderPipelineDescriptor()
+{
+    m_objCObj = nil;
+}
+
+CPP_METAL_READWRITE_LABEL_PROPERTY_IMPLEMENTATION(TileRenderPipelineDescriptor)
+
+CPP_METAL_READWRITE_PROPERTY_IMPLEMENTATION(TileRenderPipelineDescriptor, UInteger, rasterSampleCount);
+
+CPP_METAL_READWRITE_BOOL_PROPERTY_IMPLEMENTATION(TileRenderPipelineDescriptor, threadgroupSizeMatchesTileSize, threadgroupSizeMatchesTileSize);
+
+void TileRenderPipelineDescriptor::tileFunction(const Function * function)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    if(function)
+    {
+        m_objCObj.tileFunction = function->objCObj();
+        m_tileFunction = *function;
+    }
+    else
+    {
+        m_objCObj.tileFunction = nil;
+        m_tileFunction = Function();
+    }
+}
+
+const Function * TileRenderPipelineDescriptor::tileFunction() const
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    if(m_objCObj.tileFunction == nil)
+    {
+        assert(m_tileFunction.objCObj() == nil);
+
+        return nullptr;
+    }
+    return &m_tileFunction;
+}
+
+void TileRenderPipelineDescriptor::colorAttachmentPixelFormat(UInteger index, PixelFormat format)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+    assert(index < MaxColorAttachments);
+
+    m_objCObj.colorAttachments[index].pixelFormat = (MTLPixelFormat)format;
+}
+
+PixelFormat TileRenderPipelineDescriptor::colorAttachmentPixelFormat(UInteger index) const
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+    assert(index < MaxColorAttachments);
+
+    return (PixelFormat)m_objCObj.colorAttachments[index].pixelFormat;
+}
+
+bool TileRenderPipelineDescriptor::operator==(const TileRenderPipelineDescriptor & rhs) const
+{
+    return [m_objCObj isEqual:rhs.objCObj()];
+}
+
+
 #pragma mark - RenderPipelineState
 
 CPP_METAL_CONSTRUCTOR_IMPLEMENTATION(RenderPipelineState);
@@ -229,4 +229,22 @@ void Texture::getBytes(void * pixelBytes,
                               mipmapLevel:mipmapLevel];
 }
 
+Texture Texture::makeTextureView(PixelFormat pixelFormat,
+                                 TextureType textureType,
+                                 const Range & levels,
+                                 const Range & slices)
+{
+    CPP_METAL_VALIDATE_WRAPPED_NIL();
+
+    const NSRange levelRange = NSMakeRange(levels.location, levels.length);
+    const NSRange sliceRange = NSMakeRange(slices.location, slices.length);
+
+    const id<MTLTexture> objCObj = [((id<MTLTexture>)m_objCObj) newTextureViewWithPixelFormat:(MTLPixelFormat)pixelFormat
+                                                                                  textureType:(MTLTextureType)textureType
+                                                                                       levels:levelRange
+                                                                                       slices:sliceRange];
+
+    return Texture(objCObj, *m_device);
+}
+
 CPP_METAL_DEVICE_GETTER_IMPLEMENTATION(Texture);
@@ -12,7 +12,7 @@ Implementation of renderer class which performs Metal setup and per frame render
 #include "AAPLUtilities.h"
 #include "AAPLRenderer.h"
 
-#include <simd/simd.h>
+#include "SDSM_Simd.h"
 
 #if TARGET_MACOS
 #define ColorClass NSColor
@@ -20,8 +20,31 @@ Implementation of vector, matrix, and quaternion math utility functions useful f
 #include <assert.h>
 #include <stdlib.h>
 
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define AAPL_BATCH_SSE 1
+#if defined(__AVX__)
+#define AAPL_BATCH_AVX 1
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AAPL_BATCH_NEON 1
+#endif
+
 uint32_t seed_lo, seed_hi;
 
+#if SDSM_SIMD_PORTABLE
+
+float AAPL_SIMD_OVERLOAD float32_from_float16(uint16_t i) {
+    return SDSMSimd::halfToFloat(i);
+}
+
+uint16_t AAPL_SIMD_OVERLOAD float16_from_float32(float f) {
+    return SDSMSimd::floatToHalf(f);
+}
+
+#else
+
 static float inline F16ToF32(const __fp16 *address) {
     return *address;
 }
@@ -40,6 +63,8 @@ uint16_t AAPL_SIMD_OVERLOAD float16_from_float32(float f) {
     return f16;
 }
 
+#endif
+
 vector_float3 AAPL_SIMD_OVERLOAD generate_random_vector(float min, float max)
 {
     vector_float3 rand;
@@ -386,6 +411,32 @@ matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_inverse_transpose(matrix_float4x4 m) {
     return matrix_invert(matrix_transpose(m));
 }
 
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_invert_rigid(matrix_float4x4 m) {
+    vector_float3 x = m.columns[0].xyz;
+    vector_float3 y = m.columns[1].xyz;
+    vector_float3 z = m.columns[2].xyz;
+    vector_float3 t = m.columns[3].xyz;
+
+    // The rotation's inverse is its transpose, which undoes the translation rotated back
+    return matrix_make_rows(x.x, x.y, x.z, -vector_dot(x, t),
+                            y.x, y.y, y.z, -vector_dot(y, t),
+                            z.x, z.y, z.z, -vector_dot(z, t),
+                              0,   0,   0,                 1 );
+}
+
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_invert_perspective_left_hand(matrix_float4x4 m) {
+    float xs = m.columns[0][0];
+    float ys = m.columns[1][1];
+    float zs = m.columns[2][2];
+    float zt = m.columns[3][2];
+
+    // Clip w is eye z, and clip z is zs * z + zt * w
+    return matrix_make_rows(1 / xs,      0,       0,        0,
+                                 0, 1 / ys,       0,        0,
+                                 0,      0,       0,        1,
+                                 0,      0, 1 / zt, -zs / zt );
+}
+
 quaternion_float AAPL_SIMD_OVERLOAD quaternion(float x, float y, float z, float w) {
     return (quaternion_float){ x, y, z, w };
 }
@@ -635,3 +686,185 @@ vector_float3 AAPL_SIMD_OVERLOAD right_direction_vector_from_quaternion(quaterni
     // Negate for a right-handed coordinate system
     return direction;
 }
+
+//------------------------------------------------------------------------------
+// Batched transforms.  Each kernel is written once against a set of lanes and run
+// with the widest set the target has, then with narrower ones for the remainder.
+
+struct ScalarLanes {
+    typedef float Lanes;
+    static const size_t width = 1;
+    static Lanes load(const float *p) { return *p; }
+    static void store(float *p, Lanes a) { *p = a; }
+    static Lanes splat(float s) { return s; }
+    static Lanes add(Lanes a, Lanes b) { return a + b; }
+    static Lanes sub(Lanes a, Lanes b) { return a - b; }
+    static Lanes mul(Lanes a, Lanes b) { return a * b; }
+    static Lanes abs(Lanes a) { return fabsf(a); }
+};
+
+#if AAPL_BATCH_AVX
+struct AVXLanes {
+    typedef __m256 Lanes;
+    static const size_t width = 8;
+    static Lanes load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, Lanes a) { _mm256_storeu_ps(p, a); }
+    static Lanes splat(float s) { return _mm256_set1_ps(s); }
+    static Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+    static Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+    static Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+    static Lanes abs(Lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+};
+#endif
+
+#if AAPL_BATCH_SSE
+struct SSELanes {
+    typedef __m128 Lanes;
+    static const size_t width = 4;
+    static Lanes load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, Lanes a) { _mm_storeu_ps(p, a); }
+    static Lanes splat(float s) { return _mm_set1_ps(s); }
+    static Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+    static Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+    static Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+    static Lanes abs(Lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+};
+#elif AAPL_BATCH_NEON
+struct NEONLanes {
+    typedef float32x4_t Lanes;
+    static const size_t width = 4;
+    static Lanes load(const float *p) { return vld1q_f32(p); }
+    static void store(float *p, Lanes a) { vst1q_f32(p, a); }
+    static Lanes splat(float s) { return vdupq_n_f32(s); }
+    static Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+    static Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+    static Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+    static Lanes abs(Lanes a) { return vabsq_f32(a); }
+};
+#endif
+
+// Transforms whole groups of L::width points from first on and returns where it stopped
+template <class L>
+static size_t transform_points(const matrix_float4x4 &m, soa_float3 points, soa_float3 result,
+                               size_t first, size_t count) {
+    typename L::Lanes columns[4][3];
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 3; row++) {
+            columns[column][row] = L::splat(m.columns[column][row]);
+        }
+    }
+
+    size_t i = first;
+
+    for (; i + L::width <= count; i += L::width) {
+        typename L::Lanes x = L::load(points.x + i);
+        typename L::Lanes y = L::load(points.y + i);
+        typename L::Lanes z = L::load(points.z + i);
+        typename L::Lanes transformed[3];
+
+        for (int row = 0; row < 3; row++) {
+            transformed[row] = L::add(L::add(L::add(L::mul(columns[0][row], x),
+                                                    L::mul(columns[1][row], y)),
+                                             L::mul(columns[2][row], z)),
+                                      columns[3][row]);
+        }
+
+        L::store(result.x + i, transformed[0]);
+        L::store(result.y + i, transformed[1]);
+        L::store(result.z + i, transformed[2]);
+    }
+
+    return i;
+}
+
+template <class L>
+static size_t transform_boxes(const matrix_float4x4 &m, soa_box_float3 boxes, soa_box_float3 result,
+                              size_t first, size_t count) {
+    typename L::Lanes columns[4][3];
+    typename L::Lanes absColumns[3][3];
+    typename L::Lanes half = L::splat(0.5f);
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 3; row++) {
+            columns[column][row] = L::splat(m.columns[column][row]);
+
+            if (column < 3) {
+                absColumns[column][row] = L::abs(columns[column][row]);
+            }
+        }
+    }
+
+    size_t i = first;
+
+    for (; i + L::width <= count; i += L::width) {
+        typename L::Lanes min[3] = { L::load(boxes.min.x + i), L::load(boxes.min.y + i), L::load(boxes.min.z + i) };
+        typename L::Lanes max[3] = { L::load(boxes.max.x + i), L::load(boxes.max.y + i), L::load(boxes.max.z + i) };
+        typename L::Lanes center[3];
+        typename L::Lanes extent[3];
+
+        // Halved first as in transformAxisAlignedBox, so infinite boxes keep finite extents
+        for (int axis = 0; axis < 3; axis++) {
+            typename L::Lanes halfMin = L::mul(min[axis], half);
+            typename L::Lanes halfMax = L::mul(max[axis], half);
+
+            center[axis] = L::add(halfMin, halfMax);
+            extent[axis] = L::sub(halfMax, halfMin);
+        }
+
+        float *resultMin[3] = { result.min.x + i, result.min.y + i, result.min.z + i };
+        float *resultMax[3] = { result.max.x + i, result.max.y + i, result.max.z + i };
+
+        for (int row = 0; row < 3; row++) {
+            typename L::Lanes transformedCenter = columns[3][row];
+            typename L::Lanes transformedExtent = L::mul(absColumns[0][row], extent[0]);
+
+            for (int column = 0; column < 3; column++) {
+                transformedCenter = L::add(transformedCenter, L::mul(columns[column][row], center[column]));
+            }
+
+            transformedExtent = L::add(transformedExtent, L::mul(absColumns[1][row], extent[1]));
+            transformedExtent = L::add(transformedExtent, L::mul(absColumns[2][row], extent[2]));
+
+            L::store(resultMin[row], L::sub(transformedCenter, transformedExtent));
+            L::store(resultMax[row], L::add(transformedCenter, transformedExtent));
+        }
+    }
+
+    return i;
+}
+
+soa_box_float3 AAPL_SIMD_OVERLOAD soa_box_float3_from_buffer(float *buffer, size_t count) {
+    soa_box_float3 boxes = {
+        { buffer, buffer + count, buffer + 2 * count },
+        { buffer + 3 * count, buffer + 4 * count, buffer + 5 * count } };
+    return boxes;
+}
+
+void AAPL_SIMD_OVERLOAD matrix_transform_points(matrix_float4x4 m, soa_float3 points,
+                                                soa_float3 result, size_t count) {
+    size_t i = 0;
+#if AAPL_BATCH_AVX
+    i = transform_points<AVXLanes>(m, points, result, i, count);
+#endif
+#if AAPL_BATCH_SSE
+    i = transform_points<SSELanes>(m, points, result, i, count);
+#elif AAPL_BATCH_NEON
+    i = transform_points<NEONLanes>(m, points, result, i, count);
+#endif
+    transform_points<ScalarLanes>(m, points, result, i, count);
+}
+
+void AAPL_SIMD_OVERLOAD matrix_transform_boxes(matrix_float4x4 m, soa_box_float3 boxes,
+                                               soa_box_float3 result, size_t count) {
+    size_t i = 0;
+#if AAPL_BATCH_AVX
+    i = transform_boxes<AVXLanes>(m, boxes, result, i, count);
+#endif
+#if AAPL_BATCH_SSE
+    i = transform_boxes<SSELanes>(m, boxes, result, i, count);
+#elif AAPL_BATCH_NEON
+    i = transform_boxes<NEONLanes>(m, boxes, result, i, count);
+#endif
+    transform_boxes<ScalarLanes>(m, boxes, result, i, count);
+}
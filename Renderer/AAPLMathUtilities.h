@@ -6,10 +6,15 @@ Header for vector, matrix, and quaternion math utility functions useful for 3D g
 */
 
 #include <stdlib.h>
-#include <simd/simd.h>
+#include "SDSM_Simd.h"
 
 // Because these are common methods, allow other libraries to overload their implementation.
+// Only clang has the attribute; C++ overloads without it.
+#if defined(__clang__)
 #define AAPL_SIMD_OVERLOAD __attribute__((__overloadable__))
+#else
+#define AAPL_SIMD_OVERLOAD
+#endif
 
 /// A single-precision quaternion type.
 typedef vector_float4 quaternion_float;
@@ -187,6 +192,43 @@ matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_perspective_frustum_right_hand(float l
 /// Returns the inverse of the transpose of the given matrix.
 matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_inverse_transpose(matrix_float4x4 m);
 
+/// Returns the inverse of a rotation followed by a translation, such as a look at
+/// matrix, without a general 4x4 inversion.
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_invert_rigid(matrix_float4x4 m);
+
+/// Returns the inverse of a projection built by matrix_perspective_left_hand
+/// without a general 4x4 inversion.
+matrix_float4x4 AAPL_SIMD_OVERLOAD matrix_invert_perspective_left_hand(matrix_float4x4 m);
+
+/// Points in structure of arrays layout, one array per coordinate, so a batch
+/// transforms four or eight points per SIMD instruction.
+typedef struct soa_float3 {
+    float *x;
+    float *y;
+    float *z;
+} soa_float3;
+
+/// Axis aligned boxes in structure of arrays layout.
+typedef struct soa_box_float3 {
+    soa_float3 min;
+    soa_float3 max;
+} soa_box_float3;
+
+/// Carves count boxes out of a buffer of 6 * count floats: all min x, then min y,
+/// min z, max x, max y and max z.
+soa_box_float3 AAPL_SIMD_OVERLOAD soa_box_float3_from_buffer(float *buffer, size_t count);
+
+/// Transforms count points with w = 1 by the affine matrix m; the bottom row is ignored.
+/// Gives the same bits as m * (x, y, z, 1) one point at a time.  result may alias points.
+void AAPL_SIMD_OVERLOAD matrix_transform_points(matrix_float4x4 m, soa_float3 points,
+                                                soa_float3 result, size_t count);
+
+/// Bounds of count axis aligned boxes after the affine matrix m: the transformed center
+/// plus and minus the extents scaled by the absolute rotation and scale.  Gives the same
+/// bits as transformAxisAlignedBox in SDSM_Culling.h.  result may alias boxes.
+void AAPL_SIMD_OVERLOAD matrix_transform_boxes(matrix_float4x4 m, soa_box_float3 boxes,
+                                               soa_box_float3 result, size_t count);
+
 /// Constructs an identity quaternion.
 quaternion_float AAPL_SIMD_OVERLOAD quaternion_identity(void);
 
@@ -10,6 +10,7 @@ Header for mesh and submesh objects used for managing models
 #include <unordered_map>
 
 #include "AAPLShaderTypes.h"
+#include "SDSM_Culling.h"
 #include <vector>
 
 struct MeshVertex
@@ -97,6 +98,10 @@ public:
     const MeshBuffer & indexBuffer() const;
     const std::vector<MTL::Texture> & textures() const;
 
+    // Model space bounds of the vertices the submesh indexes.  Unbounded unless set.
+    const AxisAlignedBox & bounds() const;
+    void bounds(const AxisAlignedBox & bounds);
+
 private:
 
     MTL::PrimitiveType m_primitiveType;
@@ -108,6 +113,8 @@ private:
     MeshBuffer m_indexBuffer;
 
     std::vector<MTL::Texture> m_textures;
+
+    AxisAlignedBox m_bounds = infiniteAxisAlignedBox();
 };
 
 struct Mesh
@@ -136,11 +143,17 @@ public:
 
     const std::vector<MeshBuffer> & vertexBuffers() const;
 
+    // Model space bounds of all submeshes.  Unbounded unless set.
+    const AxisAlignedBox & bounds() const;
+    void bounds(const AxisAlignedBox & bounds);
+
 private:
 
     std::vector<Submesh> m_submeshes;
 
     std::vector<MeshBuffer> m_vertexBuffers;
+
+    AxisAlignedBox m_bounds = infiniteAxisAlignedBox();
 };
 
 std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
@@ -201,6 +214,16 @@ inline const MeshBuffer & Submesh::indexBuffer() const
     return m_indexBuffer;
 }
 
+inline const AxisAlignedBox & Submesh::bounds() const
+{
+    return m_bounds;
+}
+
+inline void Submesh::bounds(const AxisAlignedBox & bounds)
+{
+    m_bounds = bounds;
+}
+
 #pragma mark - Mesh inline implementations
 
 inline const std::vector<MTL::Texture> & Submesh::textures() const
@@ -218,6 +241,16 @@ inline const std::vector<MeshBuffer> & Mesh::vertexBuffers() const
     return m_vertexBuffers;
 }
 
+inline const AxisAlignedBox & Mesh::bounds() const
+{
+    return m_bounds;
+}
+
+inline void Mesh::bounds(const AxisAlignedBox & bounds)
+{
+    m_bounds = bounds;
+}
+
 
 
 #endif // Mesh_h
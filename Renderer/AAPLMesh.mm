@@ -6,7 +6,9 @@ Implementation for Mesh and Submesh objects.
 */
 #include <MetalKit/MetalKit.h>
 #include <ModelIO/ModelIO.h>
+#include <memory>
 #include <set>
+#include <string>
 #include <unordered_map>
 
 #include "AAPLMesh.h"
@@ -15,6 +17,7 @@ Implementation for Mesh and Submesh objects.
 #include "AAPLShaderTypes.h"
 #include "AAPLUtilities.h"
 #include "CPPMetal.hpp"
+#include "SDSM_MeshCache.h"
 
 using namespace MTL;
 
@@ -104,9 +107,26 @@ Mesh::~Mesh()
 {
 }
 
-static Texture createTextureFromMaterial(MDLMaterial * material,
-                                         MDLMaterialSemantic materialSemantic,
-                                         MTK::TextureLoader & textureLoader)
+static_assert(NumMeshTextures == MeshCacheTexturesPerMaterial, "Mesh cache materials hold a submesh's textures");
+static_assert(IndexTypeUInt16 == MeshCacheIndexTypeUInt16 && IndexTypeUInt32 == MeshCacheIndexTypeUInt32,
+              "Mesh cache submeshes record index types as Metal's values");
+static_assert(PrimitiveTypeTriangleStrip == MeshCachePrimitiveTypeTriangleStrip,
+              "Mesh cache submeshes record primitive types as Metal's values");
+
+// Material semantic of the texture at each index a submesh binds
+static const MDLMaterialSemantic MeshTextureSemantics[NumMeshTextures] =
+{
+    MDLMaterialSemanticBaseColor,
+    MDLMaterialSemanticSpecular,
+    MDLMaterialSemanticTangentSpaceNormal
+};
+
+// Finds the texture a material property refers to, as a file URL and as an asset catalog name.
+// Returns false if the material has no string or URL property with the semantic.
+static bool materialTextureReference(MDLMaterial * material,
+                                     MDLMaterialSemantic materialSemantic,
+                                     std::string & path,
+                                     std::string & name)
 {
     NSArray<MDLMaterialProperty *> *propertiesWithSemantic =
         [material propertiesWithSemantic:materialSemantic];
@@ -116,14 +136,6 @@ static Texture createTextureFromMaterial(MDLMaterial * material,
         if(property.type == MDLMaterialPropertyTypeString ||
            property.type == MDLMaterialPropertyTypeURL)
         {
-            // Load the textures with shader read using private storage
-            MTK::TextureLoaderOptions options;
-            options.usage = MTL::TextureUsageShaderRead;
-            options.storageMode = MTL::StorageModePrivate;
-
-            // First will interpret the string as a file path and attempt to load it with
-            //    -[MTKTextureLoader newTextureWithContentsOfURL:options:error:]
-
             NSURL *url = property.URLValue;
             NSMutableString *URLString = nil;
             if(property.type == MDLMaterialPropertyTypeURL)
@@ -136,44 +148,83 @@ static Texture createTextureFromMaterial(MDLMaterial * material,
                 [URLString appendString:property.stringValue];
             }
 
-            // Attempt to load the texture from the file system
-            MTL::Texture texture = textureLoader.makeTexture(URLString.UTF8String,
-                                                             options);
+            path = URLString.UTF8String;
+            name = property.stringValue ? property.stringValue.UTF8String : "";
 
-            // If the texture has been found for a material using the string as a file path name...
-            if(texture.objCObj())
-            {
-                // ...return it
-                return texture;
-            }
+            return true;
+        }
+    }
 
-            // If not texture has been fround by interpreting the URL as a path, attempt to load it
-            // from the asset catalog by interpreting the string as an asset catalog resource name
+    return false;
+}
 
-            texture = textureLoader.makeTexture(property.stringValue.UTF8String,
-                                                1.0,
-                                                options);
+static Texture createTextureFromReference(const std::string & path,
+                                          const std::string & name,
+                                          MDLMaterialSemantic materialSemantic,
+                                          MTK::TextureLoader & textureLoader)
+{
+    // Load the textures with shader read using private storage
+    MTK::TextureLoaderOptions options;
+    options.usage = MTL::TextureUsageShaderRead;
+    options.storageMode = MTL::StorageModePrivate;
 
-            // If a texture with the by interpreting the URL as an asset catalog name
-            if(texture.objCObj())
-            {
-                // ...return it
-                return texture;
-            }
+    // First will interpret the string as a file path and attempt to load it with
+    //    -[MTKTextureLoader newTextureWithContentsOfURL:options:error:]
 
-            // If did not find the texture in by interpreting it as a file path or as an asset name
-            // in the asset catalog, something went wrong (Perhaps the file was missing or
-            // misnamed in the asset catalog, model/material file, or file system)
+    // Attempt to load the texture from the file system
+    MTL::Texture texture = textureLoader.makeTexture(path.c_str(),
+                                                     options);
 
-            // Depending on how the Metal render pipeline use with this submesh is implemented,
-            // this condition can be handled more gracefully.  The app could load a dummy texture
-            // that will look okay when set with the pipeline or ensure that the pipelines
-            // rendering this submesh do not require a material with this property.
+    // If the texture has been found for a material using the string as a file path name...
+    if(texture.objCObj())
+    {
+        // ...return it
+        return texture;
+    }
 
-            [NSException raise:@"Texture data for material property not found"
-                        format:@"Requested material property semantic: %lu string: %@",
-                                materialSemantic, property.stringValue];
-        }
+    // If not texture has been fround by interpreting the URL as a path, attempt to load it
+    // from the asset catalog by interpreting the string as an asset catalog resource name
+
+    if(!name.empty())
+    {
+        texture = textureLoader.makeTexture(name.c_str(),
+                                            1.0,
+                                            options);
+    }
+
+    // If a texture with the by interpreting the URL as an asset catalog name
+    if(texture.objCObj())
+    {
+        // ...return it
+        return texture;
+    }
+
+    // If did not find the texture in by interpreting it as a file path or as an asset name
+    // in the asset catalog, something went wrong (Perhaps the file was missing or
+    // misnamed in the asset catalog, model/material file, or file system)
+
+    // Depending on how the Metal render pipeline use with this submesh is implemented,
+    // this condition can be handled more gracefully.  The app could load a dummy texture
+    // that will look okay when set with the pipeline or ensure that the pipelines
+    // rendering this submesh do not require a material with this property.
+
+    [NSException raise:@"Texture data for material property not found"
+                format:@"Requested material property semantic: %lu string: %s",
+                        materialSemantic, name.c_str()];
+
+    return Texture();
+}
+
+static Texture createTextureFromMaterial(MDLMaterial * material,
+                                         MDLMaterialSemantic materialSemantic,
+                                         MTK::TextureLoader & textureLoader)
+{
+    std::string path;
+    std::string name;
+
+    if(materialTextureReference(material, materialSemantic, path, name))
+    {
+        return createTextureFromReference(path, name, materialSemantic, textureLoader);
     }
 
     [NSException raise:@"No appropriate material property from which to create texture"
@@ -182,8 +233,29 @@ static Texture createTextureFromMaterial(MDLMaterial * material,
     return Texture();
 }
 
+// Model space bounds of the vertices a submesh indexes, used to cull shadow casters per cascade
+static AxisAlignedBox createSubmeshBounds(MDLSubmesh *modelIOSubmesh,
+                                          MDLVertexAttributeData *positions)
+{
+    AxisAlignedBox bounds = emptyAxisAlignedBox();
+
+    MDLMeshBufferMap *indexMap = [[modelIOSubmesh indexBufferAsIndexType:MDLIndexBitDepthUInt32] map];
+    const uint32_t *indices = (const uint32_t *)indexMap.bytes;
+
+    for(NSUInteger i = 0; i < modelIOSubmesh.indexCount; i++)
+    {
+        const float *position = (const float *)((const uint8_t *)positions.dataStart +
+                                                indices[i] * positions.stride);
+
+        expandAxisAlignedBox(bounds, position);
+    }
+
+    return bounds;
+}
+
 static Submesh createSubmesh(MDLSubmesh *modelIOSubmesh,
                              MTKSubmesh *metalKitSubmesh,
+                             MDLVertexAttributeData *positions,
                              MTL::Device & device,
                              MTK::TextureLoader & textureLoader)
 {
@@ -219,14 +291,81 @@ static Submesh createSubmesh(MDLSubmesh *modelIOSubmesh,
                     indexBuffer,
                     textures);
 
+    if(positions)
+    {
+        submesh.bounds(createSubmeshBounds(modelIOSubmesh, positions));
+    }
+
     return submesh;
 }
 
 
+// Records a mesh as MetalKit laid it out, so later launches can load it from the mesh cache.
+// Returns false if its buffers cannot be read by the CPU.
+static bool addMeshToCache(MeshCacheWriter & cacheWriter,
+                           MDLMesh *modelIOMesh,
+                           MTKMesh *metalKitMesh,
+                           const Mesh & mesh)
+{
+    cacheWriter.beginMesh((uint32_t)metalKitMesh.vertexCount, mesh.bounds());
+
+    for(NSUInteger argumentIndex = 0; argumentIndex < metalKitMesh.vertexBuffers.count; argumentIndex++)
+    {
+        MTKMeshBuffer * mtkMeshBuffer = metalKitMesh.vertexBuffers[argumentIndex];
+        if((NSNull*)mtkMeshBuffer != [NSNull null])
+        {
+            const uint8_t *contents = (const uint8_t *)mtkMeshBuffer.buffer.contents;
+            MDLVertexBufferLayout *layout = modelIOMesh.vertexDescriptor.layouts[argumentIndex];
+
+            if(!contents ||
+               !cacheWriter.addVertexStream((uint32_t)argumentIndex,
+                                            (uint32_t)layout.stride,
+                                            contents + mtkMeshBuffer.offset,
+                                            mtkMeshBuffer.length))
+            {
+                return false;
+            }
+        }
+    }
+
+    for(NSUInteger index = 0; index < metalKitMesh.submeshes.count; index++)
+    {
+        MDLSubmesh *modelIOSubmesh = modelIOMesh.submeshes[index];
+        MTKSubmesh *metalKitSubmesh = metalKitMesh.submeshes[index];
+
+        const uint8_t *indices = (const uint8_t *)metalKitSubmesh.indexBuffer.buffer.contents;
+
+        if(!indices)
+        {
+            return false;
+        }
+
+        std::string paths[NumMeshTextures];
+        std::string names[NumMeshTextures];
+
+        for(int i = 0; i < NumMeshTextures; i++)
+        {
+            materialTextureReference(modelIOSubmesh.material, MeshTextureSemantics[i], paths[i], names[i]);
+        }
+
+        cacheWriter.addSubmesh((uint32_t)metalKitSubmesh.primitiveType,
+                               (uint32_t)metalKitSubmesh.indexType,
+                               (uint32_t)metalKitSubmesh.indexCount,
+                               cacheWriter.addMaterial(paths, names),
+                               indices + metalKitSubmesh.indexBuffer.offset,
+                               metalKitSubmesh.indexBuffer.length,
+                               mesh.submeshes()[index].bounds());
+    }
+
+    return true;
+}
+
+
 Mesh createMeshFromModelIOMesh(MDLMesh *modelIOMesh,
                                MDLVertexDescriptor *vertexDescriptor,
                                MTK::TextureLoader & textureLoader,
                                MTL::Device & device,
+                               MeshCacheWriter *cacheWriter,
                                NSError * __nullable * __nullable error)
 {
 
@@ -278,23 +417,42 @@ Mesh createMeshFromModelIOMesh(MDLMesh *modelIOMesh,
         }
     }
 
+    // Read positions back as 32-bit floats whatever format the relayout stored them in
+    MDLVertexAttributeData *positions = [modelIOMesh vertexAttributeDataForAttributeNamed:MDLVertexAttributePosition
+                                                                                  asFormat:MDLVertexFormatFloat3];
+
     std::vector<Submesh> submeshes;
 
+    AxisAlignedBox meshBounds = emptyAxisAlignedBox();
+
     // Create an Submesh object for each submesh and a add it to the submesh's array
     for(NSUInteger index = 0; index < metalKitMesh.submeshes.count; index++)
     {
         // Create an app specific submesh to hold the MetalKit submesh
         Submesh submesh = createSubmesh(modelIOMesh.submeshes[index],
                                         metalKitMesh.submeshes[index],
+                                        positions,
                                         device,
                                         textureLoader);
 
+        mergeAxisAlignedBox(meshBounds, submesh.bounds());
+
         submeshes.emplace_back(submesh);
     }
 
 
     Mesh mesh(submeshes ,vertexBuffers);
 
+    if(positions)
+    {
+        mesh.bounds(meshBounds);
+    }
+
+    if(cacheWriter && !addMeshToCache(*cacheWriter, modelIOMesh, metalKitMesh, mesh))
+    {
+        cacheWriter->abandon();
+    }
+
     return mesh;
 }
 
@@ -302,6 +460,7 @@ static std::vector<Mesh> createMeshesFromModelIOObject(MDLObject* object,
                                                        MDLVertexDescriptor * vertexDescriptor,
                                                        MTK::TextureLoader & textureLoader,
                                                        MTL::Device & device,
+                                                       MeshCacheWriter *cacheWriter,
                                                        NSError * __nullable * __nullable error)
 {
     std::vector<Mesh> newMeshes;
@@ -316,6 +475,7 @@ static std::vector<Mesh> createMeshesFromModelIOObject(MDLObject* object,
                                                  vertexDescriptor,
                                                  textureLoader,
                                                  device,
+                                                 cacheWriter,
                                                  error);
 
         newMeshes.emplace_back(newMesh);
@@ -327,7 +487,7 @@ static std::vector<Mesh> createMeshesFromModelIOObject(MDLObject* object,
     {
         std::vector<Mesh> childMeshes;
 
-        childMeshes = createMeshesFromModelIOObject(child, vertexDescriptor, textureLoader, device, error);
+        childMeshes = createMeshesFromModelIOObject(child, vertexDescriptor, textureLoader, device, cacheWriter, error);
 
         newMeshes.insert(newMeshes.end(), childMeshes.begin(), childMeshes.end());
     }
@@ -335,6 +495,146 @@ static std::vector<Mesh> createMeshesFromModelIOObject(MDLObject* object,
     return newMeshes;
 }
 
+// Signs what the cached vertex streams depend on: the attributes' formats, offsets and buffer
+// indices, and the layouts' strides
+static uint32_t meshCacheLayoutSignature(const MTL::VertexDescriptor & vertexDescriptor)
+{
+    uint32_t signature = MeshCacheHashSeed;
+
+    for(UInteger i = 0; i < MTL::MaxVertexAttributes; i++)
+    {
+        signature = meshCacheHash(signature, (uint32_t)vertexDescriptor.attributes[i].format());
+        signature = meshCacheHash(signature, (uint32_t)vertexDescriptor.attributes[i].offset());
+        signature = meshCacheHash(signature, (uint32_t)vertexDescriptor.attributes[i].bufferIndex());
+    }
+
+    for(UInteger i = 0; i < MTL::MaxVertexBufferLayouts; i++)
+    {
+        signature = meshCacheHash(signature, (uint32_t)vertexDescriptor.layouts[i].stride());
+    }
+
+    return signature;
+}
+
+// Path of the mesh cache for a model file in the app's caches directory, or an empty string if
+// there is no such directory
+static std::string meshCachePath(NSURL *modelFileURL)
+{
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+
+    NSURL *cachesURL = [fileManager URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask].firstObject;
+
+    if(!cachesURL)
+    {
+        return std::string();
+    }
+
+    NSString *bundleIdentifier = [NSBundle mainBundle].bundleIdentifier;
+
+    if(bundleIdentifier)
+    {
+        cachesURL = [cachesURL URLByAppendingPathComponent:bundleIdentifier isDirectory:YES];
+    }
+
+    if(![fileManager createDirectoryAtURL:cachesURL withIntermediateDirectories:YES attributes:nil error:nil])
+    {
+        return std::string();
+    }
+
+    NSString *fileName = [modelFileURL.lastPathComponent.stringByDeletingPathExtension
+                          stringByAppendingPathExtension:@"meshcache"];
+
+    return [cachesURL URLByAppendingPathComponent:fileName].fileSystemRepresentation;
+}
+
+// Buffer holding the vertex and index streams of a mesh cache.  Aliases the mapped file, which the
+// buffer then keeps open, unless the page size does not allow it, in which case it copies them.
+static Buffer newBufferFromMeshCache(const std::shared_ptr<MeshCacheFile> & cache, MTL::Device & device)
+{
+    if(MeshCacheDataAlignment % (uint64_t)getpagesize() == 0)
+    {
+        std::shared_ptr<MeshCacheFile> mapping = cache;
+
+        id<MTLBuffer> buffer = [device.objCObj() newBufferWithBytesNoCopy:cache->data()
+                                                                   length:cache->dataLength()
+                                                                  options:MTLResourceStorageModeShared
+                                                              deallocator:^(void *pointer, NSUInteger length)
+                                                              {
+                                                                  mapping->close();
+                                                              }];
+
+        if(buffer)
+        {
+            return Buffer(buffer, device);
+        }
+    }
+
+    return device.makeBuffer(cache->data(), cache->dataLength());
+}
+
+static std::vector<Mesh> *newMeshesFromMeshCache(const std::shared_ptr<MeshCacheFile> & cache,
+                                                 MTL::Device & device,
+                                                 MTK::TextureLoader & textureLoader)
+{
+    Buffer metalBuffer = newBufferFromMeshCache(cache, device);
+
+    const MeshCacheHeader & header = cache->header();
+
+    std::vector<Mesh> *newMeshes = new std::vector<Mesh>();
+
+    for(uint32_t meshIndex = 0; meshIndex < header.meshCount; meshIndex++)
+    {
+        const MeshCacheMesh & cachedMesh = cache->meshes()[meshIndex];
+
+        std::vector<MeshBuffer> vertexBuffers;
+
+        for(uint32_t i = 0; i < cachedMesh.streamCount; i++)
+        {
+            const MeshCacheStream & stream = cachedMesh.streams[i];
+
+            vertexBuffers.emplace_back(metalBuffer, stream.offset, stream.length, stream.argumentIndex);
+        }
+
+        std::vector<Submesh> submeshes;
+
+        for(uint32_t i = 0; i < cachedMesh.submeshCount; i++)
+        {
+            const MeshCacheSubmesh & cachedSubmesh = cache->submeshes()[cachedMesh.firstSubmesh + i];
+            const MeshCacheMaterial & material = cache->materials()[cachedSubmesh.materialIndex];
+
+            std::vector<MTL::Texture> textures(NumMeshTextures, Texture());
+
+            for(int textureIndex = 0; textureIndex < NumMeshTextures; textureIndex++)
+            {
+                textures[textureIndex] = createTextureFromReference(cache->string(material.textures[textureIndex].pathOffset),
+                                                                    cache->string(material.textures[textureIndex].nameOffset),
+                                                                    MeshTextureSemantics[textureIndex],
+                                                                    textureLoader);
+            }
+
+            MeshBuffer indexBuffer(metalBuffer, cachedSubmesh.indexOffset, cachedSubmesh.indexLength);
+
+            Submesh submesh((PrimitiveType) cachedSubmesh.primitiveType,
+                            (IndexType) cachedSubmesh.indexType,
+                            cachedSubmesh.indexCount,
+                            indexBuffer,
+                            textures);
+
+            submesh.bounds(cachedSubmesh.bounds);
+
+            submeshes.emplace_back(submesh);
+        }
+
+        Mesh mesh(submeshes, vertexBuffers);
+
+        mesh.bounds(cachedMesh.bounds);
+
+        newMeshes->emplace_back(mesh);
+    }
+
+    return newMeshes;
+}
+
 std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
                                            MTL::Device & device,
                                            const MTL::VertexDescriptor & vertexDescriptor,
@@ -357,6 +657,36 @@ std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
 
     AAPLAssert(modelFileURL, "Could not find model (%s) file in bundle", modelFileURL.absoluteString.UTF8String);
 
+    // Create a MetalKit texture loader to load material textures from files or the asset catalog
+    //   into Metal textures
+    MTK::TextureLoader textureLoader(device);
+
+    // Load the meshes from the cache an earlier launch wrote, unless the model file or the vertex
+    // layout changed since.  This skips parsing the model and generating tangents.
+    uint32_t layoutSignature = meshCacheLayoutSignature(vertexDescriptor);
+    uint64_t sourceSize = 0;
+    int64_t sourceModificationTime = 0;
+
+    std::string cachePath;
+
+    if(meshCacheSourceStamp(modelFileURL.fileSystemRepresentation, sourceSize, sourceModificationTime))
+    {
+        cachePath = meshCachePath(modelFileURL);
+    }
+
+    if(!cachePath.empty())
+    {
+        std::shared_ptr<MeshCacheFile> cache = std::make_shared<MeshCacheFile>();
+
+        if(cache->open(cachePath.c_str(), layoutSignature, sourceSize, sourceModificationTime) &&
+           cache->header().meshCount > 0)
+        {
+            return newMeshesFromMeshCache(cache, device, textureLoader);
+        }
+    }
+
+    MeshCacheWriter cacheWriter(layoutSignature, sourceSize, sourceModificationTime);
+
     // Create a MetalKit mesh buffer allocator so that ModelIO will load mesh data directly into
     // Metal buffers accessible by the GPU
     MTKMeshBufferAllocator *bufferAllocator =
@@ -372,10 +702,6 @@ std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
 
     AAPLAssert(asset, "Failed to open model file with given URL: %s", modelFileURL.absoluteString.UTF8String);
 
-    // Create a MetalKit texture loader to load material textures from files or the asset catalog
-    //   into Metal textures
-    MTK::TextureLoader textureLoader(device);
-
     std::vector<Mesh> *newMeshes = new std::vector<Mesh>();
 
     NSError *nserror;
@@ -390,6 +716,7 @@ std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
                                                     modelIOVertexDescriptor,
                                                     textureLoader,
                                                     device,
+                                                    cachePath.empty() ? nullptr : &cacheWriter,
                                                     &nserror);
 
         newMeshes->insert(newMeshes->end(), assetMeshes.begin(), assetMeshes.end());
@@ -400,6 +727,12 @@ std::vector<Mesh> *newMeshesFromBundlePath(const char* bundlePath,
         *error = (__bridge CFErrorRef)nserror;
     }
 
+    // Failing to write the cache only means the next launch loads the model again
+    if(!cachePath.empty() && !nserror && !newMeshes->empty())
+    {
+        cacheWriter.write(cachePath.c_str());
+    }
+
     return newMeshes;
 }
 
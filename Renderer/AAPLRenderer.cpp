@@ -8,7 +8,7 @@ Implementation of renderer class which performs Metal setup and per frame render
 #include "AAPLUtilities.h"
 
 #include<sys/sysctl.h>
-#include <simd/simd.h>
+#include "SDSM_Simd.h"
 #include <stdlib.h>
 
 #include "AAPLBufferExaminationManager.h"
@@ -16,32 +16,76 @@ Implementation of renderer class which performs Metal setup and per frame render
 #include "AAPLMesh.h"
 #include "AAPLMathUtilities.h"
 #include "SDSM_Utilities.h"
+#include "SDSM_Reduction.h"
 
 using namespace simd;
 
 // Include header shared between C code here, which executes Metal API commands, and .metal files
 #include "AAPLShaderTypes.h"
 
+static void setSoABox(const soa_box_float3 & boxes, size_t index, const AxisAlignedBox & box)
+{
+    boxes.min.x[index] = box.min[0];
+    boxes.min.y[index] = box.min[1];
+    boxes.min.z[index] = box.min[2];
+    boxes.max.x[index] = box.max[0];
+    boxes.max.y[index] = box.max[1];
+    boxes.max.z[index] = box.max[2];
+}
+
+static AxisAlignedBox soaBox(const soa_box_float3 & boxes, size_t index)
+{
+    return makeAxisAlignedBox(boxes.min.x[index], boxes.min.y[index], boxes.min.z[index],
+                              boxes.max.x[index], boxes.max.y[index], boxes.max.z[index]);
+}
+
 Renderer::Renderer(MTK::View & view)
 : m_view(view)
 , m_device(view.device())
-, m_completedHandler(nullptr)
 , m_originalLightPositions(nullptr)
 , m_frameDataBufferIndex(0)
 , m_frameNumber(0)
+#if USE_SHADOW_ATLAS
+, m_shadowAtlas(SHADOW_ATLAS_RES, SHADOW_ATLAS_TEXEL_BUDGET)
+#endif
 #if SUPPORT_BUFFER_EXAMINATION
 , m_bufferExaminationManager(nullptr)
 #endif
 {
     this->m_inFlightSemaphore = dispatch_semaphore_create(MaxFramesInFlight);
+
+    for (uint i = 0; i < MaxFramesInFlight; i++) {
+        this->m_frameCompletedHandlers[i].semaphore = m_inFlightSemaphore;
+        this->m_frameCompletedHandlers[i].pendingCommandBuffers = 0;
+    }
+
     this->m_camera = new Camera();
     this->m_camera->setNear(NearPlane);
     this->m_camera->setFar(FarPlane);
     this->m_lightPhi = 0.0f;
     this->m_lightTheta = 2.0f;
+    this->m_lightMatricesDirty = true;
     this->m_partitioningMode = LOG_PARTITIONING;
     this->m_visualizationMode = VISUALIZE_NORMAL;
+    this->m_depthReductionMode = DEPTH_REDUCTION_FUSED;
+    this->m_coarseDepthReduction = false;
+    this->m_sparseReductionStride = 1;
+    this->m_sparseReductionFrame = 0;
+    this->m_gpuDrivenCascades = false;
+    this->m_encodeCascadeMatrices = false;
+    this->m_shadowCastersCulled = false;
+    this->m_cascadeCount = CASCADED_SHADOW_COUNT;
+    this->m_usedCascadeCount = CASCADED_SHADOW_COUNT;
+    this->m_autoCascadeCount = false;
+    this->m_frustumCascadeCount = CASCADED_SHADOW_COUNT;
     this->m_frustrumLock = false;
+    this->m_layeredShadowsSupported = false;
+    this->m_layeredShadows = false;
+    this->m_shadowCaching = true;
+    this->m_amortizedCascades = false;
+    this->m_asyncReduction = true;
+    this->m_motionPrediction = true;
+    this->m_reductionSubmission = RenderQueueGraph::none(RENDER_QUEUE_REDUCTION);
 }
 
 
@@ -50,8 +94,6 @@ Renderer::~Renderer()
     delete [] m_originalLightPositions;
 
     delete m_meshes;
-
-    delete m_completedHandler;
 }
 
 /// Create Metal render state objects
@@ -276,6 +318,38 @@ void Renderer::loadMetal()
             m_shadowGenPipelineState = m_device.makeRenderPipelineState(renderPipelineDescriptor, &error);
 
             delete shadowVertexFunction;
+
+            // Layered rendering and viewport arrays, which route the instances to the squares of
+            // the shadow atlas instead of slices, need Apple5 GPUs on iOS and are available on all Macs
+            m_layeredShadowsSupported = m_device.supportsFamily( MTL::GPUFamilyMac1 ) ||
+                                        m_device.supportsFamily( MTL::GPUFamilyApple5 );
+
+            if(m_layeredShadowsSupported)
+            {
+                MTL::Function * shadowLayeredVertexFunction = shaderLibrary.newFunctionWithName( "shadow_vertex_layered" );
+
+                renderPipelineDescriptor.label( "Shadow Gen Layered" );
+                renderPipelineDescriptor.vertexFunction( shadowLayeredVertexFunction );
+                renderPipelineDescriptor.inputPrimitiveTopology( MTL::PrimitiveTopologyClassTriangle );
+
+                m_shadowGenLayeredPipelineState = m_device.makeRenderPipelineState(renderPipelineDescriptor, &error);
+
+                delete shadowLayeredVertexFunction;
+            }
+
+            // Resets the dirty texels of a cached cascade to the far plane
+            MTL::Function * shadowClearVertexFunction = shaderLibrary.newFunctionWithName( "shadow_clear_vertex" );
+
+            MTL::RenderPipelineDescriptor clearPipelineDescriptor;
+            clearPipelineDescriptor.label( "Shadow Clear" );
+            clearPipelineDescriptor.vertexDescriptor( nullptr );
+            clearPipelineDescriptor.vertexFunction( shadowClearVertexFunction );
+            clearPipelineDescriptor.fragmentFunction( nullptr );
+            clearPipelineDescriptor.depthAttachmentPixelFormat( shadowMapPixelFormat );
+
+            m_shadowClearPipelineState = m_device.makeRenderPipelineState(clearPipelineDescriptor, &error);
+
+            delete shadowClearVertexFunction;
         }
 
         #pragma mark Shadow pass depth state setup
@@ -285,17 +359,29 @@ void Renderer::loadMetal()
             depthStencilDesc.depthCompareFunction( MTL::CompareFunctionLessEqual );
             depthStencilDesc.depthWriteEnabled( true );
             m_shadowDepthStencilState = m_device.makeDepthStencilState( depthStencilDesc );
+
+            depthStencilDesc.label( "Shadow Clear" );
+            depthStencilDesc.depthCompareFunction( MTL::CompareFunctionAlways );
+            m_shadowClearDepthStencilState = m_device.makeDepthStencilState( depthStencilDesc );
         }
 
         #pragma mark Shadow map setup
         {
             MTL::TextureDescriptor shadowTextureDesc;
 
+            // The atlas stays an array texture with one slice so the G-buffer shaders sample
+            // both layouts the same way
             shadowTextureDesc.textureType(MTL::TextureType2DArray);
-            shadowTextureDesc.arrayLength(CASCADED_SHADOW_COUNT);
-            shadowTextureDesc.pixelFormat( shadowMapPixelFormat );
+#if USE_SHADOW_ATLAS
+            shadowTextureDesc.arrayLength(1);
+            shadowTextureDesc.width( SHADOW_ATLAS_RES );
+            shadowTextureDesc.height( SHADOW_ATLAS_RES );
+#else
+            shadowTextureDesc.arrayLength(MAX_CASCADED_SHADOW_COUNT);
             shadowTextureDesc.width( SHADOW_MAP_RES );
             shadowTextureDesc.height( SHADOW_MAP_RES );
+#endif
+            shadowTextureDesc.pixelFormat( shadowMapPixelFormat );
             shadowTextureDesc.mipmapLevelCount( 1 );
             shadowTextureDesc.resourceOptions( MTL::ResourceStorageModePrivate );
             shadowTextureDesc.usage( MTL::TextureUsageRenderTarget | MTL::TextureUsageShaderRead );
@@ -311,11 +397,13 @@ void Renderer::loadMetal()
             m_shadowRenderPassDescriptor.depthAttachment.storeAction( MTL::StoreActionStore );
             m_shadowRenderPassDescriptor.depthAttachment.clearDepth( 1.0 );
             m_shadowRenderPassDescriptor.depthAttachment.slice(0);
+
+            m_layeredShadowRenderPassDescriptor = m_shadowRenderPassDescriptor;
         }
 
         // Create buffers for cascade index
         {
-            for (uint i = 0; i < CASCADED_SHADOW_COUNT; i++) {
+            for (uint i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
                 static const MTL::ResourceOptions storageMode = MTL::ResourceStorageModeShared;
                 m_cascadeIndexBuffers[i] = m_device.makeBuffer(sizeof(int), storageMode);
                 int *index = (int*) m_cascadeIndexBuffers[i].contents();
@@ -328,18 +416,90 @@ void Renderer::loadMetal()
             MTL::Function reduceMinMaxDepthFunction = shaderLibrary.makeFunction("reduce_min_max_depth");
             m_reduceDepthComputePipelineState = m_device.makeComputePipelineState(reduceMinMaxDepthFunction);
 
+            MTL::Function reduceMinMaxDepthHierarchicalFunction = shaderLibrary.makeFunction("reduce_min_max_depth_hierarchical");
+            m_reduceDepthHierarchicalComputePipelineState =
+                m_device.makeComputePipelineState(reduceMinMaxDepthHierarchicalFunction);
+
             MTL::Function reduceLightFrustumFunction = shaderLibrary.makeFunction("reduce_light_frustum");
             m_reduceLightFrustumComputePipelineState = m_device.makeComputePipelineState(reduceLightFrustumFunction);
 
+            MTL::Function reduceLightFrustumSparseFunction = shaderLibrary.makeFunction("reduce_light_frustum_sparse");
+            m_reduceLightFrustumSparseComputePipelineState =
+                m_device.makeComputePipelineState(reduceLightFrustumSparseFunction);
+
+            MTL::Function reduceDepthHistogramFunction = shaderLibrary.makeFunction("reduce_depth_histogram");
+            m_reduceDepthHistogramComputePipelineState = m_device.makeComputePipelineState(reduceDepthHistogramFunction);
+
+            MTL::Function reduceDepthHistogramCoarseFunction = shaderLibrary.makeFunction("reduce_depth_histogram_coarse");
+            m_reduceDepthHistogramCoarseComputePipelineState =
+                m_device.makeComputePipelineState(reduceDepthHistogramCoarseFunction);
+
+            MTL::Function reduceAliasingErrorFunction = shaderLibrary.makeFunction("reduce_aliasing_error");
+            m_reduceAliasingErrorComputePipelineState = m_device.makeComputePipelineState(reduceAliasingErrorFunction);
+
+            MTL::Function buildDepthPyramidBaseFunction = shaderLibrary.makeFunction("build_depth_pyramid_base");
+            m_buildDepthPyramidBaseComputePipelineState = m_device.makeComputePipelineState(buildDepthPyramidBaseFunction);
+
+            MTL::Function buildDepthPyramidLevelFunction = shaderLibrary.makeFunction("build_depth_pyramid_level");
+            m_buildDepthPyramidLevelComputePipelineState = m_device.makeComputePipelineState(buildDepthPyramidLevelFunction);
+
+            MTL::Function buildCascadeMatricesFunction = shaderLibrary.makeFunction("build_cascade_matrices");
+            m_buildCascadeMatricesComputePipelineState = m_device.makeComputePipelineState(buildCascadeMatricesFunction);
+
+            // The single pass deferred renderer never stores its G-buffer, so it reduces depth with
+            // a tile shader inside its render pass.  Tile shaders need Apple4 GPUs.
+            m_tileReductionSupported = m_singlePassDeferred && m_device.supportsFamily( MTL::GPUFamilyApple4 );
+
+            if(m_tileReductionSupported)
+            {
+                MTL::Function reduceDepthHistogramTileFunction = shaderLibrary.makeFunction("reduce_depth_histogram_tile");
+
+                MTL::TileRenderPipelineDescriptor tilePipelineDescriptor;
+
+                tilePipelineDescriptor.label( "Depth Histogram Tile Reduction" );
+                tilePipelineDescriptor.tileFunction( &reduceDepthHistogramTileFunction );
+                tilePipelineDescriptor.rasterSampleCount( 1 );
+                tilePipelineDescriptor.threadgroupSizeMatchesTileSize( true );
+                tilePipelineDescriptor.colorAttachmentPixelFormat( RenderTargetLighting, m_view.colorPixelFormat() );
+                tilePipelineDescriptor.colorAttachmentPixelFormat( RenderTargetAlbedo, m_albedo_specular_GBufferFormat );
+                tilePipelineDescriptor.colorAttachmentPixelFormat( RenderTargetNormal, m_normal_shadow_GBufferFormat );
+                tilePipelineDescriptor.colorAttachmentPixelFormat( RenderTargetDepth, m_depth_GBufferFormat );
+
+                m_reduceDepthHistogramTilePipelineState = m_device.makeRenderPipelineState( tilePipelineDescriptor, &error );
+
+                AAPLAssert(error == nullptr, error, "Failed to create depth histogram tile reduction pipeline state");
+            }
+
             static const MTL::ResourceOptions storageMode = MTL::ResourceStorageModeShared;
 
-            m_minMaxDepthBuffer = m_device.makeBuffer(sizeof(int) * 2, storageMode);
+            // Every frame in flight reduces into its own buffers.  Until the first reduction
+            // completes, frames read the full depth range written here.
+            for (uint i = 0; i < MaxFramesInFlight; i++) {
+                m_minMaxDepthBuffers[i] = m_device.makeBuffer(sizeof(int) * 2, storageMode);
+
+                int *dataPtrResult = (int*) m_minMaxDepthBuffers[i].contents();
+                dataPtrResult[0] = encodeOrderedFloat(NearPlane);
+                dataPtrResult[1] = encodeOrderedFloat(FarPlane);
+
+                m_lightFrustumBoundingBoxBuffers[i] = m_device.makeBuffer(sizeof(int) * 6 * MAX_CASCADED_SHADOW_COUNT, storageMode);
+
+                m_depthHistogramBuffers[i] = m_device.makeBuffer(sizeof(int) * DepthHistogramLength, storageMode);
 
-            int *dataPtrResult = (int*) m_minMaxDepthBuffer.contents();
-            dataPtrResult[0] = NearPlane * LARGE_INTEGER;
-            dataPtrResult[1] = FarPlane * LARGE_INTEGER;
+                m_aliasingErrorBuffers[i] = m_device.makeBuffer(sizeof(int) * AliasingErrorLength, storageMode);
 
-            m_lightFrustumBoundingBoxBuffer = m_device.makeBuffer(sizeof(int) * 6 * CASCADED_SHADOW_COUNT);
+                int *histogram = (int*) m_depthHistogramBuffers[i].contents();
+                resetDepthHistogram(histogram, NearPlane, FarPlane);
+                histogram[DepthHistogramMinDepth] = encodeOrderedFloat(NearPlane);
+                histogram[DepthHistogramMaxDepth] = encodeOrderedFloat(FarPlane);
+
+                m_reductionReadbackModes[i] = m_depthReductionMode;
+                m_reductionReadbackStrides[i] = 1;
+                m_reductionReadbackAliasing[i] = false;
+                m_reductionReadbackCascadeCounts[i] = 0;
+            }
+
+            m_reductionResultAge = 0;
+            m_reductionResultSerial = UINT64_MAX;
         }
 
     }
@@ -361,45 +521,24 @@ void Renderer::loadMetal()
 
         m_frustumPipelineState = m_device.makeRenderPipelineState(renderPipelineDescriptor, &error);
 
-        m_viewFrustumBuffer = m_device.makeBuffer(sizeof(FrustumVertex) * (4 * CASCADED_SHADOW_COUNT + 4),
+        m_viewFrustumBuffer = m_device.makeBuffer(sizeof(FrustumVertex) * (4 * MAX_CASCADED_SHADOW_COUNT + 4),
                                                   MTL::ResourceStorageModeShared);
 
-        m_viewFrustumIndexBuffer = m_device.makeBuffer(sizeof(int) * 16 * (CASCADED_SHADOW_COUNT + 1));
+        m_viewFrustumIndexBuffer = m_device.makeBuffer(sizeof(int) * 16 * (MAX_CASCADED_SHADOW_COUNT + 1));
 
-        m_lightFrustumBuffer = m_device.makeBuffer(sizeof(FrustumVertex) * (8 * CASCADED_SHADOW_COUNT),
+        m_lightFrustumBuffer = m_device.makeBuffer(sizeof(FrustumVertex) * (8 * MAX_CASCADED_SHADOW_COUNT),
                                                   MTL::ResourceStorageModeShared);
         m_lightFrustumBuffer.label("light frustum buffer");
 
-        m_lightFrustumIndexBuffer = m_device.makeBuffer(sizeof(int) * 24 * CASCADED_SHADOW_COUNT);
-
-        int* indexBufferPtr = (int*)m_viewFrustumIndexBuffer.contents();
-
-        for (int i = 0; i < CASCADED_SHADOW_COUNT + 1; i++) {
-            for (int j = 0; j < 4; j++) {
-                indexBufferPtr[i * 8 + j * 2] = i * 4 + j;
-                indexBufferPtr[i * 8 + j * 2 + 1] = i * 4 + (j + 1) % 4;
-            }
-        }
-
-        for (int i = 0; i < 4; i++) {
-            indexBufferPtr[8 * (CASCADED_SHADOW_COUNT + 1) + 2 * i] = i;
-            indexBufferPtr[8 * (CASCADED_SHADOW_COUNT + 1) + 2 * i + 1] = i + CASCADED_SHADOW_COUNT * 4;
-        }
-
-        int* lightIndexBufferPtr = (int*)m_lightFrustumIndexBuffer.contents();
+        m_lightFrustumIndexBuffer = m_device.makeBuffer(sizeof(int) * 24 * MAX_CASCADED_SHADOW_COUNT);
 
-        for (int i = 0; i < CASCADED_SHADOW_COUNT; i++) {
-            for (int j = 0; j < 4; j++) {
-                lightIndexBufferPtr[24 * i + j * 6] = j + 8 * i;
-                lightIndexBufferPtr[24 * i + j * 6 + 1] = (j + 1) % 4 + 8 * i;
+        updateFrustumIndexBuffer(m_frustumCascadeCount);
 
-                lightIndexBufferPtr[24 * i + j * 6 + 2] = j + 4 + 8 * i;
-                lightIndexBufferPtr[24 * i + j * 6 + 3] = (j + 1) % 4 + 4 + 8 * i;
+        // Every cascade's boxes are drawn from the same vertices whatever the cascade count
+        static constexpr FrustumIndexTable<24 * MAX_CASCADED_SHADOW_COUNT> lightFrustumIndices =
+            lightFrustumIndexTable<MAX_CASCADED_SHADOW_COUNT>();
 
-                lightIndexBufferPtr[24 * i + j * 6 + 4] = j + 8 * i;
-                lightIndexBufferPtr[24 * i + j * 6 + 5] = j + 4 + 8 * i;
-            }
-        }
+        memcpy(m_lightFrustumIndexBuffer.contents(), lightFrustumIndices.indices, sizeof(lightFrustumIndices.indices));
 
         MTL::StencilDescriptor stencilStateDesc;
 //        stencilStateDesc.stencilCompareFunction( MTL::CompareFunctionEqual );
@@ -420,6 +559,13 @@ void Renderer::loadMetal()
     }
 
     m_commandQueue = m_device.makeCommandQueue();
+    m_reductionQueue = m_device.makeCommandQueue();
+
+    m_commandQueue.label( "Graphics Queue" );
+    m_reductionQueue.label( "Depth Reduction Queue" );
+
+    m_queueGraph.setQueueEvent(RENDER_QUEUE_GRAPHICS, m_device.makeEvent());
+    m_queueGraph.setQueueEvent(RENDER_QUEUE_REDUCTION, m_device.makeEvent());
 }
 
 /// Load models/textures, etc.
@@ -434,6 +580,35 @@ void Renderer::loadScene()
 
     AAPLAssert(m_meshes, error, "Could not create meshes from model file");
 
+    // Far cascade refreshes may draw about two cascades' worth of casters per frame
+    {
+        int submeshCount = 0;
+
+        for (const Mesh & mesh : *m_meshes) {
+            submeshCount += (int)mesh.submeshes().size();
+        }
+
+        m_cascadeScheduler.setDrawBudget(2 * submeshCount);
+
+        size_t casterCount = m_meshes->size() + submeshCount;
+
+        m_casterBounds.resize(6 * casterCount);
+        m_lightViewCasterBounds.resize(6 * casterCount);
+
+        soa_box_float3 casterBoxes = soa_box_float3_from_buffer(m_casterBounds.data(), casterCount);
+        size_t submeshIndex = m_meshes->size();
+
+        for (size_t i = 0; i < m_meshes->size(); i++) {
+            const Mesh & mesh = (*m_meshes)[i];
+
+            setSoABox(casterBoxes, i, mesh.bounds());
+
+            for (auto& submesh : mesh.submeshes()) {
+                setSoABox(casterBoxes, submeshIndex++, submesh.bounds());
+            }
+        }
+    }
+
     /**
     // Generate data
     {
@@ -506,7 +681,7 @@ void Renderer::updateWorldState()
 
     // Set projection matrix and calculate inverted projection matrix
     frameData->projection_matrix = this->m_camera->projMatrix();
-    frameData->projection_matrix_inverse = matrix_invert(this->m_camera->projMatrix());
+    frameData->projection_matrix_inverse = this->m_camera->inverseProjMatrix();
 
     // Set screen dimensions
     frameData->framebuffer_width = (uint)m_albedo_specular_GBuffer.width();
@@ -521,23 +696,23 @@ void Renderer::updateWorldState()
 //                                                    0,   5,   0,
 //                                                    0 ,  1,   0);
 
-    float4x4 view_matrix = m_camera->viewMatrix();
-
-    view_matrix = view_matrix * matrix4x4_scale(1, 1, 1);
+    const float4x4 & view_matrix = m_camera->viewMatrix();
 
     frameData->view_matrix = view_matrix;
 
     float4x4 templeScaleMatrix = matrix4x4_scale(0.1, 0.1, 0.1);
     float4x4 templeTranslateMatrix = matrix4x4_translation(0, -10, 0);
     float4x4 templeModelMatrix = templeTranslateMatrix * templeScaleMatrix;
+    float4x4 templeModelMatrixInverse = matrix4x4_scale(10, 10, 10) * matrix4x4_translation(0, 10, 0);
     frameData->temple_model_matrix = templeModelMatrix;
     frameData->temple_modelview_matrix = frameData->view_matrix * templeModelMatrix;
     frameData->temple_normal_matrix = matrix3x3_upper_left(frameData->temple_modelview_matrix);
 
 //    float skyRotation = m_frameNumber * 0.005f - (M_PI_4*3);
 
-    float3 yAxis = {0, 1, 0}, zAxis = {0, 0, 1};
-    float4x4 skyModelMatrix = matrix4x4_rotation(m_lightPhi, yAxis) * matrix4x4_rotation(m_lightTheta, zAxis);
+    const LightMatrices & light = lightMatrices();
+
+    float4x4 skyModelMatrix = light.skyModelMatrix;
     frameData->sky_modelview_matrix = skyModelMatrix;
 
     // Update directional light color
@@ -546,94 +721,467 @@ void Renderer::updateWorldState()
     frameData->sun_specular_intensity = 1;
 
     // Update sun direction in view space
+    float4 sunWorldDirection = light.sunWorldDirection;
+
+    frameData->sun_eye_direction = view_matrix * sunWorldDirection;
+    frameData->sun_world_direction = sunWorldDirection;
+
+    // Inverses the cascade construction needs, derived once per frame from cached matrices
+    m_frameMatrices.inverseViewMatrix = m_camera->inverseViewMatrix();
+    m_frameMatrices.inverseShadowViewMatrix = light.inverseShadowViewMatrix;
+    m_frameMatrices.shadowModelViewMatrix = light.shadowViewMatrix * templeModelMatrix;
+    m_frameMatrices.inverseShadowModelViewMatrix = templeModelMatrixInverse * light.inverseShadowViewMatrix;
+
+    // Calculate cascade projection matrices
+
+    {
+        frameData->shadow_view_matrix = light.shadowViewMatrix;
+
+        frameData->unproject_matrix =
+            m_camera->inverseViewProjMatrix() *
+            matrix4x4_translation(-1.0, -1.0, 0.0) *
+            matrix4x4_scale(2.0 / (float)m_view.drawableSize().width, 2.0 / (float)m_view.drawableSize().height, 1.0) *
+            matrix4x4_translation(0.0, (float)m_view.drawableSize().height, 0.0) *
+            matrix4x4_scale(1.0, -1.0, 1.0);
+
+        // GPU driven cascades are built by build_cascade_matrices from the histogram of the previous
+        // frame, which the GPU finishes before it starts on this frame
+        size_t previousSlot = ReadbackRing<MaxFramesInFlight>::slot(m_reductionReadback.nextSerial() - 1);
+
+        m_encodeCascadeMatrices = m_gpuDrivenCascades &&
+            m_reductionReadbackModes[previousSlot] == DEPTH_REDUCTION_FUSED;
+
+        // Picking the cascade count only needs the depth range, which is read from the newest
+        // completed reduction without waiting even when the matrices are built on the GPU
+        size_t readbackSlot = newestReductionSlot();
+
+        if (m_autoCascadeCount) {
+            int *dataPtrResult = m_reductionReadbackModes[readbackSlot] == DEPTH_REDUCTION_FUSED ?
+                (int*) m_depthHistogramBuffers[readbackSlot].contents() :
+                (int*) m_minMaxDepthBuffers[readbackSlot].contents();
+
+            m_cascadeCount = autoCascadeCount(decodeOrderedFloat(dataPtrResult[0]),
+                                              decodeOrderedFloat(dataPtrResult[1]),
+                                              AutoCascadeSplitRatio, m_cascadeCount);
+        }
+
+        frameData->cascadeCount = m_cascadeCount;
+
+        if (m_partitioningMode == FEEDBACK_PARTITIONING) {
+            updateSplitOptimizer(readbackSlot);
+        }
+
+        // The atlas and the CPU built matrices share one set of splits, so the atlas sizes each
+        // cascade for the range it is rendered with
+        CameraMotion motion;
+        bool predictBounds = updateCascadeSplits(frameData, readbackSlot, motion);
+
+        updateShadowAtlas(frameData, readbackSlot);
+
+        if (m_encodeCascadeMatrices) {
+            m_cascadeMatricesSlot = previousSlot;
+            m_shadowCastersCulled = false;
+
+            // The CPU does not see matrices built on the GPU, so every cascade is re-rendered
+            m_shadowCache.invalidate();
+        } else {
+            updateCascadeMatrices(frameData, readbackSlot, predictBounds, motion);
+        }
+    }
+
+    frameData->screenWidth = (float)m_view.drawableSize().width;
+    frameData->fov = m_camera->fov();
+    frameData->nearPlane = NearPlane;
+    frameData->farPlane = FarPlane;
+    frameData->partitioning_mode = m_partitioningMode;
+
+    frameData->visualization_mode = m_visualizationMode;
+}
+
+/// Matrices of the sun, rebuilt after its angles change
+const LightMatrices & Renderer::lightMatrices()
+{
+    if (!m_lightMatricesDirty) {
+        return m_lightMatrices;
+    }
+
+    float3 yAxis = {0, 1, 0}, zAxis = {0, 0, 1};
+    float4x4 skyModelMatrix = matrix4x4_rotation(m_lightPhi, yAxis) * matrix4x4_rotation(m_lightTheta, zAxis);
+
     float4 sunModelPosition = {0.0, 1.0, 0.0, 0.0};
 
     float4 sunWorldPosition = skyModelMatrix * sunModelPosition;
 
     float4 sunWorldDirection = -sunWorldPosition;
 
-    frameData->sun_eye_direction = view_matrix * sunWorldDirection;
-    frameData->sun_world_direction = sunWorldDirection;
+    float4 directionalLightUpVector = {0.0, 1.0, 1.0, 1.0};
 
-    // Calculate cascade projection matrices
+    directionalLightUpVector = skyModelMatrix * directionalLightUpVector;
 
-    {
-        float cascadeEnds[CASCADED_SHADOW_COUNT + 1];
-        int *dataPtrResult = (int*) m_minMaxDepthBuffer.contents();
-
-        if (this->m_partitioningMode == LOG_PARTITIONING) {
-            logPartitioning((float)dataPtrResult[0] / (float)LARGE_INTEGER,
-                            (float)dataPtrResult[1] / (float)LARGE_INTEGER,
-                            CASCADED_SHADOW_COUNT,
-                            cascadeEnds);
+    directionalLightUpVector.xyz = normalize(directionalLightUpVector.xyz);
+
+    float4x4 shadowViewMatrix = matrix_look_at_left_hand(sunWorldDirection.xyz / 10,
+                                                         (float3){0,0,0},
+                                                         directionalLightUpVector.xyz);
+
+    m_lightMatrices.skyModelMatrix = skyModelMatrix;
+    m_lightMatrices.shadowViewMatrix = shadowViewMatrix;
+    m_lightMatrices.inverseShadowViewMatrix = matrix_invert_rigid(shadowViewMatrix);
+    m_lightMatrices.sunWorldDirection = sunWorldDirection;
+
+    m_lightMatricesDirty = false;
+
+    return m_lightMatrices;
+}
+
+/// Find the readback slot holding the newest reduction the GPU has finished.  If none has finished
+/// yet, the slot this frame is about to write is idle and still holds the full range written at
+/// load time.
+size_t Renderer::newestReductionSlot()
+{
+    uint64_t resultSerial;
+
+    if (m_reductionReadback.newestCompleted(resultSerial)) {
+        m_reductionResultAge = m_reductionReadback.age(resultSerial);
+        m_reductionResultSerial = resultSerial;
+        return ReadbackRing<MaxFramesInFlight>::slot(resultSerial);
+    }
+
+    m_reductionResultAge = 0;
+    m_reductionResultSerial = UINT64_MAX;
+    return ReadbackRing<MaxFramesInFlight>::slot(m_reductionReadback.nextSerial());
+}
+
+/// Split the depth range of the newest completed reduction into cascades.  With motion prediction
+/// the range is first widened by the camera's motion since that reduction, which is returned for
+/// predicting the cascade bounds.  Returns whether the bounds are predicted.
+bool Renderer::updateCascadeSplits(FrameData *frameData, size_t readbackSlot, CameraMotion & motion)
+{
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+
+    bool fusedResult = m_reductionReadbackModes[readbackSlot] == DEPTH_REDUCTION_FUSED;
+
+    // The fused reduction leaves the depth range at the start of its histogram
+    int *dataPtrResult = fusedResult ?
+        (int*) m_depthHistogramBuffers[readbackSlot].contents() :
+        (int*) m_minMaxDepthBuffers[readbackSlot].contents();
+
+    float minDepth = decodeOrderedFloat(dataPtrResult[0]);
+    float maxDepth = decodeOrderedFloat(dataPtrResult[1]);
+
+    // The slot holds results of an earlier frame only once a reduction has completed; the full
+    // range written at load time needs no prediction
+    bool predictBounds = m_motionPrediction && m_reductionResultSerial != UINT64_MAX;
+
+    if (predictBounds) {
+        const float4x4 & projectionMatrix = frameData->projection_matrix;
+        float tanHalfDiagonal = sqrtf(1.0f / (projectionMatrix.columns[0][0] * projectionMatrix.columns[0][0]) +
+                                      1.0f / (projectionMatrix.columns[1][1] * projectionMatrix.columns[1][1]));
+
+        motion = cameraMotion((const float*)&m_reductionReadbackViewMatrices[readbackSlot],
+                              (const float*)&m_reductionReadbackLightViewMatrices[readbackSlot],
+                              (const float*)&frameData->view_matrix,
+                              (const float*)&frameData->shadow_view_matrix,
+                              tanHalfDiagonal);
+
+        m_boundsPredictor.predictDepthRange(motion, minDepth, maxDepth, NearPlane, &minDepth, &maxDepth);
+        maxDepth = std::min(maxDepth, FarPlane);
+    }
+
+    m_usedCascadeCount = partitionCascades(minDepth, maxDepth, fusedResult ? dataPtrResult : nullptr, cascadeEnds);
+
+    // Splits built on the GPU overwrite these before any shader reads them
+    for (uint i = 0; i < m_cascadeCount + 1; i++) {
+        frameData->cascadeEnds[i] = cascadeEnds[i];
+    }
+
+    return predictBounds;
+}
+
+/// Build the shadow matrices on the CPU from a completed reduction and this frame's splits
+void Renderer::updateCascadeMatrices(FrameData *frameData, size_t readbackSlot,
+                                     bool predictBounds, const CameraMotion & motion)
+{
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+    float lightFrustumBoundingBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+
+    bool fusedResult = m_reductionReadbackModes[readbackSlot] == DEPTH_REDUCTION_FUSED;
+
+    for (uint i = 0; i < m_cascadeCount + 1; i++) {
+        cascadeEnds[i] = frameData->cascadeEnds[i];
+    }
+
+    if (fusedResult && predictBounds) {
+        DepthSlab slabs[SDSM_HISTOGRAM_BIN_COUNT];
+        int slabCount = depthSlabsFromHistogram((int*) m_depthHistogramBuffers[readbackSlot].contents(),
+                                                NearPlane, FarPlane, slabs);
+
+        // Bins straddling a split count in full, as in cascadeBoundsFromDepthHistogram
+        for (uint i = 0; i < m_cascadeCount; i++) {
+            float start = cascadeEnds[i];
+            float end = cascadeEnds[i + 1];
+
+            alignToDepthHistogramBins(NearPlane, FarPlane, &start, &end);
+            m_boundsPredictor.predictCascadeBounds(motion, slabs, slabCount, start, end,
+                                                   lightFrustumBoundingBoxes + 6 * i);
+        }
+    } else if (fusedResult) {
+        cascadeBoundsFromDepthHistogram((int*) m_depthHistogramBuffers[readbackSlot].contents(),
+                                        NearPlane, FarPlane,
+                                        cascadeEnds, m_cascadeCount, lightFrustumBoundingBoxes);
+    } else {
+        // Bounds reduced with another cascade count do not line up with these splits, but the
+        // mismatch only lasts until the next reduction completes
+        int *boundingBoxPtr = (int*) m_lightFrustumBoundingBoxBuffers[readbackSlot].contents();
+
+        for (uint i = 0; i < m_cascadeCount; i++) {
+            decodeBoundingBox(boundingBoxPtr + 6 * i, lightFrustumBoundingBoxes + 6 * i);
+        }
+
+        // A sparse result only covers its own pixels of every cell; merged with the results
+        // before it, it covers every pixel once the rotation is complete
+        int stride = m_reductionReadbackStrides[readbackSlot];
+
+        if (stride > 1) {
+            m_sparseBoundsHistory.accumulate(m_reductionResultSerial, lightFrustumBoundingBoxes,
+                                             m_cascadeCount, stride * stride,
+                                             (const float*)&frameData->shadow_view_matrix);
         } else {
-            uniformPartitioning(NearPlane, FarPlane, CASCADED_SHADOW_COUNT, cascadeEnds);
+            m_sparseBoundsHistory.reset();
+        }
+
+        // The reduced cascades are the slabs, which only line up with the boxes when the cascade
+        // count has not changed since
+        if (predictBounds && m_reductionReadbackCascadeCounts[readbackSlot] == m_cascadeCount) {
+            DepthSlab slabs[MAX_CASCADED_SHADOW_COUNT];
+
+            for (uint i = 0; i < m_cascadeCount; i++) {
+                slabs[i].start = m_reductionReadbackCascadeEnds[readbackSlot][i];
+                slabs[i].end = m_reductionReadbackCascadeEnds[readbackSlot][i + 1];
+                memcpy(slabs[i].boundingBox, lightFrustumBoundingBoxes + 6 * i, sizeof(slabs[i].boundingBox));
+            }
+
+            m_boundsPredictor.predictCascadeBounds(motion, slabs, m_cascadeCount, cascadeEnds,
+                                                   m_cascadeCount, lightFrustumBoundingBoxes);
         }
+    }
 
-        FrameData *frameData = (FrameData *) (m_uniformBuffers[m_frameDataBufferIndex].contents());
+    const float4x4 & shadowModelViewMatrix = m_frameMatrices.shadowModelViewMatrix;
 
-        for (uint i = 0; i < CASCADED_SHADOW_COUNT + 1; i++) {
-            frameData->cascadeEnds[i] = cascadeEnds[i];
+    // Stale cascades are checked against the tight receiver bounds, while the padded bounds drive
+    // culling and the matrices of cascades the scheduler may leave stale
+    float receiverBoundingBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    memcpy(receiverBoundingBoxes, lightFrustumBoundingBoxes, sizeof(receiverBoundingBoxes));
+
+    if (m_shadowCaching && m_amortizedCascades) {
+        for (uint i = 1; i < m_cascadeCount; i++) {
+            padCascadeBounds(lightFrustumBoundingBoxes + 6 * i, AmortizedCascadePadding);
         }
+    }
+
+    float cascadeNearZ[MAX_CASCADED_SHADOW_COUNT];
+
+    updateShadowCasterMasks(shadowModelViewMatrix, lightFrustumBoundingBoxes, cascadeNearZ);
+
+    if (!m_frustrumLock && m_frustumCascadeCount != m_cascadeCount) {
+        m_frustumCascadeCount = m_cascadeCount;
+        updateFrustumIndexBuffer(m_frustumCascadeCount);
+    }
 
-        float4 directionalLightUpVector = {0.0, 1.0, 1.0, 1.0};
+    // A locked visualization keeps the frusta it has
+    FrustumVertex *viewFrustumPtr = m_frustrumLock ? nullptr : (FrustumVertex*) m_viewFrustumBuffer.contents();
+    FrustumVertex *lightFrustumPtr = m_frustrumLock ? nullptr : (FrustumVertex*) m_lightFrustumBuffer.contents();
 
-        directionalLightUpVector = skyModelMatrix * directionalLightUpVector;
+    float4x4 shadowProjectionMatrices[MAX_CASCADED_SHADOW_COUNT];
+
+    withCascadeCount(m_cascadeCount, [&](auto cascadeCount) {
+        cascadedShadowProjectionMatrices<decltype(cascadeCount)::value>(
+             m_frameMatrices.inverseViewMatrix, this->camera()->aspect(), this->camera()->fov(),
+             m_frameMatrices.inverseShadowViewMatrix, cascadeEnds, lightFrustumBoundingBoxes, cascadeNearZ,
+             shadowProjectionMatrices, viewFrustumPtr, lightFrustumPtr);
+    });
+
+    for (uint i = 0; i < m_cascadeCount; i++) {
+        frameData->shadow_mvp_matrices[i] = shadowProjectionMatrices[i] * shadowModelViewMatrix;
+    }
+
+    if (m_shadowCaching) {
+        updateShadowCache(frameData, receiverBoundingBoxes);
+    }
+
+    for (uint i = 0; i < m_cascadeCount; i++) {
+        // When calculating texture coordinates to sample from shadow map, flip the y/t coordinate and
+        // convert from the [-1, 1] range of clip coordinates to [0, 1] range of
+        // used for texture sampling
+        float4x4 shadowScale = matrix4x4_scale(0.5f, -0.5f, 1.0);
+        float4x4 shadowTranslate = matrix4x4_translation(0.5, 0.5, 0);
+        float4x4 shadowTransform = shadowTranslate * shadowScale;
+
+        frameData->shadow_mvp_xform_matrices[i] = shadowTransform * frameData->shadow_mvp_matrices[i];
+    }
+}
 
-        directionalLightUpVector.xyz = normalize(directionalLightUpVector.xyz);
+/// Decide which cascades keep their texels from an earlier frame.  Unchanged cascades always do.
+/// With amortized updates, far cascades whose stale matrix still covers their receivers also do
+/// until the scheduler refreshes them.  A cascade that keeps its texels has to be drawn and sampled
+/// with the matrix it was rendered with, which replaces this frame's matrix.
+void Renderer::updateShadowCache(FrameData *frameData, const float *receiverBoundingBoxes)
+{
+    uint32_t updateMask = ~0u;
 
-        float4x4 shadowViewMatrix = matrix_look_at_left_hand(sunWorldDirection.xyz / 10,
-                                                                    (float3){0,0,0},
-                                                                    directionalLightUpVector.xyz);
-        frameData->shadow_view_matrix = shadowViewMatrix;
+    if (m_amortizedCascades) {
+        CascadeUpdateRequest requests[MAX_CASCADED_SHADOW_COUNT];
 
-        float4x4 shadowModelViewMatrix = shadowViewMatrix * templeModelMatrix;
+        const float4x4 & lightViewToModel = m_frameMatrices.inverseShadowModelViewMatrix;
 
-        FrustumVertex *viewFrustumPtr = (FrustumVertex*) m_viewFrustumBuffer.contents();
-        FrustumVertex *lightFrustumPtr = (FrustumVertex*) m_lightFrustumBuffer.contents();
+        for (int i = 0; i < m_cascadeCount; i++) {
+            CascadeUpdateRequest & request = requests[i];
+            ShadowCacheRect region = shadowCacheRegion(i);
 
-        for (uint i = 0; i < CASCADED_SHADOW_COUNT; i++) {
+            request.changed = !m_shadowCache.matches(i, (const float*)&frameData->shadow_mvp_matrices[i], region);
+            request.reusable = false;
+            request.drawCount = 0;
 
-            FrustumVertex viewFrustumVertices[4 * CASCADED_SHADOW_COUNT + 4];
-            FrustumVertex lightFrustumVertices[8 * CASCADED_SHADOW_COUNT];
+            if (request.changed && m_shadowCache.isValid(i) && m_shadowCache.region(i) == region) {
+                float4x4 staleMatrix;
+                memcpy(&staleMatrix, m_shadowCache.matrix(i), sizeof(float4x4));
 
-            float4x4 shadowProjectionMatrix = cascadedShadowProjectionMatrix(
-                 this->camera()->viewMatrix(), this->camera()->aspect(), this->camera()->fov(),
-                 shadowViewMatrix, cascadeEnds, i, viewFrustumVertices, lightFrustumVertices, m_lightFrustumBoundingBoxBuffer);
+                float4x4 receiverToStaleClip = staleMatrix * lightViewToModel;
 
-            if (!m_frustrumLock) {
-                for (uint j = 0; j < 4 * CASCADED_SHADOW_COUNT + 4; j++) {
-                    viewFrustumPtr[j] = viewFrustumVertices[j];
-                }
+                request.reusable = staleCascadeCoversReceivers((const float*)&receiverToStaleClip,
+                                                               receiverBoundingBoxes + 6 * i);
+            }
 
-                for (uint j = 0; j < 8 * CASCADED_SHADOW_COUNT; j++) {
-                    lightFrustumPtr[j] = lightFrustumVertices[j];
-                }
+            for (uint32_t mask : m_submeshCascadeMasks) {
+                request.drawCount += (mask >> i) & 1;
             }
+        }
 
-            frameData->shadow_mvp_matrices[i] = shadowProjectionMatrix * shadowModelViewMatrix;
-
-            // When calculating texture coordinates to sample from shadow map, flip the y/t coordinate and
-            // convert from the [-1, 1] range of clip coordinates to [0, 1] range of
-            // used for texture sampling
-            float4x4 shadowScale = matrix4x4_scale(0.5f, -0.5f, 1.0);
-            float4x4 shadowTranslate = matrix4x4_translation(0.5, 0.5, 0);
-            float4x4 shadowTransform = shadowTranslate * shadowScale;
-
-            frameData->shadow_mvp_xform_matrices[i] = shadowTransform * frameData->shadow_mvp_matrices[i];
-            frameData->unproject_matrix =
-                matrix_invert(frameData->projection_matrix * frameData->view_matrix) *
-                matrix4x4_translation(-1.0, -1.0, 0.0) *
-                matrix4x4_scale(2.0 / (float)m_view.drawableSize().width, 2.0 / (float)m_view.drawableSize().height, 1.0) *
-                matrix4x4_translation(0.0, (float)m_view.drawableSize().height, 0.0) *
-                matrix4x4_scale(1.0, -1.0, 1.0);
+        updateMask = m_cascadeScheduler.schedule(requests, m_cascadeCount);
+    }
+
+    for (int i = 0; i < m_cascadeCount; i++) {
+        if (updateMask & (1u << i)) {
+            m_shadowCache.updateCascade(i, (const float*)&frameData->shadow_mvp_matrices[i], shadowCacheRegion(i));
         }
+
+        memcpy(&frameData->shadow_mvp_matrices[i], m_shadowCache.matrix(i), sizeof(float4x4));
+    }
+}
+
+/// Feed the aliasing error the newest completed reduction measured to the split optimizer, along
+/// with the splits it was measured with
+void Renderer::updateSplitOptimizer(size_t readbackSlot)
+{
+    if (m_reductionResultSerial == UINT64_MAX || !m_reductionReadbackAliasing[readbackSlot]) {
+        return;
     }
 
-    frameData->screenWidth = (float)m_view.drawableSize().width;
-    frameData->fov = m_camera->fov();
+    const int *aliasingErrors = (const int*) m_aliasingErrorBuffers[readbackSlot].contents();
+    uint cascadeCount = m_reductionReadbackCascadeCounts[readbackSlot];
 
-    frameData->visualization_mode = m_visualizationMode;
+    float errors[MAX_CASCADED_SHADOW_COUNT];
+
+    for (uint i = 0; i < cascadeCount; i++) {
+        errors[i] = aliasingErrorPercentile(aliasingErrors, i, AliasingFeedbackPercentile);
+    }
+
+    m_splitOptimizer.update(m_reductionReadbackCascadeEnds[readbackSlot], errors, cascadeCount);
+}
+
+/// Splits of the current partitioning mode.  Feedback partitioning spreads the depth range by
+/// the split optimizer's shares.  Returns the number of cascades in use, as cascadePartitioning.
+int Renderer::partitionCascades(float minDepth, float maxDepth, const int *histogram, float *cascadeEnds)
+{
+    if (m_partitioningMode == FEEDBACK_PARTITIONING) {
+        m_splitOptimizer.partition(minDepth, maxDepth, m_cascadeCount, cascadeEnds);
+        return m_cascadeCount;
+    }
+
+    return cascadePartitioning(m_partitioningMode, minDepth, maxDepth, NearPlane, FarPlane,
+                               histogram, m_cascadeCount, cascadeEnds);
+}
+
+/// Place the cascades in the shadow map.  With the atlas, each cascade's share of the texel budget
+/// follows its screen coverage and aliasing error, estimated for this frame's CPU splits even when
+/// the splits the frame renders with are built on the GPU.
+void Renderer::updateShadowAtlas(FrameData *frameData, size_t readbackSlot)
+{
+#if USE_SHADOW_ATLAS
+    int *histogram = m_reductionReadbackModes[readbackSlot] == DEPTH_REDUCTION_FUSED ?
+        (int*) m_depthHistogramBuffers[readbackSlot].contents() : nullptr;
+
+    float weights[MAX_CASCADED_SHADOW_COUNT];
+
+    shadowAtlasWeights(histogram, NearPlane, FarPlane, frameData->cascadeEnds, m_cascadeCount, weights);
+
+    m_shadowAtlas.update(weights, m_cascadeCount);
+
+    for (int i = 0; i < m_cascadeCount; i++) {
+        const ShadowAtlasRect & rect = m_shadowAtlas.rect(i);
+
+        frameData->shadowAtlasRects[i] = (float4){(float)rect.x, (float)rect.y, (float)rect.size, (float)rect.size} /
+                                         (float)SHADOW_ATLAS_RES;
+    }
+#else
+    for (int i = 0; i < m_cascadeCount; i++) {
+        frameData->shadowAtlasRects[i] = (float4){0.0f, 0.0f, 1.0f, 1.0f};
+    }
+#endif
+}
+
+/// Find the cascades every mesh and submesh casts shadows into, and fit the near plane of each
+/// cascade to its casters.  Each cascade renders casters from the receivers' light view bounds in
+/// x and y, extended towards the light, so anything outside that volume cannot shadow a visible
+/// receiver.  The near plane moves up to the closest remaining caster, which keeps the depth range
+/// of the 16 bit shadow map no larger than the cascade's contents.
+void Renderer::updateShadowCasterMasks(const float4x4 & shadowModelViewMatrix,
+                                       const float *lightFrustumBoundingBoxes,
+                                       float *cascadeNearZ)
+{
+    AxisAlignedBox cascadeVolumes[MAX_CASCADED_SHADOW_COUNT];
+
+    for (int i = 0; i < m_cascadeCount; i++) {
+        cascadeVolumes[i] = cascadeCasterVolume(lightFrustumBoundingBoxes + 6 * i, -FLT_MAX);
+    }
+
+    resetCascadeNearPlanes(lightFrustumBoundingBoxes, m_cascadeCount, cascadeNearZ);
+
+    m_meshCascadeMasks.resize(m_meshes->size());
+    m_submeshCascadeMasks.clear();
+
+    // All casters move to light view space at once, meshes first, then submeshes
+    size_t casterCount = m_casterBounds.size() / 6;
+    soa_box_float3 lightBoxes = soa_box_float3_from_buffer(m_lightViewCasterBounds.data(), casterCount);
+
+    matrix_transform_boxes(shadowModelViewMatrix, soa_box_float3_from_buffer(m_casterBounds.data(), casterCount),
+                           lightBoxes, casterCount);
+
+    size_t submeshIndex = m_meshes->size();
+
+    for (size_t i = 0; i < m_meshes->size(); i++) {
+        const Mesh & mesh = (*m_meshes)[i];
+
+        // Every submesh lies inside the mesh bounds, so a mesh outside all cascades skips them
+        m_meshCascadeMasks[i] = cascadeOverlapMask(soaBox(lightBoxes, i), cascadeVolumes, m_cascadeCount);
+
+        for (size_t j = 0; j < mesh.submeshes().size(); j++, submeshIndex++) {
+            uint32_t mask = 0;
+
+            if (m_meshCascadeMasks[i]) {
+                // The submesh bounds are tighter than the mesh's, so they drive the near plane
+                AxisAlignedBox lightBox = soaBox(lightBoxes, submeshIndex);
+
+                mask = cascadeOverlapMask(lightBox, cascadeVolumes, m_cascadeCount);
+
+                includeCasterInNearPlanes(lightBox, mask, cascadeNearZ);
+            }
+
+            m_submeshCascadeMasks.push_back(mask);
+        }
+    }
+
+    m_shadowCastersCulled = true;
 }
 
 /// Called whenever view changes orientation or layout is changed
@@ -675,15 +1223,56 @@ void Renderer::drawableSizeWillChange(MTL::Size size, MTL::StorageMode GBufferSt
     m_albedo_specular_GBuffer.label( "Albedo + Spetetcular GBuffer" );
     m_normal_shadow_GBuffer.label( "Normal + Shadow GBuffer" );
     m_depth_GBuffer.label( "Depth GBuffer" );
+
+    // The single pass deferred renderer keeps depth in tile memory and has nothing to build it from
+    m_depthPyramidLevels.clear();
+
+    if (!m_singlePassDeferred)
+    {
+        MTL::TextureDescriptor depthPyramidDesc;
+
+        int levelCount = depthPyramidLevelCount((int)size.width, (int)size.height);
+
+        depthPyramidDesc.pixelFormat( MTL::PixelFormatRG32Float );
+        depthPyramidDesc.width( depthPyramidLevelSize((int)size.width) );
+        depthPyramidDesc.height( depthPyramidLevelSize((int)size.height) );
+        depthPyramidDesc.mipmapLevelCount( levelCount );
+        depthPyramidDesc.textureType( MTL::TextureType2D );
+        depthPyramidDesc.usage( MTL::TextureUsageShaderRead | MTL::TextureUsageShaderWrite );
+        depthPyramidDesc.storageMode( MTL::StorageModePrivate );
+
+        m_depthPyramid = m_device.makeTexture( depthPyramidDesc );
+        m_depthPyramid.label( "Depth Pyramid" );
+
+        for (int level = 0; level < levelCount; level++) {
+            m_depthPyramidLevels.push_back(m_depthPyramid.makeTextureView(MTL::PixelFormatRG32Float,
+                                                                          MTL::TextureType2D,
+                                                                          { (MTL::UInteger)level, 1 },
+                                                                          { 0, 1 }));
+        }
+    }
 }
 
 #pragma mark Common Rendering Code
 
-/// Draw the Mesh objects with the given renderEncoder
-void Renderer::drawMeshes( MTL::RenderCommandEncoder & renderEncoder )
+/// Draw the Mesh objects with the given renderEncoder.  When a shadow cascade is given, meshes and
+/// submeshes culled from that cascade are skipped.
+void Renderer::drawMeshes( MTL::RenderCommandEncoder & renderEncoder, int cascade )
 {
-    for (auto& mesh : *m_meshes)
+    bool culled = cascade >= 0 && m_shadowCastersCulled;
+    uint32_t cascadeBit = culled ? 1u << cascade : 0;
+    size_t submeshIndex = 0;
+
+    for (size_t meshIndex = 0; meshIndex < m_meshes->size(); meshIndex++)
     {
+        const Mesh & mesh = (*m_meshes)[meshIndex];
+
+        if (culled && !(m_meshCascadeMasks[meshIndex] & cascadeBit))
+        {
+            submeshIndex += mesh.submeshes().size();
+            continue;
+        }
+
         for (auto& meshBuffer : mesh.vertexBuffers())
         {
             renderEncoder.setVertexBuffer( meshBuffer.buffer(),
@@ -693,6 +1282,11 @@ void Renderer::drawMeshes( MTL::RenderCommandEncoder & renderEncoder )
 
         for (auto& submesh : mesh.submeshes())
         {
+            if (culled && !(m_submeshCascadeMasks[submeshIndex++] & cascadeBit))
+            {
+                continue;
+            }
+
             // Set any textures read/sampled from the render pipeline
             const std::vector<MTL::Texture> & submeshTextures = submesh.textures();
 
@@ -745,9 +1339,25 @@ MTL::CommandBuffer Renderer::beginFrame()
 
     updateWorldState();
 
+    // The drawable's command buffer always counts towards the frame's completion
+    m_frameCompletedHandlers[m_frameDataBufferIndex].pendingCommandBuffers = 1;
+
     return commandBuffer;
 }
 
+/// Create a completed handler functor for Metal to execute when the GPU has fully finished
+/// processing the commands encoded for this frame.  This implenentation of the completed hander
+/// signals the `m_inFlightSemaphore` once the last command buffer of the frame completes, which
+/// indicates that the GPU is no longer accesing the the dynamic buffer written this frame.  When the
+/// GPU no longer accesses the buffer, the Renderer can safely overwrite the buffer's data to update
+/// data for a future frame.
+void Renderer::FrameCompletedHandler::operator()(const MTL::CommandBuffer &)
+{
+    if (pendingCommandBuffers.fetch_sub(1) == 1) {
+        dispatch_semaphore_signal(semaphore);
+    }
+}
+
 /// Perform operations necessary to obtain a command buffer for rendering to the drawable.  By
 /// endoding commands that are not dependant on the drawable in a separate command buffer, Metal
 /// can begin executing encoded commands for the frame (commands from the previous command buffer)
@@ -756,32 +1366,44 @@ MTL::CommandBuffer Renderer::beginDrawableCommands()
 {
     MTL::CommandBuffer commandBuffer = m_commandQueue.commandBuffer();
 
-    if(!m_completedHandler)
-    {
-        // Create a completed handler functor for Metal to execute when the GPU has fully finished
-        // processing the commands encoded for this frame.  This implenentation of the completed
-        // hander signals the `m_inFlightSemaphore`, which indicates that the GPU is no longer
-        // accesing the the dynamic buffer written this frame.  When the GPU no longer accesses the
-        // buffer, the Renderer can safely overwrite the buffer's data to update data for a future
-        // frame.
-        struct CommandBufferCompletedHandler : public MTL::CommandBufferHandler
-        {
-            dispatch_semaphore_t semaphore;
-            void operator()(const MTL::CommandBuffer &)
-            {
-                dispatch_semaphore_signal(semaphore);
-            }
-        };
+    commandBuffer.addCompletedHandler(m_frameCompletedHandlers[m_frameDataBufferIndex]);
 
-        CommandBufferCompletedHandler *completedHandler = new CommandBufferCompletedHandler();
-        completedHandler->semaphore = m_inFlightSemaphore;
+    return commandBuffer;
+}
 
-        m_completedHandler = completedHandler;
-    }
+/// Make the commands encoded from here on into a graphics command buffer wait for the newest
+/// reduction on the reduction queue, which reads the G-buffer depth and writes the histogram the
+/// GPU driven cascades are built from.  Encodes nothing if an earlier wait covers it.
+void Renderer::waitForReduction(MTL::CommandBuffer & commandBuffer)
+{
+    m_queueGraph.wait(commandBuffer, RENDER_QUEUE_GRAPHICS, m_queueGraph.lastSignaled(RENDER_QUEUE_REDUCTION));
+}
 
-    commandBuffer.addCompletedHandler(*m_completedHandler);
+/// Close the graphics command buffer holding this frame's G-buffer pass and get a command buffer
+/// on the reduction queue that waits for it.  Call right before committing the graphics commands.
+MTL::CommandBuffer Renderer::beginReductionCommands(MTL::CommandBuffer & commandBuffer)
+{
+    RenderQueueGraph::Submission graphicsSubmission = m_queueGraph.begin(RENDER_QUEUE_GRAPHICS);
+    m_queueGraph.signal(commandBuffer, graphicsSubmission);
 
-    return commandBuffer;
+    MTL::CommandBuffer reductionCommandBuffer = m_reductionQueue.commandBuffer();
+
+    m_reductionSubmission = m_queueGraph.begin(RENDER_QUEUE_REDUCTION);
+    m_queueGraph.wait(reductionCommandBuffer, RENDER_QUEUE_REDUCTION, graphicsSubmission);
+
+    return reductionCommandBuffer;
+}
+
+/// Signal and commit the reduction commands.  The frame's in flight slot stays busy until they
+/// complete as well, since they read this frame's uniforms and readback buffers.
+void Renderer::endReductionCommands(MTL::CommandBuffer & commandBuffer)
+{
+    m_queueGraph.signal(commandBuffer, m_reductionSubmission);
+
+    m_frameCompletedHandlers[m_frameDataBufferIndex].pendingCommandBuffers++;
+    commandBuffer.addCompletedHandler(m_frameCompletedHandlers[m_frameDataBufferIndex]);
+
+    commandBuffer.commit();
 }
 
 /// Perform cleanup operations including presenting the drawable and committing the command buffer
@@ -825,27 +1447,289 @@ void Renderer::endFrame(MTL::CommandBuffer & commandBuffer)
     commandBuffer.commit();
 }
 
+/// Cascades the shadow pass renders this frame, one bit per cascade
+uint32_t Renderer::shadowCascadeMask()
+{
+    uint32_t cascadeMask = 0;
+
+    for (int i = 0; i < m_cascadeCount; i++) {
+        // Clustered partitioning leaves unused cascades with zero width and no receivers.  Splits
+        // built on the GPU are not known here, so build_cascade_matrices gives those cascades a
+        // matrix that rasterizes nothing instead.
+        if (!m_encodeCascadeMatrices && i >= m_usedCascadeCount) {
+            continue;
+        }
+
+        cascadeMask |= 1u << i;
+    }
+
+    return cascadeMask;
+}
+
+/// Region of the shadow map a cascade renders into
+ShadowCacheRect Renderer::shadowCacheRegion(int cascade)
+{
+#if USE_SHADOW_ATLAS
+    const ShadowAtlasRect & rect = m_shadowAtlas.rect(cascade);
+
+    return {0, rect.x, rect.y, rect.size, rect.size};
+#else
+    return {cascade, 0, 0, SHADOW_MAP_RES, SHADOW_MAP_RES};
+#endif
+}
+
+/// Reset the texels of a cached cascade inside rect to the far plane before its casters are drawn
+/// again.  The viewport must cover rect.  The scissor is left on rect so the casters only touch the
+/// cleared texels, and the caster pipeline state is restored.
+void Renderer::clearShadowRect( MTL::RenderCommandEncoder & renderEncoder, const ShadowCacheRect & rect )
+{
+    MTL::ScissorRect scissorRect = { (MTL::UInteger)rect.x, (MTL::UInteger)rect.y,
+                                     (MTL::UInteger)rect.width, (MTL::UInteger)rect.height };
+
+    renderEncoder.setScissorRect( scissorRect );
+
+    renderEncoder.setRenderPipelineState( m_shadowClearPipelineState );
+    renderEncoder.setDepthStencilState( m_shadowClearDepthStencilState );
+    renderEncoder.setCullMode( MTL::CullModeNone );
+    renderEncoder.setDepthBias( 0, 0, 0 );
+
+    renderEncoder.drawPrimitives( MTL::PrimitiveTypeTriangle, 0, 3 );
+
+    renderEncoder.setRenderPipelineState( m_shadowGenPipelineState );
+    renderEncoder.setDepthStencilState( m_shadowDepthStencilState );
+    renderEncoder.setCullMode( MTL::CullModeBack );
+    renderEncoder.setDepthBias( 0.015, 7, 0.02 );
+}
+
 /// Draw to the depth texture from the directional lights point of view to generate the shadow map
 void Renderer::drawShadow(MTL::CommandBuffer & commandBuffer)
 {
-    for (int i = 0; i < CASCADED_SHADOW_COUNT; i++) {
-        m_shadowRenderPassDescriptor.depthAttachment.slice(i);
+    if (m_encodeCascadeMatrices) {
+        // The matrices are built from the previous frame's histogram
+        waitForReduction(commandBuffer);
 
-        MTL::RenderCommandEncoder encoder = commandBuffer.renderCommandEncoderWithDescriptor(m_shadowRenderPassDescriptor);
+        buildCascadeMatrices(commandBuffer);
+    }
 
-        encoder.label( "Shadow Map Pass");
+    uint32_t cascadeMask = shadowCascadeMask();
 
-        encoder.setRenderPipelineState( m_shadowGenPipelineState );
-        encoder.setDepthStencilState( m_shadowDepthStencilState );
-        encoder.setCullMode( MTL::CullModeBack );
-        encoder.setDepthBias( 0.015, 7, 0.02 );
+    // Cascades built on the GPU bypass the cache, which invalidated itself for them
+    bool caching = m_shadowCaching && !m_encodeCascadeMatrices;
 
-        encoder.setVertexBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
-        encoder.setVertexBuffer(m_cascadeIndexBuffers[i], 0, BufferIndexCascadeIndex);
+    uint32_t renderMask = cascadeMask;
+    bool fullyDirty = true;
 
-        drawMeshes( encoder );
+    if (caching) {
+        for (int i = 0; i < m_cascadeCount; i++) {
+            if (!m_shadowCache.isDirty(i)) {
+                renderMask &= ~(1u << i);
+            } else if (!m_shadowCache.isFullyDirty(i)) {
+                fullyDirty = false;
+            }
+        }
+    }
 
-        encoder.endEncoding();
+    if (!renderMask) {
+        return;
+    }
+
+#if USE_SHADOW_ATLAS
+    drawShadowAtlas(commandBuffer, renderMask, caching);
+#else
+    // The layered pass clears every slice, so it only runs when nothing is kept from earlier frames
+    if (m_layeredShadows && renderMask == cascadeMask && fullyDirty) {
+        drawShadowLayered(commandBuffer, cascadeMask);
+    } else {
+        for (int i = 0; i < m_cascadeCount; i++) {
+            if (!(renderMask & (1u << i))) {
+                continue;
+            }
+
+            bool partial = caching && !m_shadowCache.isFullyDirty(i);
+
+            m_shadowRenderPassDescriptor.depthAttachment.slice(i);
+            m_shadowRenderPassDescriptor.depthAttachment.loadAction( partial ? MTL::LoadActionLoad : MTL::LoadActionClear );
+
+            MTL::RenderCommandEncoder encoder = commandBuffer.renderCommandEncoderWithDescriptor(m_shadowRenderPassDescriptor);
+
+            encoder.label( "Shadow Map Pass");
+
+            encoder.setRenderPipelineState( m_shadowGenPipelineState );
+            encoder.setDepthStencilState( m_shadowDepthStencilState );
+            encoder.setCullMode( MTL::CullModeBack );
+            encoder.setDepthBias( 0.015, 7, 0.02 );
+
+            encoder.setVertexBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+            encoder.setVertexBuffer(m_cascadeIndexBuffers[i], 0, BufferIndexCascadeIndex);
+
+            if (partial) {
+                clearShadowRect( encoder, m_shadowCache.dirtyRect(i) );
+            }
+
+            drawMeshes( encoder, i );
+
+            encoder.endEncoding();
+        }
+    }
+#endif
+
+    if (caching) {
+        for (int i = 0; i < m_cascadeCount; i++) {
+            if (renderMask & (1u << i)) {
+                m_shadowCache.markRendered(i);
+            }
+        }
+    }
+}
+
+#if USE_SHADOW_ATLAS
+
+/// Draw the cascades in cascadeMask into their squares of the shadow atlas with a single encoder.
+/// Without caching the whole atlas is cleared once.  With caching the atlas is loaded and only the
+/// dirty texels of each cascade are cleared and drawn.  In layered mode every caster is then drawn
+/// once, instanced over its cascades, with a viewport and scissor rect per cascade.
+void Renderer::drawShadowAtlas(MTL::CommandBuffer & commandBuffer, uint32_t cascadeMask, bool caching)
+{
+    m_shadowRenderPassDescriptor.depthAttachment.loadAction( caching ? MTL::LoadActionLoad : MTL::LoadActionClear );
+
+    MTL::RenderCommandEncoder encoder = commandBuffer.renderCommandEncoderWithDescriptor(m_shadowRenderPassDescriptor);
+
+    encoder.label( "Shadow Atlas Pass");
+
+    encoder.setRenderPipelineState( m_shadowGenPipelineState );
+    encoder.setDepthStencilState( m_shadowDepthStencilState );
+    encoder.setCullMode( MTL::CullModeBack );
+    encoder.setDepthBias( 0.015, 7, 0.02 );
+
+    encoder.setVertexBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+
+    MTL::Viewport viewports[MAX_CASCADED_SHADOW_COUNT];
+    MTL::ScissorRect scissorRects[MAX_CASCADED_SHADOW_COUNT];
+
+    for (int i = 0; i < m_cascadeCount; i++) {
+        const ShadowAtlasRect & rect = m_shadowAtlas.rect(i);
+
+        viewports[i] = { (double)rect.x, (double)rect.y, (double)rect.size, (double)rect.size, 0.0, 1.0 };
+        scissorRects[i] = { (MTL::UInteger)rect.x, (MTL::UInteger)rect.y,
+                            (MTL::UInteger)rect.size, (MTL::UInteger)rect.size };
+
+        if (!(cascadeMask & (1u << i))) {
+            continue;
+        }
+
+        encoder.setViewport( viewports[i] );
+
+        if (caching) {
+            const ShadowCacheRect & dirtyRect = m_shadowCache.dirtyRect(i);
+
+            clearShadowRect( encoder, dirtyRect );
+
+            scissorRects[i] = { (MTL::UInteger)dirtyRect.x, (MTL::UInteger)dirtyRect.y,
+                                (MTL::UInteger)dirtyRect.width, (MTL::UInteger)dirtyRect.height };
+        } else {
+            encoder.setScissorRect( scissorRects[i] );
+        }
+
+        if (!m_layeredShadows) {
+            encoder.setVertexBuffer(m_cascadeIndexBuffers[i], 0, BufferIndexCascadeIndex);
+
+            drawMeshes( encoder, i );
+        }
+    }
+
+    if (m_layeredShadows) {
+        encoder.setRenderPipelineState( m_shadowGenLayeredPipelineState );
+        encoder.setViewports( viewports, m_cascadeCount );
+        encoder.setScissorRects( scissorRects, m_cascadeCount );
+
+        drawShadowCastersLayered( encoder, cascadeMask );
+    }
+
+    encoder.endEncoding();
+}
+
+#endif
+
+/// Draw all cascades with a single encoder.  Every caster is drawn once, instanced over the cascades
+/// it reaches, and each instance is routed to its cascade's slice of the shadow map.
+void Renderer::drawShadowLayered(MTL::CommandBuffer & commandBuffer, uint32_t cascadeMask)
+{
+    // Every layer of the render target array is cleared, including cascades nothing is drawn into
+    m_layeredShadowRenderPassDescriptor.renderTargetArrayLength(m_cascadeCount);
+
+    MTL::RenderCommandEncoder encoder = commandBuffer.renderCommandEncoderWithDescriptor(m_layeredShadowRenderPassDescriptor);
+
+    encoder.label( "Layered Shadow Map Pass");
+
+    encoder.setRenderPipelineState( m_shadowGenLayeredPipelineState );
+    encoder.setDepthStencilState( m_shadowDepthStencilState );
+    encoder.setCullMode( MTL::CullModeBack );
+    encoder.setDepthBias( 0.015, 7, 0.02 );
+
+    encoder.setVertexBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+
+    drawShadowCastersLayered( encoder, cascadeMask );
+
+    encoder.endEncoding();
+}
+
+/// Draw each mesh and submesh instanced over the cascades in cascadeMask it was not culled from
+void Renderer::drawShadowCastersLayered( MTL::RenderCommandEncoder & renderEncoder, uint32_t cascadeMask )
+{
+    size_t submeshIndex = 0;
+
+    for (size_t meshIndex = 0; meshIndex < m_meshes->size(); meshIndex++)
+    {
+        const Mesh & mesh = (*m_meshes)[meshIndex];
+
+        uint32_t meshMask = cascadeMask;
+
+        if (m_shadowCastersCulled)
+        {
+            meshMask &= m_meshCascadeMasks[meshIndex];
+        }
+
+        if (!meshMask)
+        {
+            submeshIndex += mesh.submeshes().size();
+            continue;
+        }
+
+        for (auto& meshBuffer : mesh.vertexBuffers())
+        {
+            renderEncoder.setVertexBuffer( meshBuffer.buffer(),
+                                           meshBuffer.offset(),
+                                           meshBuffer.argumentIndex() );
+        }
+
+        for (auto& submesh : mesh.submeshes())
+        {
+            uint32_t submeshMask = meshMask;
+
+            if (m_shadowCastersCulled)
+            {
+                submeshMask &= m_submeshCascadeMasks[submeshIndex];
+            }
+
+            submeshIndex++;
+
+            unsigned int cascadeList;
+            int instanceCount = packCascadeList(submeshMask, &cascadeList);
+
+            if (instanceCount == 0)
+            {
+                continue;
+            }
+
+            renderEncoder.setVertexBytes( &cascadeList, sizeof(cascadeList), BufferIndexCascadeIndex );
+
+            renderEncoder.drawIndexedPrimitives( submesh.primitiveType(),
+                                                 submesh.indexCount(),
+                                                 submesh.indexType(),
+                                                 submesh.indexBuffer().buffer(),
+                                                 submesh.indexBuffer().offset(),
+                                                 instanceCount );
+        }
     }
 }
 
@@ -869,6 +1753,86 @@ void Renderer::drawGBuffer(MTL::RenderCommandEncoder & renderEncoder)
 
 // Reduce min and max depth and compute tight light frusta using compute pipeline
 // It assumes that depth buffer contains depth values in eye space
+/// Claim this frame's slot of the reduction readback ring for a reduction encoded into the given
+/// command buffer.  The slot becomes readable once the command buffer completes.
+size_t Renderer::beginReductionReadback(MTL::CommandBuffer &commandBuffer, DepthReductionMode mode)
+{
+    // The in flight semaphore guarantees the GPU is done with this frame's slot, so the CPU can
+    // reset it.
+    uint64_t readbackSerial = m_reductionReadback.beginWrite();
+    size_t readbackSlot = ReadbackRing<MaxFramesInFlight>::slot(readbackSerial);
+
+    m_reductionReadbackModes[readbackSlot] = mode;
+    m_reductionReadbackStrides[readbackSlot] = 1;
+
+    // The reduction reads the depth this frame renders, seen from this frame's camera and light
+    const FrameData *frameData = (const FrameData *) (m_uniformBuffers[m_frameDataBufferIndex].contents());
+
+    m_reductionReadbackViewMatrices[readbackSlot] = frameData->view_matrix;
+    m_reductionReadbackLightViewMatrices[readbackSlot] = frameData->shadow_view_matrix;
+    m_reductionReadbackCascadeCounts[readbackSlot] = frameData->cascadeCount;
+
+    for (uint i = 0; i < frameData->cascadeCount + 1; i++) {
+        m_reductionReadbackCascadeEnds[readbackSlot][i] = frameData->cascadeEnds[i];
+    }
+
+    struct ReductionCompletedHandler : public MTL::CommandBufferHandler
+    {
+        ReadbackRing<MaxFramesInFlight> *readback;
+        uint64_t serial;
+
+        void operator()(const MTL::CommandBuffer &)
+        {
+            readback->complete(serial);
+            delete this;
+        }
+    };
+
+    ReductionCompletedHandler *completedHandler = new ReductionCompletedHandler();
+    completedHandler->readback = &m_reductionReadback;
+    completedHandler->serial = readbackSerial;
+
+    commandBuffer.addCompletedHandler(*completedHandler);
+
+    return readbackSlot;
+}
+
+/// Build the min/max depth pyramid of this frame's G-buffer depth.  Runs once after the G-buffer
+/// pass, so every later pass needing coarse depth bounds reads it instead of the full resolution
+/// depth, and is skipped on frames where no pass reads it.  Dispatches in one encoder run in
+/// order, so each level sees the one before it.
+void Renderer::buildDepthPyramid(MTL::CommandBuffer &commandBuffer)
+{
+    if (!depthPyramidNeeded()) {
+        return;
+    }
+
+    MTL::ComputeCommandEncoder computeEncoder = commandBuffer.computeCommandEncoder();
+    computeEncoder.label( "Build depth pyramid" );
+
+    MTL::Size threadgroupSize = MTL::SizeMake(8, 8, 1);
+
+    computeEncoder.setComputePipelineState(m_buildDepthPyramidBaseComputePipelineState);
+    computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
+    computeEncoder.setTexture(m_depthPyramidLevels[0], TextureIndexDepthPyramid);
+
+    computeEncoder.dispatchThreads(MTL::SizeMake(m_depthPyramidLevels[0].width(), m_depthPyramidLevels[0].height(), 1),
+                                   threadgroupSize);
+
+    computeEncoder.setComputePipelineState(m_buildDepthPyramidLevelComputePipelineState);
+
+    for (size_t level = 1; level < m_depthPyramidLevels.size(); level++) {
+        MTL::Texture & pyramidLevel = m_depthPyramidLevels[level];
+
+        computeEncoder.setTexture(m_depthPyramidLevels[level - 1], TextureIndexDepth);
+        computeEncoder.setTexture(pyramidLevel, TextureIndexDepthPyramid);
+
+        computeEncoder.dispatchThreads(MTL::SizeMake(pyramidLevel.width(), pyramidLevel.height(), 1), threadgroupSize);
+    }
+
+    computeEncoder.endEncoding();
+}
+
 void Renderer::computeLightFrusta(MTL::CommandBuffer &commandBuffer)
 {
     MTL::ComputeCommandEncoder computeEncoder = commandBuffer.computeCommandEncoder();
@@ -881,38 +1845,198 @@ void Renderer::computeLightFrusta(MTL::CommandBuffer &commandBuffer)
 
     MTL::Size threadgroupSize = MTL::SizeMake(sqrtl(maxThreads), sqrtl(maxThreads), 1);
 
+    size_t readbackSlot = beginReductionReadback(commandBuffer, m_depthReductionMode);
+
+    m_reductionReadbackAliasing[readbackSlot] = m_partitioningMode == FEEDBACK_PARTITIONING;
+
+    if (m_reductionReadbackAliasing[readbackSlot]) {
+        reduceAliasingError(computeEncoder, readbackSlot);
+    }
+
+    MTL::Buffer & minMaxDepthBuffer = m_minMaxDepthBuffers[readbackSlot];
+    MTL::Buffer & lightFrustumBoundingBoxBuffer = m_lightFrustumBoundingBoxBuffers[readbackSlot];
+    MTL::Buffer & depthHistogramBuffer = m_depthHistogramBuffers[readbackSlot];
+
+    if (m_depthReductionMode == DEPTH_REDUCTION_FUSED) {
+        // depth range and per bin light space bounds in a single pass over the depth buffer
+
+        resetDepthHistogram((int*) depthHistogramBuffer.contents(), NearPlane, FarPlane);
+
+        if (depthPyramidNeeded()) {
+            // One thread per block of pixels, with bounds dilated to the whole block
+            uint32_t level = std::min<uint32_t>(SDSM_DEPTH_PYRAMID_REDUCTION_LEVEL,
+                                                (uint32_t)m_depthPyramidLevels.size() - 1);
+
+            MTL::Texture & pyramidLevel = m_depthPyramidLevels[level];
+
+            computeEncoder.setComputePipelineState(m_reduceDepthHistogramCoarseComputePipelineState);
+            computeEncoder.setBuffer(depthHistogramBuffer, 0, BufferIndexDepthHistogram);
+            computeEncoder.setBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+            computeEncoder.setBytes(&level, sizeof(level), BufferIndexDepthPyramidLevel);
+            computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
+            computeEncoder.setTexture(m_depthPyramid, TextureIndexDepthPyramid);
+
+            computeEncoder.dispatchThreads(MTL::SizeMake(pyramidLevel.width(), pyramidLevel.height(), 1),
+                                           MTL::SizeMake(8, 8, 1));
+
+            computeEncoder.endEncoding();
+            return;
+        }
+
+        computeEncoder.setComputePipelineState(m_reduceDepthHistogramComputePipelineState);
+        computeEncoder.setBuffer(depthHistogramBuffer, 0, BufferIndexDepthHistogram);
+        computeEncoder.setBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+        computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
+
+        computeEncoder.dispatchThreads(gridSize, threadgroupSize);
+
+        computeEncoder.endEncoding();
+        return;
+    }
+
     // reduce min and max depth
 
-    int *minMaxDepthDataPtr = (int*) m_minMaxDepthBuffer.contents();
+    int *minMaxDepthDataPtr = (int*) minMaxDepthBuffer.contents();
 
-    minMaxDepthDataPtr[0] = FarPlane * LARGE_INTEGER;
-    minMaxDepthDataPtr[1] = NearPlane * LARGE_INTEGER;
+    minMaxDepthDataPtr[0] = encodeOrderedFloat(FarPlane);
+    minMaxDepthDataPtr[1] = encodeOrderedFloat(NearPlane);
 
-    computeEncoder.setComputePipelineState(m_reduceDepthComputePipelineState);
-    computeEncoder.setBuffer(m_minMaxDepthBuffer, 0, BufferIndexMinMaxDepth);
+    computeEncoder.setBuffer(minMaxDepthBuffer, 0, BufferIndexMinMaxDepth);
     computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
 
-    computeEncoder.dispatchThreads(gridSize, threadgroupSize);
+    if (m_depthReductionMode == DEPTH_REDUCTION_HIERARCHICAL) {
+        // The kernel sizes its threadgroup memory for this exact threadgroup size
+        MTL::Size reductionThreadgroupSize = MTL::SizeMake(SDSM_REDUCTION_THREADGROUP_SIZE,
+                                                           SDSM_REDUCTION_THREADGROUP_SIZE, 1);
+
+        computeEncoder.setComputePipelineState(m_reduceDepthHierarchicalComputePipelineState);
+        computeEncoder.dispatchThreads(gridSize, reductionThreadgroupSize);
+    } else {
+        computeEncoder.setComputePipelineState(m_reduceDepthComputePipelineState);
+        computeEncoder.dispatchThreads(gridSize, threadgroupSize);
+    }
 
     // tighten light frusta
 
-    int *dataPtr = (int*)m_lightFrustumBoundingBoxBuffer.contents();
+    int *dataPtr = (int*)lightFrustumBoundingBoxBuffer.contents();
 
-    for (uint i = 0; i < CASCADED_SHADOW_COUNT; i++) {
-        dataPtr[6 * i + BoundingBoxMinX] = LARGE_INTEGER * 1000;
-        dataPtr[6 * i + BoundingBoxMinY] = LARGE_INTEGER * 1000;
-        dataPtr[6 * i + BoundingBoxMinZ] = LARGE_INTEGER * 1000;
-        dataPtr[6 * i + BoundingBoxMaxX] = -LARGE_INTEGER * 1000;
-        dataPtr[6 * i + BoundingBoxMaxY] = -LARGE_INTEGER * 1000;
-        dataPtr[6 * i + BoundingBoxMaxZ] = -LARGE_INTEGER * 1000;
+    for (uint i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        resetBoundingBox(dataPtr + 6 * i);
     }
 
-    computeEncoder.setComputePipelineState(m_reduceLightFrustumComputePipelineState);
-    computeEncoder.setBuffer(m_lightFrustumBoundingBoxBuffer, 0, BufferIndexBoundingBox);
+    computeEncoder.setBuffer(lightFrustumBoundingBoxBuffer, 0, BufferIndexBoundingBox);
     computeEncoder.setBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
     computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
 
-    computeEncoder.dispatchThreads(gridSize, threadgroupSize);
+    if (m_sparseReductionStride > 1) {
+        // One thread per cell, reading this frame's pixel of the cell's rotation
+        const FrameData *frameData = (const FrameData*) m_uniformBuffers[m_frameDataBufferIndex].contents();
+
+        // Width of a pixel at unit eye space depth, the larger of both axes
+        float pixelSize = std::max(2.0f / (frameData->projection_matrix.columns[0][0] * gridSize.width),
+                                   2.0f / (frameData->projection_matrix.columns[1][1] * gridSize.height));
+
+        SparseReductionParams params;
+        params.stride = m_sparseReductionStride;
+        params.padding = sparseReductionPadding(m_sparseReductionStride, pixelSize);
+        sparseReductionOffset(m_sparseReductionFrame++, m_sparseReductionStride, &params.offsetX, &params.offsetY);
+
+        m_reductionReadbackStrides[readbackSlot] = m_sparseReductionStride;
+
+        computeEncoder.setComputePipelineState(m_reduceLightFrustumSparseComputePipelineState);
+        computeEncoder.setBytes(&params, sizeof(params), BufferIndexSparseReduction);
+
+        computeEncoder.dispatchThreads(MTL::SizeMake((gridSize.width + params.stride - 1) / params.stride,
+                                                     (gridSize.height + params.stride - 1) / params.stride, 1),
+                                       threadgroupSize);
+    } else {
+        computeEncoder.setComputePipelineState(m_reduceLightFrustumComputePipelineState);
+        computeEncoder.dispatchThreads(gridSize, threadgroupSize);
+    }
+
+    computeEncoder.endEncoding();
+}
+
+/// Measure each cascade's aliasing error for feedback partitioning into a readback slot, with the
+/// splits and shadow atlas of this frame
+void Renderer::reduceAliasingError(MTL::ComputeCommandEncoder &computeEncoder, size_t readbackSlot)
+{
+    MTL::Buffer & aliasingErrorBuffer = m_aliasingErrorBuffers[readbackSlot];
+
+    resetAliasingErrors((int*) aliasingErrorBuffer.contents());
+
+    float shadowMapSize = (float)m_shadowMap.width();
+
+    computeEncoder.setComputePipelineState(m_reduceAliasingErrorComputePipelineState);
+    computeEncoder.setBuffer(aliasingErrorBuffer, 0, BufferIndexAliasingError);
+    computeEncoder.setBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+    computeEncoder.setBytes(&shadowMapSize, sizeof(shadowMapSize), BufferIndexShadowMapSize);
+    computeEncoder.setTexture(m_depth_GBuffer, TextureIndexDepth);
+
+    computeEncoder.dispatchThreads(MTL::SizeMake(m_depth_GBuffer.width(), m_depth_GBuffer.height(), 1),
+                                   MTL::SizeMake(16, 16, 1));
+}
+
+// Threadgroup memory of reduce_depth_histogram_tile's partial histogram, padded to the 16 byte
+// granularity Metal requires
+static const MTL::UInteger DepthHistogramTileMemoryLength = (sizeof(int) * DepthHistogramLength + 15) & ~15;
+
+/// Set the tile size and tile memory of the single pass deferred renderer's combined pass, which
+/// reduce_depth_histogram_tile depends on
+void Renderer::prepareTileReductionPass(MTL::RenderPassDescriptor & renderPassDescriptor)
+{
+    if(!m_tileReductionSupported)
+    {
+        return;
+    }
+
+    renderPassDescriptor.tileWidth( SDSM_REDUCTION_TILE_SIZE );
+    renderPassDescriptor.tileHeight( SDSM_REDUCTION_TILE_SIZE );
+    renderPassDescriptor.threadgroupMemoryLength( DepthHistogramTileMemoryLength );
+}
+
+/// Reduce the G-buffer depth into this frame's depth histogram from tile memory, for the single
+/// pass deferred renderer whose G-buffer is never stored.  Must be encoded into the combined pass
+/// after the G-buffer draws.  The result has the layout of the fused reduction, so the cascades
+/// are built from it the same way regardless of the depth reduction mode.
+void Renderer::reduceDepthHistogramTiles(MTL::CommandBuffer &commandBuffer, MTL::RenderCommandEncoder & renderEncoder)
+{
+    if(!m_tileReductionSupported)
+    {
+        return;
+    }
+
+    renderEncoder.pushDebugGroup( "Depth Histogram Tile Reduction" );
+
+    size_t readbackSlot = beginReductionReadback(commandBuffer, DEPTH_REDUCTION_FUSED);
+
+    MTL::Buffer & depthHistogramBuffer = m_depthHistogramBuffers[readbackSlot];
+
+    resetDepthHistogram((int*) depthHistogramBuffer.contents(), NearPlane, FarPlane);
+
+    renderEncoder.setRenderPipelineState( m_reduceDepthHistogramTilePipelineState );
+    renderEncoder.setTileBuffer( depthHistogramBuffer, 0, BufferIndexDepthHistogram );
+    renderEncoder.setTileBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+    renderEncoder.setThreadgroupMemoryLength( DepthHistogramTileMemoryLength, 0, 0 );
+
+    renderEncoder.dispatchThreadsPerTile( MTL::SizeMake(renderEncoder.tileWidth(), renderEncoder.tileHeight(), 1) );
+
+    renderEncoder.popDebugGroup();
+}
+
+// Build this frame's cascade splits and shadow matrices on the GPU from the previous frame's
+// depth histogram.  Must be encoded before anything reading the cascade data of FrameData.
+void Renderer::buildCascadeMatrices(MTL::CommandBuffer &commandBuffer)
+{
+    MTL::ComputeCommandEncoder computeEncoder = commandBuffer.computeCommandEncoder();
+    computeEncoder.label( "Build cascade matrices" );
+
+    computeEncoder.setComputePipelineState(m_buildCascadeMatricesComputePipelineState);
+    computeEncoder.setBuffer( m_uniformBuffers[m_frameDataBufferIndex], 0, BufferIndexFrameData );
+    computeEncoder.setBuffer(m_depthHistogramBuffers[m_cascadeMatricesSlot], 0, BufferIndexDepthHistogram);
+
+    computeEncoder.dispatchThreads(MTL::SizeMake(m_cascadeCount, 1, 1),
+                                   MTL::SizeMake(m_cascadeCount, 1, 1));
 
     computeEncoder.endEncoding();
 }
@@ -948,16 +2072,29 @@ void Renderer::drawFrustum(MTL::RenderCommandEncoder & renderEncoder)
     renderEncoder.setVertexBuffer(m_uniformBuffers[m_frameDataBufferIndex], 0, 1);
 //    renderEncoder.setTriangleFillMode(MTL::TriangleFillModeLines);
 
-    renderEncoder.drawIndexedPrimitives(MTL::PrimitiveTypeLine, 8 * (CASCADED_SHADOW_COUNT + 1) + 8,
+    renderEncoder.drawIndexedPrimitives(MTL::PrimitiveTypeLine, 8 * (m_frustumCascadeCount + 1) + 8,
                                         MTL::IndexTypeUInt32,
                                         m_viewFrustumIndexBuffer, 0);
 
     renderEncoder.setVertexBuffer(m_lightFrustumBuffer, 0, 0);
-    renderEncoder.drawIndexedPrimitives(MTL::PrimitiveTypeLine, 24 * CASCADED_SHADOW_COUNT,
+    renderEncoder.drawIndexedPrimitives(MTL::PrimitiveTypeLine, 24 * m_frustumCascadeCount,
                                         MTL::IndexTypeUInt32,
                                         m_lightFrustumIndexBuffer, 0);
 }
 
+/// Connect the near rectangles of the visualized cascades, the far rectangle of the last one, and
+/// the corners of the first near rectangle to the last far rectangle
+void Renderer::updateFrustumIndexBuffer(int cascadeCount)
+{
+    void *indexBufferPtr = m_viewFrustumIndexBuffer.contents();
+
+    withCascadeCount(cascadeCount, [indexBufferPtr](auto count) {
+        static constexpr auto indices = viewFrustumIndexTable<decltype(count)::value>();
+
+        memcpy(indexBufferPtr, indices.indices, sizeof(indices.indices));
+    });
+}
+
 MTL::Library Renderer::makeShaderLibrary()
 {
     CFErrorRef error = nullptr;
@@ -1002,11 +2139,13 @@ Camera* Renderer::camera()
 void Renderer::changeLightPhiBy(float delta)
 {
     m_lightPhi += delta;
+    m_lightMatricesDirty = true;
 }
 
 void Renderer::changeLightThetaBy(float delta)
 {
     m_lightTheta += delta;
+    m_lightMatricesDirty = true;
 }
 
 void Renderer::switchPartitioning()
@@ -1014,12 +2153,166 @@ void Renderer::switchPartitioning()
     if (m_partitioningMode == LOG_PARTITIONING) {
         m_partitioningMode = UNIFORM_PARTITIONING;
         printf("Switched to uniform partitioning");
+    } else if (m_partitioningMode == UNIFORM_PARTITIONING) {
+        m_partitioningMode = ADAPTIVE_PARTITIONING;
+        printf("Switched to adaptive partitioning");
+    } else if (m_partitioningMode == ADAPTIVE_PARTITIONING) {
+        m_partitioningMode = CLUSTERED_PARTITIONING;
+        printf("Switched to clustered partitioning");
+    } else if (m_partitioningMode == CLUSTERED_PARTITIONING) {
+        // The splits start over from log partitioning
+        m_splitOptimizer.reset();
+        m_partitioningMode = FEEDBACK_PARTITIONING;
+        printf("Switched to aliasing feedback partitioning");
     } else {
         m_partitioningMode = LOG_PARTITIONING;
         printf("Switched to log partitioning");
     }
 }
 
+void Renderer::switchDepthReduction()
+{
+    if (m_depthReductionMode == DEPTH_REDUCTION_ATOMIC) {
+        m_depthReductionMode = DEPTH_REDUCTION_HIERARCHICAL;
+        printf("Switched to hierarchical depth reduction");
+    } else if (m_depthReductionMode == DEPTH_REDUCTION_HIERARCHICAL) {
+        m_depthReductionMode = DEPTH_REDUCTION_FUSED;
+        printf("Switched to fused depth histogram reduction");
+    } else {
+        m_depthReductionMode = DEPTH_REDUCTION_ATOMIC;
+        printf("Switched to per-pixel atomic depth reduction");
+    }
+}
+
+void Renderer::switchCoarseDepthReduction()
+{
+    m_coarseDepthReduction = !m_coarseDepthReduction;
+
+    if (m_coarseDepthReduction) {
+        printf("Switched the fused reduction to level %d of the depth pyramid, with estimated bin counts",
+               SDSM_DEPTH_PYRAMID_REDUCTION_LEVEL);
+    } else {
+        printf("Switched the fused reduction to every pixel");
+    }
+}
+
+void Renderer::switchSparseReduction()
+{
+    // Cells of 1, 2 and 4 pixels square read every pixel, 1 in 4 and 1 in 16 per frame
+    m_sparseReductionStride = m_sparseReductionStride < 4 ? m_sparseReductionStride * 2 : 1;
+    m_sparseReductionFrame = 0;
+
+    if (m_sparseReductionStride > 1) {
+        printf("Switched the light frustum reduction to 1 in %d pixels per frame",
+               m_sparseReductionStride * m_sparseReductionStride);
+    } else {
+        printf("Switched the light frustum reduction to every pixel");
+    }
+}
+
+void Renderer::switchAsyncReduction()
+{
+    m_asyncReduction = !m_asyncReduction;
+
+    if (m_asyncReduction) {
+        printf("Switched depth reduction to its own command queue");
+    } else {
+        printf("Switched depth reduction to the graphics command queue");
+    }
+}
+
+void Renderer::switchMotionPrediction()
+{
+    m_motionPrediction = !m_motionPrediction;
+
+    if (m_motionPrediction) {
+        printf("Switched to cascade bounds reprojected to the current camera");
+    } else {
+        printf("Switched to cascade bounds of the reduced frame");
+    }
+}
+
+void Renderer::switchCascadeConstruction()
+{
+    m_gpuDrivenCascades = !m_gpuDrivenCascades;
+
+    // The GPU only builds cascades from the fused reduction's histogram
+    if (m_gpuDrivenCascades) {
+        m_depthReductionMode = DEPTH_REDUCTION_FUSED;
+        printf("Switched to GPU driven cascades");
+    } else {
+        printf("Switched to CPU built cascades");
+    }
+}
+
+void Renderer::changeCascadeCountBy(int delta)
+{
+    m_autoCascadeCount = false;
+    m_cascadeCount = std::min(std::max(m_cascadeCount + delta, 1), MAX_CASCADED_SHADOW_COUNT);
+    printf("Switched to %d cascades", m_cascadeCount);
+}
+
+void Renderer::switchAutoCascadeCount()
+{
+    m_autoCascadeCount = !m_autoCascadeCount;
+
+    if (m_autoCascadeCount) {
+        printf("Switched to automatic cascade count");
+    } else {
+        printf("Switched to fixed cascade count of %d", m_cascadeCount);
+    }
+}
+
+void Renderer::switchLayeredShadows()
+{
+    if (!m_layeredShadowsSupported) {
+        printf("Layered shadow rendering is not supported on this device");
+        return;
+    }
+
+    m_layeredShadows = !m_layeredShadows;
+
+    if (m_layeredShadows) {
+        printf("Switched to layered shadow rendering");
+    } else {
+        printf("Switched to drawing the casters once per cascade");
+    }
+}
+
+void Renderer::switchShadowCaching()
+{
+    m_shadowCaching = !m_shadowCaching;
+
+    // Cascades rendered while caching was off were never recorded, so start from scratch
+    m_shadowCache.invalidate();
+    m_cascadeScheduler.reset();
+
+    if (m_shadowCaching) {
+        printf("Switched to cached shadow cascades");
+    } else {
+        printf("Switched to re-rendering every shadow cascade each frame");
+    }
+}
+
+void Renderer::switchAmortizedCascades()
+{
+    if (!m_shadowCaching) {
+        printf("Amortized cascade updates need shadow caching");
+        return;
+    }
+
+    m_amortizedCascades = !m_amortizedCascades;
+
+    if (m_amortizedCascades) {
+        m_cascadeScheduler.reset();
+        printf("Switched to amortized cascade updates");
+    } else {
+        printf("Switched to updating every changed cascade each frame, %llu of %llu cascade passes were skipped",
+               (unsigned long long)m_cascadeScheduler.skippedTotal(),
+               (unsigned long long)(m_cascadeScheduler.skippedTotal() + m_cascadeScheduler.passesTotal()));
+    }
+}
+
 void Renderer::setVisualizationMode(VisualizationMode mode)
 {
     m_visualizationMode = mode;
@@ -10,12 +10,22 @@ Header for renderer class which performs Metal setup and per frame rendering
 #include "AAPLBufferExaminationManager.h"
 #include "AAPLMesh.h"
 #include "Camera.h"
+#include "SDSM_ReadbackRing.h"
+#include "SDSM_ShadowAtlas.h"
+#include "SDSM_ShadowCache.h"
+#include "SDSM_CascadeScheduler.h"
+#include "SDSM_BoundsHistory.h"
+#include "SDSM_QueueGraph.h"
+#include "SDSM_BoundsPredictor.h"
+#include "SDSM_SplitOptimizer.h"
 
 #include <CoreGraphics/CoreGraphics.h>
 #include <CoreFoundation/CoreFoundation.h>
 
 #include "CPPMetal.hpp"
 
+struct FrameData;
+
 // The max number of command buffers in flight
 static const uint8_t MaxFramesInFlight = 3;
 
@@ -25,9 +35,46 @@ static const uint32_t NumLights = 256;
 static const float NearPlane = 1;
 static const float FarPlane = 750;
 
-enum PartitioningMode {
-    LOG_PARTITIONING = 0,
-    UNIFORM_PARTITIONING = 1
+// Largest far / near depth ratio a single cascade may cover with automatic cascade counts
+static const float AutoCascadeSplitRatio = 10;
+
+// Margin added around the receivers of far cascades with amortized updates, as a fraction of their
+// extent, so their stale matrices keep covering the receivers while the camera moves
+static const float AmortizedCascadePadding = 0.1f;
+
+// Fraction of a cascade's samples whose aliasing error feedback partitioning equalizes
+static const float AliasingFeedbackPercentile = 0.95f;
+
+enum DepthReductionMode {
+    DEPTH_REDUCTION_ATOMIC = 0,
+    DEPTH_REDUCTION_HIERARCHICAL = 1,
+    DEPTH_REDUCTION_FUSED = 2
+};
+
+// Command queues ordered by the renderer's queue graph
+enum RenderQueue {
+    RENDER_QUEUE_GRAPHICS = 0,
+    RENDER_QUEUE_REDUCTION = 1,
+    RENDER_QUEUE_COUNT = 2
+};
+
+// Matrices derived from the light angles, rebuilt only after the light moves
+struct LightMatrices
+{
+    simd::float4x4 skyModelMatrix;
+    simd::float4x4 shadowViewMatrix;
+    simd::float4x4 inverseShadowViewMatrix;
+    simd::float4 sunWorldDirection;
+};
+
+// Matrices of the current frame, derived once in updateWorldState and shared by the CPU work
+// building the frame's cascades
+struct FrameMatrices
+{
+    simd::float4x4 inverseViewMatrix;
+    simd::float4x4 inverseShadowViewMatrix;
+    simd::float4x4 shadowModelViewMatrix;
+    simd::float4x4 inverseShadowModelViewMatrix;
 };
 
 class Renderer
@@ -54,6 +101,8 @@ public:
 
     int8_t frameDataBufferIndex() const;
 
+    uint64_t reductionResultAge() const;
+
     MTL::Buffer & frameDataBuffer(int8_t frameDataBufferIndex);
 
     MTL::Buffer & lightPositions(int8_t frameDataBufferIndex);
@@ -68,6 +117,10 @@ public:
 
     MTL::Texture & depth_GBuffer();
 
+    // Min/max depth mip chain of the current frame, built after the G-buffer pass by the renderers
+    // that store their G-buffer.  Level n covers 2^(n+1) x 2^(n+1) pixels; see SDSMShared.h.
+    MTL::Texture & depthPyramid();
+
     MTL::Texture & shadowMap();
 
     // Open the Metal shader library
@@ -89,6 +142,17 @@ public:
     void changeLightPhiBy(float delta);
 
     void switchPartitioning();
+    void switchDepthReduction();
+    void switchCoarseDepthReduction();
+    void switchSparseReduction();
+    void switchAsyncReduction();
+    void switchMotionPrediction();
+    void switchCascadeConstruction();
+    void changeCascadeCountBy(int delta);
+    void switchAutoCascadeCount();
+    void switchLayeredShadows();
+    void switchShadowCaching();
+    void switchAmortizedCascades();
     void setVisualizationMode(VisualizationMode mode);
     void switchFrustrumLock();
     void drawFrustum(MTL::RenderCommandEncoder & renderEncoder);
@@ -107,6 +171,12 @@ protected:
 
     void endFrame(MTL::CommandBuffer & commandBuffer);
 
+    void waitForReduction(MTL::CommandBuffer & commandBuffer);
+
+    MTL::CommandBuffer beginReductionCommands(MTL::CommandBuffer & commandBuffer);
+
+    void endReductionCommands(MTL::CommandBuffer & commandBuffer);
+
     void drawShadow( MTL::CommandBuffer & commandBuffer );
 
     void drawGBuffer( MTL::RenderCommandEncoder & renderEncoder );
@@ -123,8 +193,18 @@ protected:
 
     void drawableSizeWillChange(MTL::Size size, MTL::StorageMode GBufferStorageMode);
 
+    bool depthPyramidNeeded() const;
+
+    void buildDepthPyramid(MTL::CommandBuffer &commandBuffer);
+
     void computeLightFrusta(MTL::CommandBuffer &commandBuffer);
 
+    void prepareTileReductionPass(MTL::RenderPassDescriptor & renderPassDescriptor);
+
+    void reduceDepthHistogramTiles(MTL::CommandBuffer &commandBuffer, MTL::RenderCommandEncoder & renderEncoder);
+
+    void buildCascadeMatrices(MTL::CommandBuffer &commandBuffer);
+
     MTL::Texture *currentDrawableTexture();
 
     MTL::Device m_device;
@@ -147,6 +227,11 @@ protected:
 
     MTL::Texture m_depth_GBuffer;
 
+    // Min/max depth pyramid of m_depth_GBuffer and a view of each level for the kernels writing it
+    MTL::Texture m_depthPyramid;
+
+    std::vector<MTL::Texture> m_depthPyramidLevels;
+
     // This is used to build render pipelines that perform common operations for both the iOS and macOS
     // renderers.  The only difference between the iOS and macOS versions of these pipelines is that
     // the iOS renderer needs the GBuffers attached as render targets while the macOS renderer needs
@@ -155,36 +240,105 @@ protected:
     // in the implementation of the Renderer base class which is common to both renderers.
     bool m_singlePassDeferred;
 
+    // The single pass deferred renderer reduces depth with a tile shader when the GPU supports it
+    bool m_tileReductionSupported;
+
     MTL::DepthStencilState * m_dontWriteDepthStencilState;
 
 private:
 
     void updateLights(const simd::float4x4 & modelViewMatrix);
 
+    size_t beginReductionReadback(MTL::CommandBuffer &commandBuffer, DepthReductionMode mode);
+
     void updateWorldState();
 
-    void drawMeshes( MTL::RenderCommandEncoder & renderEncoder );
+    const LightMatrices & lightMatrices();
+
+    size_t newestReductionSlot();
+
+    bool updateCascadeSplits(FrameData *frameData, size_t readbackSlot, CameraMotion & motion);
+
+    void updateCascadeMatrices(FrameData *frameData, size_t readbackSlot,
+                               bool predictBounds, const CameraMotion & motion);
+
+    void updateShadowAtlas(FrameData *frameData, size_t readbackSlot);
+
+    void updateSplitOptimizer(size_t readbackSlot);
+
+    int partitionCascades(float minDepth, float maxDepth, const int *histogram, float *cascadeEnds);
+
+    void reduceAliasingError(MTL::ComputeCommandEncoder &computeEncoder, size_t readbackSlot);
+
+    void updateFrustumIndexBuffer(int cascadeCount);
+
+    void updateShadowCasterMasks(const simd::float4x4 & shadowModelViewMatrix,
+                                 const float *lightFrustumBoundingBoxes,
+                                 float *cascadeNearZ);
+
+    void drawMeshes( MTL::RenderCommandEncoder & renderEncoder, int cascade = -1 );
+
+    uint32_t shadowCascadeMask();
+
+    ShadowCacheRect shadowCacheRegion(int cascade);
+
+    void updateShadowCache(FrameData *frameData, const float *receiverBoundingBoxes);
+
+    void clearShadowRect( MTL::RenderCommandEncoder & renderEncoder, const ShadowCacheRect & rect );
+
+    void drawShadowLayered( MTL::CommandBuffer & commandBuffer, uint32_t cascadeMask );
+
+#if USE_SHADOW_ATLAS
+    void drawShadowAtlas( MTL::CommandBuffer & commandBuffer, uint32_t cascadeMask, bool caching );
+#endif
+
+    void drawShadowCastersLayered( MTL::RenderCommandEncoder & renderEncoder, uint32_t cascadeMask );
 
     dispatch_semaphore_t m_inFlightSemaphore;
 
-    MTL::CommandBufferHandler *m_completedHandler;
+    // Signals m_inFlightSemaphore once every command buffer of a frame that counts towards it
+    // has completed, which with the asynchronous reduction is more than one
+    struct FrameCompletedHandler : public MTL::CommandBufferHandler
+    {
+        dispatch_semaphore_t semaphore;
+        std::atomic<int> pendingCommandBuffers;
+
+        void operator()(const MTL::CommandBuffer &);
+    };
+
+    FrameCompletedHandler m_frameCompletedHandlers[MaxFramesInFlight];
 
     // Vertex descriptor for models loaded with MetalKit
     MTL::VertexDescriptor m_defaultVertexDescriptor;
 
     MTL::CommandQueue m_commandQueue;
 
+    // The traditional deferred renderer reduces depth on its own queue, overlapping the lighting
+    // pass and the next frame's shadow pass
+    MTL::CommandQueue m_reductionQueue;
+    bool m_asyncReduction;
+
+    typedef QueueGraph<MTL::CommandBuffer, MTL::Event, RENDER_QUEUE_COUNT> RenderQueueGraph;
+
+    RenderQueueGraph m_queueGraph;
+
+    // This frame's submission to the reduction queue
+    RenderQueueGraph::Submission m_reductionSubmission;
+
     // Pipeline states
     MTL::RenderPipelineState m_GBufferPipelineState;
     MTL::RenderPipelineState m_fairyPipelineState;
     MTL::RenderPipelineState m_skyboxPipelineState;
     MTL::RenderPipelineState m_shadowGenPipelineState;
+    MTL::RenderPipelineState m_shadowGenLayeredPipelineState;
+    MTL::RenderPipelineState m_shadowClearPipelineState;
     MTL::RenderPipelineState m_directionalLightPipelineState;
 
     // Depht Stencitl States
     MTL::DepthStencilState m_directionLightDepthStencilState;
     MTL::DepthStencilState m_GBufferDepthStencilState;
     MTL::DepthStencilState m_shadowDepthStencilState;
+    MTL::DepthStencilState m_shadowClearDepthStencilState;
     MTL::DepthStencilState m_pointLightDepthStencilState;
 
 #if LIGHT_STENCIL_CULLING
@@ -193,6 +347,25 @@ private:
 #endif
 
     MTL::RenderPassDescriptor m_shadowRenderPassDescriptor;
+    MTL::RenderPassDescriptor m_layeredShadowRenderPassDescriptor;
+
+    // Draw every caster once, instanced over the cascades, instead of once per cascade.  The
+    // instances go to slices of the shadow map, or to viewports of the shadow atlas.
+    bool m_layeredShadowsSupported;
+    bool m_layeredShadows;
+
+#if USE_SHADOW_ATLAS
+    // Layout of the cascades in the shadow atlas
+    ShadowAtlasAllocator m_shadowAtlas;
+#endif
+
+    // Cascades whose matrix did not change keep last frame's texels instead of being re-rendered
+    bool m_shadowCaching;
+    ShadowCascadeCache m_shadowCache;
+
+    // Lets far cascades keep a stale matrix for a few frames to spread their re-rendering
+    bool m_amortizedCascades;
+    CascadeUpdateScheduler m_cascadeScheduler;
 
     // Depth render target for shadow map
     MTL::Texture m_shadowMap;
@@ -228,7 +401,7 @@ private:
     simd::float4x4 m_projection_matrix;
 
     // Projection matrix used to render the shadow map
-    simd::float4x4 m_shadowProjectionMatrix[CASCADED_SHADOW_COUNT];
+    simd::float4x4 m_shadowProjectionMatrix[MAX_CASCADED_SHADOW_COUNT];
 
     // Current frame number rendering
     uint64_t m_frameNumber;
@@ -248,14 +421,50 @@ private:
     float m_lightPhi;
     float m_lightTheta;
 
-    MTL::Buffer m_cascadeIndexBuffers[CASCADED_SHADOW_COUNT];
+    bool m_lightMatricesDirty;
+    LightMatrices m_lightMatrices;
+
+    FrameMatrices m_frameMatrices;
+
+    MTL::Buffer m_cascadeIndexBuffers[MAX_CASCADED_SHADOW_COUNT];
+
+    // Number of cascades rendered this frame, and whether it follows the depth range
+    int m_cascadeCount;
+    bool m_autoCascadeCount;
+
+    // Cascades the CPU built splits leave non empty; the rest have zero width and are not rendered
+    int m_usedCascadeCount;
+
+    // Cascade count the frustum visualization buffers were last written with
+    int m_frustumCascadeCount;
 
     PartitioningMode m_partitioningMode;
     VisualizationMode m_visualizationMode;
+    DepthReductionMode m_depthReductionMode;
+
+    // The fused reduction reads a coarse level of the depth pyramid instead of every pixel.  Off by
+    // default: the coarse reduction only estimates the bin counts adaptive and clustered
+    // partitioning follow, while the depth range and bin bounds stay exact.
+    bool m_coarseDepthReduction;
+
+    // The light frustum reduction reads one pixel per cell of this many pixels square, rotating
+    // through the cell over the frames, and merges the bounds of a full rotation.  1 reads every pixel.
+    int m_sparseReductionStride;
+    uint32_t m_sparseReductionFrame;
+    SparseBoundsHistory m_sparseBoundsHistory;
 
     // Compute configuration
     MTL::ComputePipelineState m_reduceDepthComputePipelineState;
+    MTL::ComputePipelineState m_reduceDepthHierarchicalComputePipelineState;
     MTL::ComputePipelineState m_reduceLightFrustumComputePipelineState;
+    MTL::ComputePipelineState m_reduceLightFrustumSparseComputePipelineState;
+    MTL::ComputePipelineState m_reduceDepthHistogramComputePipelineState;
+    MTL::ComputePipelineState m_reduceDepthHistogramCoarseComputePipelineState;
+    MTL::ComputePipelineState m_reduceAliasingErrorComputePipelineState;
+    MTL::ComputePipelineState m_buildDepthPyramidBaseComputePipelineState;
+    MTL::ComputePipelineState m_buildDepthPyramidLevelComputePipelineState;
+    MTL::ComputePipelineState m_buildCascadeMatricesComputePipelineState;
+    MTL::RenderPipelineState m_reduceDepthHistogramTilePipelineState;
 
     // Visualization of view frustum and light frusta
     bool m_frustrumLock;
@@ -267,7 +476,64 @@ private:
     MTL::DepthStencilState m_frustumDepthStencilState;
 
     // tightening light frusta
-    MTL::Buffer m_lightFrustumBoundingBoxBuffer;
+    MTL::Buffer m_lightFrustumBoundingBoxBuffers[MaxFramesInFlight];
+
+    // Depth range and per bin light space bounds written by the fused reduction
+    MTL::Buffer m_depthHistogramBuffers[MaxFramesInFlight];
+
+    // Per cascade aliasing error written by reduce_aliasing_error with feedback partitioning
+    MTL::Buffer m_aliasingErrorBuffers[MaxFramesInFlight];
+
+    // Tracks which frame's reduction results are safe to read back
+    ReadbackRing<MaxFramesInFlight> m_reductionReadback;
+
+    // Reduction mode each readback slot was last written with
+    DepthReductionMode m_reductionReadbackModes[MaxFramesInFlight];
+
+    // Whether each readback slot's last reduction measured the aliasing error
+    bool m_reductionReadbackAliasing[MaxFramesInFlight];
+
+    // Sparse reduction stride each readback slot was last written with
+    int m_reductionReadbackStrides[MaxFramesInFlight];
+
+    // Camera, light and cascade splits of the frame each readback slot was last reduced from
+    simd::float4x4 m_reductionReadbackViewMatrices[MaxFramesInFlight];
+    simd::float4x4 m_reductionReadbackLightViewMatrices[MaxFramesInFlight];
+    float m_reductionReadbackCascadeEnds[MaxFramesInFlight][MAX_CASCADED_SHADOW_COUNT + 1];
+    uint m_reductionReadbackCascadeCounts[MaxFramesInFlight];
+
+    // Move the reduced depth range and bounds to the current camera before building cascades,
+    // since the reduction they come from is a frame or more old
+    bool m_motionPrediction;
+    CascadeBoundsPredictor m_boundsPredictor;
+
+    // Splits of feedback partitioning, moved towards equal aliasing error in every cascade
+    AliasingSplitOptimizer m_splitOptimizer;
+
+    // Readback serial of the reduction results used by the current frame
+    uint64_t m_reductionResultSerial;
+
+    // Age in frames of the reduction results used by the current frame
+    uint64_t m_reductionResultAge;
+
+    // Build cascade matrices on the GPU instead of reading the reduction back
+    bool m_gpuDrivenCascades;
+
+    // Whether this frame builds its cascade matrices on the GPU and from which histogram slot
+    bool m_encodeCascadeMatrices;
+    size_t m_cascadeMatricesSlot;
+
+    // Cascades each mesh and submesh of m_meshes casts into, one bit per cascade, flattened in
+    // draw order.  Only valid when the cascade bounds of this frame are known on the CPU.
+    std::vector<uint32_t> m_meshCascadeMasks;
+    std::vector<uint32_t> m_submeshCascadeMasks;
+
+    // Model space bounds of every mesh followed by every submesh in the layout of
+    // soa_box_float3_from_buffer, and the same boxes in light view space for the current frame,
+    // so culling transforms all casters with one matrix_transform_boxes call
+    std::vector<float> m_casterBounds;
+    std::vector<float> m_lightViewCasterBounds;
+    bool m_shadowCastersCulled;
 
     void populateLights();
 
@@ -275,7 +541,7 @@ private:
 
 protected:
 
-    MTL::Buffer m_minMaxDepthBuffer;
+    MTL::Buffer m_minMaxDepthBuffers[MaxFramesInFlight];
     BufferExaminationManager *m_bufferExaminationManager;
 
 #endif // END SUPPORT_BUFFER_EXAMINATION
@@ -323,6 +589,11 @@ inline int8_t Renderer::frameDataBufferIndex() const
     return m_frameDataBufferIndex;
 }
 
+inline uint64_t Renderer::reductionResultAge() const
+{
+    return m_reductionResultAge;
+}
+
 inline MTL::Buffer & Renderer::frameDataBuffer(int8_t frameDataBufferIndex)
 {
     return m_uniformBuffers[frameDataBufferIndex];
@@ -358,6 +629,17 @@ inline MTL::Texture & Renderer::depth_GBuffer()
     return m_depth_GBuffer;
 }
 
+inline MTL::Texture & Renderer::depthPyramid()
+{
+    return m_depthPyramid;
+}
+
+// The coarse fused reduction is the only pass reading the depth pyramid
+inline bool Renderer::depthPyramidNeeded() const
+{
+    return m_coarseDepthReduction && m_depthReductionMode == DEPTH_REDUCTION_FUSED && !m_depthPyramidLevels.empty();
+}
+
 inline MTL::Texture & Renderer::shadowMap()
 {
     return m_shadowMap;
@@ -60,8 +60,10 @@ void Renderer_SinglePassDeferred::loadMetal()
     m_viewRenderPassDescriptor.colorAttachments[RenderTargetAlbedo].storeAction(MTL::StoreActionDontCare);
     m_viewRenderPassDescriptor.colorAttachments[RenderTargetNormal].loadAction(MTL::LoadActionDontCare);
     m_viewRenderPassDescriptor.colorAttachments[RenderTargetNormal].storeAction(MTL::StoreActionDontCare);
-    m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].loadAction(MTL::LoadActionDontCare);
+    // Pixels the G-buffer pass does not cover must read as empty (0) in the depth reduction
+    m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].loadAction(MTL::LoadActionClear);
     m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].storeAction(MTL::StoreActionDontCare);
+    m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].clearColor(MTL::ClearColorMake(0, 0, 0, 0));
     m_viewRenderPassDescriptor.depthAttachment.loadAction( MTL::LoadActionClear );
     m_viewRenderPassDescriptor.depthAttachment.storeAction( MTL::StoreActionDontCare) ;
     m_viewRenderPassDescriptor.stencilAttachment.loadAction( MTL::LoadActionClear );
@@ -69,6 +71,8 @@ void Renderer_SinglePassDeferred::loadMetal()
     m_viewRenderPassDescriptor.depthAttachment.clearDepth( 1.0 );
     m_viewRenderPassDescriptor.stencilAttachment.clearStencil( 0 );
 
+    Renderer::prepareTileReductionPass( m_viewRenderPassDescriptor );
+
 }
 
 /// Respond to view size change
@@ -118,6 +122,9 @@ void Renderer_SinglePassDeferred::drawInView(MTK::View& view)
 
         Renderer::drawGBuffer( renderEncoder );
 
+        // Reduce depth while the G-buffer is still in tile memory
+        Renderer::reduceDepthHistogramTiles( commandBuffer, renderEncoder );
+
         drawDirectionalLight( renderEncoder );
 
 //        Renderer::drawPointLightMask( renderEncoder );
@@ -192,7 +199,7 @@ void Renderer_SinglePassDeferred::validateBufferExaminationMode()
         // When exiting buffer examination mode, return to efficient state settings
         m_viewRenderPassDescriptor.colorAttachments[RenderTargetAlbedo].loadAction( MTL::LoadActionDontCare );
         m_viewRenderPassDescriptor.colorAttachments[RenderTargetNormal].loadAction( MTL::LoadActionDontCare );
-        m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].loadAction( MTL::LoadActionDontCare );
+        m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].loadAction( MTL::LoadActionClear );
         m_viewRenderPassDescriptor.colorAttachments[RenderTargetAlbedo].storeAction( MTL::StoreActionDontCare );
         m_viewRenderPassDescriptor.colorAttachments[RenderTargetNormal].storeAction( MTL::StoreActionDontCare );
         m_viewRenderPassDescriptor.colorAttachments[RenderTargetDepth].storeAction( MTL::StoreActionDontCare );
@@ -104,6 +104,9 @@ void Renderer_TraditionalDeferred::drawInView(MTK::View & view)
 
         Renderer::drawShadow( commandBuffer );
 
+        // The G-buffer pass overwrites the depth the previous frame's reduction reads
+        Renderer::waitForReduction( commandBuffer );
+
         m_GBufferRenderPassDescriptor.depthAttachment.texture( *view.depthStencilTexture() );
         m_GBufferRenderPassDescriptor.stencilAttachment.texture( *view.depthStencilTexture() );
 
@@ -115,12 +118,28 @@ void Renderer_TraditionalDeferred::drawInView(MTK::View & view)
 
         renderEncoder.endEncoding();
 
-        Renderer::computeLightFrusta( commandBuffer );
+        if (m_asyncReduction) {
+            // The reduction runs on its own queue once the G-buffer is done, overlapping the
+            // lighting pass and the next frame's shadow pass
+            MTL::CommandBuffer reductionCommandBuffer = Renderer::beginReductionCommands( commandBuffer );
+            reductionCommandBuffer.label( "Depth Reduction Commands" );
+
+            commandBuffer.commit();
+
+            Renderer::buildDepthPyramid( reductionCommandBuffer );
+
+            Renderer::computeLightFrusta( reductionCommandBuffer );
 
-        // Commit commands so that Metal can begin working on non-drawable dependant work without
-        // waiting for a drawable to become avaliable
-        commandBuffer.commit();
-        commandBuffer.waitUntilCompleted();
+            Renderer::endReductionCommands( reductionCommandBuffer );
+        } else {
+            Renderer::buildDepthPyramid( commandBuffer );
+
+            Renderer::computeLightFrusta( commandBuffer );
+
+            // Commit commands so that Metal can begin working on non-drawable dependant work without
+            // waiting for a drawable to become avaliable
+            commandBuffer.commit();
+        }
     }
 
     {
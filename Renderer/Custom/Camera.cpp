@@ -20,12 +20,82 @@ Camera::Camera()
     m_up = vector3(0.0f, 1.0f, 0.0f);
     m_center = vector3(0.0f, 5.0f, 0.0f);
 
+    m_fov = 0.0f;
+    m_aspect = 1.0f;
+    m_near = 1.0f;
+    m_far = 1000.0f;
+
+    m_viewDirty = true;
+    m_projDirty = true;
+    m_viewProjDirty = true;
+
     updateEye();
 }
 
-float4x4 Camera::viewMatrix()
+const float4x4 & Camera::viewMatrix()
+{
+    updateViewMatrices();
+    return m_viewMatrix;
+}
+
+const float4x4 & Camera::inverseViewMatrix()
+{
+    updateViewMatrices();
+    return m_inverseViewMatrix;
+}
+
+const float4x4 & Camera::viewProjMatrix()
+{
+    updateViewProjMatrices();
+    return m_viewProjMatrix;
+}
+
+const float4x4 & Camera::inverseViewProjMatrix()
+{
+    updateViewProjMatrices();
+    return m_inverseViewProjMatrix;
+}
+
+void Camera::updateViewMatrices()
+{
+    if (!m_viewDirty) {
+        return;
+    }
+
+    m_viewMatrix = matrix_look_at_left_hand(m_eye, m_center, m_up);
+    m_inverseViewMatrix = matrix_invert_rigid(m_viewMatrix);
+    m_viewDirty = false;
+}
+
+void Camera::updateProjMatrices()
+{
+    if (!m_projDirty) {
+        return;
+    }
+
+    m_projMatrix = matrix_perspective_left_hand(m_fov, m_aspect, m_near, m_far);
+    m_inverseProjMatrix = matrix_invert_perspective_left_hand(m_projMatrix);
+    m_projDirty = false;
+}
+
+void Camera::updateViewProjMatrices()
+{
+    updateViewMatrices();
+    updateProjMatrices();
+
+    if (!m_viewProjDirty) {
+        return;
+    }
+
+    m_viewProjMatrix = m_projMatrix * m_viewMatrix;
+    m_inverseViewProjMatrix = m_inverseViewMatrix * m_inverseProjMatrix;
+    m_viewProjDirty = false;
+}
+
+void Camera::invalidateProj()
 {
-    return matrix_look_at_left_hand(m_eye, m_center, m_up);
+    m_projDirty = true;
+    m_viewProjDirty = true;
 }
 
 void Camera::updateEye()
@@ -39,7 +109,16 @@ void Camera::updateEye()
     m_tangent = normalize(cross(m_forward, vector3(0.0f, 1.0f, 0.0f)));
     m_up = cross(m_tangent, m_forward);
 
-    m_fov = 65.0f * (M_PI / 180.0f);
+    m_viewDirty = true;
+    m_viewProjDirty = true;
+
+    // Moving the eye also resets the field of view
+    float fov = 65.0f * (M_PI / 180.0f);
+
+    if (fov != m_fov) {
+        m_fov = fov;
+        invalidateProj();
+    }
 }
 
 void Camera::rotateYawBy(float delta)
@@ -78,26 +157,37 @@ void Camera::changeDistanceBy(float delta)
 void Camera::setFov(float fov)
 {
     m_fov = fov;
+    invalidateProj();
 }
 
 void Camera::setAspect(float aspect)
 {
     m_aspect = aspect;
+    invalidateProj();
 }
 
 void Camera::setNear(float near)
 {
     m_near = near;
+    invalidateProj();
 }
 
 void Camera::setFar(float far)
 {
     m_far = far;
+    invalidateProj();
+}
+
+const float4x4 & Camera::projMatrix()
+{
+    updateProjMatrices();
+    return m_projMatrix;
 }
 
-float4x4 Camera::projMatrix()
+const float4x4 & Camera::inverseProjMatrix()
 {
-    return matrix_perspective_left_hand(m_fov, m_aspect, m_near, m_far);
+    updateProjMatrices();
+    return m_inverseProjMatrix;
 }
 
 float Camera::aspect()
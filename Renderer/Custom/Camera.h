@@ -9,7 +9,7 @@
 #ifndef Camera_h
 #define Camera_h
 
-#include <simd/simd.h>
+#include "../SDSM_Simd.h"
 
 using namespace simd;
 
@@ -19,8 +19,13 @@ public:
 
     explicit Camera();
 
-    float4x4 viewMatrix();
-    float4x4 projMatrix();
+    // Matrices are cached and only rebuilt on first use after the camera changes
+    const float4x4 & viewMatrix();
+    const float4x4 & projMatrix();
+    const float4x4 & inverseViewMatrix();
+    const float4x4 & inverseProjMatrix();
+    const float4x4 & viewProjMatrix();
+    const float4x4 & inverseViewProjMatrix();
     void rotateYawBy(float delta);
     void rotatePitchBy(float delta);
     void moveCenterBy(float deltaX, float deltaY, float deltaZ);
@@ -49,7 +54,22 @@ private:
     float m_near;
     float m_far;
 
+    float4x4 m_viewMatrix;
+    float4x4 m_inverseViewMatrix;
+    float4x4 m_projMatrix;
+    float4x4 m_inverseProjMatrix;
+    float4x4 m_viewProjMatrix;
+    float4x4 m_inverseViewProjMatrix;
+
+    bool m_viewDirty;
+    bool m_projDirty;
+    bool m_viewProjDirty;
+
     void updateEye();
+    void invalidateProj();
+    void updateViewMatrices();
+    void updateProjMatrices();
+    void updateViewProjMatrices();
 };
 
 #endif /* Camera_h */
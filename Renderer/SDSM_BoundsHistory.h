@@ -0,0 +1,96 @@
+//
+//  SDSM_BoundsHistory.h
+//  DeferredLighting C++
+//
+//  Temporal accumulation of the light frustum bounds of the sparse reduction.  Each sparse
+//  reduction reads a different pixel of every cell, so the union of the bounds of one full
+//  rotation of offsets covers every pixel of the rotation's frames.  Plain C++, no Metal.
+//
+
+#ifndef SDSM_BoundsHistory_h
+#define SDSM_BoundsHistory_h
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+
+// Longest rotation kept, matching the 1/16 sampling rate
+#define SDSM_BOUNDS_HISTORY_LENGTH 16
+
+class SparseBoundsHistory
+{
+public:
+
+    SparseBoundsHistory()
+    {
+        memset(m_lightViewMatrix, 0, sizeof(m_lightViewMatrix));
+        reset();
+    }
+
+    // Forgets every result, for example when the full rate reduction takes over
+    void reset()
+    {
+        m_count = 0;
+        m_next = 0;
+        m_length = 0;
+        m_cascadeCount = 0;
+        m_lastSerial = UINT64_MAX;
+    }
+
+    // Adds the bounding boxes of a completed sparse reduction, 6 floats per cascade as decoded by
+    // decodeBoundingBox, and overwrites them with the union of the last length results.  serial
+    // identifies the reduction, so a result read again by a later frame is only added once.  The
+    // boxes are in the light view space of lightViewMatrix; a change of the light, of the
+    // rotation length or of the cascade count starts the history over.
+    void accumulate(uint64_t serial, float *boundingBoxes, int cascadeCount, int length,
+                    const float *lightViewMatrix)
+    {
+        length = std::min(std::max(length, 1), SDSM_BOUNDS_HISTORY_LENGTH);
+
+        if (length != m_length || cascadeCount != m_cascadeCount ||
+            memcmp(lightViewMatrix, m_lightViewMatrix, sizeof(m_lightViewMatrix)) != 0) {
+            reset();
+
+            m_length = length;
+            m_cascadeCount = cascadeCount;
+            memcpy(m_lightViewMatrix, lightViewMatrix, sizeof(m_lightViewMatrix));
+        }
+
+        if (serial != m_lastSerial) {
+            memcpy(m_entries[m_next], boundingBoxes, sizeof(float) * 6 * cascadeCount);
+
+            m_next = (m_next + 1) % m_length;
+            m_count = std::min(m_count + 1, m_length);
+            m_lastSerial = serial;
+        }
+
+        // Empty boxes are inverted, so they drop out of the union
+        for (int entry = 0; entry < m_count; entry++) {
+            for (int i = 0; i < 6 * cascadeCount; i++) {
+                boundingBoxes[i] = i % 6 < 3 ? std::min(boundingBoxes[i], m_entries[entry][i])
+                                             : std::max(boundingBoxes[i], m_entries[entry][i]);
+            }
+        }
+    }
+
+    // Results the current union is made of
+    int count() const
+    {
+        return m_count;
+    }
+
+private:
+
+    float m_entries[SDSM_BOUNDS_HISTORY_LENGTH][6 * MAX_CASCADED_SHADOW_COUNT];
+    float m_lightViewMatrix[16];
+
+    int m_count;
+    int m_next;
+    int m_length;
+    int m_cascadeCount;
+    uint64_t m_lastSerial;
+};
+
+#endif /* SDSM_BoundsHistory_h */
@@ -0,0 +1,349 @@
+//
+//  SDSM_BoundsPredictor.h
+//  DeferredLighting C++
+//
+//  Predicts the depth range and the per-cascade light space bounds of the current frame from a
+//  reduction of an earlier frame's depth and the camera motion since then.  Reduced bounds are
+//  kept per depth slab, either histogram bins or the cascades of the reduction, so receivers can
+//  be moved to the depth the new camera sees them at before they are assigned to cascades.
+//  Matrices are column major 4x4.  Plain C++, no Metal.
+//
+
+#ifndef SDSM_BoundsPredictor_h
+#define SDSM_BoundsPredictor_h
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "Shaders/SDSMShared.h"
+#include "SDSM_Culling.h"
+
+inline void multiplyMatrices4x4(const float *a, const float *b, float *result)
+{
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+
+            for (int i = 0; i < 4; i++) {
+                sum += a[4 * i + row] * b[4 * column + i];
+            }
+
+            result[4 * column + row] = sum;
+        }
+    }
+}
+
+// Inverse of a rotation followed by a translation, such as a view matrix
+inline void invertRigidMatrix4x4(const float *matrix, float *result)
+{
+    for (int column = 0; column < 3; column++) {
+        for (int row = 0; row < 3; row++) {
+            result[4 * column + row] = matrix[4 * row + column];
+        }
+
+        result[4 * column + 3] = 0.0f;
+    }
+
+    for (int row = 0; row < 3; row++) {
+        result[12 + row] = -(result[row] * matrix[12] + result[4 + row] * matrix[13] + result[8 + row] * matrix[14]);
+    }
+
+    result[15] = 1.0f;
+}
+
+// Light space bounding box, 6 floats like the light frustum bounding boxes, of the receivers
+// between two eye space depths
+struct DepthSlab
+{
+    float start;
+    float end;
+    float boundingBox[6];
+};
+
+// Slabs of a reduced histogram's non empty bins.  Returns the number of slabs written, at most
+// SDSM_HISTOGRAM_BIN_COUNT.
+inline int depthSlabsFromHistogram(const int *histogram, float nearPlane, float farPlane, DepthSlab *slabs)
+{
+    int slabCount = 0;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        const int *binData = histogram + DepthHistogramBins + bin * DepthHistogramBinStride;
+
+        if (binData[DepthHistogramBinCount] == 0) {
+            continue;
+        }
+
+        DepthSlab & slab = slabs[slabCount++];
+
+        slab.start = depthHistogramBinStart(bin, nearPlane, farPlane);
+        slab.end = depthHistogramBinStart(bin + 1, nearPlane, farPlane);
+        decodeBoundingBox(binData + DepthHistogramBinBoundingBox, slab.boundingBox);
+    }
+
+    return slabCount;
+}
+
+// Widens a depth range to the histogram bins it overlaps
+inline void alignToDepthHistogramBins(float nearPlane, float farPlane, float *start, float *end)
+{
+    *start = depthHistogramBinStart(depthHistogramBin(*start, nearPlane, farPlane), nearPlane, farPlane);
+    *end = depthHistogramBinStart(depthHistogramBin(*end, nearPlane, farPlane) + 1, nearPlane, farPlane);
+}
+
+// How receivers seen by the camera of a reduced frame appear to the current camera
+struct CameraMotion
+{
+    // Light space of the reduction to the current light space, for receivers fixed in the world
+    float worldFixed[16];
+
+    // The same for receivers that keep their place on screen, such as newly revealed surfaces
+    // that look like the ones they replace
+    float viewFixed[16];
+
+    // Distance the camera moved and angle in radians it turned
+    float translation;
+    float rotation;
+
+    // A receiver fixed in the world at old eye space depth d is now at a depth between
+    // minDepthScale * d + depthOffset and maxDepthScale * d + depthOffset
+    float minDepthScale;
+    float maxDepthScale;
+    float depthOffset;
+};
+
+// Motion between the view and light view matrices of the reduced frame and the current ones.
+// tanHalfDiagonal is the tangent of half the view frustum's diagonal field of view, which bounds
+// how far off axis a receiver at a given depth can be.
+inline CameraMotion cameraMotion(const float *reducedView, const float *reducedLightView,
+                                 const float *view, const float *lightView, float tanHalfDiagonal)
+{
+    CameraMotion motion;
+
+    float inverse[16];
+    float reducedToView[16];
+    float temp[16];
+
+    // reduced light space -> world -> current light space
+    invertRigidMatrix4x4(reducedLightView, inverse);
+    multiplyMatrices4x4(lightView, inverse, motion.worldFixed);
+
+    // reduced light space -> reduced view space, taken as current view space -> world -> current light space
+    multiplyMatrices4x4(reducedView, inverse, temp);
+    invertRigidMatrix4x4(view, inverse);
+    multiplyMatrices4x4(inverse, temp, reducedToView);
+    multiplyMatrices4x4(lightView, reducedToView, motion.viewFixed);
+
+    // reduced view space -> current view space for receivers fixed in the world
+    invertRigidMatrix4x4(reducedView, inverse);
+    multiplyMatrices4x4(view, inverse, temp);
+
+    // The rotation keeps lengths, so the translation is as long as the camera's move
+    motion.translation = sqrtf(temp[12] * temp[12] + temp[13] * temp[13] + temp[14] * temp[14]);
+
+    float trace = temp[0] + temp[5] + temp[10];
+    motion.rotation = acosf(std::min(std::max(0.5f * (trace - 1.0f), -1.0f), 1.0f));
+
+    // Depth after the move is the third row applied to the old position, whose x and y lie
+    // within tanHalfDiagonal * d of the axis
+    float offAxis = sqrtf(temp[2] * temp[2] + temp[6] * temp[6]) * tanHalfDiagonal;
+
+    motion.minDepthScale = temp[10] - offAxis;
+    motion.maxDepthScale = temp[10] + offAxis;
+    motion.depthOffset = temp[14];
+
+    return motion;
+}
+
+// Eye space depths a receiver between two old depths can be at after the motion
+inline void reprojectDepthRange(const CameraMotion & motion, float start, float end,
+                                float *reprojectedStart, float *reprojectedEnd)
+{
+    *reprojectedStart = std::min(motion.minDepthScale * start, motion.minDepthScale * end) + motion.depthOffset;
+    *reprojectedEnd = std::max(motion.maxDepthScale * start, motion.maxDepthScale * end) + motion.depthOffset;
+}
+
+class CascadeBoundsPredictor
+{
+public:
+
+    // The margin added around predicted boxes is marginScale times the camera translation plus
+    // the rotation times the cascade's far split, an estimate of how far receivers at the far
+    // end of the cascade moved on screen
+    explicit CascadeBoundsPredictor(float marginScale = 0.25f)
+    : m_marginScale(marginScale)
+    {
+    }
+
+    // Depth range of the receivers of a reduced depth range after the motion: the union of the
+    // old range, for receivers that keep their depth, and the range of receivers fixed in the
+    // world.  The minimum does not go below minDepth.
+    void predictDepthRange(const CameraMotion & motion, float reducedMin, float reducedMax, float minDepth,
+                           float *predictedMin, float *predictedMax) const
+    {
+        float reprojectedMin;
+        float reprojectedMax;
+
+        reprojectDepthRange(motion, reducedMin, reducedMax, &reprojectedMin, &reprojectedMax);
+
+        *predictedMin = std::max(std::min(reducedMin, reprojectedMin), minDepth);
+        *predictedMax = std::max(reducedMax, reprojectedMax);
+    }
+
+    // Light space bounds of the receivers of the current frame between two depths.  Receivers
+    // fixed in the world come from the slabs whose reprojected depth range overlaps the cascade;
+    // receivers that keep their place on screen come from the slabs overlapping the cascade.  A
+    // cascade no slab reaches stays empty.  To predict what cascadeBoundsFromDepthHistogram will
+    // return for a histogram of the current frame, pass the splits widened with
+    // alignToDepthHistogramBins, since its bins straddling a split count in full.
+    void predictCascadeBounds(const CameraMotion & motion, const DepthSlab *slabs, int slabCount,
+                              float cascadeStart, float cascadeEnd, float *result) const
+    {
+        AxisAlignedBox worldFixed = emptyAxisAlignedBox();
+        AxisAlignedBox viewFixed = emptyAxisAlignedBox();
+
+        for (int i = 0; i < slabCount; i++) {
+            const DepthSlab & slab = slabs[i];
+
+            float reprojectedStart;
+            float reprojectedEnd;
+
+            reprojectDepthRange(motion, slab.start, slab.end, &reprojectedStart, &reprojectedEnd);
+
+            if (reprojectedStart < cascadeEnd && reprojectedEnd > cascadeStart) {
+                mergeAxisAlignedBox(worldFixed, boxFromBoundingBox(slab.boundingBox));
+            }
+
+            if (slab.start < cascadeEnd && slab.end > cascadeStart) {
+                mergeAxisAlignedBox(viewFixed, boxFromBoundingBox(slab.boundingBox));
+            }
+        }
+
+        AxisAlignedBox predicted = emptyAxisAlignedBox();
+
+        if (worldFixed.min[0] <= worldFixed.max[0]) {
+            mergeAxisAlignedBox(predicted, transformAxisAlignedBox(motion.worldFixed, worldFixed));
+        }
+
+        if (viewFixed.min[0] <= viewFixed.max[0]) {
+            mergeAxisAlignedBox(predicted, transformAxisAlignedBox(motion.viewFixed, viewFixed));
+        }
+
+        float margin = 0.0f;
+
+        if (predicted.min[0] <= predicted.max[0]) {
+            margin = m_marginScale * (motion.translation + motion.rotation * cascadeEnd);
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            result[axis] = predicted.min[axis] - margin;
+            result[axis + 3] = predicted.max[axis] + margin;
+        }
+    }
+
+    // predictCascadeBounds for every cascade, 6 floats per cascade
+    void predictCascadeBounds(const CameraMotion & motion, const DepthSlab *slabs, int slabCount,
+                              const float *cascadeEnds, int cascadeCount, float *boundingBoxes) const
+    {
+        for (int i = 0; i < cascadeCount; i++) {
+            predictCascadeBounds(motion, slabs, slabCount, cascadeEnds[i], cascadeEnds[i + 1], boundingBoxes + 6 * i);
+        }
+    }
+
+private:
+
+    static AxisAlignedBox boxFromBoundingBox(const float *boundingBox)
+    {
+        return makeAxisAlignedBox(boundingBox[0], boundingBox[1], boundingBox[2],
+                                  boundingBox[3], boundingBox[4], boundingBox[5]);
+    }
+
+    float m_marginScale;
+};
+
+// Error of predicted cascade bounds against the bounds reduced from the depth of the frame they
+// were predicted for.  A cascade misses by how far the true box sticks out of the predicted one,
+// relative to the true box's extent on that axis, and is loose by the ratio of the predicted to
+// the true area in light space x and y, which is what the shadow map resolution is spread over.
+class BoundsPredictionStats
+{
+public:
+
+    BoundsPredictionStats()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        m_cascadeCount = 0;
+        m_missCount = 0;
+        m_missSum = 0.0;
+        m_maxMiss = 0.0f;
+        m_areaRatioSum = 0.0;
+    }
+
+    // Adds one frame.  Cascades whose true box is empty are skipped.  Misses up to the tolerance,
+    // relative to the extent, do not count.
+    void addFrame(const float *predictedBoxes, const float *trueBoxes, int cascadeCount, float tolerance = 1e-4f)
+    {
+        for (int i = 0; i < cascadeCount; i++) {
+            const float *predicted = predictedBoxes + 6 * i;
+            const float *truth = trueBoxes + 6 * i;
+
+            if (truth[0] > truth[3] || truth[1] > truth[4] || truth[2] > truth[5]) {
+                continue;
+            }
+
+            float miss = 0.0f;
+
+            for (int axis = 0; axis < 3; axis++) {
+                float extent = std::max(truth[axis + 3] - truth[axis], FLT_MIN);
+
+                miss = std::max(miss, (predicted[axis] - truth[axis]) / extent);
+                miss = std::max(miss, (truth[axis + 3] - predicted[axis + 3]) / extent);
+            }
+
+            float trueArea = std::max((truth[3] - truth[0]) * (truth[4] - truth[1]), FLT_MIN);
+            float predictedArea = std::max(predicted[3] - predicted[0], 0.0f) * std::max(predicted[4] - predicted[1], 0.0f);
+
+            m_cascadeCount++;
+            m_missCount += miss > tolerance ? 1 : 0;
+            m_missSum += miss;
+            m_maxMiss = std::max(m_maxMiss, miss);
+            m_areaRatioSum += predictedArea / trueArea;
+        }
+    }
+
+    // Fraction of cascades whose true box was not covered
+    float missRate() const
+    {
+        return m_cascadeCount > 0 ? (float)m_missCount / (float)m_cascadeCount : 0.0f;
+    }
+
+    float meanMiss() const
+    {
+        return m_cascadeCount > 0 ? (float)(m_missSum / m_cascadeCount) : 0.0f;
+    }
+
+    float maxMiss() const
+    {
+        return m_maxMiss;
+    }
+
+    // Mean predicted over true light space area; 1 is as tight as the true bounds
+    float meanAreaRatio() const
+    {
+        return m_cascadeCount > 0 ? (float)(m_areaRatioSum / m_cascadeCount) : 0.0f;
+    }
+
+private:
+
+    int m_cascadeCount;
+    int m_missCount;
+    double m_missSum;
+    float m_maxMiss;
+    double m_areaRatioSum;
+};
+
+#endif /* SDSM_BoundsPredictor_h */
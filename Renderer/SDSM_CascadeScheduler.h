@@ -0,0 +1,218 @@
+//
+//  SDSM_CascadeScheduler.h
+//  DeferredLighting C++
+//
+//  Spreads the re-rendering of far cascades over several frames.  Cascade 0 follows the camera
+//  every frame; cascade i may keep a stale matrix for up to 2^i frames, as long as that matrix
+//  still covers the cascade's receivers.  Refreshes are staggered across frames and limited by a
+//  budget of caster draws.  Plain C++, no Metal.
+//
+
+#ifndef SDSM_CascadeScheduler_h
+#define SDSM_CascadeScheduler_h
+
+#include <stdint.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+#include "SDSM_Culling.h"
+
+// Whether a cascade rendered with a stale matrix still shades this frame's receivers correctly.
+// receiverToStaleClip maps the space of the receiver box to the clip space of the stale matrix;
+// the box holds min x, y, z followed by max x, y, z like the light frustum bounding boxes.  The
+// receivers have to land inside the stale cascade's x, y and depth range.  Casters between them
+// and the light were rendered with the stale matrix too, since the cascade volumes are open
+// towards the light.  A cascade without receivers is always covered.  The tolerance absorbs the
+// rounding of receivers that sit exactly on the edge of the stale cascade.
+inline bool staleCascadeCoversReceivers(const float *receiverToStaleClip, const float *receiverBoundingBox,
+                                        float tolerance = 1e-4f)
+{
+    if (receiverBoundingBox[0] > receiverBoundingBox[3] ||
+        receiverBoundingBox[1] > receiverBoundingBox[4] ||
+        receiverBoundingBox[2] > receiverBoundingBox[5]) {
+        return true;
+    }
+
+    AxisAlignedBox clipBox = transformAxisAlignedBox(receiverToStaleClip,
+        makeAxisAlignedBox(receiverBoundingBox[0], receiverBoundingBox[1], receiverBoundingBox[2],
+                           receiverBoundingBox[3], receiverBoundingBox[4], receiverBoundingBox[5]));
+
+    return clipBox.min[0] >= -1.0f - tolerance && clipBox.max[0] <= 1.0f + tolerance &&
+           clipBox.min[1] >= -1.0f - tolerance && clipBox.max[1] <= 1.0f + tolerance &&
+           clipBox.min[2] >= -tolerance && clipBox.max[2] <= 1.0f + tolerance;
+}
+
+// Grows a receiver box by a fraction of its extent on each side in x and y and away from the
+// light in z, so a matrix fitted to it keeps covering receivers that drift for a few frames.
+// The near side follows the casters and is left alone.  Empty boxes stay empty.
+inline void padCascadeBounds(float *receiverBoundingBox, float fraction)
+{
+    if (receiverBoundingBox[0] > receiverBoundingBox[3] ||
+        receiverBoundingBox[1] > receiverBoundingBox[4] ||
+        receiverBoundingBox[2] > receiverBoundingBox[5]) {
+        return;
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        float margin = fraction * (receiverBoundingBox[axis + 3] - receiverBoundingBox[axis]);
+
+        if (axis < 2) {
+            receiverBoundingBox[axis] -= margin;
+        }
+
+        receiverBoundingBox[axis + 3] += margin;
+    }
+}
+
+// What the scheduler needs to know about a cascade this frame
+struct CascadeUpdateRequest
+{
+    // The cascade's matrix or region differs from the one its texels were rendered with
+    bool changed;
+
+    // The texels can be kept: they exist, sit in the same region and cover this frame's receivers
+    bool reusable;
+
+    // Caster draws needed to re-render the cascade
+    int drawCount;
+};
+
+class CascadeUpdateScheduler
+{
+public:
+
+    // maxInterval caps how many frames any cascade may stay stale.  drawBudget limits the caster
+    // draws of the refreshes of one frame and maxRefreshesPerFrame how many stale cascades are
+    // refreshed together, which staggers them.  Cascade 0 and cascades that cannot be reused are
+    // always rendered and only count against the budget.
+    explicit CascadeUpdateScheduler(int maxInterval = 8, int drawBudget = INT_MAX, int maxRefreshesPerFrame = 1)
+    : m_maxInterval(maxInterval)
+    , m_drawBudget(drawBudget)
+    , m_maxRefreshesPerFrame(maxRefreshesPerFrame)
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        m_frame = 0;
+        m_skippedLastFrame = 0;
+        m_drawsLastFrame = 0;
+        m_skippedTotal = 0;
+        m_passesTotal = 0;
+
+        for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            m_lastUpdate[i] = 0;
+        }
+    }
+
+    void setDrawBudget(int drawBudget)
+    {
+        m_drawBudget = drawBudget;
+    }
+
+    // Frames cascade i may stay stale: 1, 2, 4, ... up to the maximum interval
+    int interval(int cascade) const
+    {
+        return std::min(1 << std::min(cascade, 30), m_maxInterval);
+    }
+
+    // Picks the cascades to re-render this frame and returns them as a mask.  Unchanged cascades
+    // are up to date without rendering.  Changed cascades that are due are refreshed most overdue
+    // first until the refresh count or the draw budget runs out; the others keep their stale
+    // matrix and count as skipped passes.
+    uint32_t schedule(const CascadeUpdateRequest *requests, int cascadeCount)
+    {
+        uint32_t updateMask = 0;
+        int draws = 0;
+        int candidates[MAX_CASCADED_SHADOW_COUNT];
+        int candidateCount = 0;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            if (!requests[i].changed) {
+                m_lastUpdate[i] = m_frame;
+            } else if (i == 0 || !requests[i].reusable) {
+                updateMask |= 1u << i;
+                draws += requests[i].drawCount;
+            } else if (m_frame - m_lastUpdate[i] >= interval(i)) {
+                candidates[candidateCount++] = i;
+            }
+        }
+
+        // Ratio of age to interval, compared without division; ties go to the nearer cascade
+        std::stable_sort(candidates, candidates + candidateCount, [this](int a, int b) {
+            return (int64_t)(m_frame - m_lastUpdate[a]) * interval(b) >
+                   (int64_t)(m_frame - m_lastUpdate[b]) * interval(a);
+        });
+
+        int refreshes = 0;
+
+        for (int c = 0; c < candidateCount && refreshes < m_maxRefreshesPerFrame; c++) {
+            int i = candidates[c];
+
+            if (draws + requests[i].drawCount > m_drawBudget) {
+                continue;
+            }
+
+            updateMask |= 1u << i;
+            draws += requests[i].drawCount;
+            refreshes++;
+        }
+
+        m_skippedLastFrame = 0;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            if (updateMask & (1u << i)) {
+                m_lastUpdate[i] = m_frame;
+                m_passesTotal++;
+            } else if (requests[i].changed) {
+                m_skippedLastFrame++;
+            }
+        }
+
+        m_drawsLastFrame = draws;
+        m_skippedTotal += m_skippedLastFrame;
+        m_frame++;
+
+        return updateMask;
+    }
+
+    // Changed cascades left stale by the last schedule call
+    int skippedLastFrame() const
+    {
+        return m_skippedLastFrame;
+    }
+
+    int drawsLastFrame() const
+    {
+        return m_drawsLastFrame;
+    }
+
+    // Shadow passes skipped and rendered for changed cascades since the last reset
+    uint64_t skippedTotal() const
+    {
+        return m_skippedTotal;
+    }
+
+    uint64_t passesTotal() const
+    {
+        return m_passesTotal;
+    }
+
+private:
+
+    int m_maxInterval;
+    int m_drawBudget;
+    int m_maxRefreshesPerFrame;
+
+    int m_frame;
+    int m_lastUpdate[MAX_CASCADED_SHADOW_COUNT];
+
+    int m_skippedLastFrame;
+    int m_drawsLastFrame;
+    uint64_t m_skippedTotal;
+    uint64_t m_passesTotal;
+};
+
+#endif /* SDSM_CascadeScheduler_h */
@@ -0,0 +1,278 @@
+//
+//  SDSM_Culling.h
+//  DeferredLighting C++
+//
+//  Shadow caster culling against the orthographic volumes of the cascades.  Caster bounds are
+//  axis aligned boxes in model space, transformed to light view space once per frame and then
+//  tested against every cascade volume.  The box math uses SSE or NEON when available and
+//  falls back to scalar code, so the library builds with any C++ compiler.
+//
+
+#ifndef SDSM_Culling_h
+#define SDSM_Culling_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SDSM_CULLING_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SDSM_CULLING_NEON 1
+#endif
+
+// Axis aligned box with the fourth lane of min and max unused, so each corner loads as one vector
+struct alignas(16) AxisAlignedBox
+{
+    float min[4];
+    float max[4];
+};
+
+inline AxisAlignedBox makeAxisAlignedBox(float minX, float minY, float minZ,
+                                         float maxX, float maxY, float maxZ)
+{
+    AxisAlignedBox box = {{minX, minY, minZ, 0.0f}, {maxX, maxY, maxZ, 0.0f}};
+    return box;
+}
+
+// Box that overlaps everything, used for geometry without known bounds
+inline AxisAlignedBox infiniteAxisAlignedBox()
+{
+    return makeAxisAlignedBox(-FLT_MAX, -FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
+}
+
+// Inverted box that grows to the bounds of the points added with expandAxisAlignedBox
+inline AxisAlignedBox emptyAxisAlignedBox()
+{
+    return makeAxisAlignedBox(FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+inline void expandAxisAlignedBox(AxisAlignedBox & box, const float *point)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        box.min[axis] = point[axis] < box.min[axis] ? point[axis] : box.min[axis];
+        box.max[axis] = point[axis] > box.max[axis] ? point[axis] : box.max[axis];
+    }
+}
+
+inline void mergeAxisAlignedBox(AxisAlignedBox & box, const AxisAlignedBox & other)
+{
+    expandAxisAlignedBox(box, other.min);
+    expandAxisAlignedBox(box, other.max);
+}
+
+// Bounds of a box after an affine transform given as a column major 4x4 matrix.  The center is
+// transformed and the extents grow by the absolute value of the rotation and scale part.  Halving
+// before subtracting keeps the extents of infiniteAxisAlignedBox finite, so zeros in the matrix
+// do not turn them into NaNs.
+inline AxisAlignedBox transformAxisAlignedBox(const float *matrix, const AxisAlignedBox & box)
+{
+    AxisAlignedBox result;
+
+#if SDSM_CULLING_SSE
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    __m128 halfMin = _mm_mul_ps(_mm_load_ps(box.min), half);
+    __m128 halfMax = _mm_mul_ps(_mm_load_ps(box.max), half);
+
+    __m128 center = _mm_add_ps(halfMin, halfMax);
+    __m128 extent = _mm_sub_ps(halfMax, halfMin);
+
+    __m128 transformedCenter = _mm_loadu_ps(matrix + 12);
+    __m128 transformedExtent = _mm_setzero_ps();
+
+    for (int column = 0; column < 3; column++) {
+        __m128 matrixColumn = _mm_loadu_ps(matrix + 4 * column);
+        __m128 centerLane = _mm_set1_ps(((const float *)&center)[column]);
+        __m128 extentLane = _mm_set1_ps(((const float *)&extent)[column]);
+
+        transformedCenter = _mm_add_ps(transformedCenter, _mm_mul_ps(matrixColumn, centerLane));
+        transformedExtent = _mm_add_ps(transformedExtent,
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, matrixColumn), extentLane));
+    }
+
+    _mm_store_ps(result.min, _mm_sub_ps(transformedCenter, transformedExtent));
+    _mm_store_ps(result.max, _mm_add_ps(transformedCenter, transformedExtent));
+#elif SDSM_CULLING_NEON
+    float32x4_t halfMin = vmulq_n_f32(vld1q_f32(box.min), 0.5f);
+    float32x4_t halfMax = vmulq_n_f32(vld1q_f32(box.max), 0.5f);
+
+    float32x4_t center = vaddq_f32(halfMin, halfMax);
+    float32x4_t extent = vsubq_f32(halfMax, halfMin);
+
+    float32x4_t transformedCenter = vld1q_f32(matrix + 12);
+    float32x4_t transformedExtent = vdupq_n_f32(0.0f);
+
+    float centerLanes[4];
+    float extentLanes[4];
+    vst1q_f32(centerLanes, center);
+    vst1q_f32(extentLanes, extent);
+
+    for (int column = 0; column < 3; column++) {
+        float32x4_t matrixColumn = vld1q_f32(matrix + 4 * column);
+
+        transformedCenter = vmlaq_n_f32(transformedCenter, matrixColumn, centerLanes[column]);
+        transformedExtent = vmlaq_n_f32(transformedExtent, vabsq_f32(matrixColumn), extentLanes[column]);
+    }
+
+    vst1q_f32(result.min, vsubq_f32(transformedCenter, transformedExtent));
+    vst1q_f32(result.max, vaddq_f32(transformedCenter, transformedExtent));
+#else
+    for (int row = 0; row < 4; row++) {
+        float center = matrix[12 + row];
+        float extent = 0.0f;
+
+        for (int column = 0; column < 3; column++) {
+            float boxCenter = 0.5f * box.min[column] + 0.5f * box.max[column];
+            float boxExtent = 0.5f * box.max[column] - 0.5f * box.min[column];
+
+            center += matrix[4 * column + row] * boxCenter;
+            extent += fabsf(matrix[4 * column + row]) * boxExtent;
+        }
+
+        result.min[row] = center - extent;
+        result.max[row] = center + extent;
+    }
+#endif
+
+    return result;
+}
+
+// Whether two boxes overlap on all three axes
+inline bool axisAlignedBoxesOverlap(const AxisAlignedBox & a, const AxisAlignedBox & b)
+{
+#if SDSM_CULLING_SSE
+    __m128 separated = _mm_or_ps(_mm_cmpgt_ps(_mm_load_ps(a.min), _mm_load_ps(b.max)),
+                                 _mm_cmpgt_ps(_mm_load_ps(b.min), _mm_load_ps(a.max)));
+
+    return (_mm_movemask_ps(separated) & 0x7) == 0;
+#elif SDSM_CULLING_NEON
+    uint32x4_t separated = vorrq_u32(vcgtq_f32(vld1q_f32(a.min), vld1q_f32(b.max)),
+                                     vcgtq_f32(vld1q_f32(b.min), vld1q_f32(a.max)));
+
+    // Ignore the unused fourth lane
+    separated = vsetq_lane_u32(0, separated, 3);
+
+    return vmaxvq_u32(separated) == 0;
+#else
+    for (int axis = 0; axis < 3; axis++) {
+        if (a.min[axis] > b.max[axis] || b.min[axis] > a.max[axis]) {
+            return false;
+        }
+    }
+
+    return true;
+#endif
+}
+
+// Light view space volume a cascade renders casters from.  The cascade's receivers bound it in x
+// and y and from behind; towards the light it extends to the near plane of the orthographic
+// projection, since casters in front of the receivers still throw shadows onto them.
+// A cascade without receivers has an inverted box and rejects every caster.  The receiver box
+// holds min x, y, z followed by max x, y, z like the light frustum bounding boxes.
+inline AxisAlignedBox cascadeCasterVolume(const float *receiverBoundingBox, float nearZ)
+{
+    // An inverted box of +-FLT_MAX still touches infiniteAxisAlignedBox, so it is inverted past it
+    for (int axis = 0; axis < 3; axis++) {
+        if (!(receiverBoundingBox[axis] <= receiverBoundingBox[axis + 3])) {
+            return makeAxisAlignedBox(INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY);
+        }
+    }
+
+    return makeAxisAlignedBox(receiverBoundingBox[0], receiverBoundingBox[1], nearZ,
+                              receiverBoundingBox[3], receiverBoundingBox[4], receiverBoundingBox[5]);
+}
+
+// Bit i of the result is set if a light view space caster box overlaps cascade volume i
+inline uint32_t cascadeOverlapMask(const AxisAlignedBox & casterBox,
+                                   const AxisAlignedBox *cascadeVolumes, int cascadeCount)
+{
+    uint32_t mask = 0;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        if (axisAlignedBoxesOverlap(casterBox, cascadeVolumes[i])) {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+}
+
+// Cascade masks of a batch of model space caster boxes sharing one model to light view transform
+inline void cullShadowCasters(const float *modelToLightMatrix,
+                              const AxisAlignedBox *casterBoxes, size_t casterCount,
+                              const AxisAlignedBox *cascadeVolumes, int cascadeCount,
+                              uint32_t *cascadeMasks)
+{
+    for (size_t i = 0; i < casterCount; i++) {
+        AxisAlignedBox lightBox = transformAxisAlignedBox(modelToLightMatrix, casterBoxes[i]);
+
+        cascadeMasks[i] = cascadeOverlapMask(lightBox, cascadeVolumes, cascadeCount);
+    }
+}
+
+// Starts the near plane fit of fitCascadeNearPlanes: without casters the near plane of a cascade
+// sits on the near bound of its receivers.  Receiver boxes are laid out as for cascadeCasterVolume.
+// The plane stays at least minDepthRange in front of the receivers' far bound, so receivers that
+// are flat in light view space do not collapse the projection.
+inline void resetCascadeNearPlanes(const float *receiverBoundingBoxes, int cascadeCount, float *nearZ,
+                                   float minDepthRange = 1.0f)
+{
+    for (int i = 0; i < cascadeCount; i++) {
+        float receiverMinZ = receiverBoundingBoxes[6 * i + 2];
+        float receiverMaxZ = receiverBoundingBoxes[6 * i + 5];
+
+        // Cascades without receivers keep their inverted box
+        nearZ[i] = receiverMinZ <= receiverMaxZ ? fminf(receiverMinZ, receiverMaxZ - minDepthRange) : receiverMinZ;
+    }
+}
+
+// Pulls the near plane of every cascade in cascadeMask towards the light so that a light view
+// space caster box lies behind it.  Boxes of casters without known bounds (see
+// infiniteAxisAlignedBox) transform to a depth of -FLT_MAX or beyond and leave the planes unchanged.
+inline void includeCasterInNearPlanes(const AxisAlignedBox & casterBox, uint32_t cascadeMask, float *nearZ)
+{
+    if (!(casterBox.min[2] > -FLT_MAX)) {
+        return;
+    }
+
+    for (int i = 0; cascadeMask; i++, cascadeMask >>= 1) {
+        if ((cascadeMask & 1) && casterBox.min[2] < nearZ[i]) {
+            nearZ[i] = casterBox.min[2];
+        }
+    }
+}
+
+// Culls a batch of model space caster boxes like cullShadowCasters and fits the near plane of
+// every cascade's orthographic projection to the casters that survive.  The cascade volumes are
+// open towards the light, so every caster between the light and the receivers counts, and the
+// fitted plane is the nearest point of those casters or of the receivers, whichever is closer.
+// That keeps the depth range of each cascade as small as its contents allow.
+inline void fitCascadeNearPlanes(const float *modelToLightMatrix,
+                                 const AxisAlignedBox *casterBoxes, size_t casterCount,
+                                 const float *receiverBoundingBoxes, int cascadeCount,
+                                 uint32_t *cascadeMasks, float *nearZ)
+{
+    // One volume per bit of a cascade mask
+    AxisAlignedBox cascadeVolumes[32];
+
+    for (int i = 0; i < cascadeCount; i++) {
+        cascadeVolumes[i] = cascadeCasterVolume(receiverBoundingBoxes + 6 * i, -FLT_MAX);
+    }
+
+    resetCascadeNearPlanes(receiverBoundingBoxes, cascadeCount, nearZ);
+
+    for (size_t i = 0; i < casterCount; i++) {
+        AxisAlignedBox lightBox = transformAxisAlignedBox(modelToLightMatrix, casterBoxes[i]);
+
+        cascadeMasks[i] = cascadeOverlapMask(lightBox, cascadeVolumes, cascadeCount);
+
+        includeCasterInNearPlanes(lightBox, cascadeMasks[i], nearZ);
+    }
+}
+
+#endif /* SDSM_Culling_h */
@@ -0,0 +1,251 @@
+//
+//  SDSM_DepthPyramid.h
+//  DeferredLighting C++
+//
+//  CPU builder of the min/max depth pyramid that build_depth_pyramid_base and
+//  build_depth_pyramid_level produce on the GPU.  Levels hold interleaved min, max pairs like the
+//  RG32Float texture and come out bit for bit equal to the kernels' output.  Rows are split over
+//  threads and reduced four (base) or two (further levels) texels at a time with SSE or NEON when
+//  available, with scalar code for the edges and other compilers.
+//
+
+#ifndef SDSM_DepthPyramid_h
+#define SDSM_DepthPyramid_h
+
+#include <float.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "Shaders/AAPLConfig.h"
+#include "Shaders/SDSMShared.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SDSM_PYRAMID_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SDSM_PYRAMID_NEON 1
+#endif
+
+struct DepthPyramidLevel
+{
+    int width;
+    int height;
+
+    // width * height min, max pairs, row by row
+    std::vector<float> texels;
+};
+
+// Texels [x0, width) of one row of level 0, from two rows of the depth buffer, with clamped reads
+inline void buildDepthPyramidBaseTexels(const float *row0, const float *row1, int depthWidth,
+                                        float *texels, int x0, int width)
+{
+    for (int x = x0; x < width; x++) {
+        int first = 2 * x;
+        int second = std::min(first + 1, depthWidth - 1);
+
+        texels[2 * x] = depthPyramidMin(depthPyramidMin(depthPyramidMinSample(row0[first]), depthPyramidMinSample(row0[second])),
+                                        depthPyramidMin(depthPyramidMinSample(row1[first]), depthPyramidMinSample(row1[second])));
+        texels[2 * x + 1] = depthPyramidMax(depthPyramidMax(row0[first], row0[second]),
+                                            depthPyramidMax(row1[first], row1[second]));
+    }
+}
+
+// One row of level 0
+inline void buildDepthPyramidBaseRow(const float *depth, int depthWidth, int depthHeight, int y, float *texels)
+{
+    int width = depthPyramidLevelSize(depthWidth);
+
+    const float *row0 = depth + (size_t)depthWidth * (2 * y);
+    const float *row1 = depth + (size_t)depthWidth * std::min(2 * y + 1, depthHeight - 1);
+
+    int x = 0;
+
+#if SDSM_PYRAMID_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 empty = _mm_set1_ps(FLT_MAX);
+
+    // Four texels from eight pixels of each row while none of them needs clamping
+    for (; 2 * x + 8 <= depthWidth; x += 4) {
+        __m128 a0 = _mm_loadu_ps(row0 + 2 * x), a1 = _mm_loadu_ps(row0 + 2 * x + 4);
+        __m128 b0 = _mm_loadu_ps(row1 + 2 * x), b1 = _mm_loadu_ps(row1 + 2 * x + 4);
+
+        // Even and odd columns of both rows
+        __m128 evenA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 oddA = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 evenB = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 oddB = _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1));
+
+        // _mm_min_ps(a, b) and _mm_max_ps(a, b) are a < b ? a : b and a > b ? a : b
+        __m128 maxDepth = _mm_max_ps(_mm_max_ps(evenA, oddA), _mm_max_ps(evenB, oddB));
+
+        #define SDSM_PYRAMID_MIN_SAMPLE(v) _mm_or_ps(_mm_and_ps(_mm_cmpgt_ps(v, zero), v), \
+                                                     _mm_andnot_ps(_mm_cmpgt_ps(v, zero), empty))
+        __m128 minDepth = _mm_min_ps(_mm_min_ps(SDSM_PYRAMID_MIN_SAMPLE(evenA), SDSM_PYRAMID_MIN_SAMPLE(oddA)),
+                                     _mm_min_ps(SDSM_PYRAMID_MIN_SAMPLE(evenB), SDSM_PYRAMID_MIN_SAMPLE(oddB)));
+        #undef SDSM_PYRAMID_MIN_SAMPLE
+
+        _mm_storeu_ps(texels + 2 * x, _mm_unpacklo_ps(minDepth, maxDepth));
+        _mm_storeu_ps(texels + 2 * x + 4, _mm_unpackhi_ps(minDepth, maxDepth));
+    }
+#elif SDSM_PYRAMID_NEON
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t empty = vdupq_n_f32(FLT_MAX);
+
+    for (; 2 * x + 8 <= depthWidth; x += 4) {
+        float32x4x2_t a = vld2q_f32(row0 + 2 * x);
+        float32x4x2_t b = vld2q_f32(row1 + 2 * x);
+
+        float32x4_t maxDepth = vmaxq_f32(vmaxq_f32(a.val[0], a.val[1]), vmaxq_f32(b.val[0], b.val[1]));
+
+        #define SDSM_PYRAMID_MIN_SAMPLE(v) vbslq_f32(vcgtq_f32(v, zero), v, empty)
+        float32x4_t minDepth = vminq_f32(vminq_f32(SDSM_PYRAMID_MIN_SAMPLE(a.val[0]), SDSM_PYRAMID_MIN_SAMPLE(a.val[1])),
+                                         vminq_f32(SDSM_PYRAMID_MIN_SAMPLE(b.val[0]), SDSM_PYRAMID_MIN_SAMPLE(b.val[1])));
+        #undef SDSM_PYRAMID_MIN_SAMPLE
+
+        float32x4x2_t result = {{minDepth, maxDepth}};
+        vst2q_f32(texels + 2 * x, result);
+    }
+#endif
+
+    buildDepthPyramidBaseTexels(row0, row1, depthWidth, texels, x, width);
+}
+
+// Texels [x0, width) of one row of a further level, from two rows of the level before
+inline void buildDepthPyramidLevelTexels(const float *row0, const float *row1, int sourceWidth,
+                                         float *texels, int x0, int width)
+{
+    for (int x = x0; x < width; x++) {
+        int first = 2 * x;
+        int second = std::min(first + 1, sourceWidth - 1);
+
+        texels[2 * x] = depthPyramidMin(depthPyramidMin(row0[2 * first], row0[2 * second]),
+                                        depthPyramidMin(row1[2 * first], row1[2 * second]));
+        texels[2 * x + 1] = depthPyramidMax(depthPyramidMax(row0[2 * first + 1], row0[2 * second + 1]),
+                                            depthPyramidMax(row1[2 * first + 1], row1[2 * second + 1]));
+    }
+}
+
+// One row of a further level
+inline void buildDepthPyramidLevelRow(const DepthPyramidLevel & source, int y, float *texels)
+{
+    int width = depthPyramidLevelSize(source.width);
+
+    const float *row0 = source.texels.data() + (size_t)2 * source.width * (2 * y);
+    const float *row1 = source.texels.data() + (size_t)2 * source.width * std::min(2 * y + 1, source.height - 1);
+
+    int x = 0;
+
+#if SDSM_PYRAMID_SSE
+    // Two texels from four source texels of each row while none of them needs clamping
+    for (; 2 * x + 4 <= source.width; x += 2) {
+        __m128 a0 = _mm_loadu_ps(row0 + 4 * x), a1 = _mm_loadu_ps(row0 + 4 * x + 4);
+        __m128 b0 = _mm_loadu_ps(row1 + 4 * x), b1 = _mm_loadu_ps(row1 + 4 * x + 4);
+
+        // Left and right source texel of both output texels, as min, max, min, max
+        __m128 left = _mm_min_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 0, 1, 0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(1, 0, 1, 0)));
+        __m128 leftMax = _mm_max_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(1, 0, 1, 0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(1, 0, 1, 0)));
+        __m128 right = _mm_min_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 2, 3, 2)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 2, 3, 2)));
+        __m128 rightMax = _mm_max_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 2, 3, 2)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 2, 3, 2)));
+
+        __m128 minDepth = _mm_min_ps(left, right);
+        __m128 maxDepth = _mm_max_ps(leftMax, rightMax);
+
+        // The mins of the two output texels are in lanes 0 and 2, their maxes in lanes 1 and 3
+        __m128 pairs = _mm_shuffle_ps(minDepth, maxDepth, _MM_SHUFFLE(3, 1, 2, 0));
+
+        _mm_storeu_ps(texels + 2 * x, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+#elif SDSM_PYRAMID_NEON
+    for (; 2 * x + 4 <= source.width; x += 2) {
+        // De-interleave four source texels of each row into their min and max lanes
+        float32x4x2_t a = vld2q_f32(row0 + 4 * x);
+        float32x4x2_t b = vld2q_f32(row1 + 4 * x);
+
+        float32x4_t minDepth = vminq_f32(a.val[0], b.val[0]);
+        float32x4_t maxDepth = vmaxq_f32(a.val[1], b.val[1]);
+
+        // Pairwise over neighbouring source texels gives both output texels
+        float32x2_t minPair = vpmin_f32(vget_low_f32(minDepth), vget_high_f32(minDepth));
+        float32x2_t maxPair = vpmax_f32(vget_low_f32(maxDepth), vget_high_f32(maxDepth));
+
+        float32x2x2_t result = {{minPair, maxPair}};
+        vst2_f32(texels + 2 * x, result);
+    }
+#endif
+
+    buildDepthPyramidLevelTexels(row0, row1, source.width, texels, x, width);
+}
+
+// Runs rowFunction(y) for all rows, split into contiguous bands over up to threadCount threads.
+// Small levels are not worth the threads and run on the calling thread.
+template <typename RowFunction>
+inline void forEachDepthPyramidRow(int height, int threadCount, const RowFunction & rowFunction)
+{
+    const int minRowsPerThread = 16;
+
+    threadCount = std::max(1, std::min(threadCount, height / minRowsPerThread));
+
+    std::vector<std::thread> threads;
+
+    for (int t = 1; t < threadCount; t++) {
+        int begin = height * t / threadCount;
+        int end = height * (t + 1) / threadCount;
+
+        threads.emplace_back([begin, end, &rowFunction]() {
+            for (int y = begin; y < end; y++) {
+                rowFunction(y);
+            }
+        });
+    }
+
+    for (int y = 0; y < height / threadCount; y++) {
+        rowFunction(y);
+    }
+
+    for (std::thread & thread : threads) {
+        thread.join();
+    }
+}
+
+// Builds every level of the pyramid of a depth image laid out like m_depth_GBuffer (eye space
+// depth, 0 for empty pixels).  A threadCount of 0 uses one thread per hardware thread.
+inline std::vector<DepthPyramidLevel> buildDepthPyramid(const float *depth, int width, int height, int threadCount = 0)
+{
+    if (threadCount <= 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<DepthPyramidLevel> levels(depthPyramidLevelCount(width, height));
+
+    for (size_t level = 0; level < levels.size(); level++) {
+        int sourceWidth = level == 0 ? width : levels[level - 1].width;
+        int sourceHeight = level == 0 ? height : levels[level - 1].height;
+
+        DepthPyramidLevel & result = levels[level];
+
+        result.width = depthPyramidLevelSize(sourceWidth);
+        result.height = depthPyramidLevelSize(sourceHeight);
+        result.texels.resize((size_t)2 * result.width * result.height);
+
+        float *texels = result.texels.data();
+        size_t rowLength = (size_t)2 * result.width;
+
+        if (level == 0) {
+            forEachDepthPyramidRow(result.height, threadCount, [=](int y) {
+                buildDepthPyramidBaseRow(depth, width, height, y, texels + rowLength * y);
+            });
+        } else {
+            const DepthPyramidLevel *source = &levels[level - 1];
+
+            forEachDepthPyramidRow(result.height, threadCount, [=](int y) {
+                buildDepthPyramidLevelRow(*source, y, texels + rowLength * y);
+            });
+        }
+    }
+
+    return levels;
+}
+
+#endif /* SDSM_DepthPyramid_h */
@@ -0,0 +1,538 @@
+//
+//  SDSM_MeshCache.h
+//  DeferredLighting C++
+//
+//  Binary cache of meshes already laid out for the renderer's vertex descriptor, so later launches
+//  skip parsing the model, generating tangents and relaying out the vertices.  The file holds a
+//  header, mesh, submesh and material tables, a string table of texture references and a data
+//  section of 256 byte aligned vertex and index streams.  The data section starts and ends on a
+//  16 KB boundary, the largest VM page size, so a mapping of the file can back a buffer directly.
+//
+//  The cache is a per-machine file in native byte order.  It is only valid for the source file
+//  and vertex layout it was written for, which the header records and open checks.
+//
+
+#ifndef SDSM_MeshCache_h
+#define SDSM_MeshCache_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SDSM_Culling.h"
+
+// Bump when the file layout or the way meshes are built before caching changes
+static const uint32_t MeshCacheVersion = 1;
+
+static const uint64_t MeshCacheStreamAlignment = 256;
+static const uint64_t MeshCacheDataAlignment = 16384;
+
+// Submesh index and primitive types take the values of MTL::IndexType and MTL::PrimitiveType
+static const uint32_t MeshCacheIndexTypeUInt16 = 0;
+static const uint32_t MeshCacheIndexTypeUInt32 = 1;
+static const uint32_t MeshCachePrimitiveTypeTriangleStrip = 4;
+
+static const int MeshCacheMaxVertexStreams = 4;
+static const int MeshCacheTexturesPerMaterial = 3;
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t layoutSignature;
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+    uint32_t meshCount;
+    uint32_t submeshCount;
+    uint32_t materialCount;
+    uint32_t stringLength;
+    uint64_t dataOffset;
+    uint64_t dataLength;
+};
+
+// Offsets and lengths are relative to the data section
+struct MeshCacheStream
+{
+    uint32_t argumentIndex;
+    uint32_t stride;
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct MeshCacheMesh
+{
+    AxisAlignedBox bounds;
+    uint32_t firstSubmesh;
+    uint32_t submeshCount;
+    uint32_t vertexCount;
+    uint32_t streamCount;
+    MeshCacheStream streams[MeshCacheMaxVertexStreams];
+};
+
+struct MeshCacheSubmesh
+{
+    AxisAlignedBox bounds;
+    uint32_t primitiveType;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+    uint64_t indexOffset;
+    uint64_t indexLength;
+};
+
+// A texture is loaded from its file path and, failing that, from the asset catalog by name.  Both
+// are offsets into the string table.
+struct MeshCacheTexture
+{
+    uint32_t pathOffset;
+    uint32_t nameOffset;
+};
+
+struct MeshCacheMaterial
+{
+    MeshCacheTexture textures[MeshCacheTexturesPerMaterial];
+};
+
+static const char MeshCacheMagic[8] = {'S', 'D', 'S', 'M', 'M', 'E', 'S', 'H'};
+
+inline uint64_t alignMeshCacheOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// FNV-1a step, used to sign the vertex layout a cache was written for
+inline uint32_t meshCacheHash(uint32_t hash, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((value >> (8 * i)) & 0xFF)) * 16777619u;
+    }
+
+    return hash;
+}
+
+static const uint32_t MeshCacheHashSeed = 2166136261u;
+
+// Size and modification time the cache records to notice the source file changed.  Returns false
+// if the file cannot be examined.
+inline bool meshCacheSourceStamp(const char *path, uint64_t & size, int64_t & modificationTime)
+{
+    struct stat status;
+
+    if (stat(path, &status) != 0) {
+        return false;
+    }
+
+    size = (uint64_t)status.st_size;
+    modificationTime = (int64_t)status.st_mtime;
+
+    return true;
+}
+
+// Gathers meshes in the order they are loaded and writes them as a cache file
+class MeshCacheWriter
+{
+public:
+
+    MeshCacheWriter(uint32_t layoutSignature, uint64_t sourceSize, int64_t sourceModificationTime)
+    : m_abandoned(false)
+    {
+        memset(&m_header, 0, sizeof(m_header));
+        memcpy(m_header.magic, MeshCacheMagic, sizeof(MeshCacheMagic));
+
+        m_header.version = MeshCacheVersion;
+        m_header.layoutSignature = layoutSignature;
+        m_header.sourceSize = sourceSize;
+        m_header.sourceModificationTime = sourceModificationTime;
+
+        // Offset 0 is the empty string
+        m_strings.push_back('\0');
+    }
+
+    // Returns the index of a material with these texture paths and names, adding it unless an
+    // identical one was added before
+    uint32_t addMaterial(const std::string *paths, const std::string *names)
+    {
+        MeshCacheMaterial material;
+
+        for (int i = 0; i < MeshCacheTexturesPerMaterial; i++) {
+            material.textures[i].pathOffset = addString(paths[i]);
+            material.textures[i].nameOffset = addString(names[i]);
+        }
+
+        for (size_t i = 0; i < m_materials.size(); i++) {
+            if (memcmp(&m_materials[i], &material, sizeof(material)) == 0) {
+                return (uint32_t)i;
+            }
+        }
+
+        m_materials.push_back(material);
+
+        return (uint32_t)m_materials.size() - 1;
+    }
+
+    // Starts a mesh.  Its vertex streams and submeshes follow.
+    void beginMesh(uint32_t vertexCount, const AxisAlignedBox & bounds)
+    {
+        MeshCacheMesh mesh;
+        memset(&mesh, 0, sizeof(mesh));
+
+        mesh.bounds = bounds;
+        mesh.firstSubmesh = (uint32_t)m_submeshes.size();
+        mesh.vertexCount = vertexCount;
+
+        m_meshes.push_back(mesh);
+    }
+
+    // Returns false if the mesh already has MeshCacheMaxVertexStreams streams
+    bool addVertexStream(uint32_t argumentIndex, uint32_t stride, const void *bytes, uint64_t length)
+    {
+        MeshCacheMesh & mesh = m_meshes.back();
+
+        if (mesh.streamCount == MeshCacheMaxVertexStreams) {
+            return false;
+        }
+
+        MeshCacheStream & stream = mesh.streams[mesh.streamCount++];
+
+        stream.argumentIndex = argumentIndex;
+        stream.stride = stride;
+        stream.offset = addData(bytes, length);
+        stream.length = length;
+
+        return true;
+    }
+
+    void addSubmesh(uint32_t primitiveType, uint32_t indexType, uint32_t indexCount, uint32_t materialIndex,
+                    const void *indices, uint64_t indexLength, const AxisAlignedBox & bounds)
+    {
+        MeshCacheSubmesh submesh;
+        memset(&submesh, 0, sizeof(submesh));
+
+        submesh.bounds = bounds;
+        submesh.primitiveType = primitiveType;
+        submesh.indexType = indexType;
+        submesh.indexCount = indexCount;
+        submesh.materialIndex = materialIndex;
+        submesh.indexOffset = addData(indices, indexLength);
+        submesh.indexLength = indexLength;
+
+        m_submeshes.push_back(submesh);
+        m_meshes.back().submeshCount++;
+    }
+
+    // Marks the cache incomplete, for a mesh that could not be recorded.  write then fails.
+    void abandon()
+    {
+        m_abandoned = true;
+    }
+
+    // Writes the cache next to the path and renames it into place, so a reader never sees a
+    // partially written file.  Returns false if the file could not be written.
+    bool write(const char *path)
+    {
+        if (m_abandoned) {
+            return false;
+        }
+
+        m_header.meshCount = (uint32_t)m_meshes.size();
+        m_header.submeshCount = (uint32_t)m_submeshes.size();
+        m_header.materialCount = (uint32_t)m_materials.size();
+        m_header.stringLength = (uint32_t)m_strings.size();
+
+        uint64_t tablesLength = sizeof(MeshCacheHeader) +
+                                m_meshes.size() * sizeof(MeshCacheMesh) +
+                                m_submeshes.size() * sizeof(MeshCacheSubmesh) +
+                                m_materials.size() * sizeof(MeshCacheMaterial) +
+                                m_strings.size();
+
+        m_header.dataOffset = alignMeshCacheOffset(tablesLength, MeshCacheDataAlignment);
+        m_header.dataLength = alignMeshCacheOffset(m_data.size(), MeshCacheDataAlignment);
+
+        std::string temporaryPath = std::string(path) + ".tmp";
+
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+
+        if (!file) {
+            return false;
+        }
+
+        std::vector<uint8_t> padding(MeshCacheDataAlignment, 0);
+
+        bool written = writeBytes(file, &m_header, sizeof(m_header)) &&
+                       writeBytes(file, m_meshes.data(), m_meshes.size() * sizeof(MeshCacheMesh)) &&
+                       writeBytes(file, m_submeshes.data(), m_submeshes.size() * sizeof(MeshCacheSubmesh)) &&
+                       writeBytes(file, m_materials.data(), m_materials.size() * sizeof(MeshCacheMaterial)) &&
+                       writeBytes(file, m_strings.data(), m_strings.size()) &&
+                       writeBytes(file, padding.data(), m_header.dataOffset - tablesLength) &&
+                       writeBytes(file, m_data.data(), m_data.size()) &&
+                       writeBytes(file, padding.data(), m_header.dataLength - m_data.size());
+
+        written = (fclose(file) == 0) && written;
+
+        if (!written || rename(temporaryPath.c_str(), path) != 0) {
+            unlink(temporaryPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    static bool writeBytes(FILE *file, const void *bytes, size_t length)
+    {
+        return length == 0 || fwrite(bytes, 1, length, file) == length;
+    }
+
+    uint32_t addString(const std::string & string)
+    {
+        if (string.empty()) {
+            return 0;
+        }
+
+        // Repeated strings share an offset, so materials naming the same textures compare equal
+        auto found = m_stringOffsets.find(string);
+
+        if (found != m_stringOffsets.end()) {
+            return found->second;
+        }
+
+        uint32_t offset = (uint32_t)m_strings.size();
+
+        m_strings.insert(m_strings.end(), string.begin(), string.end());
+        m_strings.push_back('\0');
+        m_stringOffsets.emplace(string, offset);
+
+        return offset;
+    }
+
+    uint64_t addData(const void *bytes, uint64_t length)
+    {
+        uint64_t offset = alignMeshCacheOffset(m_data.size(), MeshCacheStreamAlignment);
+
+        m_data.resize(offset + length, 0);
+        memcpy(m_data.data() + offset, bytes, length);
+
+        return offset;
+    }
+
+    MeshCacheHeader m_header;
+
+    bool m_abandoned;
+
+    std::vector<MeshCacheMesh> m_meshes;
+    std::vector<MeshCacheSubmesh> m_submeshes;
+    std::vector<MeshCacheMaterial> m_materials;
+    std::vector<char> m_strings;
+    std::unordered_map<std::string, uint32_t> m_stringOffsets;
+    std::vector<uint8_t> m_data;
+};
+
+// Maps a cache file and checks it before any of its tables are used
+class MeshCacheFile
+{
+public:
+
+    MeshCacheFile()
+    : m_mapping(nullptr)
+    , m_mappingLength(0)
+    , m_header(nullptr)
+    {
+    }
+
+    ~MeshCacheFile()
+    {
+        close();
+    }
+
+    MeshCacheFile(const MeshCacheFile &) = delete;
+
+    MeshCacheFile & operator=(const MeshCacheFile &) = delete;
+
+    // Returns false, leaving the file closed, if the cache is missing, truncated, inconsistent, or
+    // was written for another format version, vertex layout or source file
+    bool open(const char *path, uint32_t layoutSignature, uint64_t sourceSize, int64_t sourceModificationTime)
+    {
+        close();
+
+        int descriptor = ::open(path, O_RDONLY);
+
+        if (descriptor < 0) {
+            return false;
+        }
+
+        struct stat status;
+
+        if (fstat(descriptor, &status) != 0 || (uint64_t)status.st_size < sizeof(MeshCacheHeader)) {
+            ::close(descriptor);
+            return false;
+        }
+
+        // Private and writable so a buffer aliasing the data sees ordinary memory.  Pages are only
+        // copied if something writes to them.
+        void *mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+
+        ::close(descriptor);
+
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+
+        m_mapping = mapping;
+        m_mappingLength = (size_t)status.st_size;
+        m_header = (const MeshCacheHeader *)mapping;
+
+        if (!validate(layoutSignature, sourceSize, sourceModificationTime)) {
+            close();
+            return false;
+        }
+
+        madvise((uint8_t *)m_mapping + m_header->dataOffset, (size_t)m_header->dataLength, MADV_WILLNEED);
+
+        return true;
+    }
+
+    void close()
+    {
+        if (m_mapping) {
+            munmap(m_mapping, m_mappingLength);
+        }
+
+        m_mapping = nullptr;
+        m_mappingLength = 0;
+        m_header = nullptr;
+    }
+
+    const MeshCacheHeader & header() const
+    {
+        return *m_header;
+    }
+
+    const MeshCacheMesh *meshes() const
+    {
+        return (const MeshCacheMesh *)(m_header + 1);
+    }
+
+    const MeshCacheSubmesh *submeshes() const
+    {
+        return (const MeshCacheSubmesh *)(meshes() + m_header->meshCount);
+    }
+
+    const MeshCacheMaterial *materials() const
+    {
+        return (const MeshCacheMaterial *)(submeshes() + m_header->submeshCount);
+    }
+
+    const char *string(uint32_t offset) const
+    {
+        return (const char *)(materials() + m_header->materialCount) + offset;
+    }
+
+    // Page aligned start of the vertex and index streams, a whole number of pages long
+    uint8_t *data() const
+    {
+        return (uint8_t *)m_mapping + m_header->dataOffset;
+    }
+
+    uint64_t dataLength() const
+    {
+        return m_header->dataLength;
+    }
+
+private:
+
+    static bool rangeFits(uint64_t offset, uint64_t length, uint64_t limit)
+    {
+        return offset <= limit && length <= limit - offset;
+    }
+
+    bool validate(uint32_t layoutSignature, uint64_t sourceSize, int64_t sourceModificationTime) const
+    {
+        const MeshCacheHeader & header = *m_header;
+
+        if (memcmp(header.magic, MeshCacheMagic, sizeof(MeshCacheMagic)) != 0 ||
+            header.version != MeshCacheVersion ||
+            header.layoutSignature != layoutSignature ||
+            header.sourceSize != sourceSize ||
+            header.sourceModificationTime != sourceModificationTime) {
+            return false;
+        }
+
+        uint64_t tablesLength = sizeof(MeshCacheHeader) +
+                                (uint64_t)header.meshCount * sizeof(MeshCacheMesh) +
+                                (uint64_t)header.submeshCount * sizeof(MeshCacheSubmesh) +
+                                (uint64_t)header.materialCount * sizeof(MeshCacheMaterial) +
+                                header.stringLength;
+
+        if (header.dataOffset % MeshCacheDataAlignment != 0 ||
+            header.dataLength % MeshCacheDataAlignment != 0 ||
+            tablesLength > header.dataOffset ||
+            !rangeFits(header.dataOffset, header.dataLength, m_mappingLength)) {
+            return false;
+        }
+
+        if (header.stringLength == 0 || string(header.stringLength - 1)[0] != '\0') {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < header.materialCount; i++) {
+            for (const MeshCacheTexture & texture : materials()[i].textures) {
+                if (texture.pathOffset >= header.stringLength || texture.nameOffset >= header.stringLength) {
+                    return false;
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < header.submeshCount; i++) {
+            const MeshCacheSubmesh & submesh = submeshes()[i];
+
+            if (submesh.materialIndex >= header.materialCount ||
+                submesh.primitiveType > MeshCachePrimitiveTypeTriangleStrip ||
+                (submesh.indexType != MeshCacheIndexTypeUInt16 && submesh.indexType != MeshCacheIndexTypeUInt32) ||
+                !rangeFits(submesh.indexOffset, submesh.indexLength, header.dataLength)) {
+                return false;
+            }
+
+            uint64_t indexSize = submesh.indexType == MeshCacheIndexTypeUInt32 ? 4 : 2;
+
+            if ((uint64_t)submesh.indexCount * indexSize > submesh.indexLength) {
+                return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            const MeshCacheMesh & mesh = meshes()[i];
+
+            if (!rangeFits(mesh.firstSubmesh, mesh.submeshCount, header.submeshCount) ||
+                mesh.streamCount > MeshCacheMaxVertexStreams) {
+                return false;
+            }
+
+            for (uint32_t j = 0; j < mesh.streamCount; j++) {
+                const MeshCacheStream & stream = mesh.streams[j];
+
+                if (!rangeFits(stream.offset, stream.length, header.dataLength) ||
+                    stream.length < (uint64_t)mesh.vertexCount * stream.stride) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void *m_mapping;
+    size_t m_mappingLength;
+
+    const MeshCacheHeader *m_header;
+};
+
+#endif /* SDSM_MeshCache_h */
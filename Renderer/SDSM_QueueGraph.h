@@ -0,0 +1,118 @@
+//
+//  SDSM_QueueGraph.h
+//  DeferredLighting C++
+//
+//  Dependencies between command buffers submitted to several command queues.  Every queue has an
+//  event counting its submissions: the n-th submission of a queue signals value n once its
+//  commands have completed.  A submission depending on a submission of another queue waits on
+//  that queue's event for the value, while dependencies within a queue follow from its order.
+//  The graph only calls encodeSignalEvent and encodeWaitForEvent on the command buffers it is
+//  given, so it builds without Metal and runs against mock command buffers and events.
+//
+
+#ifndef SDSM_QueueGraph_h
+#define SDSM_QueueGraph_h
+
+#include <stdint.h>
+
+template <typename CommandBuffer, typename Event, int QueueCount>
+class QueueGraph
+{
+public:
+
+    // A command buffer submitted to a queue through the graph.  Value 0 stands for everything
+    // submitted before the graph's first submission on the queue and never needs a wait.
+    struct Submission
+    {
+        int queue;
+        uint64_t value;
+    };
+
+    QueueGraph()
+    {
+        for (int queue = 0; queue < QueueCount; queue++) {
+            m_submitted[queue] = 0;
+            m_signaled[queue] = 0;
+
+            for (int other = 0; other < QueueCount; other++) {
+                m_waited[queue][other] = 0;
+            }
+        }
+
+        m_waitCount = 0;
+    }
+
+    // The event a queue signals.  It must start at 0 and only be signaled by the graph.
+    void setQueueEvent(int queue, const Event & event)
+    {
+        m_events[queue] = event;
+    }
+
+    static Submission none(int queue)
+    {
+        return {queue, 0};
+    }
+
+    // Starts the next submission of a queue.  Command buffers outside the graph may be committed
+    // to the queue in between, but every submission begun has to be signaled and committed in
+    // the order it was begun, or the submissions depending on it wait forever.
+    Submission begin(int queue)
+    {
+        return {queue, ++m_submitted[queue]};
+    }
+
+    // Makes the commands encoded from here on into a command buffer of a queue wait for a
+    // dependency.  Returns whether a wait was encoded: dependencies on the same queue, on nothing
+    // and on submissions an earlier wait of the queue already covers need none, since a queue
+    // runs its command buffers in order.  Must not be called while an encoder is active.
+    bool wait(CommandBuffer & commandBuffer, int queue, const Submission & dependency)
+    {
+        uint64_t & waited = m_waited[queue][dependency.queue];
+
+        if (dependency.queue == queue || dependency.value <= waited) {
+            return false;
+        }
+
+        commandBuffer.encodeWaitForEvent(m_events[dependency.queue], dependency.value);
+
+        waited = dependency.value;
+        m_waitCount++;
+
+        return true;
+    }
+
+    // Signals a submission once everything encoded into its command buffer so far has completed.
+    // Call after the submission's last command and before committing.
+    void signal(CommandBuffer & commandBuffer, const Submission & submission)
+    {
+        commandBuffer.encodeSignalEvent(m_events[submission.queue], submission.value);
+
+        m_signaled[submission.queue] = submission.value;
+    }
+
+    // Newest submission of a queue that was signaled, for dependencies on the queue's latest work
+    Submission lastSignaled(int queue) const
+    {
+        return {queue, m_signaled[queue]};
+    }
+
+    // Waits encoded since the graph was created
+    uint64_t waitCount() const
+    {
+        return m_waitCount;
+    }
+
+private:
+
+    Event m_events[QueueCount];
+
+    uint64_t m_submitted[QueueCount];
+    uint64_t m_signaled[QueueCount];
+
+    // Newest value of the second queue an earlier submission of the first one waited for
+    uint64_t m_waited[QueueCount][QueueCount];
+
+    uint64_t m_waitCount;
+};
+
+#endif /* SDSM_QueueGraph_h */
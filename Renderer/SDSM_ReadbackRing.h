@@ -0,0 +1,90 @@
+//
+//  SDSM_ReadbackRing.h
+//  DeferredLighting C++
+//
+//  Bookkeeping for reduction results the CPU reads back from the GPU.  Every frame writes its
+//  results to its own slot, and the GPU marks the slot completed from a command buffer completed
+//  handler.  The CPU then always consumes the newest completed slot instead of waiting for the
+//  frame it just encoded, so it never stalls and never reads a buffer the GPU is still writing.
+//
+
+#ifndef SDSM_ReadbackRing_h
+#define SDSM_ReadbackRing_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+template <size_t SlotCount>
+class ReadbackRing
+{
+public:
+
+    ReadbackRing()
+    : m_lastSerial(0)
+    {
+        for (size_t i = 0; i < SlotCount; i++) {
+            m_completedSerials[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Slot written by the frame with the given serial
+    static size_t slot(uint64_t serial)
+    {
+        return serial % SlotCount;
+    }
+
+    // Serial the next call to beginWrite returns.  Its slot is never in use by the GPU once the
+    // frame has passed the in flight semaphore, so it is safe to read before beginWrite resets it.
+    uint64_t nextSerial() const
+    {
+        return m_lastSerial + 1;
+    }
+
+    // Claims the slot of the next frame and returns the frame's serial.  The caller must only do
+    // this once the GPU has finished the frame that last used the slot.
+    uint64_t beginWrite()
+    {
+        uint64_t serial = ++m_lastSerial;
+
+        m_completedSerials[slot(serial)].store(0, std::memory_order_relaxed);
+
+        return serial;
+    }
+
+    // Marks the results of a frame as readable.  Called from the thread running completed handlers.
+    void complete(uint64_t serial)
+    {
+        m_completedSerials[slot(serial)].store(serial, std::memory_order_release);
+    }
+
+    // Finds the newest frame whose results are readable.  Returns false if no frame completed yet.
+    bool newestCompleted(uint64_t & serial) const
+    {
+        serial = 0;
+
+        for (size_t i = 0; i < SlotCount; i++) {
+            uint64_t completedSerial = m_completedSerials[i].load(std::memory_order_acquire);
+
+            if (completedSerial > serial) {
+                serial = completedSerial;
+            }
+        }
+
+        return serial != 0;
+    }
+
+    // Number of frames between the frame that produced a result and the next frame to be written
+    uint64_t age(uint64_t serial) const
+    {
+        return nextSerial() - serial;
+    }
+
+private:
+
+    std::atomic<uint64_t> m_completedSerials[SlotCount];
+
+    uint64_t m_lastSerial;
+};
+
+#endif /* SDSM_ReadbackRing_h */
@@ -0,0 +1,419 @@
+//
+//  SDSM_Reduction.h
+//  DeferredLighting C++
+//
+//  CPU reference implementations of the SDSM reductions in SDSM.metal.  They run over a float
+//  depth image laid out like m_depth_GBuffer (eye space depth, 0 for empty pixels) and produce
+//  the same ordered float encoded results as the kernels, so GPU output can be checked against
+//  them and the reductions can be profiled on machines without a Metal device.
+//
+
+#ifndef SDSM_Reduction_h
+#define SDSM_Reduction_h
+
+#include <stdint.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+#include "Shaders/SDSMShared.h"
+
+// Min and max depth of m_minMaxDepthBuffer in the ordered float encoding of encodeOrderedFloat,
+// plus the number of global atomic operations the matching kernel issues to produce them
+struct DepthReductionResult
+{
+    int minDepth;
+    int maxDepth;
+    uint64_t atomicCount;
+};
+
+// Mirrors reduce_min_max_depth: every pixel issues one atomic max and, if not empty, one atomic min
+inline DepthReductionResult reduceMinMaxDepthAtomic(const float *depth,
+                                                    uint32_t width, uint32_t height,
+                                                    int initialMin, int initialMax)
+{
+    DepthReductionResult result = {initialMin, initialMax, 0};
+
+    for (uint32_t i = 0; i < width * height; i++) {
+        int depthInt = encodeOrderedFloat(depth[i]);
+
+        result.maxDepth = std::max(result.maxDepth, depthInt);
+        result.atomicCount++;
+
+        if (depthInt > 0) {
+            result.minDepth = std::min(result.minDepth, depthInt);
+            result.atomicCount++;
+        }
+    }
+
+    return result;
+}
+
+// Mirrors reduce_min_max_depth_hierarchical: pixels are reduced per threadgroup sized tile and
+// only the tile result reaches the global atomics
+inline DepthReductionResult reduceMinMaxDepthHierarchical(const float *depth,
+                                                          uint32_t width, uint32_t height,
+                                                          int initialMin, int initialMax,
+                                                          uint32_t threadgroupSize = SDSM_REDUCTION_THREADGROUP_SIZE)
+{
+    DepthReductionResult result = {initialMin, initialMax, 0};
+
+    for (uint32_t tileY = 0; tileY < height; tileY += threadgroupSize) {
+        for (uint32_t tileX = 0; tileX < width; tileX += threadgroupSize) {
+            int tileMin = INT_MAX;
+            int tileMax = INT_MIN;
+
+            uint32_t endY = std::min(tileY + threadgroupSize, height);
+            uint32_t endX = std::min(tileX + threadgroupSize, width);
+
+            for (uint32_t y = tileY; y < endY; y++) {
+                for (uint32_t x = tileX; x < endX; x++) {
+                    int depthInt = encodeOrderedFloat(depth[y * width + x]);
+
+                    tileMax = std::max(tileMax, depthInt);
+
+                    if (depthInt > 0) {
+                        tileMin = std::min(tileMin, depthInt);
+                    }
+                }
+            }
+
+            result.maxDepth = std::max(result.maxDepth, tileMax);
+            result.atomicCount++;
+
+            if (tileMin != INT_MAX) {
+                result.minDepth = std::min(result.minDepth, tileMin);
+                result.atomicCount++;
+            }
+        }
+    }
+
+    return result;
+}
+
+// Prepares a histogram of DepthHistogramLength ints for reduce_depth_histogram
+inline void resetDepthHistogram(int *histogram, float nearPlane, float farPlane)
+{
+    histogram[DepthHistogramMinDepth] = encodeOrderedFloat(farPlane);
+    histogram[DepthHistogramMaxDepth] = encodeOrderedFloat(nearPlane);
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        int *binData = histogram + DepthHistogramBins + bin * DepthHistogramBinStride;
+
+        binData[DepthHistogramBinCount] = 0;
+        resetBoundingBox(binData + DepthHistogramBinBoundingBox);
+    }
+}
+
+// Adds one sample to a histogram the way reduce_depth_histogram does.  toLightSpace(x, y, depth,
+// position) has to write the light space position of the sample at pixel (x, y) into position[3].
+template <typename LightSpaceTransform>
+inline void addDepthHistogramSample(uint32_t x, uint32_t y, float sampleDepth,
+                                    float nearPlane, float farPlane,
+                                    LightSpaceTransform & toLightSpace, int *histogram)
+{
+    int depthInt = encodeOrderedFloat(sampleDepth);
+
+    histogram[DepthHistogramMinDepth] = std::min(histogram[DepthHistogramMinDepth], depthInt);
+    histogram[DepthHistogramMaxDepth] = std::max(histogram[DepthHistogramMaxDepth], depthInt);
+
+    float position[3];
+    toLightSpace(x, y, sampleDepth, position);
+
+    int sampleBox[6];
+    for (int axis = 0; axis < 3; axis++) {
+        sampleBox[axis] = encodeOrderedFloat(position[axis]);
+        sampleBox[axis + 3] = sampleBox[axis];
+    }
+
+    int *binData = histogram + DepthHistogramBins +
+        depthHistogramBin(sampleDepth, nearPlane, farPlane) * DepthHistogramBinStride;
+
+    binData[DepthHistogramBinCount]++;
+    mergeBoundingBox(binData + DepthHistogramBinBoundingBox, sampleBox);
+}
+
+// CPU reference of reduce_depth_histogram.  toLightSpace is called as for addDepthHistogramSample.
+// The histogram must have been reset with resetDepthHistogram.  Returns the number of global
+// atomics the kernel issues.
+template <typename LightSpaceTransform>
+inline uint64_t reduceDepthHistogram(const float *depth, uint32_t width, uint32_t height,
+                                     float nearPlane, float farPlane,
+                                     LightSpaceTransform toLightSpace, int *histogram)
+{
+    uint64_t atomicCount = 0;
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            float sampleDepth = depth[y * width + x];
+            if (sampleDepth < 1e-6) {
+                continue;
+            }
+
+            addDepthHistogramSample(x, y, sampleDepth, nearPlane, farPlane, toLightSpace, histogram);
+
+            atomicCount += 9;
+        }
+    }
+
+    return atomicCount;
+}
+
+// Merges a partial histogram into a histogram like the last step of reduce_depth_histogram_tile.
+// Entries of the partial histogram that no sample reached are skipped.  Returns the number of
+// device atomics the merge issues.
+inline uint64_t mergeDepthHistogram(const int *partialHistogram, float nearPlane, float farPlane,
+                                    int *histogram)
+{
+    uint64_t atomicCount = 0;
+
+    for (int i = 0; i < DepthHistogramLength; i++) {
+        int value = partialHistogram[i];
+
+        if (value == depthHistogramResetValue(i, nearPlane, farPlane)) {
+            continue;
+        }
+
+        switch (depthHistogramMergeOp(i)) {
+            case DepthHistogramMergeMin:
+                histogram[i] = std::min(histogram[i], value);
+                break;
+            case DepthHistogramMergeMax:
+                histogram[i] = std::max(histogram[i], value);
+                break;
+            case DepthHistogramMergeAdd:
+                histogram[i] += value;
+                break;
+        }
+
+        atomicCount++;
+    }
+
+    return atomicCount;
+}
+
+// CPU reference of reduce_depth_histogram_tile.  The image is split into tiles of tileSize pixels
+// square, each tile is reduced into a partial histogram with the layout of the frame histogram,
+// and the partial histograms are merged with mergeDepthHistogram.  The result is identical to
+// reduceDepthHistogram's.  The histogram must have been reset with resetDepthHistogram.  Returns
+// the number of device atomics the kernel issues.
+template <typename LightSpaceTransform>
+inline uint64_t reduceDepthHistogramTiled(const float *depth, uint32_t width, uint32_t height,
+                                          float nearPlane, float farPlane,
+                                          LightSpaceTransform toLightSpace, int *histogram,
+                                          uint32_t tileSize = SDSM_REDUCTION_TILE_SIZE)
+{
+    uint64_t atomicCount = 0;
+
+    int tileHistogram[DepthHistogramLength];
+
+    for (uint32_t tileY = 0; tileY < height; tileY += tileSize) {
+        for (uint32_t tileX = 0; tileX < width; tileX += tileSize) {
+            resetDepthHistogram(tileHistogram, nearPlane, farPlane);
+
+            uint32_t endY = std::min(tileY + tileSize, height);
+            uint32_t endX = std::min(tileX + tileSize, width);
+
+            for (uint32_t y = tileY; y < endY; y++) {
+                for (uint32_t x = tileX; x < endX; x++) {
+                    float sampleDepth = depth[y * width + x];
+                    if (sampleDepth < 1e-6) {
+                        continue;
+                    }
+
+                    addDepthHistogramSample(x, y, sampleDepth, nearPlane, farPlane, toLightSpace, tileHistogram);
+                }
+            }
+
+            atomicCount += mergeDepthHistogram(tileHistogram, nearPlane, farPlane, histogram);
+        }
+    }
+
+    return atomicCount;
+}
+
+// Light space bounding boxes of all cascades, 6 floats each, from a reduced histogram
+inline void cascadeBoundsFromDepthHistogram(const int *histogram, float nearPlane, float farPlane,
+                                            const float *cascadeEnds, int cascadeCount,
+                                            float *boundingBoxes)
+{
+    for (int i = 0; i < cascadeCount; i++) {
+        cascadeBoundsFromDepthHistogram(histogram, nearPlane, farPlane,
+                                        cascadeEnds[i], cascadeEnds[i + 1], boundingBoxes + 6 * i);
+    }
+}
+
+// Histogram of a captured depth image without light space bounds, enough to evaluate partitionings
+inline void depthHistogramFromImage(const float *depth, uint32_t width, uint32_t height,
+                                    float nearPlane, float farPlane, int *histogram)
+{
+    resetDepthHistogram(histogram, nearPlane, farPlane);
+
+    reduceDepthHistogram(depth, width, height, nearPlane, farPlane,
+                         [](uint32_t, uint32_t, float, float *position) {
+                             position[0] = position[1] = position[2] = 0.0f;
+                         },
+                         histogram);
+}
+
+// Mean perspective aliasing of a partitioning over the samples of a histogram.  A cascade's texels
+// cover about as much as the view frustum is wide at the cascade's far split, and a screen pixel
+// covers the frustum width at the sample's depth, so each sample contributes farSplit / depth.
+// 1 is the ideal; the value is only meant to compare partitionings of the same histogram.
+inline float partitioningAliasingError(const int *histogram, float nearPlane, float farPlane,
+                                       const float *cascadeEnds, int cascadeCount)
+{
+    double error = 0.0;
+    int sampleCount = 0;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        int binCount = histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+        if (binCount == 0) {
+            continue;
+        }
+
+        float depth = nearPlane * powf(farPlane / nearPlane, ((float)bin + 0.5f) / (float)SDSM_HISTOGRAM_BIN_COUNT);
+
+        int cascade = 0;
+        while (cascade < cascadeCount - 1 && depth > cascadeEnds[cascade + 1]) {
+            cascade++;
+        }
+
+        error += (double)binCount * std::max(cascadeEnds[cascade + 1] / depth, 1.0f);
+        sampleCount += binCount;
+    }
+
+    return sampleCount > 0 ? (float)(error / sampleCount) : 0.0f;
+}
+
+// Mirrors reduce_light_frustum: every pixel goes into the cascade whose splits enclose its depth.
+// toLightSpace is called as for addDepthHistogramSample.  The cascadeCount boxes, 6 ints each,
+// must have been reset with resetBoundingBox.  Returns the number of global atomics the kernel
+// issues.
+template <typename LightSpaceTransform>
+inline uint64_t reduceLightFrustum(const float *depth, uint32_t width, uint32_t height,
+                                   const float *cascadeEnds, int cascadeCount,
+                                   LightSpaceTransform toLightSpace, int *boundingBoxes)
+{
+    uint64_t atomicCount = 0;
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            float sampleDepth = depth[y * width + x];
+            if (sampleDepth < 1e-6) {
+                continue;
+            }
+
+            float position[3];
+            toLightSpace(x, y, sampleDepth, position);
+
+            int sampleBox[6];
+            for (int axis = 0; axis < 3; axis++) {
+                sampleBox[axis] = encodeOrderedFloat(position[axis]);
+                sampleBox[axis + 3] = sampleBox[axis];
+            }
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (sampleDepth > cascadeEnds[i] && sampleDepth < cascadeEnds[i + 1]) {
+                    mergeBoundingBox(boundingBoxes + 6 * i, sampleBox);
+                    atomicCount += 6;
+                }
+            }
+        }
+    }
+
+    return atomicCount;
+}
+
+// CPU reference of reduce_light_frustum_sparse for one frame's SparseReductionParams.  Arguments
+// are as for reduceLightFrustum.  Returns the number of global atomics the kernel issues.
+template <typename LightSpaceTransform>
+inline uint64_t reduceLightFrustumSparse(const float *depth, uint32_t width, uint32_t height,
+                                         const float *cascadeEnds, int cascadeCount,
+                                         const SparseReductionParams & params,
+                                         LightSpaceTransform toLightSpace, int *boundingBoxes)
+{
+    uint64_t atomicCount = 0;
+
+    for (uint32_t y = params.offsetY; y < height; y += params.stride) {
+        for (uint32_t x = params.offsetX; x < width; x += params.stride) {
+            float sampleDepth = depth[y * width + x];
+            if (sampleDepth < 1e-6) {
+                continue;
+            }
+
+            float padding = sampleDepth * params.padding;
+
+            float position[3];
+            toLightSpace(x, y, sampleDepth, position);
+
+            int sampleBox[6];
+            for (int axis = 0; axis < 3; axis++) {
+                sampleBox[axis] = encodeOrderedFloat(position[axis] - padding);
+                sampleBox[axis + 3] = encodeOrderedFloat(position[axis] + padding);
+            }
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (sampleDepth + padding > cascadeEnds[i] && sampleDepth - padding < cascadeEnds[i + 1]) {
+                    mergeBoundingBox(boundingBoxes + 6 * i, sampleBox);
+                    atomicCount += 6;
+                }
+            }
+        }
+    }
+
+    return atomicCount;
+}
+
+// Samples the full rate reduction puts into a cascade, and how many of them lie outside that
+// cascade's box of a sparse reduction
+struct SparseBoundsCoverage
+{
+    uint64_t sampleCount;
+    uint64_t missCount;
+};
+
+// Checks bounds produced by reduceLightFrustumSparse, decoded to 6 floats per cascade and possibly
+// merged over several frames, against every sample of a depth image.  Arguments are otherwise as
+// for reduceLightFrustum.  A miss is a sample the shadow maps fitted to the sparse bounds would not
+// cover.
+template <typename LightSpaceTransform>
+inline SparseBoundsCoverage sparseBoundsCoverage(const float *depth, uint32_t width, uint32_t height,
+                                                 const float *cascadeEnds, int cascadeCount,
+                                                 LightSpaceTransform toLightSpace, const float *sparseBoundingBoxes)
+{
+    SparseBoundsCoverage coverage = {0, 0};
+
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            float sampleDepth = depth[y * width + x];
+            if (sampleDepth < 1e-6) {
+                continue;
+            }
+
+            float position[3];
+            toLightSpace(x, y, sampleDepth, position);
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (!(sampleDepth > cascadeEnds[i] && sampleDepth < cascadeEnds[i + 1])) {
+                    continue;
+                }
+
+                const float *box = sparseBoundingBoxes + 6 * i;
+
+                coverage.sampleCount++;
+
+                for (int axis = 0; axis < 3; axis++) {
+                    if (position[axis] < box[axis] || position[axis] > box[axis + 3]) {
+                        coverage.missCount++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return coverage;
+}
+
+#endif /* SDSM_Reduction_h */
@@ -0,0 +1,215 @@
+//
+//  SDSM_ShadowAtlas.h
+//  DeferredLighting C++
+//
+//  Packs the cascades into one shadow atlas and sizes them under a texel budget.  Each cascade
+//  gets a square whose edge follows its share of the screen and its aliasing error, the sizes are
+//  kept from frame to frame until they drift far enough from the ideal, and the squares are
+//  packed onto shelves of the atlas.  Everything here is plain C++ with deterministic results.
+//
+
+#ifndef SDSM_ShadowAtlas_h
+#define SDSM_ShadowAtlas_h
+
+#include <math.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+#include "Shaders/SDSMShared.h"
+
+// Square region of the atlas a cascade renders into, in texels
+struct ShadowAtlasRect
+{
+    int x;
+    int y;
+    int size;
+};
+
+// Relative importance of a cascade's resolution.  The aliasing error of gbuffer_fragment's
+// VISUALIZE_ALIASING_ERROR mode is (end - start) / depth divided by the cascade resolution, up to
+// factors common to all cascades, and it is worst at the cascade's near split.  It is weighted by
+// the fraction of screen samples in the cascade, taken from a depth histogram when there is one.
+inline void shadowAtlasWeights(const int *histogram /* may be null */, float nearPlane, float farPlane,
+                               const float *cascadeEnds, int cascadeCount, float *weights)
+{
+    float coverage[MAX_CASCADED_SHADOW_COUNT];
+    float sampleCount = 0.0f;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        coverage[i] = 0.0f;
+    }
+
+    if (histogram) {
+        for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+            float binCount = (float)histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+            if (binCount == 0.0f) {
+                continue;
+            }
+
+            float binCenter = SDSM_SQRT(SDSM_MAX(depthHistogramBinStart(bin, nearPlane, farPlane), nearPlane) *
+                                        SDSM_MIN(depthHistogramBinStart(bin + 1, nearPlane, farPlane), farPlane));
+
+            int cascade = 0;
+            while (cascade < cascadeCount - 1 && binCenter >= cascadeEnds[cascade + 1]) {
+                cascade++;
+            }
+
+            coverage[cascade] += binCount;
+            sampleCount += binCount;
+        }
+    }
+
+    for (int i = 0; i < cascadeCount; i++) {
+        float cascadeCoverage = sampleCount > 0.0f ? coverage[i] / sampleCount : 1.0f / cascadeCount;
+        float start = std::max(cascadeEnds[i], nearPlane);
+
+        weights[i] = cascadeCoverage * std::max(cascadeEnds[i + 1] - cascadeEnds[i], 0.0f) / start;
+    }
+}
+
+// Edge lengths minimizing the total weighted aliasing error sum(weight / size) for a total area
+// sum(size^2) of texelBudget.  The optimum has size proportional to the cube root of the weight.
+// Sizes are rounded down to the granularity and clamped to [minSize, maxSize].
+inline void solveShadowAtlasSizes(const float *weights, int cascadeCount, float texelBudget,
+                                  int minSize, int maxSize, int granularity, int *sizes)
+{
+    float norm = 0.0f;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        norm += powf(std::max(weights[i], 0.0f), 2.0f / 3.0f);
+    }
+
+    for (int i = 0; i < cascadeCount; i++) {
+        float size = norm > 0.0f ?
+            sqrtf(texelBudget / norm) * cbrtf(std::max(weights[i], 0.0f)) :
+            sqrtf(texelBudget / cascadeCount);
+
+        int snapped = (int)size / granularity * granularity;
+
+        sizes[i] = std::min(std::max(snapped, minSize), maxSize);
+    }
+}
+
+// Packs squares onto shelves, largest first.  Each shelf is as tall as its first square and
+// squares go left to right until the row is full.  Returns false if they do not fit the atlas.
+inline bool packShadowAtlas(const int *sizes, int cascadeCount, int atlasSize, ShadowAtlasRect *rects)
+{
+    int order[MAX_CASCADED_SHADOW_COUNT];
+
+    for (int i = 0; i < cascadeCount; i++) {
+        order[i] = i;
+    }
+
+    // Ties keep the cascade order so the layout only depends on the sizes
+    std::stable_sort(order, order + cascadeCount, [sizes](int a, int b) { return sizes[a] > sizes[b]; });
+
+    int shelfY = 0;
+    int shelfHeight = 0;
+    int x = 0;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        int size = sizes[order[i]];
+
+        if (x + size > atlasSize) {
+            shelfY += shelfHeight;
+            shelfHeight = 0;
+            x = 0;
+        }
+
+        if (x + size > atlasSize || shelfY + size > atlasSize) {
+            return false;
+        }
+
+        rects[order[i]] = {x, shelfY, size};
+
+        shelfHeight = std::max(shelfHeight, size);
+        x += size;
+    }
+
+    return true;
+}
+
+// Keeps the atlas layout of the cascades across frames
+class ShadowAtlasAllocator
+{
+public:
+
+    ShadowAtlasAllocator(int atlasSize, float texelBudget,
+                         int minSize = 64, int granularity = 32, float hysteresis = 0.2f)
+    : m_atlasSize(atlasSize)
+    , m_texelBudget(texelBudget)
+    , m_minSize(std::min(minSize, atlasSize / MAX_CASCADED_SHADOW_COUNT))
+    , m_granularity(granularity)
+    , m_hysteresis(hysteresis)
+    , m_cascadeCount(0)
+    {
+    }
+
+    // Resizes and repacks the cascades for this frame's weights.  The previous layout is kept while
+    // the cascade count is unchanged and no cascade's ideal size moved by more than the hysteresis
+    // fraction, so the cascades do not shimmer from small changes.  Returns true if the layout changed.
+    bool update(const float *weights, int cascadeCount)
+    {
+        int sizes[MAX_CASCADED_SHADOW_COUNT];
+
+        solveShadowAtlasSizes(weights, cascadeCount, m_texelBudget,
+                              m_minSize, m_atlasSize, m_granularity, sizes);
+
+        if (cascadeCount == m_cascadeCount) {
+            bool drifted = false;
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (fabsf((float)(sizes[i] - m_idealSizes[i])) > m_hysteresis * m_idealSizes[i]) {
+                    drifted = true;
+                }
+            }
+
+            if (!drifted) {
+                return false;
+            }
+        }
+
+        for (int i = 0; i < cascadeCount; i++) {
+            m_idealSizes[i] = sizes[i];
+        }
+
+        // Shrink everything until it packs.  The minimum size is capped so that every cascade at
+        // minimum size fits into one row, which ends the loop.
+        float budget = m_texelBudget;
+
+        while (!packShadowAtlas(sizes, cascadeCount, m_atlasSize, m_rects)) {
+            budget *= 0.9f;
+            solveShadowAtlasSizes(weights, cascadeCount, budget,
+                                  m_minSize, m_atlasSize, m_granularity, sizes);
+        }
+
+        m_cascadeCount = cascadeCount;
+
+        return true;
+    }
+
+    const ShadowAtlasRect & rect(int cascade) const
+    {
+        return m_rects[cascade];
+    }
+
+    int atlasSize() const
+    {
+        return m_atlasSize;
+    }
+
+private:
+
+    int m_atlasSize;
+    float m_texelBudget;
+    int m_minSize;
+    int m_granularity;
+    float m_hysteresis;
+
+    // Sizes the current layout was solved for, before shrinking them to fit
+    int m_cascadeCount;
+    int m_idealSizes[MAX_CASCADED_SHADOW_COUNT];
+    ShadowAtlasRect m_rects[MAX_CASCADED_SHADOW_COUNT];
+};
+
+#endif /* SDSM_ShadowAtlas_h */
@@ -0,0 +1,205 @@
+//
+//  SDSM_ShadowCache.h
+//  DeferredLighting C++
+//
+//  Keeps the contents of the shadow cascades across frames.  A cascade whose matrix and shadow
+//  map region did not change since it was rendered keeps its texels and its old matrix, so with a
+//  fixed light and a still camera nothing is re-rendered.  Moving casters only dirty the texels
+//  they cover, which the renderer re-renders with a scissor rectangle.  Plain C++, no Metal.
+//
+
+#ifndef SDSM_ShadowCache_h
+#define SDSM_ShadowCache_h
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+#include "SDSM_Culling.h"
+
+// Texel rectangle in one slice of the shadow map
+struct ShadowCacheRect
+{
+    int slice;
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+inline bool operator==(const ShadowCacheRect & a, const ShadowCacheRect & b)
+{
+    return a.slice == b.slice && a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+inline bool operator!=(const ShadowCacheRect & a, const ShadowCacheRect & b)
+{
+    return !(a == b);
+}
+
+// Smallest rectangle containing both.  Empty rectangles have zero width or height.
+inline ShadowCacheRect unionShadowCacheRects(const ShadowCacheRect & a, const ShadowCacheRect & b)
+{
+    if (a.width <= 0 || a.height <= 0) {
+        return b;
+    }
+
+    if (b.width <= 0 || b.height <= 0) {
+        return a;
+    }
+
+    int x = std::min(a.x, b.x);
+    int y = std::min(a.y, b.y);
+
+    return {a.slice, x, y,
+            std::max(a.x + a.width, b.x + b.width) - x,
+            std::max(a.y + a.height, b.y + b.height) - y};
+}
+
+class ShadowCascadeCache
+{
+public:
+
+    // Matrices are compared element by element.  The default only absorbs float noise, so any
+    // real change of the light or the cascade bounds re-renders the cascade.
+    explicit ShadowCascadeCache(float matrixTolerance = 1e-5f)
+    : m_matrixTolerance(matrixTolerance)
+    {
+        invalidate();
+    }
+
+    // Forgets the contents of every cascade, for example when the shadow map was overwritten
+    void invalidate()
+    {
+        for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            m_entries[i].valid = false;
+            m_entries[i].dirtyRect = {0, 0, 0, 0, 0};
+        }
+    }
+
+    // Whether the cascade's cached texels were rendered with this matrix and region, up to the
+    // tolerance.  The matrix is column major and maps caster space to clip space.
+    bool matches(int cascade, const float *matrix, const ShadowCacheRect & region) const
+    {
+        const Entry & entry = m_entries[cascade];
+
+        if (!entry.valid || entry.region != region) {
+            return false;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            if (fabsf(matrix[i] - entry.matrix[i]) > m_matrixTolerance) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Compares a cascade's shadow matrix and region for this frame with the cached ones.  A
+    // cascade that was never rendered, whose region changed or whose matrix moved by more than
+    // the tolerance becomes fully dirty and takes on the new matrix.  Otherwise it keeps the
+    // matrix it was rendered with, which the caller must keep using for drawing and sampling.
+    void updateCascade(int cascade, const float *matrix, const ShadowCacheRect & region)
+    {
+        Entry & entry = m_entries[cascade];
+
+        if (!matches(cascade, matrix, region)) {
+            memcpy(entry.matrix, matrix, sizeof(entry.matrix));
+            entry.region = region;
+            entry.valid = true;
+            entry.dirtyRect = region;
+        }
+    }
+
+    // Dirties the texels a caster box covers in every cascade.  The box is in the space the
+    // cascade matrices transform from.  A moving caster has to dirty its bounds before and after
+    // the move.  Boxes outside a cascade's region leave it clean.
+    void invalidateCaster(const AxisAlignedBox & casterBox)
+    {
+        for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            Entry & entry = m_entries[i];
+
+            if (!entry.valid) {
+                continue;
+            }
+
+            AxisAlignedBox clipBox = transformAxisAlignedBox(entry.matrix, casterBox);
+
+            // Clip space x and y map to the region with y pointing down, like the texture lookup
+            const ShadowCacheRect & region = entry.region;
+
+            float minX = region.x + (clipBox.min[0] * 0.5f + 0.5f) * region.width;
+            float maxX = region.x + (clipBox.max[0] * 0.5f + 0.5f) * region.width;
+            float minY = region.y + (0.5f - clipBox.max[1] * 0.5f) * region.height;
+            float maxY = region.y + (0.5f - clipBox.min[1] * 0.5f) * region.height;
+
+            int x0 = (int)std::max(floorf(minX), (float)region.x);
+            int y0 = (int)std::max(floorf(minY), (float)region.y);
+            int x1 = (int)std::min(ceilf(maxX), (float)(region.x + region.width));
+            int y1 = (int)std::min(ceilf(maxY), (float)(region.y + region.height));
+
+            if (x1 <= x0 || y1 <= y0) {
+                continue;
+            }
+
+            entry.dirtyRect = unionShadowCacheRects(entry.dirtyRect, {region.slice, x0, y0, x1 - x0, y1 - y0});
+        }
+    }
+
+    bool isDirty(int cascade) const
+    {
+        return m_entries[cascade].dirtyRect.width > 0 && m_entries[cascade].dirtyRect.height > 0;
+    }
+
+    bool isFullyDirty(int cascade) const
+    {
+        return m_entries[cascade].dirtyRect == m_entries[cascade].region;
+    }
+
+    // Texels of the cascade that have to be cleared and re-rendered
+    const ShadowCacheRect & dirtyRect(int cascade) const
+    {
+        return m_entries[cascade].dirtyRect;
+    }
+
+    // Whether the cascade holds texels from an earlier frame
+    bool isValid(int cascade) const
+    {
+        return m_entries[cascade].valid;
+    }
+
+    const ShadowCacheRect & region(int cascade) const
+    {
+        return m_entries[cascade].region;
+    }
+
+    // Matrix the cascade's cached texels were rendered with
+    const float *matrix(int cascade) const
+    {
+        return m_entries[cascade].matrix;
+    }
+
+    // Call once the dirty texels of the cascade have been re-rendered
+    void markRendered(int cascade)
+    {
+        m_entries[cascade].dirtyRect = {0, 0, 0, 0, 0};
+    }
+
+private:
+
+    struct Entry
+    {
+        bool valid;
+        float matrix[16];
+        ShadowCacheRect region;
+        ShadowCacheRect dirtyRect;
+    };
+
+    float m_matrixTolerance;
+
+    Entry m_entries[MAX_CASCADED_SHADOW_COUNT];
+};
+
+#endif /* SDSM_ShadowCache_h */
@@ -0,0 +1,759 @@
+//
+//  SDSM_Simd.h
+//  DeferredLighting C++
+//
+//  The vector and matrix types of <simd/simd.h> for the CPU side of the renderer.  Apple builds
+//  use the SDK header; elsewhere, or with SDSM_SIMD_PORTABLE defined, this provides the subset
+//  AAPLMathUtilities, Camera and the SDSM headers use, under the same names.
+//
+//  The portable math is written once against four float lanes and instantiated for the backend
+//  the compiler targets: SSE (with AVX for matrix products), NEON on AArch64, or plain scalar
+//  code, which can be forced with SDSM_SIMD_SCALAR.  Every backend performs the same IEEE
+//  operations in the same order, so they agree with the scalar reference bit for bit as long as
+//  the compiler does not contract multiplies and adds into FMAs (GCC: -ffp-contract=off when
+//  FMA is available).
+//
+
+#ifndef SDSM_Simd_h
+#define SDSM_Simd_h
+
+#if defined(__APPLE__) && !defined(SDSM_SIMD_PORTABLE)
+
+#include <simd/simd.h>
+
+#else
+
+#ifndef SDSM_SIMD_PORTABLE
+#define SDSM_SIMD_PORTABLE 1
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(SDSM_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define SDSM_SIMD_SSE 1
+#include <immintrin.h>
+#if defined(__AVX__)
+#define SDSM_SIMD_AVX 1
+#endif
+#elif !defined(SDSM_SIMD_SCALAR) && defined(__ARM_NEON) && defined(__aarch64__)
+#define SDSM_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__F16C__) && !SDSM_SIMD_SSE
+#include <immintrin.h>
+#endif
+
+namespace SDSMSimd
+{
+    // Four lanes in plain C++, the reference the other backends must match
+    struct ScalarBackend
+    {
+        struct Lanes { float v[4]; };
+
+        static Lanes load(const float *p) { Lanes r = {{ p[0], p[1], p[2], p[3] }}; return r; }
+        static Lanes load3(const float *p) { Lanes r = {{ p[0], p[1], p[2], 0.0f }}; return r; }
+        static void store(float *p, Lanes a) { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+        static Lanes splat(float s) { Lanes r = {{ s, s, s, s }}; return r; }
+        static Lanes set(float x, float y, float z, float w) { Lanes r = {{ x, y, z, w }}; return r; }
+        static float first(Lanes a) { return a.v[0]; }
+
+        static Lanes add(Lanes a, Lanes b)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i];
+            return r;
+        }
+
+        static Lanes sub(Lanes a, Lanes b)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i];
+            return r;
+        }
+
+        static Lanes mul(Lanes a, Lanes b)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i];
+            return r;
+        }
+
+        static Lanes div(Lanes a, Lanes b)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = a.v[i] / b.v[i];
+            return r;
+        }
+
+        static Lanes sqrt(Lanes a)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = sqrtf(a.v[i]);
+            return r;
+        }
+
+        static Lanes negate(Lanes a)
+        {
+            Lanes r;
+            for (int i = 0; i < 4; i++) r.v[i] = -a.v[i];
+            return r;
+        }
+
+        // Lane 3 set to +0, for three component vectors whose fourth lane is padding
+        static Lanes clearW(Lanes a) { a.v[3] = 0.0f; return a; }
+
+        // Lanes A, B, C and D of a
+        template <int A, int B, int C, int D>
+        static Lanes shuffle(Lanes a) { Lanes r = {{ a.v[A], a.v[B], a.v[C], a.v[D] }}; return r; }
+    };
+
+#if SDSM_SIMD_SSE
+    struct SSEBackend
+    {
+        typedef __m128 Lanes;
+
+        static Lanes load(const float *p) { return _mm_loadu_ps(p); }
+        static Lanes load3(const float *p) { return _mm_loadu_ps(p); }
+        static void store(float *p, Lanes a) { _mm_storeu_ps(p, a); }
+        static Lanes splat(float s) { return _mm_set1_ps(s); }
+        static Lanes set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+        static float first(Lanes a) { return _mm_cvtss_f32(a); }
+        static Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+        static Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+        static Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+        static Lanes div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+        static Lanes sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+        static Lanes negate(Lanes a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+        static Lanes clearW(Lanes a) { return _mm_and_ps(a, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1))); }
+
+        template <int A, int B, int C, int D>
+        static Lanes shuffle(Lanes a) { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(D, C, B, A)); }
+    };
+
+    typedef SSEBackend NativeBackend;
+#elif SDSM_SIMD_NEON
+    struct NEONBackend
+    {
+        typedef float32x4_t Lanes;
+
+        static Lanes load(const float *p) { return vld1q_f32(p); }
+        static Lanes load3(const float *p) { return vld1q_f32(p); }
+        static void store(float *p, Lanes a) { vst1q_f32(p, a); }
+        static Lanes splat(float s) { return vdupq_n_f32(s); }
+        static Lanes set(float x, float y, float z, float w) { Lanes r = { x, y, z, w }; return r; }
+        static float first(Lanes a) { return vgetq_lane_f32(a, 0); }
+        static Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+        static Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+        static Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+        static Lanes div(Lanes a, Lanes b) { return vdivq_f32(a, b); }
+        static Lanes sqrt(Lanes a) { return vsqrtq_f32(a); }
+        static Lanes negate(Lanes a) { return vnegq_f32(a); }
+        static Lanes clearW(Lanes a) { return vsetq_lane_f32(0.0f, a, 3); }
+
+        template <int A, int B, int C, int D>
+        static Lanes shuffle(Lanes a)
+        {
+            Lanes r = { vgetq_lane_f32(a, A), vgetq_lane_f32(a, B), vgetq_lane_f32(a, C), vgetq_lane_f32(a, D) };
+            return r;
+        }
+    };
+
+    typedef NEONBackend NativeBackend;
+#else
+    typedef ScalarBackend NativeBackend;
+#endif
+
+    // The first N lanes; whatever follows a three component vector is left out of the scalar
+    // lanes, where reading it would read padding no one wrote
+    template <class B, int N>
+    inline typename B::Lanes load(const float *p)
+    {
+        return N == 3 ? B::load3(p) : B::load(p);
+    }
+
+    // Sum of the products of the first N lanes, added pairwise: (x + y) + (z + w).  Every lane
+    // of the result holds the sum, since addition commutes.
+    template <class B, int N>
+    inline typename B::Lanes dotLanes(typename B::Lanes a, typename B::Lanes b)
+    {
+        typename B::Lanes p = B::mul(a, b);
+        if (N == 3) p = B::clearW(p);
+        p = B::add(p, B::template shuffle<1, 0, 3, 2>(p));
+        return B::add(p, B::template shuffle<2, 3, 0, 1>(p));
+    }
+
+    template <class B, int N>
+    inline float dot(const float *a, const float *b)
+    {
+        return B::first(dotLanes<B, N>(load<B, N>(a), load<B, N>(b)));
+    }
+
+    // v / sqrt(dot(v, v)) without leaving the vector registers: the length is already in every
+    // lane, where a scalar sqrtf would have to be moved out and broadcast back
+    template <class B, int N>
+    inline void normalize(const float *v, float *result)
+    {
+        typename B::Lanes a = load<B, N>(v);
+        B::store(result, B::div(a, B::sqrt(dotLanes<B, N>(a, a))));
+    }
+
+    template <class B>
+    inline float dot3(typename B::Lanes a, typename B::Lanes b)
+    {
+        return B::first(dotLanes<B, 3>(a, b));
+    }
+
+    // Lane 3 of the result is undefined
+    template <class B>
+    inline typename B::Lanes cross(typename B::Lanes a, typename B::Lanes b)
+    {
+        return B::sub(B::mul(B::template shuffle<1, 2, 0, 3>(a), B::template shuffle<2, 0, 1, 3>(b)),
+                      B::mul(B::template shuffle<2, 0, 1, 3>(a), B::template shuffle<1, 2, 0, 3>(b)));
+    }
+
+    // Columns are four floats apart whatever N is, as in matrix_float3x3 and matrix_float4x4.
+    // result = ((c0 * v.x + c1 * v.y) + c2 * v.z) + c3 * v.w, with v loaded once and its lanes
+    // broadcast in registers; splatting each one from memory costs a load per lane on top of the
+    // same shuffle
+    template <class B, int N>
+    inline void transform(const float *columns, const float *v, float *result)
+    {
+        typename B::Lanes lanes = load<B, N>(v);
+        typename B::Lanes r = B::mul(load<B, N>(columns), B::template shuffle<0, 0, 0, 0>(lanes));
+        r = B::add(r, B::mul(load<B, N>(columns + 4), B::template shuffle<1, 1, 1, 1>(lanes)));
+        r = B::add(r, B::mul(load<B, N>(columns + 8), B::template shuffle<2, 2, 2, 2>(lanes)));
+        if (N == 4) r = B::add(r, B::mul(load<B, N>(columns + 12), B::template shuffle<3, 3, 3, 3>(lanes)));
+        B::store(result, r);
+    }
+
+    template <class B, int N>
+    inline void multiply(const float *a, const float *b, float *result)
+    {
+        for (int i = 0; i < N; i++) {
+            transform<B, N>(a, b + 4 * i, result + 4 * i);
+        }
+    }
+
+#if SDSM_SIMD_AVX
+    // Two columns of the product per instruction, with the same operations as transform
+    inline void multiply4x4AVX(const float *a, const float *b, float *result)
+    {
+        __m256 columns[4];
+        for (int i = 0; i < 4; i++) {
+            columns[i] = _mm256_broadcast_ps((const __m128 *)(a + 4 * i));
+        }
+
+        for (int j = 0; j < 4; j += 2) {
+            __m256 v = _mm256_loadu_ps(b + 4 * j);
+            __m256 r = _mm256_mul_ps(columns[0], _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));
+            r = _mm256_add_ps(r, _mm256_mul_ps(columns[1], _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1))));
+            r = _mm256_add_ps(r, _mm256_mul_ps(columns[2], _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2))));
+            r = _mm256_add_ps(r, _mm256_mul_ps(columns[3], _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3))));
+            _mm256_storeu_ps(result + 4 * j, r);
+        }
+    }
+#endif
+
+    template <int N>
+    inline void transpose(const float *m, float *result)
+    {
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                result[4 * j + i] = m[4 * i + j];
+            }
+        }
+    }
+
+    // The rows of the inverse are the cofactor rows b x c, c x a and a x b of the columns a, b, c
+    // over the determinant
+    template <class B>
+    inline void invert3x3(const float *m, float *result)
+    {
+        typedef typename B::Lanes Lanes;
+
+        Lanes a = B::load3(m), b = B::load3(m + 4), c = B::load3(m + 8);
+        Lanes r0 = cross<B>(b, c);
+        Lanes r1 = cross<B>(c, a);
+        Lanes r2 = cross<B>(a, b);
+        Lanes invDet = B::splat(1.0f / dot3<B>(a, r0));
+
+        float rows[12];
+        B::store(rows, B::mul(r0, invDet));
+        B::store(rows + 4, B::mul(r1, invDet));
+        B::store(rows + 8, B::mul(r2, invDet));
+        transpose<3>(rows, result);
+    }
+
+    // Lengyel's inverse from the 3D parts a, b, c, d of the columns and their w components
+    // x, y, z, w: s = a x b, t = c x d, u = y a - x b and v = w c - z d
+    template <class B>
+    inline void invert4x4(const float *m, float *result)
+    {
+        typedef typename B::Lanes Lanes;
+
+        Lanes a = B::load(m), b = B::load(m + 4), c = B::load(m + 8), d = B::load(m + 12);
+        Lanes x = B::template shuffle<3, 3, 3, 3>(a);
+        Lanes y = B::template shuffle<3, 3, 3, 3>(b);
+        Lanes z = B::template shuffle<3, 3, 3, 3>(c);
+        Lanes w = B::template shuffle<3, 3, 3, 3>(d);
+
+        Lanes s = cross<B>(a, b);
+        Lanes t = cross<B>(c, d);
+        Lanes u = B::sub(B::mul(a, y), B::mul(b, x));
+        Lanes v = B::sub(B::mul(c, w), B::mul(d, z));
+
+        Lanes invDet = B::splat(1.0f / (dot3<B>(s, v) + dot3<B>(t, u)));
+        s = B::mul(s, invDet);
+        t = B::mul(t, invDet);
+        u = B::mul(u, invDet);
+        v = B::mul(v, invDet);
+
+        float rows[16];
+        B::store(rows, B::add(cross<B>(b, v), B::mul(t, y)));
+        B::store(rows + 4, B::sub(cross<B>(v, a), B::mul(t, x)));
+        B::store(rows + 8, B::add(cross<B>(d, u), B::mul(s, w)));
+        B::store(rows + 12, B::sub(cross<B>(u, c), B::mul(s, z)));
+        rows[3] = -dot3<B>(b, t);
+        rows[7] = dot3<B>(a, t);
+        rows[11] = -dot3<B>(d, s);
+        rows[15] = dot3<B>(c, s);
+        transpose<4>(rows, result);
+    }
+
+    // Reads lanes of the enclosing vector as a shorter or reordered vector, as in v.xyz
+    template <typename Vector, int A, int B, int C = -1, int D = -1>
+    struct Swizzle
+    {
+        float lanes[4];
+
+        operator Vector() const
+        {
+            Vector r;
+            r.elements[0] = lanes[A];
+            r.elements[1] = lanes[B];
+            if (C >= 0) r.elements[C >= 0 ? 2 : 0] = lanes[C >= 0 ? C : 0];
+            if (D >= 0) r.elements[D >= 0 ? 3 : 0] = lanes[D >= 0 ? D : 0];
+            return r;
+        }
+
+        // Only writes the selected lanes.  Copying one swizzle to another copies the whole
+        // vector, so convert first: a.xyz = (vector_float3)b.xyz.
+        Swizzle & operator=(const Vector & v)
+        {
+            lanes[A] = v.elements[0];
+            lanes[B] = v.elements[1];
+            if (C >= 0) lanes[C >= 0 ? C : 0] = v.elements[C >= 0 ? 2 : 0];
+            if (D >= 0) lanes[D >= 0 ? D : 0] = v.elements[D >= 0 ? 3 : 0];
+            return *this;
+        }
+    };
+}
+
+struct alignas(8) vector_float2
+{
+    union {
+        struct { float x, y; };
+        float elements[2];
+    };
+
+    float & operator[](int i) { return elements[i]; }
+    float operator[](int i) const { return elements[i]; }
+};
+
+struct alignas(16) vector_float3
+{
+    union {
+        struct { float x, y, z; };
+        float elements[4];
+        SDSMSimd::Swizzle<vector_float2, 0, 1> xy;
+    };
+
+    float & operator[](int i) { return elements[i]; }
+    float operator[](int i) const { return elements[i]; }
+};
+
+struct alignas(16) vector_float4
+{
+    union {
+        struct { float x, y, z, w; };
+        float elements[4];
+        SDSMSimd::Swizzle<vector_float2, 0, 1> xy;
+        SDSMSimd::Swizzle<vector_float2, 0, 3> xw;
+        SDSMSimd::Swizzle<vector_float3, 0, 1, 2> xyz;
+        SDSMSimd::Swizzle<vector_float4, 1, 0, 3, 2> yxwz;
+    };
+
+    float & operator[](int i) { return elements[i]; }
+    float operator[](int i) const { return elements[i]; }
+};
+
+struct matrix_float3x3
+{
+    vector_float3 columns[3];
+};
+
+struct matrix_float4x4
+{
+    vector_float4 columns[4];
+};
+
+typedef vector_float2 simd_float2;
+typedef vector_float3 simd_float3;
+typedef vector_float4 simd_float4;
+typedef matrix_float3x3 simd_float3x3;
+typedef matrix_float4x4 simd_float4x4;
+
+static const matrix_float3x3 matrix_identity_float3x3 = {{
+    { 1.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f } }};
+
+static const matrix_float4x4 matrix_identity_float4x4 = {{
+    { 1.0f, 0.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 0.0f, 1.0f } }};
+
+namespace SDSMSimd
+{
+    struct Add
+    {
+        float operator()(float a, float b) const { return a + b; }
+        NativeBackend::Lanes operator()(NativeBackend::Lanes a, NativeBackend::Lanes b) const { return NativeBackend::add(a, b); }
+    };
+
+    struct Subtract
+    {
+        float operator()(float a, float b) const { return a - b; }
+        NativeBackend::Lanes operator()(NativeBackend::Lanes a, NativeBackend::Lanes b) const { return NativeBackend::sub(a, b); }
+    };
+
+    struct Multiply
+    {
+        float operator()(float a, float b) const { return a * b; }
+        NativeBackend::Lanes operator()(NativeBackend::Lanes a, NativeBackend::Lanes b) const { return NativeBackend::mul(a, b); }
+    };
+
+    struct Divide
+    {
+        float operator()(float a, float b) const { return a / b; }
+        NativeBackend::Lanes operator()(NativeBackend::Lanes a, NativeBackend::Lanes b) const { return NativeBackend::div(a, b); }
+    };
+
+    // Stored whole for the same reason as vector3 and vector4: the operator that loads it next
+    // would stall on lane by lane stores
+    template <class Vector>
+    inline Vector splat(float s)
+    {
+        Vector r;
+        NativeBackend::store(r.elements, NativeBackend::splat(s));
+        return r;
+    }
+
+    template <>
+    inline vector_float2 splat<vector_float2>(float s)
+    {
+        vector_float2 r = { s, s };
+        return r;
+    }
+
+    template <class Op>
+    inline vector_float2 lanewise(vector_float2 a, vector_float2 b, Op op)
+    {
+        vector_float2 r = { op(a.x, b.x), op(a.y, b.y) };
+        return r;
+    }
+
+    template <class Op>
+    inline vector_float3 lanewise(const vector_float3 &a, const vector_float3 &b, Op op)
+    {
+        vector_float3 r;
+        NativeBackend::store(r.elements, op(load<NativeBackend, 3>(a.elements), load<NativeBackend, 3>(b.elements)));
+        return r;
+    }
+
+    template <class Op>
+    inline vector_float4 lanewise(const vector_float4 &a, const vector_float4 &b, Op op)
+    {
+        vector_float4 r;
+        NativeBackend::store(r.elements, op(NativeBackend::load(a.elements), NativeBackend::load(b.elements)));
+        return r;
+    }
+}
+
+#define SDSM_SIMD_ARITHMETIC(Vector, op, Op)                                                                    \
+    inline Vector operator op(Vector a, Vector b) { return SDSMSimd::lanewise(a, b, SDSMSimd::Op()); }           \
+    inline Vector operator op(Vector a, float s) { return a op SDSMSimd::splat<Vector>(s); }                     \
+    inline Vector operator op(float s, Vector a) { return SDSMSimd::splat<Vector>(s) op a; }                     \
+    inline Vector & operator op##=(Vector &a, Vector b) { return a = a op b; }                                   \
+    inline Vector & operator op##=(Vector &a, float s) { return a = a op s; }
+
+#define SDSM_SIMD_VECTOR_OPERATORS(Vector)                                                                      \
+    SDSM_SIMD_ARITHMETIC(Vector, +, Add)                                                                         \
+    SDSM_SIMD_ARITHMETIC(Vector, -, Subtract)                                                                    \
+    SDSM_SIMD_ARITHMETIC(Vector, *, Multiply)                                                                    \
+    SDSM_SIMD_ARITHMETIC(Vector, /, Divide)                                                                      \
+    inline Vector operator-(Vector a) { for (float &e : a.elements) e = -e; return a; }
+
+SDSM_SIMD_VECTOR_OPERATORS(vector_float2)
+SDSM_SIMD_VECTOR_OPERATORS(vector_float3)
+SDSM_SIMD_VECTOR_OPERATORS(vector_float4)
+
+#undef SDSM_SIMD_VECTOR_OPERATORS
+#undef SDSM_SIMD_ARITHMETIC
+
+inline vector_float2 vector2(float x, float y) { vector_float2 r = { x, y }; return r; }
+// Built in a register and stored whole: a vector written lane by lane and then loaded as one
+// stalls store forwarding, which costs more than the arithmetic of a cross product
+inline vector_float3 vector3(float x, float y, float z)
+{
+    vector_float3 r;
+    SDSMSimd::NativeBackend::store(r.elements, SDSMSimd::NativeBackend::set(x, y, z, 0.0f));
+    return r;
+}
+
+inline vector_float4 vector4(float x, float y, float z, float w)
+{
+    vector_float4 r;
+    SDSMSimd::NativeBackend::store(r.elements, SDSMSimd::NativeBackend::set(x, y, z, w));
+    return r;
+}
+
+inline vector_float4 vector4(vector_float3 xyz, float w) { return vector4(xyz.x, xyz.y, xyz.z, w); }
+
+inline float vector_dot(vector_float2 a, vector_float2 b) { return a.x * b.x + a.y * b.y; }
+inline float vector_dot(vector_float3 a, vector_float3 b) { return SDSMSimd::dot<SDSMSimd::NativeBackend, 3>(a.elements, b.elements); }
+inline float vector_dot(vector_float4 a, vector_float4 b) { return SDSMSimd::dot<SDSMSimd::NativeBackend, 4>(a.elements, b.elements); }
+
+inline float vector_length_squared(vector_float2 v) { return vector_dot(v, v); }
+inline float vector_length_squared(vector_float3 v) { return vector_dot(v, v); }
+inline float vector_length_squared(vector_float4 v) { return vector_dot(v, v); }
+
+inline float vector_length(vector_float2 v) { return sqrtf(vector_dot(v, v)); }
+inline float vector_length(vector_float3 v) { return sqrtf(vector_dot(v, v)); }
+inline float vector_length(vector_float4 v) { return sqrtf(vector_dot(v, v)); }
+
+inline vector_float2 vector_normalize(vector_float2 v) { return v / vector_length(v); }
+
+inline vector_float3 vector_normalize(vector_float3 v)
+{
+    vector_float3 r;
+    SDSMSimd::normalize<SDSMSimd::NativeBackend, 3>(v.elements, r.elements);
+    return r;
+}
+
+inline vector_float4 vector_normalize(vector_float4 v)
+{
+    vector_float4 r;
+    SDSMSimd::normalize<SDSMSimd::NativeBackend, 4>(v.elements, r.elements);
+    return r;
+}
+
+inline vector_float3 vector_cross(vector_float3 a, vector_float3 b)
+{
+    typedef SDSMSimd::NativeBackend B;
+    vector_float3 r;
+    B::store(r.elements, SDSMSimd::cross<B>(B::load3(a.elements), B::load3(b.elements)));
+    return r;
+}
+
+inline vector_float3 operator*(const matrix_float3x3 &m, const vector_float3 &v)
+{
+    vector_float3 r;
+    SDSMSimd::transform<SDSMSimd::NativeBackend, 3>(m.columns[0].elements, v.elements, r.elements);
+    return r;
+}
+
+inline vector_float4 operator*(const matrix_float4x4 &m, const vector_float4 &v)
+{
+    vector_float4 r;
+    SDSMSimd::transform<SDSMSimd::NativeBackend, 4>(m.columns[0].elements, v.elements, r.elements);
+    return r;
+}
+
+inline matrix_float3x3 operator*(const matrix_float3x3 &a, const matrix_float3x3 &b)
+{
+    matrix_float3x3 r;
+    SDSMSimd::multiply<SDSMSimd::NativeBackend, 3>(a.columns[0].elements, b.columns[0].elements, r.columns[0].elements);
+    return r;
+}
+
+inline matrix_float4x4 operator*(const matrix_float4x4 &a, const matrix_float4x4 &b)
+{
+    matrix_float4x4 r;
+#if SDSM_SIMD_AVX
+    SDSMSimd::multiply4x4AVX(a.columns[0].elements, b.columns[0].elements, r.columns[0].elements);
+#else
+    SDSMSimd::multiply<SDSMSimd::NativeBackend, 4>(a.columns[0].elements, b.columns[0].elements, r.columns[0].elements);
+#endif
+    return r;
+}
+
+inline matrix_float3x3 matrix_multiply(matrix_float3x3 a, matrix_float3x3 b) { return a * b; }
+inline matrix_float4x4 matrix_multiply(matrix_float4x4 a, matrix_float4x4 b) { return a * b; }
+inline vector_float3 matrix_multiply(matrix_float3x3 m, vector_float3 v) { return m * v; }
+inline vector_float4 matrix_multiply(matrix_float4x4 m, vector_float4 v) { return m * v; }
+
+inline matrix_float3x3 matrix_transpose(matrix_float3x3 m)
+{
+    matrix_float3x3 r;
+    SDSMSimd::transpose<3>(m.columns[0].elements, r.columns[0].elements);
+    return r;
+}
+
+inline matrix_float4x4 matrix_transpose(matrix_float4x4 m)
+{
+    matrix_float4x4 r;
+    SDSMSimd::transpose<4>(m.columns[0].elements, r.columns[0].elements);
+    return r;
+}
+
+inline matrix_float3x3 matrix_invert(matrix_float3x3 m)
+{
+    matrix_float3x3 r;
+    SDSMSimd::invert3x3<SDSMSimd::NativeBackend>(m.columns[0].elements, r.columns[0].elements);
+    return r;
+}
+
+inline matrix_float4x4 matrix_invert(matrix_float4x4 m)
+{
+    matrix_float4x4 r;
+    SDSMSimd::invert4x4<SDSMSimd::NativeBackend>(m.columns[0].elements, r.columns[0].elements);
+    return r;
+}
+
+namespace simd
+{
+    typedef ::vector_float2 float2;
+    typedef ::vector_float3 float3;
+    typedef ::vector_float4 float4;
+    typedef ::matrix_float3x3 float3x3;
+    typedef ::matrix_float4x4 float4x4;
+
+    inline float dot(float2 a, float2 b) { return vector_dot(a, b); }
+    inline float dot(float3 a, float3 b) { return vector_dot(a, b); }
+    inline float dot(float4 a, float4 b) { return vector_dot(a, b); }
+    inline float length(float2 v) { return vector_length(v); }
+    inline float length(float3 v) { return vector_length(v); }
+    inline float length(float4 v) { return vector_length(v); }
+    inline float2 normalize(float2 v) { return vector_normalize(v); }
+    inline float3 normalize(float3 v) { return vector_normalize(v); }
+    inline float4 normalize(float4 v) { return vector_normalize(v); }
+    inline float3 cross(float3 a, float3 b) { return vector_cross(a, b); }
+    inline float3x3 inverse(float3x3 m) { return matrix_invert(m); }
+    inline float4x4 inverse(float4x4 m) { return matrix_invert(m); }
+    inline float3x3 transpose(float3x3 m) { return matrix_transpose(m); }
+    inline float4x4 transpose(float4x4 m) { return matrix_transpose(m); }
+}
+
+namespace SDSMSimd
+{
+    // IEEE half to float in plain C++, exact for every number
+    inline float halfToFloatReference(uint16_t h)
+    {
+        uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+        uint32_t exponent = (h >> 10) & 0x1f;
+        uint32_t mantissa = h & 0x3ff;
+        uint32_t bits;
+
+        if (exponent == 0x1f) {
+            // Infinity, or a NaN made quiet as F16C and NEON do
+            bits = sign | 0x7f800000 | (mantissa ? 0x400000 : 0) | (mantissa << 13);
+        } else if (exponent != 0) {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        } else if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: shift the leading one up to the implicit bit
+            exponent = 113;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    // Float to IEEE half in plain C++, rounding to nearest even like F16C and NEON.  NaNs stay
+    // NaNs with the top of their payload and the quiet bit set.
+    inline uint16_t floatToHalfReference(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t magnitude = bits & 0x7fffffff;
+
+        if (magnitude > 0x7f800000) {
+            return (uint16_t)(sign | 0x7e00 | ((magnitude >> 13) & 0x3ff));
+        }
+
+        // From halfway between 65504 and 65536 up, including infinity
+        if (magnitude >= 0x477ff000) {
+            return (uint16_t)(sign | 0x7c00);
+        }
+
+        uint32_t result, remainder, halfway;
+
+        if (magnitude >= 0x38800000) {
+            // Normal: rebias the exponent from 127 to 15 and drop 13 mantissa bits
+            result = (magnitude - 0x38000000) >> 13;
+            remainder = magnitude & 0x1fff;
+            halfway = 0x1000;
+        } else if (magnitude > 0x33000000) {
+            // Subnormal: the mantissa with its implicit bit in units of 2^-24
+            uint32_t shift = 126 - (magnitude >> 23);
+            uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+            result = mantissa >> shift;
+            remainder = mantissa & ((1u << shift) - 1);
+            halfway = 1u << (shift - 1);
+        } else {
+            // 2^-25 and below round to zero
+            return (uint16_t)sign;
+        }
+
+        if (remainder > halfway || (remainder == halfway && (result & 1))) {
+            result++;
+        }
+
+        return (uint16_t)(sign | result);
+    }
+
+    inline float halfToFloat(uint16_t h)
+    {
+#if defined(__F16C__)
+        return _cvtsh_ss(h);
+#elif defined(__aarch64__)
+        __fp16 half;
+        memcpy(&half, &h, sizeof(half));
+        return half;
+#else
+        return halfToFloatReference(h);
+#endif
+    }
+
+    inline uint16_t floatToHalf(float f)
+    {
+#if defined(__F16C__)
+        return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#elif defined(__aarch64__)
+        __fp16 half = f;
+        uint16_t h;
+        memcpy(&h, &half, sizeof(h));
+        return h;
+#else
+        return floatToHalfReference(f);
+#endif
+    }
+}
+
+#endif
+
+#endif /* SDSM_Simd_h */
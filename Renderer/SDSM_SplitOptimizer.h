@@ -0,0 +1,162 @@
+//
+//  SDSM_SplitOptimizer.h
+//  DeferredLighting C++
+//
+//  Moves the cascade splits of FEEDBACK_PARTITIONING over the frames so that every cascade ends up
+//  with the same aliasing error, as measured by reduce_aliasing_error.  The splits are kept as
+//  each cascade's share of the log depth range, so they follow the reduced depth range from frame
+//  to frame.  Plain C++, no Metal.
+//
+
+#ifndef SDSM_SplitOptimizer_h
+#define SDSM_SplitOptimizer_h
+
+#include <math.h>
+#include <algorithm>
+
+#include "Shaders/AAPLConfig.h"
+
+class AliasingSplitOptimizer
+{
+public:
+
+    // Each update scales a cascade's share by the ratio of the mean error to its error raised to
+    // gain, so a gain below 1 damps the noise of the measurements and the lag between measuring a
+    // frame and using its splits.  No cascade's share drops below minShare.
+    explicit AliasingSplitOptimizer(float gain = 0.5f, float minShare = 0.02f)
+    : m_gain(gain)
+    , m_minShare(minShare)
+    {
+        reset();
+    }
+
+    // Forgets the shares, so the splits start over from log partitioning
+    void reset()
+    {
+        m_cascadeCount = 0;
+        m_errorSpread = 1.0f;
+    }
+
+    // Rebalances the shares from the splits a frame was rendered with and the error measured on
+    // it, one error per cascade.  Cascades without samples have an error of 0 and keep their
+    // share.  The result only depends on the measurement, so a measurement read by several
+    // frames moves the splits once.
+    void update(const float *measuredEnds, const float *errors, int cascadeCount)
+    {
+        if (cascadeCount < 1 || cascadeCount > MAX_CASCADED_SHADOW_COUNT ||
+            !(measuredEnds[0] > 0.0f) || !(measuredEnds[cascadeCount] > measuredEnds[0])) {
+            return;
+        }
+
+        float range = logf(measuredEnds[cascadeCount] / measuredEnds[0]);
+
+        float logErrorSum = 0.0f;
+        float minError = INFINITY;
+        float maxError = 0.0f;
+        int measuredCount = 0;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            if (errors[i] > 0.0f) {
+                logErrorSum += logf(errors[i]);
+                minError = std::min(minError, errors[i]);
+                maxError = std::max(maxError, errors[i]);
+                measuredCount++;
+            }
+        }
+
+        float meanLogError = measuredCount > 0 ? logErrorSum / (float)measuredCount : 0.0f;
+        float shares[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < cascadeCount; i++) {
+            shares[i] = std::max(logf(measuredEnds[i + 1] / measuredEnds[i]) / range, 0.0f);
+
+            if (errors[i] > 0.0f) {
+                shares[i] *= expf(m_gain * (meanLogError - logf(errors[i])));
+            }
+        }
+
+        normalizeShares(shares, cascadeCount);
+
+        m_cascadeCount = cascadeCount;
+        m_errorSpread = measuredCount > 0 ? maxError / minError : 1.0f;
+    }
+
+    // Splits over a depth range with the current shares, or log partitioning until an update
+    // with this cascade count
+    void partition(float min, float max, int cascadeCount, float *result) const
+    {
+        float range = logf(max / min);
+        float position = 0.0f;
+
+        result[0] = min;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            position += cascadeCount == m_cascadeCount ? m_shares[i] : 1.0f / (float)cascadeCount;
+            result[i + 1] = min * expf(range * std::min(position, 1.0f));
+        }
+
+        result[cascadeCount] = max;
+    }
+
+    // Largest over smallest error of the cascades with samples in the last update
+    float errorSpread() const
+    {
+        return m_errorSpread;
+    }
+
+private:
+
+    // Scales the shares to sum to 1 with none below m_minShare.  Clamping a share raises the sum,
+    // so the remaining shares are scaled into what the clamped ones leave until none more drop
+    // below the minimum.
+    void normalizeShares(const float *shares, int cascadeCount)
+    {
+        float minShare = std::min(m_minShare, 1.0f / (float)cascadeCount);
+        bool clamped[MAX_CASCADED_SHADOW_COUNT] = {};
+
+        for (int pass = 0; pass < cascadeCount; pass++) {
+            float freeSum = 0.0f;
+            int clampedCount = 0;
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (clamped[i]) {
+                    clampedCount++;
+                } else {
+                    freeSum += shares[i];
+                }
+            }
+
+            float scale = freeSum > 0.0f ? (1.0f - (float)clampedCount * minShare) / freeSum : 0.0f;
+            bool changed = false;
+
+            for (int i = 0; i < cascadeCount; i++) {
+                if (!clamped[i] && shares[i] * scale < minShare) {
+                    clamped[i] = true;
+                    changed = true;
+                }
+            }
+
+            if (!changed) {
+                for (int i = 0; i < cascadeCount; i++) {
+                    m_shares[i] = clamped[i] ? minShare : shares[i] * scale;
+                }
+
+                return;
+            }
+        }
+
+        // Every share was clamped
+        for (int i = 0; i < cascadeCount; i++) {
+            m_shares[i] = 1.0f / (float)cascadeCount;
+        }
+    }
+
+    float m_gain;
+    float m_minShare;
+
+    float m_shares[MAX_CASCADED_SHADOW_COUNT];
+    int m_cascadeCount;
+    float m_errorSpread;
+};
+
+#endif /* SDSM_SplitOptimizer_h */
@@ -5,98 +5,173 @@
 //  Created by Koreex on 2021/11/8.
 //  Copyright © 2021 Apple. All rights reserved.
 //
+//  The cascade setup is instantiated per cascade count, so its loops have fixed trip counts and its
+//  scratch arrays fixed sizes.  withCascadeCount turns the runtime count into the template argument.
+//  Include after AAPLMathUtilities.h, whose batched transforms move the frustum corners.
+//
 
 #ifndef SDSM_Utilities_h
 #define SDSM_Utilities_h
 
+#include <type_traits>
+
 #include "AAPLConfig.h"
+#include "SDSMShared.h"
+
+template <int Count, class F>
+inline typename std::enable_if<(Count > MAX_CASCADED_SHADOW_COUNT)>::type
+dispatchCascadeCount(int, F &)
+{
+}
 
-void logPartitioning(float min, float max, int partitionCount, float *result)
+template <int Count, class F>
+inline typename std::enable_if<(Count <= MAX_CASCADED_SHADOW_COUNT)>::type
+dispatchCascadeCount(int count, F & f)
 {
-    for (uint i = 0; i < partitionCount + 1; i++) {
-        result[i] = pow(max / min, (float)i / (float)partitionCount) * min;
+    if (count == Count) {
+        f(std::integral_constant<int, Count>());
+    } else {
+        dispatchCascadeCount<Count + 1>(count, f);
     }
 }
 
-void uniformPartitioning(float min, float max, int partitionCount, float *result)
+// Calls f with std::integral_constant<int, cascadeCount>, for a count from 1 to
+// MAX_CASCADED_SHADOW_COUNT; other counts do nothing
+template <class F>
+inline void withCascadeCount(int cascadeCount, F f)
 {
-    for (uint i = 0; i < partitionCount + 1; i++) {
-        result[i] = min + (max - min) * (float)i / (float)partitionCount;
+    dispatchCascadeCount<1>(cascadeCount, f);
+}
+
+template <int Length>
+struct FrustumIndexTable
+{
+    int indices[Length];
+};
+
+// Lines of the view frustum visualization: the near rectangle of every cascade, the far rectangle
+// of the last one, and the edges from the corners of the first near rectangle to the last far one
+template <int CascadeCount>
+constexpr FrustumIndexTable<8 * (CascadeCount + 1) + 8> viewFrustumIndexTable()
+{
+    FrustumIndexTable<8 * (CascadeCount + 1) + 8> table = {};
+
+    for (int i = 0; i < CascadeCount + 1; i++) {
+        for (int j = 0; j < 4; j++) {
+            table.indices[i * 8 + j * 2] = i * 4 + j;
+            table.indices[i * 8 + j * 2 + 1] = i * 4 + (j + 1) % 4;
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        table.indices[8 * (CascadeCount + 1) + 2 * i] = i;
+        table.indices[8 * (CascadeCount + 1) + 2 * i + 1] = i + CascadeCount * 4;
     }
+
+    return table;
 }
 
-//
-float4x4 cascadedShadowProjectionMatrix(float4x4 cameraViewMatrix, float aspectRatio, float fov,
-                                float4x4 shadowViewMatrix,
-                                float *cascadeEnds, int index,
-                                FrustumVertex *viewFrustumBuffer, FrustumVertex *lightFrustumBuffer,
-                                MTL::Buffer lightFrustumBoundingBox)
+// Lines of the light frustum visualization, the twelve edges of each cascade's box
+template <int CascadeCount>
+constexpr FrustumIndexTable<24 * CascadeCount> lightFrustumIndexTable()
 {
-    float tanHalfHFov = tanf(fov / 2) * aspectRatio;
-    float tanHalfVFov = tanf(fov / 2);
-
-    float xn = cascadeEnds[index] * tanHalfHFov;
-    float xf = cascadeEnds[index + 1] * tanHalfHFov;
-    float yn = cascadeEnds[index] * tanHalfVFov;
-    float yf = cascadeEnds[index + 1] * tanHalfVFov;
-
-    float4 frustumCorners[8] = {
-        vector4(xn, yn, cascadeEnds[index], 1.0f),
-        vector4(-xn, yn, cascadeEnds[index], 1.0f),
-        vector4(-xn, -yn, cascadeEnds[index], 1.0f),
-        vector4(xn, -yn, cascadeEnds[index], 1.0f),
-
-        vector4(xf, yf, cascadeEnds[index + 1], 1.0f),
-        vector4(-xf, yf, cascadeEnds[index + 1], 1.0f),
-        vector4(-xf, -yf, cascadeEnds[index + 1], 1.0f),
-        vector4(xf, -yf, cascadeEnds[index + 1], 1.0f),
-    };
-
-    float minX;
-    float maxX;
-    float minY;
-    float maxY;
-    float minZ;
-    float maxZ;
-
-    for (uint j = 0; j < 8; j++) {
-        float4 vW = matrix_invert(cameraViewMatrix) * frustumCorners[j];
-
-        if (j < 4) {
-            viewFrustumBuffer[index * 4 + j] = {{vW.x, vW.y, vW.z}, {1.0f, 1.0f, 1.0f}};
+    FrustumIndexTable<24 * CascadeCount> table = {};
+
+    for (int i = 0; i < CascadeCount; i++) {
+        for (int j = 0; j < 4; j++) {
+            table.indices[24 * i + j * 6] = j + 8 * i;
+            table.indices[24 * i + j * 6 + 1] = (j + 1) % 4 + 8 * i;
+
+            table.indices[24 * i + j * 6 + 2] = j + 4 + 8 * i;
+            table.indices[24 * i + j * 6 + 3] = (j + 1) % 4 + 4 + 8 * i;
+
+            table.indices[24 * i + j * 6 + 4] = j + 8 * i;
+            table.indices[24 * i + j * 6 + 5] = j + 4 + 8 * i;
+        }
+    }
+
+    return table;
+}
+
+// Orthographic projections of the cascades, each fitted to its light view space bounding box with
+// its near plane at nearZ.  Unless the vertex pointers are null, also writes the world space corners
+// of the view frustum's slices and of the cascades' light frusta for the frustum visualization,
+// using the inverses of the camera and light view matrices.  Adjacent slices share a rectangle, so
+// the view frustum has 4 * (CascadeCount + 1) corners and the light frusta 8 * CascadeCount.
+template <int CascadeCount>
+void cascadedShadowProjectionMatrices(const float4x4 & inverseCameraViewMatrix, float aspectRatio, float fov,
+                                      const float4x4 & inverseShadowViewMatrix, const float *cascadeEnds,
+                                      const float *lightFrustumBoundingBoxes, const float *nearZ,
+                                      float4x4 *projectionMatrices,
+                                      FrustumVertex *viewFrustumVertices, FrustumVertex *lightFrustumVertices)
+{
+    const int viewCornerCount = 4 * (CascadeCount + 1);
+    const int lightCornerCount = 8 * CascadeCount;
+
+    if (viewFrustumVertices) {
+        float tanHalfHFov = tanf(fov / 2) * aspectRatio;
+        float tanHalfVFov = tanf(fov / 2);
+
+        float x[viewCornerCount];
+        float y[viewCornerCount];
+        float z[viewCornerCount];
+
+        for (int i = 0; i < CascadeCount + 1; i++) {
+            float halfWidth = cascadeEnds[i] * tanHalfHFov;
+            float halfHeight = cascadeEnds[i] * tanHalfVFov;
+
+            x[4 * i] = halfWidth;
+            x[4 * i + 1] = -halfWidth;
+            x[4 * i + 2] = -halfWidth;
+            x[4 * i + 3] = halfWidth;
+
+            y[4 * i] = halfHeight;
+            y[4 * i + 1] = halfHeight;
+            y[4 * i + 2] = -halfHeight;
+            y[4 * i + 3] = -halfHeight;
+
+            for (int j = 0; j < 4; j++) {
+                z[4 * i + j] = cascadeEnds[i];
+            }
         }
 
-        if (index == CASCADED_SHADOW_COUNT - 1 && j >= 4) {
-            viewFrustumBuffer[index * 4 + j] = {{vW.x, vW.y, vW.z}, {1.0f, 1.0f, 1.0f}};
+        soa_float3 corners = {x, y, z};
+        matrix_transform_points(inverseCameraViewMatrix, corners, corners, viewCornerCount);
+
+        for (int j = 0; j < viewCornerCount; j++) {
+            viewFrustumVertices[j] = {{x[j], y[j], z[j]}, {1.0f, 1.0f, 1.0f}};
         }
     }
 
-    int *dataPtr = (int*) lightFrustumBoundingBox.contents();
-
-    minX = (float)dataPtr[6 * index + BoundingBoxMinX] / (float)LARGE_INTEGER;
-    minY = (float)dataPtr[6 * index + BoundingBoxMinY] / (float)LARGE_INTEGER;
-    minZ = (float)dataPtr[6 * index + BoundingBoxMinZ] / (float)LARGE_INTEGER;
-    maxX = (float)dataPtr[6 * index + BoundingBoxMaxX] / (float)LARGE_INTEGER;
-    maxY = (float)dataPtr[6 * index + BoundingBoxMaxY] / (float)LARGE_INTEGER;
-    maxZ = (float)dataPtr[6 * index + BoundingBoxMaxZ] / (float)LARGE_INTEGER;
-
-    float4 lightFrustumCornersSV[8];
-
-    lightFrustumCornersSV[0] = {minX, minY, minZ, 1.0f};
-    lightFrustumCornersSV[1] = {maxX, minY, minZ, 1.0f};
-    lightFrustumCornersSV[2] = {maxX, maxY, minZ, 1.0f};
-    lightFrustumCornersSV[3] = {minX, maxY, minZ, 1.0f};
-    lightFrustumCornersSV[4] = {minX, minY, maxZ, 1.0f};
-    lightFrustumCornersSV[5] = {maxX, minY, maxZ, 1.0f};
-    lightFrustumCornersSV[6] = {maxX, maxY, maxZ, 1.0f};
-    lightFrustumCornersSV[7] = {minX, maxY, maxZ, 1.0f};
-
-    for (uint i = 0; i < 8; i++) {
-        float4 corner = matrix_invert(shadowViewMatrix) * lightFrustumCornersSV[i];
-        lightFrustumBuffer[index * 8 + i] = {{corner.x, corner.y, corner.z}, {0.0f, 1.0f, 0.0f}};
+    if (lightFrustumVertices) {
+        float x[lightCornerCount];
+        float y[lightCornerCount];
+        float z[lightCornerCount];
+
+        // Near face first, in the winding of the view frustum rectangles
+        for (int i = 0; i < CascadeCount; i++) {
+            const float *boundingBox = lightFrustumBoundingBoxes + 6 * i;
+
+            for (int j = 0; j < 8; j++) {
+                x[8 * i + j] = boundingBox[(j + 1) % 4 < 2 ? BoundingBoxMinX : BoundingBoxMaxX];
+                y[8 * i + j] = boundingBox[j % 4 < 2 ? BoundingBoxMinY : BoundingBoxMaxY];
+                z[8 * i + j] = boundingBox[j < 4 ? BoundingBoxMinZ : BoundingBoxMaxZ];
+            }
+        }
+
+        soa_float3 corners = {x, y, z};
+        matrix_transform_points(inverseShadowViewMatrix, corners, corners, lightCornerCount);
+
+        for (int j = 0; j < lightCornerCount; j++) {
+            lightFrustumVertices[j] = {{x[j], y[j], z[j]}, {0.0f, 1.0f, 0.0f}};
+        }
     }
 
-    return matrix_ortho_left_hand(minX, maxX, minY, maxY, -100, maxZ);
+    for (int i = 0; i < CascadeCount; i++) {
+        projectionMatrices[i] = matrix_identity_float4x4;
+        applyCascadeProjection(cascadeOrthoProjection(lightFrustumBoundingBoxes + 6 * i, nearZ[i]),
+                               projectionMatrices[i].columns);
+    }
 }
 
 #endif /* SDSM_Utilities_h */
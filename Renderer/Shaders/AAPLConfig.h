@@ -5,7 +5,7 @@ Abstract:
 Header defining preprocessor conditional values that control the configuration of the app
 */
 
-#ifndef __METAL_VERSION__
+#if !defined(__METAL_VERSION__) && defined(__APPLE__)
 #include <TargetConditionals.h>
 #endif
 
@@ -37,18 +37,52 @@ Header defining preprocessor conditional values that control the configuration o
 // implementation.
 #define SUPPORT_BUFFER_EXAMINATION 1
 
+// Upper bound of the runtime cascade count.  Sizes FrameData and the shadow map array.
+#define MAX_CASCADED_SHADOW_COUNT  8
+
+// Cascade count used until it is changed at runtime
 #define CASCADED_SHADOW_COUNT      3
 
-// To deal with float numbers in atomic operation
-#define LARGE_INTEGER              1e3
+// Edge length of the threadgroups used by the hierarchical SDSM reductions.  The kernels size
+// their threadgroup memory with it, so the host must dispatch with the same threadgroup size.
+#define SDSM_REDUCTION_THREADGROUP_SIZE 16
+
+// Tile edge length of the single pass deferred renderer's combined G-buffer and lighting pass.
+// Its tile reduction builds one partial depth histogram per tile, so this also sets how many
+// partial results are merged into the frame's histogram.
+#define SDSM_REDUCTION_TILE_SIZE   16
+
+// Level of the min/max depth pyramid the coarse fused reduction reads.  A texel of level n covers
+// 2^(n+1) x 2^(n+1) pixels, so level 2 reduces 8 x 8 pixel blocks.
+#define SDSM_DEPTH_PYRAMID_REDUCTION_LEVEL 2
+
+// Number of log depth bins used by the fused SDSM reduction
+#define SDSM_HISTOGRAM_BIN_COUNT   64
 
 // Shadow map resolution
 
 #define SHADOW_MAP_RES             512
 
+// When enabled, all cascades render into squares of one shadow atlas, sized every frame from each
+// cascade's screen coverage and aliasing error under SHADOW_ATLAS_TEXEL_BUDGET.  When disabled,
+// every cascade gets its own SHADOW_MAP_RES slice of a texture array.
+#define USE_SHADOW_ATLAS           1
+
+// Edge length of the shadow atlas and the texels its cascades may use in total
+#define SHADOW_ATLAS_RES           1024
+#define SHADOW_ATLAS_TEXEL_BUDGET  (3 * SHADOW_MAP_RES * SHADOW_MAP_RES)
+
 #ifndef VISUALIZATION_MODE
 #define VISUALIZATION_MODE
 
+enum PartitioningMode {
+    LOG_PARTITIONING = 0,
+    UNIFORM_PARTITIONING = 1,
+    ADAPTIVE_PARTITIONING = 2,
+    CLUSTERED_PARTITIONING = 3,
+    FEEDBACK_PARTITIONING = 4
+};
+
 enum VisualizationMode {
     VISUALIZE_NORMAL = 0x00,
     VISUALIZE_CASCADE = 0x01,
@@ -14,6 +14,9 @@ using namespace metal;
 // Include header shared between all Metal shader code files
 #include "AAPLShaderCommon.h"
 
+// Include header shared between the shadow map reductions and C code reading their results
+#include "SDSMShared.h"
+
 // Per-vertex inputs fed by vertex buffer laid out with MTLVertexDescriptor in Metal API
 struct DescriptorDefinedVertex
 {
@@ -68,10 +71,15 @@ vertex ColorInOut gbuffer_vertex(DescriptorDefinedVertex in    [[ stage_in ]],
     return out;
 }
 
-constant half4 CASCADE_RANGE_COLORS[CASCADED_SHADOW_COUNT] = {
+constant half4 CASCADE_RANGE_COLORS[MAX_CASCADED_SHADOW_COUNT] = {
     vector_half4(0.2, 0, 0, 0),
     vector_half4(0, 0.2, 0, 0),
-    vector_half4(0, 0, 0.2, 0)
+    vector_half4(0, 0, 0.2, 0),
+    vector_half4(0.2, 0.2, 0, 0),
+    vector_half4(0, 0.2, 0.2, 0),
+    vector_half4(0.2, 0, 0.2, 0),
+    vector_half4(0.2, 0.1, 0, 0),
+    vector_half4(0.1, 0, 0.2, 0)
 };
 
 fragment GBufferData gbuffer_fragment(ColorInOut               in           [[ stage_in ]],
@@ -110,7 +118,7 @@ fragment GBufferData gbuffer_fragment(ColorInOut               in           [[ s
     half4 cascadeRangeColor = vector_half4(0, 0, 0, 0);
 
     // Determine in which shadow layer the fragment is
-    for (int i = 0; i < CASCADED_SHADOW_COUNT; i++) {
+    for (uint i = 0; i < frameData.cascadeCount; i++) {
         if (in.eye_position.z >= frameData.cascadeEnds[i] && in.eye_position.z < frameData.cascadeEnds[i + 1]) {
             cascadeRangeColor = CASCADE_RANGE_COLORS[i];
         }
@@ -120,7 +128,12 @@ fragment GBufferData gbuffer_fragment(ColorInOut               in           [[ s
         if (shadow_coord.x < 1.0 && shadow_coord.x > 0.0 && shadow_coord.y < 1.0 && shadow_coord.y > 0.0 &&
             in.eye_position.z < frameData.cascadeEnds[i + 1] && in.eye_position.z >= frameData.cascadeEnds[i]
         ) {
-            shadow_uv = shadow_coord.xy;
+            // Keep the filter footprint inside the cascade's region of the atlas
+            float4 atlasRect = frameData.shadowAtlasRects[i];
+            float2 halfTexel = 0.5f / float2(shadowMap.get_width(), shadowMap.get_height());
+
+            shadow_uv = clamp(atlasRect.xy + shadow_coord.xy * atlasRect.zw,
+                              atlasRect.xy + halfTexel, atlasRect.xy + atlasRect.zw - halfTexel);
             shadow_depth = half(shadow_coord.z);
             shadow_index = i;
             break;
@@ -147,9 +160,11 @@ fragment GBufferData gbuffer_fragment(ColorInOut               in           [[ s
     } else if (frameData.visualization_mode == VISUALIZE_CASCADE) {
         gBuffer.albedo_specular = half4(base_color_sample.xyz, specular_contrib) + cascadeRangeColor;
     } else if (frameData.visualization_mode == VISUALIZE_ALIASING_ERROR) {
-        float aliasing_error = 1.0 / (in.eye_position.z * tan(frameData.fov / 2.0f))*
-            (frameData.cascadeEnds[shadow_index + 1] - frameData.cascadeEnds[shadow_index]) *
-            frameData.screenWidth / (float)SHADOW_MAP_RES / 2.0f * 0.5f;
+        float aliasing_error = shadowAliasingError(in.eye_position.z,
+                                                   frameData.cascadeEnds[shadow_index],
+                                                   frameData.cascadeEnds[shadow_index + 1],
+                                                   tan(frameData.fov / 2.0f), frameData.screenWidth,
+                                                   frameData.shadowAtlasRects[shadow_index].z * shadowMap.get_width());
 
         gBuffer.albedo_specular = half4(aliasing_error, 1.0f - aliasing_error, 0.0f, 1.0f);
     }
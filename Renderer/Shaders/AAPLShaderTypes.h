@@ -8,7 +8,11 @@ Header containing types and enum constants shared between Metal shaders and C/Ob
 #define ShaderTypes_h
 
 #include "AAPLConfig.h"
+#ifdef __METAL_VERSION__
 #include <simd/simd.h>
+#else
+#include "../SDSM_Simd.h"
+#endif
 
 #ifndef __METAL_VERSION__
 /// 96-bit / 12 byte 3 component float vector type
@@ -35,6 +39,11 @@ typedef enum BufferIndex
 #endif
     BufferIndexMinMaxDepth       = 0,
     BufferIndexBoundingBox = 1,
+    BufferIndexSparseReduction   = 3,
+    BufferIndexDepthHistogram    = 0,
+    BufferIndexDepthPyramidLevel = 1,
+    BufferIndexAliasingError     = 0,
+    BufferIndexShadowMapSize     = 1,
     
 
 } BufferIndex;
@@ -62,7 +71,8 @@ typedef enum TextureIndex
 
     NumMeshTextures = TextureIndexNormal + 1,
 
-    TextureIndexDepth          = 0
+    TextureIndexDepth          = 0,
+    TextureIndexDepthPyramid   = 1
 
 } TextureIndex;
 
@@ -106,9 +116,13 @@ struct FrameData
     float fairy_specular_intensity;
 
     simd::float4x4 sky_modelview_matrix;
-    simd::float4x4 shadow_mvp_matrices[CASCADED_SHADOW_COUNT];
-    simd::float4x4 shadow_mvp_xform_matrices[CASCADED_SHADOW_COUNT];
-    float cascadeEnds[CASCADED_SHADOW_COUNT + 1];
+    simd::float4x4 shadow_mvp_matrices[MAX_CASCADED_SHADOW_COUNT];
+    simd::float4x4 shadow_mvp_xform_matrices[MAX_CASCADED_SHADOW_COUNT];
+    // Region of the shadow map each cascade renders into as x, y, width and height in texture
+    // coordinates.  The whole slice unless USE_SHADOW_ATLAS is enabled.
+    simd::float4 shadowAtlasRects[MAX_CASCADED_SHADOW_COUNT];
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+    uint cascadeCount;
     simd::float4x4 shadow_view_matrix;
     simd::float4x4 unproject_matrix;
 
@@ -119,6 +133,9 @@ struct FrameData
 
     float screenWidth;
     float fov;
+    float nearPlane;
+    float farPlane;
+    PartitioningMode partitioning_mode;
     VisualizationMode visualization_mode;
 };
 
@@ -5,8 +5,13 @@ Abstract:
 Metal shaders used to render shadow maps
 */
 
+#include <metal_stdlib>
+
+using namespace metal;
+
 // Include header shared between this Metal shader code and C code executing Metal API commands
 #include "AAPLShaderTypes.h"
+#include "SDSMShared.h"
 
 struct ShadowOutput
 {
@@ -25,3 +30,45 @@ vertex ShadowOutput shadow_vertex(const device ShadowVertex *positions [[ buffer
 
     return out;
 }
+
+// With the shadow atlas the cascades are viewports of one slice, each with its own scissor rect
+struct LayeredShadowOutput
+{
+    float4 position [[position]];
+#if USE_SHADOW_ATLAS
+    uint   cascade  [[viewport_array_index]];
+#else
+    uint   cascade  [[render_target_array_index]];
+#endif
+};
+
+// Renders every cascade in one pass.  Each instance draws the mesh into the shadow map slice or
+// atlas viewport of one cascade from the draw's cascade list.
+vertex LayeredShadowOutput shadow_vertex_layered(const device ShadowVertex *positions [[ buffer(BufferIndexMeshPositions) ]],
+                                                 constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                                 uint                             vid [[ vertex_id ]],
+                                                 uint                             iid [[ instance_id ]],
+                                                 constant     uint       &cascadeList [[ buffer(BufferIndexCascadeIndex) ]])
+{
+    LayeredShadowOutput out;
+
+    uint cascade = cascadeListEntry(cascadeList, iid);
+
+    out.position = frameData.shadow_mvp_matrices[cascade] * float4(positions[vid].position, 1.0);
+    out.cascade = cascade;
+
+    return out;
+}
+
+// Full viewport triangle at the far plane.  Drawn with depth writes and no depth test, it resets
+// the scissored texels of a cached cascade before its casters are re-rendered.
+vertex ShadowOutput shadow_clear_vertex(uint vid [[ vertex_id ]])
+{
+    ShadowOutput out;
+
+    float2 uv = float2((vid << 1) & 2, vid & 2);
+
+    out.position = float4(uv * 2.0 - 1.0, 1.0, 1.0);
+
+    return out;
+}
@@ -12,17 +12,82 @@ using namespace metal;
 
 #include "AAPLShaderTypes.h"
 #include "AAPLShaderCommon.h"
+#include "SDSMShared.h"
 
 kernel void reduce_min_max_depth(device atomic_int * result [[buffer(BufferIndexMinMaxDepth)]],
                        texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
                        uint2 gid [[thread_position_in_grid]])
 {
-    uint depthInt = (uint)(depthBuffer.read(gid).x * LARGE_INTEGER);
+    float depth = depthBuffer.read(gid).x;
+    int depthInt = encodeOrderedFloat(depth);
 
-    atomic_fetch_max_explicit(&result[1], as_type<int>(depthInt), memory_order_relaxed);
+    atomic_fetch_max_explicit(&result[1], depthInt, memory_order_relaxed);
 
-    if (depthInt > 0) {
-        atomic_fetch_min_explicit(result, as_type<int>(depthInt), memory_order_relaxed);
+    if (depth > 0) {
+        atomic_fetch_min_explicit(result, depthInt, memory_order_relaxed);
+    }
+}
+
+// Two level variant of reduce_min_max_depth.  Depth is first reduced inside each SIMD-group (when
+// the shading language supports it) and then across the threadgroup in threadgroup memory, so only
+// one thread per threadgroup touches the two global atomics.
+kernel void reduce_min_max_depth_hierarchical(device atomic_int * result [[buffer(BufferIndexMinMaxDepth)]],
+                       texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                       uint2 gid [[thread_position_in_grid]],
+                       uint2 threadgroupSize [[threads_per_threadgroup]],
+                       uint tid [[thread_index_in_threadgroup]]
+#if __METAL_VERSION__ >= 230
+                       , uint simdLane [[thread_index_in_simdgroup]]
+                       , uint simdGroup [[simdgroup_index_in_threadgroup]]
+                       , uint simdGroupCount [[simdgroups_per_threadgroup]]
+#endif
+                       )
+{
+    threadgroup int minDepths[SDSM_REDUCTION_THREADGROUP_SIZE * SDSM_REDUCTION_THREADGROUP_SIZE];
+    threadgroup int maxDepths[SDSM_REDUCTION_THREADGROUP_SIZE * SDSM_REDUCTION_THREADGROUP_SIZE];
+
+    float depth = depthBuffer.read(gid).x;
+    int depthInt = encodeOrderedFloat(depth);
+
+    // Empty pixels must not pull the minimum down, so they contribute the identity of min
+    int localMin = depth > 0 ? depthInt : INT_MAX;
+    int localMax = depthInt;
+
+#if __METAL_VERSION__ >= 230
+    localMin = simd_min(localMin);
+    localMax = simd_max(localMax);
+
+    if (simdLane == 0) {
+        minDepths[simdGroup] = localMin;
+        maxDepths[simdGroup] = localMax;
+    }
+
+    uint partialCount = simdGroupCount;
+#else
+    minDepths[tid] = localMin;
+    maxDepths[tid] = localMax;
+
+    uint partialCount = threadgroupSize.x * threadgroupSize.y;
+#endif
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    // Threadgroups on the right and bottom edges of the grid may be partial, so only fold in
+    // partials that were actually written
+    for (uint stride = SDSM_REDUCTION_THREADGROUP_SIZE * SDSM_REDUCTION_THREADGROUP_SIZE / 2; stride > 0; stride >>= 1) {
+        if (tid < stride && tid + stride < partialCount) {
+            minDepths[tid] = min(minDepths[tid], minDepths[tid + stride]);
+            maxDepths[tid] = max(maxDepths[tid], maxDepths[tid + stride]);
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+
+    if (tid == 0) {
+        atomic_fetch_max_explicit(&result[1], maxDepths[0], memory_order_relaxed);
+
+        if (minDepths[0] != INT_MAX) {
+            atomic_fetch_min_explicit(result, minDepths[0], memory_order_relaxed);
+        }
     }
 }
 
@@ -44,27 +109,436 @@ kernel void reduce_light_frustum(texture2d<float> depthBuffer [[texture(TextureI
     positionLS /= positionLS.w;
     positionLS = frameData.shadow_view_matrix * positionLS;
 
-    for (uint i = 0; i < CASCADED_SHADOW_COUNT; i++) {
+    for (uint i = 0; i < frameData.cascadeCount; i++) {
         if (depth > frameData.cascadeEnds[i] && depth < frameData.cascadeEnds[i + 1]) {
             atomic_fetch_min_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMinX],
-                                      as_type<int>((int)(positionLS.x * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.x),
                                       memory_order_relaxed);
             atomic_fetch_min_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMinY],
-                                      as_type<int>((int)(positionLS.y * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.y),
                                       memory_order_relaxed);
             atomic_fetch_min_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMinZ],
-                                      as_type<int>((int)(positionLS.z * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.z),
                                       memory_order_relaxed);
 
             atomic_fetch_max_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMaxX],
-                                      as_type<int>((int)(positionLS.x * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.x),
                                       memory_order_relaxed);
             atomic_fetch_max_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMaxY],
-                                      as_type<int>((int)(positionLS.y * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.y),
                                       memory_order_relaxed);
             atomic_fetch_max_explicit(&lightFrustumBoundingBox[6 * i + BoundingBoxMaxZ],
-                                      as_type<int>((int)(positionLS.z * LARGE_INTEGER)),
+                                      encodeOrderedFloat(positionLS.z),
                                       memory_order_relaxed);
         }
     }
 }
+
+// Single pass replacement of reduce_min_max_depth and reduce_light_frustum.  Every sample updates
+// the depth range and the light space bounding box of its log depth bin, so the cascade splits
+// and the per-cascade bounds of this frame can both be derived from one read of the depth buffer.
+kernel void reduce_depth_histogram(texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                                   constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                   uint2 gid [[thread_position_in_grid]],
+                                   device atomic_int * histogram [[ buffer(BufferIndexDepthHistogram) ]])
+{
+    float depth = depthBuffer.read(gid).x;
+    if (depth < 1e-6) {
+        return;
+    }
+
+    int depthInt = encodeOrderedFloat(depth);
+
+    atomic_fetch_min_explicit(&histogram[DepthHistogramMinDepth], depthInt, memory_order_relaxed);
+    atomic_fetch_max_explicit(&histogram[DepthHistogramMaxDepth], depthInt, memory_order_relaxed);
+
+    // convert to nonlinear depth;
+    float4 samplePosition = frameData.projection_matrix * float4(0, 0, depth, 1.0);
+
+    // get postion in light space from depth map
+    float4 positionLS = frameData.unproject_matrix * float4(gid.x, gid.y, samplePosition.z / samplePosition.w, 1.0);
+    positionLS /= positionLS.w;
+    positionLS = frameData.shadow_view_matrix * positionLS;
+
+    int bin = depthHistogramBin(depth, frameData.nearPlane, frameData.farPlane);
+
+    device atomic_int *binData = &histogram[DepthHistogramBins + bin * DepthHistogramBinStride];
+    device atomic_int *boundingBox = &binData[DepthHistogramBinBoundingBox];
+
+    atomic_fetch_add_explicit(&binData[DepthHistogramBinCount], 1, memory_order_relaxed);
+
+    atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinX], encodeOrderedFloat(positionLS.x), memory_order_relaxed);
+    atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinY], encodeOrderedFloat(positionLS.y), memory_order_relaxed);
+    atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinZ], encodeOrderedFloat(positionLS.z), memory_order_relaxed);
+
+    atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxX], encodeOrderedFloat(positionLS.x), memory_order_relaxed);
+    atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxY], encodeOrderedFloat(positionLS.y), memory_order_relaxed);
+    atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxZ], encodeOrderedFloat(positionLS.z), memory_order_relaxed);
+}
+
+// First level of the min/max depth pyramid, reduced from 2 x 2 pixels of the depth buffer
+kernel void build_depth_pyramid_base(texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                                     texture2d<float, access::write> pyramidLevel [[texture(TextureIndexDepthPyramid)]],
+                                     uint2 gid [[thread_position_in_grid]])
+{
+    uint2 last = uint2(depthBuffer.get_width() - 1, depthBuffer.get_height() - 1);
+    uint2 first = gid * 2;
+    uint2 second = min(first + 1, last);
+
+    float d00 = depthBuffer.read(first).x;
+    float d10 = depthBuffer.read(uint2(second.x, first.y)).x;
+    float d01 = depthBuffer.read(uint2(first.x, second.y)).x;
+    float d11 = depthBuffer.read(second).x;
+
+    float minDepth = depthPyramidMin(depthPyramidMin(depthPyramidMinSample(d00), depthPyramidMinSample(d10)),
+                                     depthPyramidMin(depthPyramidMinSample(d01), depthPyramidMinSample(d11)));
+    float maxDepth = depthPyramidMax(depthPyramidMax(d00, d10), depthPyramidMax(d01, d11));
+
+    pyramidLevel.write(float4(minDepth, maxDepth, 0, 0), gid);
+}
+
+// Every further level of the depth pyramid, reduced from 2 x 2 texels of the level before
+kernel void build_depth_pyramid_level(texture2d<float> sourceLevel [[texture(TextureIndexDepth)]],
+                                      texture2d<float, access::write> pyramidLevel [[texture(TextureIndexDepthPyramid)]],
+                                      uint2 gid [[thread_position_in_grid]])
+{
+    uint2 last = uint2(sourceLevel.get_width() - 1, sourceLevel.get_height() - 1);
+    uint2 first = gid * 2;
+    uint2 second = min(first + 1, last);
+
+    float2 t00 = sourceLevel.read(first).xy;
+    float2 t10 = sourceLevel.read(uint2(second.x, first.y)).xy;
+    float2 t01 = sourceLevel.read(uint2(first.x, second.y)).xy;
+    float2 t11 = sourceLevel.read(second).xy;
+
+    float minDepth = depthPyramidMin(depthPyramidMin(t00.x, t10.x), depthPyramidMin(t01.x, t11.x));
+    float maxDepth = depthPyramidMax(depthPyramidMax(t00.y, t10.y), depthPyramidMax(t01.y, t11.y));
+
+    pyramidLevel.write(float4(minDepth, maxDepth, 0, 0), gid);
+}
+
+// Light space position of a depth buffer pixel, reconstructed like the full resolution reductions do
+static float3 lightSpacePosition(constant FrameData &frameData, float2 pixel, float depth)
+{
+    float4 samplePosition = frameData.projection_matrix * float4(0, 0, depth, 1.0);
+
+    float4 positionLS = frameData.unproject_matrix * float4(pixel, samplePosition.z / samplePosition.w, 1.0);
+    positionLS /= positionLS.w;
+
+    return (frameData.shadow_view_matrix * positionLS).xyz;
+}
+
+// Variant of reduce_depth_histogram that reads one texel of a coarse depth pyramid level per
+// block of pixels.  The depth range is exact.  Every bin the block's depth range overlaps gets the
+// bounds of the block's corner pixels at both ends of the overlap: positions are multilinear in
+// the pixel coordinates and the depth, so those eight points bound every sample the full
+// resolution reduction would have put into the bin.  The pyramid holds no sample counts, so the
+// block's pixels, empty ones included, are spread evenly over its bins as an estimate of the bin
+// counts.
+kernel void reduce_depth_histogram_coarse(texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                                          texture2d<float> depthPyramid [[texture(TextureIndexDepthPyramid)]],
+                                          constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                          constant     uint         &level [[ buffer(BufferIndexDepthPyramidLevel) ]],
+                                          uint2 gid [[thread_position_in_grid]],
+                                          device atomic_int * histogram [[ buffer(BufferIndexDepthHistogram) ]])
+{
+    float2 depthRange = depthPyramid.read(gid, level).xy;
+
+    // Blocks of empty pixels keep the minimum at FLT_MAX, above the maximum
+    if (depthRange.x > depthRange.y) {
+        return;
+    }
+
+    atomic_fetch_min_explicit(&histogram[DepthHistogramMinDepth], encodeOrderedFloat(depthRange.x), memory_order_relaxed);
+    atomic_fetch_max_explicit(&histogram[DepthHistogramMaxDepth], encodeOrderedFloat(depthRange.y), memory_order_relaxed);
+
+    uint span = 2u << level;
+    uint2 firstPixel = gid * span;
+    uint2 lastPixel = min(firstPixel + span, uint2(depthBuffer.get_width(), depthBuffer.get_height())) - 1;
+
+    float2 corners[4] = {
+        float2(firstPixel),
+        float2(lastPixel.x, firstPixel.y),
+        float2(firstPixel.x, lastPixel.y),
+        float2(lastPixel)
+    };
+
+    int firstBin = depthHistogramBin(depthRange.x, frameData.nearPlane, frameData.farPlane);
+    int lastBin = depthHistogramBin(depthRange.y, frameData.nearPlane, frameData.farPlane);
+
+    // The first bins take the remainder, so the block adds exactly its pixel count
+    uint pixelCount = (lastPixel.x - firstPixel.x + 1) * (lastPixel.y - firstPixel.y + 1);
+    uint binCount = uint(lastBin - firstBin + 1);
+
+    for (int bin = firstBin; bin <= lastBin; bin++) {
+        int binSamples = pixelCount / binCount + (uint(bin - firstBin) < pixelCount % binCount ? 1 : 0);
+
+        float binDepths[2] = {
+            max(depthRange.x, depthHistogramBinStart(bin, frameData.nearPlane, frameData.farPlane)),
+            min(depthRange.y, depthHistogramBinStart(bin + 1, frameData.nearPlane, frameData.farPlane))
+        };
+
+        float3 boxMin = float3(FLT_MAX);
+        float3 boxMax = float3(-FLT_MAX);
+
+        for (uint i = 0; i < 8; i++) {
+            float3 positionLS = lightSpacePosition(frameData, corners[i & 3], binDepths[i >> 2]);
+
+            boxMin = min(boxMin, positionLS);
+            boxMax = max(boxMax, positionLS);
+        }
+
+        device atomic_int *binData = &histogram[DepthHistogramBins + bin * DepthHistogramBinStride];
+        device atomic_int *boundingBox = &binData[DepthHistogramBinBoundingBox];
+
+        atomic_fetch_add_explicit(&binData[DepthHistogramBinCount], binSamples, memory_order_relaxed);
+
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinX], encodeOrderedFloat(boxMin.x), memory_order_relaxed);
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinY], encodeOrderedFloat(boxMin.y), memory_order_relaxed);
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinZ], encodeOrderedFloat(boxMin.z), memory_order_relaxed);
+
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxX], encodeOrderedFloat(boxMax.x), memory_order_relaxed);
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxY], encodeOrderedFloat(boxMax.y), memory_order_relaxed);
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxZ], encodeOrderedFloat(boxMax.z), memory_order_relaxed);
+    }
+}
+
+// Variant of reduce_light_frustum with one thread per cell of params.stride pixels square, which
+// reads a single pixel of the cell.  The sample stands in for the pixels it skips: its bounds grow
+// by the distance to them at the sample's depth on every light space axis, and it goes into every
+// cascade whose depth range lies within that distance.  This only covers skipped pixels at about
+// the same depth, so the CPU merges the bounds of a full rotation of offsets.
+kernel void reduce_light_frustum_sparse(texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                                        constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                        constant     SparseReductionParams &params [[ buffer(BufferIndexSparseReduction) ]],
+                                        uint2 gid [[thread_position_in_grid]],
+                                        device atomic_int * lightFrustumBoundingBox [[ buffer(BufferIndexBoundingBox) ]])
+{
+    uint2 pixel = gid * uint(params.stride) + uint2(params.offsetX, params.offsetY);
+
+    // Cells on the right and bottom edges may lack this frame's pixel
+    if (pixel.x >= depthBuffer.get_width() || pixel.y >= depthBuffer.get_height()) {
+        return;
+    }
+
+    float depth = depthBuffer.read(pixel).x;
+    if (depth < 1e-6) {
+        return;
+    }
+
+    float padding = depth * params.padding;
+
+    float3 positionLS = lightSpacePosition(frameData, float2(pixel), depth);
+
+    int3 boxMin = int3(encodeOrderedFloat(positionLS.x - padding),
+                       encodeOrderedFloat(positionLS.y - padding),
+                       encodeOrderedFloat(positionLS.z - padding));
+    int3 boxMax = int3(encodeOrderedFloat(positionLS.x + padding),
+                       encodeOrderedFloat(positionLS.y + padding),
+                       encodeOrderedFloat(positionLS.z + padding));
+
+    for (uint i = 0; i < frameData.cascadeCount; i++) {
+        if (depth + padding > frameData.cascadeEnds[i] && depth - padding < frameData.cascadeEnds[i + 1]) {
+            device atomic_int *boundingBox = &lightFrustumBoundingBox[6 * i];
+
+            atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinX], boxMin.x, memory_order_relaxed);
+            atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinY], boxMin.y, memory_order_relaxed);
+            atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinZ], boxMin.z, memory_order_relaxed);
+
+            atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxX], boxMax.x, memory_order_relaxed);
+            atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxY], boxMax.y, memory_order_relaxed);
+            atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxZ], boxMax.z, memory_order_relaxed);
+        }
+    }
+}
+
+// Per cascade largest aliasing error and error histogram of the samples, for the split optimizer
+// of FEEDBACK_PARTITIONING.  Each threadgroup reduces into threadgroup memory first and merges
+// the entries its samples reached, so it issues at most one device atomic per entry.
+kernel void reduce_aliasing_error(texture2d<float> depthBuffer [[texture(TextureIndexDepth)]],
+                                  constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                  constant     float        &shadowMapSize [[ buffer(BufferIndexShadowMapSize) ]],
+                                  device atomic_int * aliasingErrors [[ buffer(BufferIndexAliasingError) ]],
+                                  uint2 gid [[thread_position_in_grid]],
+                                  ushort2 tid [[thread_position_in_threadgroup]],
+                                  ushort2 threadgroupSize [[threads_per_threadgroup]])
+{
+    threadgroup atomic_int partialErrors[AliasingErrorLength];
+
+    uint threadIndex = tid.y * threadgroupSize.x + tid.x;
+    uint threadCount = threadgroupSize.x * threadgroupSize.y;
+
+    for (uint i = threadIndex; i < AliasingErrorLength; i += threadCount) {
+        atomic_store_explicit(&partialErrors[i], aliasingErrorResetValue(i), memory_order_relaxed);
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    // Threads past the right and bottom edges still take part in the barriers
+    float depth = 0.0f;
+
+    if (gid.x < depthBuffer.get_width() && gid.y < depthBuffer.get_height()) {
+        depth = depthBuffer.read(gid).x;
+    }
+
+    for (uint i = 0; i < frameData.cascadeCount && depth >= 1e-6; i++) {
+        if (depth >= frameData.cascadeEnds[i] && depth < frameData.cascadeEnds[i + 1]) {
+            float error = shadowAliasingError(depth, frameData.cascadeEnds[i], frameData.cascadeEnds[i + 1],
+                                              tan(frameData.fov / 2.0f), frameData.screenWidth,
+                                              frameData.shadowAtlasRects[i].z * shadowMapSize);
+
+            threadgroup atomic_int *cascadeErrors = &partialErrors[i * AliasingErrorCascadeStride];
+
+            atomic_fetch_max_explicit(&cascadeErrors[AliasingErrorMax], encodeOrderedFloat(error), memory_order_relaxed);
+            atomic_fetch_add_explicit(&cascadeErrors[AliasingErrorBins + aliasingErrorBin(error)], 1, memory_order_relaxed);
+            break;
+        }
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (uint i = threadIndex; i < AliasingErrorLength; i += threadCount) {
+        int value = atomic_load_explicit(&partialErrors[i], memory_order_relaxed);
+
+        if (value == aliasingErrorResetValue(i)) {
+            continue;
+        }
+
+        if (i % AliasingErrorCascadeStride == AliasingErrorMax) {
+            atomic_fetch_max_explicit(&aliasingErrors[i], value, memory_order_relaxed);
+        } else {
+            atomic_fetch_add_explicit(&aliasingErrors[i], value, memory_order_relaxed);
+        }
+    }
+}
+
+// Tile shader variant of reduce_depth_histogram for the single pass deferred renderer, whose
+// G-buffer only lives in tile memory.  It runs inside the combined G-buffer and lighting pass and
+// reads depth from the imageblock.  Each tile first reduces its samples into a partial histogram
+// with the same layout in threadgroup memory, then merges the entries its samples reached into
+// the frame's histogram, so a tile issues at most one device atomic per histogram entry.
+kernel void reduce_depth_histogram_tile(imageblock<GBufferData, imageblock_layout_implicit> gBuffer,
+                                        constant     FrameData    &frameData [[ buffer(BufferIndexFrameData) ]],
+                                        device atomic_int * histogram [[ buffer(BufferIndexDepthHistogram) ]],
+                                        threadgroup atomic_int * tileHistogram [[ threadgroup(0) ]],
+                                        ushort2 tid [[thread_position_in_threadgroup]],
+                                        ushort2 tileSize [[threads_per_threadgroup]],
+                                        uint2 gid [[thread_position_in_grid]])
+{
+    uint threadIndex = tid.y * tileSize.x + tid.x;
+    uint threadCount = tileSize.x * tileSize.y;
+
+    for (uint i = threadIndex; i < DepthHistogramLength; i += threadCount) {
+        atomic_store_explicit(&tileHistogram[i],
+                              depthHistogramResetValue(i, frameData.nearPlane, frameData.farPlane),
+                              memory_order_relaxed);
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    float depth = gBuffer.read(tid).depth;
+
+    // Tiles on the right and bottom edges extend past the render target
+    if (depth >= 1e-6 && gid.x < frameData.framebuffer_width && gid.y < frameData.framebuffer_height) {
+        int depthInt = encodeOrderedFloat(depth);
+
+        atomic_fetch_min_explicit(&tileHistogram[DepthHistogramMinDepth], depthInt, memory_order_relaxed);
+        atomic_fetch_max_explicit(&tileHistogram[DepthHistogramMaxDepth], depthInt, memory_order_relaxed);
+
+        // convert to nonlinear depth;
+        float4 samplePosition = frameData.projection_matrix * float4(0, 0, depth, 1.0);
+
+        // get postion in light space from depth map
+        float4 positionLS = frameData.unproject_matrix * float4(gid.x, gid.y, samplePosition.z / samplePosition.w, 1.0);
+        positionLS /= positionLS.w;
+        positionLS = frameData.shadow_view_matrix * positionLS;
+
+        int bin = depthHistogramBin(depth, frameData.nearPlane, frameData.farPlane);
+
+        threadgroup atomic_int *binData = &tileHistogram[DepthHistogramBins + bin * DepthHistogramBinStride];
+        threadgroup atomic_int *boundingBox = &binData[DepthHistogramBinBoundingBox];
+
+        atomic_fetch_add_explicit(&binData[DepthHistogramBinCount], 1, memory_order_relaxed);
+
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinX], encodeOrderedFloat(positionLS.x), memory_order_relaxed);
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinY], encodeOrderedFloat(positionLS.y), memory_order_relaxed);
+        atomic_fetch_min_explicit(&boundingBox[BoundingBoxMinZ], encodeOrderedFloat(positionLS.z), memory_order_relaxed);
+
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxX], encodeOrderedFloat(positionLS.x), memory_order_relaxed);
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxY], encodeOrderedFloat(positionLS.y), memory_order_relaxed);
+        atomic_fetch_max_explicit(&boundingBox[BoundingBoxMaxZ], encodeOrderedFloat(positionLS.z), memory_order_relaxed);
+    }
+
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (uint i = threadIndex; i < DepthHistogramLength; i += threadCount) {
+        int value = atomic_load_explicit(&tileHistogram[i], memory_order_relaxed);
+
+        if (value == depthHistogramResetValue(i, frameData.nearPlane, frameData.farPlane)) {
+            continue;
+        }
+
+        switch (depthHistogramMergeOp(i)) {
+            case DepthHistogramMergeMin:
+                atomic_fetch_min_explicit(&histogram[i], value, memory_order_relaxed);
+                break;
+            case DepthHistogramMergeMax:
+                atomic_fetch_max_explicit(&histogram[i], value, memory_order_relaxed);
+                break;
+            case DepthHistogramMergeAdd:
+                atomic_fetch_add_explicit(&histogram[i], value, memory_order_relaxed);
+                break;
+        }
+    }
+}
+
+// Builds the cascade splits and shadow matrices of the current frame from the depth histogram of
+// the previous frame, so the shadow and G-buffer passes never wait on a CPU readback.  One thread
+// per cascade; every thread derives the splits itself since they are cheap to recompute.
+kernel void build_cascade_matrices(device FrameData &frameData [[ buffer(BufferIndexFrameData) ]],
+                                   const device int *histogram [[ buffer(BufferIndexDepthHistogram) ]],
+                                   uint cascade [[thread_position_in_grid]])
+{
+    if (cascade >= frameData.cascadeCount) {
+        return;
+    }
+
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+
+    uint usedCount = cascadePartitioning(frameData.partitioning_mode,
+                                         decodeOrderedFloat(histogram[DepthHistogramMinDepth]),
+                                         decodeOrderedFloat(histogram[DepthHistogramMaxDepth]),
+                                         frameData.nearPlane, frameData.farPlane,
+                                         histogram,
+                                         frameData.cascadeCount, cascadeEnds);
+
+    if (cascade == 0) {
+        for (uint i = 0; i < frameData.cascadeCount + 1; i++) {
+            frameData.cascadeEnds[i] = cascadeEnds[i];
+        }
+    }
+
+    // The CPU encodes the shadow pass before these splits exist, so it still draws the cascades
+    // partitioning left unused.  A zero matrix collapses every triangle to a point, which covers
+    // no pixels, and no receiver samples a zero width cascade.
+    if (cascade >= usedCount) {
+        frameData.shadow_mvp_matrices[cascade] = float4x4(0.0);
+        frameData.shadow_mvp_xform_matrices[cascade] = float4x4(0.0);
+        return;
+    }
+
+    float boundingBox[6];
+    cascadeBoundsFromDepthHistogram(histogram, frameData.nearPlane, frameData.farPlane,
+                                    cascadeEnds[cascade], cascadeEnds[cascade + 1], boundingBox);
+
+    CascadeProjection projection = cascadeOrthoProjection(boundingBox);
+
+    float4x4 shadowMVP = frameData.shadow_view_matrix * frameData.temple_model_matrix;
+    float4x4 shadowXform = shadowMVP;
+
+    applyCascadeProjection(projection, shadowMVP);
+    applyCascadeProjection(cascadeTextureProjection(projection), shadowXform);
+
+    frameData.shadow_mvp_matrices[cascade] = shadowMVP;
+    frameData.shadow_mvp_xform_matrices[cascade] = shadowXform;
+}
@@ -0,0 +1,723 @@
+//
+//  SDSMShared.h
+//  DeferredLighting C++
+//
+//  Data layouts and helper functions of the sample distribution shadow map reductions that are
+//  shared between the Metal kernels and the C++ code reading their results.  Everything here
+//  compiles both as Metal and as plain C++.
+//
+
+#ifndef SDSMShared_h
+#define SDSMShared_h
+
+#include "AAPLConfig.h"
+
+#ifdef __METAL_VERSION__
+#define SDSM_LOG(x) metal::log(x)
+#define SDSM_POW(x, y) metal::pow(x, y)
+#define SDSM_SQRT(x) metal::sqrt(x)
+#define SDSM_MIN(a, b) metal::min(a, b)
+#define SDSM_MAX(a, b) metal::max(a, b)
+// Address spaces of pointer arguments.  Plain C++ has a single address space.
+#define SDSM_THREAD thread
+#define SDSM_DEVICE device
+#define SDSM_FLOAT_AS_INT(x) as_type<int>(x)
+#define SDSM_INT_AS_FLOAT(x) as_type<float>(x)
+#else
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#define SDSM_LOG(x) logf(x)
+#define SDSM_POW(x, y) powf(x, y)
+#define SDSM_SQRT(x) sqrtf(x)
+#define SDSM_MIN(a, b) std::min(a, b)
+#define SDSM_MAX(a, b) std::max(a, b)
+#define SDSM_THREAD
+#define SDSM_DEVICE
+#define SDSM_FLOAT_AS_INT(x) sdsmFloatAsInt(x)
+#define SDSM_INT_AS_FLOAT(x) sdsmIntAsFloat(x)
+
+inline int sdsmFloatAsInt(float value)
+{
+    int bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float sdsmIntAsFloat(int bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+#endif
+
+// Order preserving encoding of floats as ints, used by the reductions' atomic min and max.  The
+// bits of positive floats already order like ints; negative floats have their magnitude bits
+// flipped so that a larger magnitude gives a smaller int.  The encoding is exact, covers the whole
+// float range and is its own inverse.  -0 orders just below +0, and NaNs order outside the
+// infinities, so the reductions must not feed them in.
+inline int encodeOrderedFloat(float value)
+{
+    int bits = SDSM_FLOAT_AS_INT(value);
+    return bits >= 0 ? bits : bits ^ 0x7FFFFFFF;
+}
+
+inline float decodeOrderedFloat(int encoded)
+{
+    return SDSM_INT_AS_FLOAT(encoded >= 0 ? encoded : encoded ^ 0x7FFFFFFF);
+}
+
+// Layout of the int buffer written by reduce_depth_histogram.  The buffer starts with the min and
+// max depth followed by SDSM_HISTOGRAM_BIN_COUNT bins.  Each bin covers a fixed log depth range
+// between the near and far planes and holds its sample count and the light space bounding box
+// (in BoundingBoxIndex order) of its samples.  Depths and coordinates use encodeOrderedFloat.
+typedef enum DepthHistogramIndex
+{
+    DepthHistogramMinDepth       = 0,
+    DepthHistogramMaxDepth       = 1,
+    DepthHistogramBins           = 2,
+
+    DepthHistogramBinCount       = 0,
+    DepthHistogramBinBoundingBox = 1,
+    DepthHistogramBinStride      = 7,
+
+    DepthHistogramLength         = DepthHistogramBins + SDSM_HISTOGRAM_BIN_COUNT * DepthHistogramBinStride
+} DepthHistogramIndex;
+
+// Returns the histogram bin containing an eye space depth
+inline int depthHistogramBin(float depth, float nearPlane, float farPlane)
+{
+    int bin = (int)(SDSM_LOG(depth / nearPlane) / SDSM_LOG(farPlane / nearPlane) * SDSM_HISTOGRAM_BIN_COUNT);
+
+    return bin < 0 ? 0 : (bin >= SDSM_HISTOGRAM_BIN_COUNT ? SDSM_HISTOGRAM_BIN_COUNT - 1 : bin);
+}
+
+// Eye space depth at which a histogram bin starts.  The first and last bins also hold the samples
+// clamped into them, so they are open towards zero and infinity respectively.
+inline float depthHistogramBinStart(int bin, float nearPlane, float farPlane)
+{
+    if (bin <= 0) {
+        return 0.0f;
+    }
+
+    if (bin >= SDSM_HISTOGRAM_BIN_COUNT) {
+        return FLT_MAX;
+    }
+
+    return nearPlane * SDSM_POW(farPlane / nearPlane, (float)bin / (float)SDSM_HISTOGRAM_BIN_COUNT);
+}
+
+// Bounding boxes are stored as min x, y, z followed by max x, y, z (BoundingBoxIndex order).
+// They are reset to an inverted box before each reduction so untouched boxes stay empty.
+inline void resetBoundingBox(SDSM_THREAD int *boundingBox)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        boundingBox[axis] = encodeOrderedFloat(FLT_MAX);
+        boundingBox[axis + 3] = encodeOrderedFloat(-FLT_MAX);
+    }
+}
+
+inline void mergeBoundingBox(SDSM_THREAD int *boundingBox, const SDSM_DEVICE int *other)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        boundingBox[axis] = SDSM_MIN(boundingBox[axis], other[axis]);
+        boundingBox[axis + 3] = SDSM_MAX(boundingBox[axis + 3], other[axis + 3]);
+    }
+}
+
+// How an entry of a partial depth histogram, such as the per tile histograms of
+// reduce_depth_histogram_tile, is combined into the frame's histogram
+typedef enum DepthHistogramMergeOp
+{
+    DepthHistogramMergeMin = 0,
+    DepthHistogramMergeMax = 1,
+    DepthHistogramMergeAdd = 2
+} DepthHistogramMergeOp;
+
+inline DepthHistogramMergeOp depthHistogramMergeOp(int index)
+{
+    if (index == DepthHistogramMinDepth) {
+        return DepthHistogramMergeMin;
+    }
+
+    if (index == DepthHistogramMaxDepth) {
+        return DepthHistogramMergeMax;
+    }
+
+    int field = (index - DepthHistogramBins) % DepthHistogramBinStride;
+
+    if (field == DepthHistogramBinCount) {
+        return DepthHistogramMergeAdd;
+    }
+
+    return field - DepthHistogramBinBoundingBox < 3 ? DepthHistogramMergeMin : DepthHistogramMergeMax;
+}
+
+// Value of a histogram entry no sample has reached yet, as written by resetDepthHistogram.
+// Merging an entry that still holds it changes nothing, so partial histograms skip those.
+inline int depthHistogramResetValue(int index, float nearPlane, float farPlane)
+{
+    if (index == DepthHistogramMinDepth) {
+        return encodeOrderedFloat(farPlane);
+    }
+
+    if (index == DepthHistogramMaxDepth) {
+        return encodeOrderedFloat(nearPlane);
+    }
+
+    if ((index - DepthHistogramBins) % DepthHistogramBinStride == DepthHistogramBinCount) {
+        return 0;
+    }
+
+    return depthHistogramMergeOp(index) == DepthHistogramMergeMin ?
+        encodeOrderedFloat(FLT_MAX) : encodeOrderedFloat(-FLT_MAX);
+}
+
+inline void decodeBoundingBox(const SDSM_THREAD int *boundingBox, SDSM_THREAD float *result)
+{
+    for (int i = 0; i < 6; i++) {
+        result[i] = decodeOrderedFloat(boundingBox[i]);
+    }
+}
+
+// The min/max depth pyramid built by build_depth_pyramid_base and build_depth_pyramid_level.
+// Level 0 has half the resolution of the depth buffer, rounded up, and every further level halves
+// the one before it down to a single texel.  A texel holds the min and max eye space depth of the
+// 2 x 2 texels below it; reads past the right and bottom edges clamp to the last row and column.
+// Empty pixels do not lower the minimum, so a texel covering only empty pixels holds FLT_MAX, 0.
+inline int depthPyramidLevelSize(int size)
+{
+    return (size + 1) / 2;
+}
+
+inline int depthPyramidLevelCount(int width, int height)
+{
+    int count = 1;
+
+    for (width = depthPyramidLevelSize(width), height = depthPyramidLevelSize(height);
+         width > 1 || height > 1;
+         width = depthPyramidLevelSize(width), height = depthPyramidLevelSize(height)) {
+        count++;
+    }
+
+    return count;
+}
+
+// Value a depth buffer pixel contributes to the minimum of its pyramid texel
+inline float depthPyramidMinSample(float depth)
+{
+    return depth > 0.0f ? depth : FLT_MAX;
+}
+
+// Both return one of their arguments, so the GPU and CPU pyramids agree bit for bit for any depth
+// that is not NaN
+inline float depthPyramidMin(float a, float b)
+{
+    return a < b ? a : b;
+}
+
+inline float depthPyramidMax(float a, float b)
+{
+    return a > b ? a : b;
+}
+
+// Parameters of reduce_light_frustum_sparse.  The depth buffer is split into cells of stride
+// pixels square and the kernel reads the pixel at offsetX, offsetY of every cell.  padding is the
+// light space distance from that pixel to the farthest pixel of its cell per unit of eye space
+// depth, see sparseReductionPadding.
+struct SparseReductionParams
+{
+    int stride;
+    int offsetX;
+    int offsetY;
+    float padding;
+};
+
+// Pixel of its cell the sparse reduction reads in a given frame.  The offset walks the cell in the
+// order of an ordered dither matrix, so the pixels of consecutive frames lie far apart and every
+// pixel is read once per stride * stride frames.  stride must be a power of two.
+inline void sparseReductionOffset(unsigned int frame, int stride, SDSM_THREAD int *offsetX, SDSM_THREAD int *offsetY)
+{
+    unsigned int index = frame % (unsigned int)(stride * stride);
+
+    *offsetX = 0;
+    *offsetY = 0;
+
+    // Two bits of the index per level of the matrix, coarsest level first
+    for (int bit = stride >> 1; bit > 0; bit >>= 1, index >>= 2) {
+        unsigned int quadrant = index & 3;
+
+        *offsetX += (quadrant == 1 || quadrant == 2) ? bit : 0;
+        *offsetY += (quadrant == 1 || quadrant == 3) ? bit : 0;
+    }
+}
+
+// Padding of SparseReductionParams for cells of stride pixels square, where pixelSize is the
+// width of a pixel at an eye space depth of 1.  A pixel at the same depth as the read one lies at
+// most stride - 1 pixels away along both axes.  Pixels of a cell at other depths are not covered.
+inline float sparseReductionPadding(int stride, float pixelSize)
+{
+    return (float)(stride - 1) * 1.41421356f * pixelSize;
+}
+
+// Derives the light space bounding box of the cascade between two splits from a reduced histogram
+// by merging the non empty bins overlapping it.  Bins straddling a split contribute to both
+// cascades, which keeps the result conservative at the cost of up to one bin of extra depth.
+inline void cascadeBoundsFromDepthHistogram(const SDSM_DEVICE int *histogram, float nearPlane, float farPlane,
+                                            float cascadeStart, float cascadeEnd,
+                                            SDSM_THREAD float *result)
+{
+    int boundingBox[6];
+    resetBoundingBox(boundingBox);
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        const SDSM_DEVICE int *binData = histogram + DepthHistogramBins + bin * DepthHistogramBinStride;
+
+        if (binData[DepthHistogramBinCount] == 0 ||
+            depthHistogramBinStart(bin, nearPlane, farPlane) > cascadeEnd ||
+            depthHistogramBinStart(bin + 1, nearPlane, farPlane) < cascadeStart) {
+            continue;
+        }
+
+        mergeBoundingBox(boundingBox, binData + DepthHistogramBinBoundingBox);
+    }
+
+    decodeBoundingBox(boundingBox, result);
+}
+
+inline void logPartitioning(float min, float max, int partitionCount, SDSM_THREAD float *result)
+{
+    for (int i = 0; i < partitionCount + 1; i++) {
+        result[i] = SDSM_POW(max / min, (float)i / (float)partitionCount) * min;
+    }
+}
+
+inline void uniformPartitioning(float min, float max, int partitionCount, SDSM_THREAD float *result)
+{
+    for (int i = 0; i < partitionCount + 1; i++) {
+        result[i] = min + (max - min) * (float)i / (float)partitionCount;
+    }
+}
+
+// Nominal eye space depth of a histogram bin edge, limited to the reduced depth range
+inline float depthHistogramEdge(int edge, float nearPlane, float farPlane, float min, float max)
+{
+    float depth = nearPlane * SDSM_POW(farPlane / nearPlane, (float)edge / (float)SDSM_HISTOGRAM_BIN_COUNT);
+
+    return SDSM_MIN(SDSM_MAX(depth, min), max);
+}
+
+// Places the splits on histogram bin edges so that the total perspective aliasing of the samples
+// is minimal.  A cascade's texels are about as large as the view frustum is wide at its far split
+// and a sample's pixel as wide as the frustum at its depth, so a cascade ending at e costs
+// e / depth per sample.  Solved exactly with dynamic programming over the non empty bin range,
+// which gives empty depth ranges between sparse foreground objects and a distant backdrop no
+// cascade resolution.
+inline void adaptivePartitioning(const SDSM_DEVICE int *histogram, float nearPlane, float farPlane,
+                                 int partitionCount, SDSM_THREAD float *result)
+{
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+
+    int firstBin = SDSM_HISTOGRAM_BIN_COUNT;
+    int lastBin = -1;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        if (histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount] > 0) {
+            firstBin = SDSM_MIN(firstBin, bin);
+            lastBin = bin;
+        }
+    }
+
+    if (lastBin + 1 - firstBin < partitionCount || max <= min || partitionCount > MAX_CASCADED_SHADOW_COUNT) {
+        logPartitioning(min, max, partitionCount, result);
+        return;
+    }
+
+    // Prefix sums of count / depth, so a cascade over bins [a, b) costs edge(b) * (prefix[b] - prefix[a])
+    float prefix[SDSM_HISTOGRAM_BIN_COUNT + 1];
+    prefix[firstBin] = 0.0f;
+
+    for (int bin = firstBin; bin <= lastBin; bin++) {
+        float depth = SDSM_MIN(SDSM_MAX(nearPlane * SDSM_POW(farPlane / nearPlane, ((float)bin + 0.5f) / (float)SDSM_HISTOGRAM_BIN_COUNT), min), max);
+        int count = histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+
+        prefix[bin + 1] = prefix[bin] + (float)count / depth;
+    }
+
+    float cost[SDSM_HISTOGRAM_BIN_COUNT + 1];
+    float nextCost[SDSM_HISTOGRAM_BIN_COUNT + 1];
+    int splitBefore[MAX_CASCADED_SHADOW_COUNT][SDSM_HISTOGRAM_BIN_COUNT + 1];
+
+    for (int end = firstBin + 1; end <= lastBin + 1; end++) {
+        cost[end] = depthHistogramEdge(end, nearPlane, farPlane, min, max) * prefix[end];
+        splitBefore[0][end] = firstBin;
+    }
+
+    for (int partition = 1; partition < partitionCount; partition++) {
+        for (int end = firstBin + partition + 1; end <= lastBin + 1; end++) {
+            float edge = depthHistogramEdge(end, nearPlane, farPlane, min, max);
+
+            nextCost[end] = FLT_MAX;
+
+            for (int start = firstBin + partition; start < end; start++) {
+                float candidate = cost[start] + edge * (prefix[end] - prefix[start]);
+
+                if (candidate < nextCost[end]) {
+                    nextCost[end] = candidate;
+                    splitBefore[partition][end] = start;
+                }
+            }
+        }
+
+        for (int end = firstBin + partition + 1; end <= lastBin + 1; end++) {
+            cost[end] = nextCost[end];
+        }
+    }
+
+    result[0] = min;
+    result[partitionCount] = max;
+
+    int end = lastBin + 1;
+    for (int partition = partitionCount - 1; partition > 0; partition--) {
+        end = splitBefore[partition][end];
+        result[partition] = depthHistogramEdge(end, nearPlane, farPlane, min, max);
+    }
+}
+
+// Finds up to partitionCount clusters in the log depth distribution of a reduced histogram with
+// 1D k-means over the non empty bins and fits one cascade to each cluster.  Splits are placed in
+// the middle of the gaps between clusters, so each cascade's light space bounds only cover its
+// cluster.  Clusters that end up empty are dropped and the unused cascades get zero width at the
+// far end.  Returns the number of cascades in use.
+inline int clusteredPartitioning(const SDSM_DEVICE int *histogram, float nearPlane, float farPlane,
+                                 int partitionCount, SDSM_THREAD float *result)
+{
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+
+    int firstBin = SDSM_HISTOGRAM_BIN_COUNT;
+    int lastBin = -1;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        if (histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount] > 0) {
+            firstBin = SDSM_MIN(firstBin, bin);
+            lastBin = bin;
+        }
+    }
+
+    if (lastBin < firstBin || max <= min || partitionCount > MAX_CASCADED_SHADOW_COUNT) {
+        logPartitioning(min, max, partitionCount, result);
+        return partitionCount;
+    }
+
+    // Centroids are kept in bin units, which are linear in log depth.  Spreading them over the
+    // occupied range rather than over sample quantiles lets a small near cluster keep its own
+    // centroid next to a backdrop holding most of the samples.
+    float centroids[MAX_CASCADED_SHADOW_COUNT] = {};
+    int clusterCount = partitionCount;
+
+    for (int i = 0; i < clusterCount; i++) {
+        centroids[i] = (float)firstBin + 0.5f +
+            (float)(lastBin - firstBin) * ((float)i + 0.5f) / (float)clusterCount;
+    }
+
+    int clusterFirstBins[MAX_CASCADED_SHADOW_COUNT];
+    int clusterLastBins[MAX_CASCADED_SHADOW_COUNT];
+
+    for (int iteration = 0; iteration < 8; iteration++) {
+        float weights[MAX_CASCADED_SHADOW_COUNT];
+        float sums[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < clusterCount; i++) {
+            weights[i] = 0.0f;
+            sums[i] = 0.0f;
+            clusterFirstBins[i] = SDSM_HISTOGRAM_BIN_COUNT;
+            clusterLastBins[i] = -1;
+        }
+
+        // Centroids stay sorted in 1D, so the nearest one is found with a forward scan
+        int cluster = 0;
+
+        for (int bin = firstBin; bin <= lastBin; bin++) {
+            int count = histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+            if (count == 0) {
+                continue;
+            }
+
+            float center = (float)bin + 0.5f;
+
+            while (cluster < clusterCount - 1 &&
+                   center - centroids[cluster] > centroids[cluster + 1] - center) {
+                cluster++;
+            }
+
+            weights[cluster] += (float)count;
+            sums[cluster] += (float)count * center;
+            clusterFirstBins[cluster] = SDSM_MIN(clusterFirstBins[cluster], bin);
+            clusterLastBins[cluster] = bin;
+        }
+
+        // Move the centroids and drop clusters that attracted no samples
+        int keptCount = 0;
+        bool converged = true;
+
+        for (int i = 0; i < clusterCount; i++) {
+            if (weights[i] == 0.0f) {
+                converged = false;
+                continue;
+            }
+
+            float centroid = sums[i] / weights[i];
+            converged = converged && centroid == centroids[i];
+
+            centroids[keptCount] = centroid;
+            clusterFirstBins[keptCount] = clusterFirstBins[i];
+            clusterLastBins[keptCount] = clusterLastBins[i];
+            keptCount++;
+        }
+
+        clusterCount = keptCount;
+
+        if (converged) {
+            break;
+        }
+    }
+
+    result[0] = min;
+
+    for (int i = 1; i < clusterCount; i++) {
+        float gapStart = depthHistogramEdge(clusterLastBins[i - 1] + 1, nearPlane, farPlane, min, max);
+        float gapEnd = depthHistogramEdge(clusterFirstBins[i], nearPlane, farPlane, min, max);
+
+        result[i] = SDSM_MAX(SDSM_SQRT(gapStart * gapEnd), result[i - 1]);
+    }
+
+    for (int i = clusterCount; i <= partitionCount; i++) {
+        result[i] = max;
+    }
+
+    return clusterCount;
+}
+
+// Splits for a partitioning mode.  Adaptive and clustered partitioning need the histogram of the fused
+// reduction and falls back to log partitioning of [min, max] without one.  Feedback partitioning
+// is refined by the CPU's AliasingSplitOptimizer and starts from log partitioning here.  Returns
+// the number of cascades in use; the cascades after them have zero width and are not rendered.
+inline int cascadePartitioning(PartitioningMode mode, float min, float max,
+                               float nearPlane, float farPlane,
+                               const SDSM_DEVICE int *histogram,
+                               int partitionCount, SDSM_THREAD float *result)
+{
+    if (mode == ADAPTIVE_PARTITIONING && histogram) {
+        adaptivePartitioning(histogram, nearPlane, farPlane, partitionCount, result);
+    } else if (mode == CLUSTERED_PARTITIONING && histogram) {
+        return clusteredPartitioning(histogram, nearPlane, farPlane, partitionCount, result);
+    } else if (mode == UNIFORM_PARTITIONING) {
+        uniformPartitioning(nearPlane, farPlane, partitionCount, result);
+    } else {
+        logPartitioning(min, max, partitionCount, result);
+    }
+
+    return partitionCount;
+}
+
+// Number of log partitioned cascades needed so that no cascade spans a larger far / near depth
+// ratio than targetRatio.  To keep the count from flickering on depth ranges close to a threshold,
+// it only drops below currentCount once the smaller count fits with 10% headroom.
+inline int autoCascadeCount(float minDepth, float maxDepth, float targetRatio, int currentCount)
+{
+    if (!(minDepth > 0.0f) || !(maxDepth > minDepth) || !(targetRatio > 1.0f)) {
+        return 1;
+    }
+
+    float rangeRatio = SDSM_LOG(maxDepth / minDepth);
+
+    int count = (int)ceil(rangeRatio / SDSM_LOG(targetRatio) - 1e-4f);
+    count = SDSM_MIN(SDSM_MAX(count, 1), MAX_CASCADED_SHADOW_COUNT);
+
+    if (count < currentCount && currentCount <= MAX_CASCADED_SHADOW_COUNT &&
+        rangeRatio / (float)count > SDSM_LOG(targetRatio * 0.9f)) {
+        count = SDSM_MIN(count + 1, currentCount);
+    }
+
+    return count;
+}
+
+// Perspective aliasing of a sample at an eye space depth in the cascade between two splits: how
+// many of the sample's pixels one of the cascade's shadow texels covers, as shown by
+// VISUALIZE_ALIASING_ERROR.  cascadeTexels is the width of the cascade's region of the shadow map.
+inline float shadowAliasingError(float depth, float cascadeStart, float cascadeEnd,
+                                 float tanHalfFov, float screenWidth, float cascadeTexels)
+{
+    return (cascadeEnd - cascadeStart) * screenWidth / (depth * tanHalfFov * cascadeTexels) * 0.25f;
+}
+
+// Log2 aliasing error range of reduce_aliasing_error's error histogram.  Errors outside the range
+// are clamped into the first and last bins.
+#define SDSM_ALIASING_ERROR_BIN_COUNT 32
+#define SDSM_ALIASING_ERROR_MIN_LOG2  (-4.0f)
+#define SDSM_ALIASING_ERROR_MAX_LOG2  4.0f
+
+// Layout of the int buffer written by reduce_aliasing_error: per cascade, the largest aliasing
+// error of its samples as encodeOrderedFloat and a histogram of their log2 errors
+typedef enum AliasingErrorIndex
+{
+    AliasingErrorMax           = 0,
+    AliasingErrorBins          = 1,
+    AliasingErrorCascadeStride = AliasingErrorBins + SDSM_ALIASING_ERROR_BIN_COUNT,
+
+    AliasingErrorLength        = MAX_CASCADED_SHADOW_COUNT * AliasingErrorCascadeStride
+} AliasingErrorIndex;
+
+inline int aliasingErrorBin(float error)
+{
+    int bin = (int)((SDSM_LOG(error) / SDSM_LOG(2.0f) - SDSM_ALIASING_ERROR_MIN_LOG2) /
+                    (SDSM_ALIASING_ERROR_MAX_LOG2 - SDSM_ALIASING_ERROR_MIN_LOG2) * SDSM_ALIASING_ERROR_BIN_COUNT);
+
+    return bin < 0 ? 0 : (bin >= SDSM_ALIASING_ERROR_BIN_COUNT ? SDSM_ALIASING_ERROR_BIN_COUNT - 1 : bin);
+}
+
+// Aliasing error at which a bin of the error histogram starts
+inline float aliasingErrorBinStart(int bin)
+{
+    return SDSM_POW(2.0f, SDSM_ALIASING_ERROR_MIN_LOG2 + (SDSM_ALIASING_ERROR_MAX_LOG2 - SDSM_ALIASING_ERROR_MIN_LOG2) *
+                          (float)bin / (float)SDSM_ALIASING_ERROR_BIN_COUNT);
+}
+
+inline int aliasingErrorResetValue(int index)
+{
+    return index % AliasingErrorCascadeStride == AliasingErrorMax ? encodeOrderedFloat(0.0f) : 0;
+}
+
+inline void resetAliasingErrors(SDSM_THREAD int *aliasingErrors)
+{
+    for (int i = 0; i < AliasingErrorLength; i++) {
+        aliasingErrors[i] = aliasingErrorResetValue(i);
+    }
+}
+
+// Aliasing error below which a fraction of a cascade's samples lie, taken at the end of the bin
+// reaching the fraction and limited to the largest error.  0 for a cascade without samples.
+inline float aliasingErrorPercentile(const SDSM_DEVICE int *aliasingErrors, int cascade, float fraction)
+{
+    const SDSM_DEVICE int *cascadeErrors = aliasingErrors + cascade * AliasingErrorCascadeStride;
+
+    int total = 0;
+    for (int bin = 0; bin < SDSM_ALIASING_ERROR_BIN_COUNT; bin++) {
+        total += cascadeErrors[AliasingErrorBins + bin];
+    }
+
+    float maxError = decodeOrderedFloat(cascadeErrors[AliasingErrorMax]);
+    int count = 0;
+
+    for (int bin = 0; bin < SDSM_ALIASING_ERROR_BIN_COUNT; bin++) {
+        count += cascadeErrors[AliasingErrorBins + bin];
+
+        if (count > 0 && (float)count >= fraction * (float)total) {
+            return SDSM_MIN(aliasingErrorBinStart(bin + 1), maxError);
+        }
+    }
+
+    return maxError;
+}
+
+// An orthographic shadow projection only scales and offsets light view space, so it is kept as
+// one scale and offset per axis instead of a full matrix
+struct CascadeProjection
+{
+    float scale[3];
+    float offset[3];
+};
+
+// Light view space depth of the near plane of cascades whose casters are unknown, such as the
+// cascades built on the GPU.  It is pulled 100 units towards the light to keep casters outside of
+// the receivers' bounds.  CPU built cascades fit the near plane to their casters instead.
+#define SDSM_CASCADE_NEAR_Z (-100.0f)
+
+// Left handed orthographic projection (matrix_ortho_left_hand) fitted to a light view space
+// bounding box in x and y and to the box's far bound in z, with the near plane at nearZ
+inline CascadeProjection cascadeOrthoProjection(const SDSM_THREAD float *boundingBox, float nearZ)
+{
+    float farZ = boundingBox[5];
+
+    CascadeProjection projection;
+
+    projection.scale[0] = 2.0f / (boundingBox[3] - boundingBox[0]);
+    projection.scale[1] = 2.0f / (boundingBox[4] - boundingBox[1]);
+    projection.scale[2] = 1.0f / (farZ - nearZ);
+
+    projection.offset[0] = (boundingBox[0] + boundingBox[3]) / (boundingBox[0] - boundingBox[3]);
+    projection.offset[1] = (boundingBox[1] + boundingBox[4]) / (boundingBox[1] - boundingBox[4]);
+    projection.offset[2] = nearZ / (nearZ - farZ);
+
+    return projection;
+}
+
+inline CascadeProjection cascadeOrthoProjection(const SDSM_THREAD float *boundingBox)
+{
+    return cascadeOrthoProjection(boundingBox, SDSM_CASCADE_NEAR_Z);
+}
+
+// Follows a projection with the mapping from clip space to shadow map texture coordinates, which
+// flips y and converts x and y from [-1, 1] to [0, 1]
+inline CascadeProjection cascadeTextureProjection(CascadeProjection projection)
+{
+    CascadeProjection result = projection;
+
+    result.scale[0] = 0.5f * projection.scale[0];
+    result.scale[1] = -0.5f * projection.scale[1];
+    result.offset[0] = 0.5f * projection.offset[0] + 0.5f;
+    result.offset[1] = -0.5f * projection.offset[1] + 0.5f;
+
+    return result;
+}
+
+// Premultiplies a column major 4x4 matrix by a projection.  Matrix only needs to support
+// matrix[column][row], so it can be a Metal float4x4, the columns of a simd matrix, or float[4][4].
+template <typename Matrix>
+inline void applyCascadeProjection(CascadeProjection projection, SDSM_THREAD Matrix &matrix)
+{
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 3; row++) {
+            matrix[column][row] = projection.scale[row] * matrix[column][row] +
+                                  projection.offset[row] * matrix[column][3];
+        }
+    }
+}
+
+// Layered shadow rendering draws a caster into all of its cascades with one instanced draw, one
+// instance per cascade.  The draw's cascades are packed into a list of 4 bit entries, lowest first,
+// and each instance renders into the shadow map slice its entry names.
+#define SDSM_CASCADE_LIST_BITS 4
+
+static_assert(MAX_CASCADED_SHADOW_COUNT * SDSM_CASCADE_LIST_BITS <= 32,
+              "A cascade list must fit every cascade into 32 bits");
+
+// Packs the cascades set in a mask into a cascade list.  Returns the number of cascades, which is
+// the instance count of the draw.
+inline int packCascadeList(unsigned int cascadeMask, SDSM_THREAD unsigned int *cascadeList)
+{
+    int count = 0;
+
+    *cascadeList = 0;
+
+    for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        if (cascadeMask & (1u << i)) {
+            *cascadeList |= (unsigned int)i << (SDSM_CASCADE_LIST_BITS * count);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// Cascade the given instance of a layered draw renders into
+inline unsigned int cascadeListEntry(unsigned int cascadeList, unsigned int instance)
+{
+    return (cascadeList >> (SDSM_CASCADE_LIST_BITS * instance)) & ((1u << SDSM_CASCADE_LIST_BITS) - 1);
+}
+
+#endif /* SDSMShared_h */
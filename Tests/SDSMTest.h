@@ -0,0 +1,163 @@
+//
+//  SDSMTest.h
+//  DeferredLighting C++
+//
+//  Minimal harness for the portable tests and benchmarks.  SDSM_TEST registers a test, SDSM_CHECK
+//  records a failure without stopping the test, and SDSM_TEST_MAIN runs every registered test and
+//  returns nonzero if any check failed.  Benchmarks pass --quick when run from ctest, so they only
+//  check that they still run, and report full timings when run by hand.
+//
+
+#ifndef SDSMTest_h
+#define SDSMTest_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+struct SDSMTestCase
+{
+    const char *name;
+    void (*function)();
+};
+
+inline std::vector<SDSMTestCase> & sdsmTestCases()
+{
+    static std::vector<SDSMTestCase> testCases;
+    return testCases;
+}
+
+inline int & sdsmTestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+struct SDSMTestRegistration
+{
+    SDSMTestRegistration(const char *name, void (*function)())
+    {
+        sdsmTestCases().push_back({name, function});
+    }
+};
+
+#define SDSM_TEST(name) \
+    static void name(); \
+    static SDSMTestRegistration name##Registration(#name, name); \
+    static void name()
+
+#define SDSM_CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            sdsmTestFailures()++; \
+        } \
+    } while (0)
+
+// Stops checking a loop after its first failure, so an exhaustive test reports one line
+#define SDSM_CHECK_OR_BREAK(condition) \
+    if (!(condition)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+        sdsmTestFailures()++; \
+        break; \
+    }
+
+inline int runSDSMTests()
+{
+    for (const SDSMTestCase & testCase : sdsmTestCases()) {
+        int failures = sdsmTestFailures();
+
+        testCase.function();
+
+        printf("%s %s\n", sdsmTestFailures() == failures ? "PASS" : "FAIL", testCase.name);
+    }
+
+    return sdsmTestFailures() == 0 ? 0 : 1;
+}
+
+#define SDSM_TEST_MAIN() \
+    int main() \
+    { \
+        return runSDSMTests(); \
+    }
+
+// True when a benchmark was started with --quick
+inline bool sdsmQuickBenchmark(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Fastest of several timed runs of a function, in nanoseconds per call
+template <class F>
+double sdsmBenchmark(F function, int iterations, int repetitions = 5)
+{
+    double best = 1e30;
+
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (int i = 0; i < iterations; i++) {
+            function();
+        }
+
+        auto end = std::chrono::steady_clock::now();
+
+        double nanoseconds = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+
+        best = nanoseconds < best ? nanoseconds : best;
+    }
+
+    return best;
+}
+
+// Keeps the optimizer from discarding a result the benchmark does not otherwise use
+template <class T>
+inline void sdsmKeep(const T & value)
+{
+    static volatile uint8_t sink;
+    sink = sink + *(const volatile uint8_t *)&value;
+}
+
+// Small deterministic generator, so every run of a test sees the same inputs
+class SDSMRandom
+{
+public:
+
+    explicit SDSMRandom(uint64_t seed)
+    : m_state(seed * 6364136223846793005ull + 1442695040888963407ull)
+    {
+    }
+
+    uint32_t next()
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t x = (uint32_t)(((m_state >> 18) ^ m_state) >> 27);
+        uint32_t rotation = (uint32_t)(m_state >> 59);
+        return (x >> rotation) | (x << ((32 - rotation) & 31));
+    }
+
+    // Uniform in [low, high)
+    float uniform(float low, float high)
+    {
+        return low + (high - low) * (float)(next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    int integer(int low, int high)
+    {
+        return low + (int)(next() % (uint32_t)(high - low + 1));
+    }
+
+private:
+
+    uint64_t m_state;
+};
+
+#endif /* SDSMTest_h */
@@ -0,0 +1,89 @@
+//
+//  SDSM_BatchTransformBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Throughput of the batched structure of arrays transforms against the per item loops they
+//  replace, for 1k, 100k and 1M points and boxes.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "SDSM_Culling.h"
+
+#include <vector>
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const size_t counts[] = {1000, 100000, 1000000};
+
+    SDSMRandom random(23);
+
+    matrix_float4x4 m = matrix_look_at_left_hand(vector3(3.0f, 4.0f, 5.0f), vector3(0.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f));
+
+    printf("%-8s %-9s %12s %12s\n", "count", "item", "loop M/s", "batched M/s");
+
+    for (size_t n : counts) {
+        if (quick && n > 1000) {
+            break;
+        }
+
+        const int iterations = (int)std::max<size_t>(1, 2000000 / n);
+
+        std::vector<vector_float4> points(n), transformedPoints(n);
+        std::vector<float> x(n), y(n), z(n), rx(n), ry(n), rz(n);
+
+        for (size_t i = 0; i < n; i++) {
+            x[i] = random.uniform(-10.0f, 10.0f);
+            y[i] = random.uniform(-10.0f, 10.0f);
+            z[i] = random.uniform(-10.0f, 10.0f);
+            points[i] = vector4(x[i], y[i], z[i], 1.0f);
+        }
+
+        double loop = sdsmBenchmark([&]() {
+            for (size_t i = 0; i < n; i++) {
+                transformedPoints[i] = m * points[i];
+            }
+            sdsmKeep(transformedPoints[n - 1].x);
+        }, iterations);
+
+        double batched = sdsmBenchmark([&]() {
+            matrix_transform_points(m, {x.data(), y.data(), z.data()}, {rx.data(), ry.data(), rz.data()}, n);
+            sdsmKeep(rx[n - 1]);
+        }, iterations);
+
+        printf("%-8zu %-9s %12.1f %12.1f\n", n, "points", n / loop * 1e3, n / batched * 1e3);
+
+        std::vector<AxisAlignedBox> boxes(n), transformedBoxes(n);
+        std::vector<float> buffer(6 * n), resultBuffer(6 * n);
+        soa_box_float3 soa = soa_box_float3_from_buffer(buffer.data(), n);
+        soa_box_float3 result = soa_box_float3_from_buffer(resultBuffer.data(), n);
+
+        for (size_t i = 0; i < n; i++) {
+            boxes[i] = makeAxisAlignedBox(x[i], y[i], z[i], x[i] + 1.0f, y[i] + 2.0f, z[i] + 3.0f);
+
+            soa.min.x[i] = boxes[i].min[0];
+            soa.min.y[i] = boxes[i].min[1];
+            soa.min.z[i] = boxes[i].min[2];
+            soa.max.x[i] = boxes[i].max[0];
+            soa.max.y[i] = boxes[i].max[1];
+            soa.max.z[i] = boxes[i].max[2];
+        }
+
+        loop = sdsmBenchmark([&]() {
+            for (size_t i = 0; i < n; i++) {
+                transformedBoxes[i] = transformAxisAlignedBox(m.columns[0].elements, boxes[i]);
+            }
+            sdsmKeep(transformedBoxes[n - 1].min[0]);
+        }, iterations);
+
+        batched = sdsmBenchmark([&]() {
+            matrix_transform_boxes(m, soa, result, n);
+            sdsmKeep(result.min.x[n - 1]);
+        }, iterations);
+
+        printf("%-8zu %-9s %12.1f %12.1f\n", n, "boxes", n / loop * 1e3, n / batched * 1e3);
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+//
+//  SDSM_BatchTransformTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the batched structure of arrays transforms: points and boxes give the same bits as
+//  the per item code they replace for every count around the SIMD widths, for infinite and
+//  inverted boxes, and when the result aliases the input.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "SDSM_Culling.h"
+
+#include <vector>
+
+static matrix_float4x4 randomAffineMatrix(SDSMRandom & random)
+{
+    matrix_float4x4 m = matrix_look_at_left_hand(vector3(random.uniform(-50.0f, 50.0f), random.uniform(-50.0f, 50.0f), random.uniform(-50.0f, 50.0f)),
+                                                 vector3(0.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f));
+
+    // Scale and an exact zero, which turns 0 * infinity into a NaN unless the extents stay finite
+    m = m * matrix4x4_scale(random.uniform(0.1f, 10.0f), random.uniform(0.1f, 10.0f), random.uniform(0.1f, 10.0f));
+    m.columns[random.integer(0, 2)][random.integer(0, 2)] = 0.0f;
+
+    return m;
+}
+
+static bool bitEqual(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+SDSM_TEST(pointsMatchMatrixTimesVector)
+{
+    SDSMRandom random(23);
+
+    for (int trial = 0; trial < 2000; trial++) {
+        matrix_float4x4 m = randomAffineMatrix(random);
+        size_t count = (size_t)random.integer(0, 37);
+
+        std::vector<float> x(count), y(count), z(count), rx(count), ry(count), rz(count);
+
+        for (size_t i = 0; i < count; i++) {
+            x[i] = random.uniform(-100.0f, 100.0f);
+            y[i] = random.uniform(-100.0f, 100.0f);
+            z[i] = random.uniform(-100.0f, 100.0f);
+        }
+
+        matrix_transform_points(m, {x.data(), y.data(), z.data()}, {rx.data(), ry.data(), rz.data()}, count);
+
+        for (size_t i = 0; i < count; i++) {
+            vector_float4 expected = m * vector4(x[i], y[i], z[i], 1.0f);
+
+            SDSM_CHECK_OR_BREAK(bitEqual(rx[i], expected.x) && bitEqual(ry[i], expected.y) && bitEqual(rz[i], expected.z));
+        }
+
+        // In place
+        matrix_transform_points(m, {x.data(), y.data(), z.data()}, {x.data(), y.data(), z.data()}, count);
+
+        for (size_t i = 0; i < count; i++) {
+            SDSM_CHECK_OR_BREAK(bitEqual(x[i], rx[i]) && bitEqual(y[i], ry[i]) && bitEqual(z[i], rz[i]));
+        }
+    }
+}
+
+SDSM_TEST(boxesMatchTransformAxisAlignedBox)
+{
+    SDSMRandom random(24);
+
+    for (int trial = 0; trial < 2000; trial++) {
+        matrix_float4x4 m = randomAffineMatrix(random);
+        size_t count = (size_t)random.integer(0, 37);
+
+        std::vector<AxisAlignedBox> boxes(count);
+        std::vector<float> buffer(6 * count), resultBuffer(6 * count);
+
+        soa_box_float3 soa = soa_box_float3_from_buffer(buffer.data(), count);
+        soa_box_float3 result = soa_box_float3_from_buffer(resultBuffer.data(), count);
+
+        for (size_t i = 0; i < count; i++) {
+            int kind = random.integer(0, 9);
+
+            if (kind == 0) {
+                boxes[i] = infiniteAxisAlignedBox();
+            } else if (kind == 1) {
+                boxes[i] = emptyAxisAlignedBox();
+            } else {
+                float x = random.uniform(-100.0f, 100.0f);
+                float y = random.uniform(-100.0f, 100.0f);
+                float z = random.uniform(-100.0f, 100.0f);
+
+                boxes[i] = makeAxisAlignedBox(x, y, z, x + random.uniform(0.0f, 10.0f), y + random.uniform(0.0f, 10.0f),
+                                              z + random.uniform(0.0f, 10.0f));
+            }
+
+            soa.min.x[i] = boxes[i].min[0];
+            soa.min.y[i] = boxes[i].min[1];
+            soa.min.z[i] = boxes[i].min[2];
+            soa.max.x[i] = boxes[i].max[0];
+            soa.max.y[i] = boxes[i].max[1];
+            soa.max.z[i] = boxes[i].max[2];
+        }
+
+        matrix_transform_boxes(m, soa, result, count);
+
+        for (size_t i = 0; i < count; i++) {
+            AxisAlignedBox expected = transformAxisAlignedBox(m.columns[0].elements, boxes[i]);
+
+            SDSM_CHECK_OR_BREAK(bitEqual(result.min.x[i], expected.min[0]) && bitEqual(result.min.y[i], expected.min[1]) &&
+                                bitEqual(result.min.z[i], expected.min[2]) && bitEqual(result.max.x[i], expected.max[0]) &&
+                                bitEqual(result.max.y[i], expected.max[1]) && bitEqual(result.max.z[i], expected.max[2]));
+
+            // Infinite boxes stay infinite instead of turning into NaNs
+            SDSM_CHECK_OR_BREAK(!isnan(result.min.x[i]) && !isnan(result.max.z[i]));
+        }
+
+        // In place
+        matrix_transform_boxes(m, soa, soa, count);
+        SDSM_CHECK_OR_BREAK(memcmp(buffer.data(), resultBuffer.data(), buffer.size() * sizeof(float)) == 0);
+    }
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,358 @@
+//
+//  SDSM_BoundsPredictorTests.cpp
+//  DeferredLighting C++
+//
+//  Replays camera paths over a ray cast scene of spheres on a ground plane.  Every frame's depth is
+//  reduced into a histogram, and the cascade bounds predicted from the histogram of one or two
+//  frames earlier are compared with the bounds of the frame's own histogram, next to the error of
+//  using the earlier bounds as they are.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+#include "SDSM_BoundsPredictor.h"
+
+#include <math.h>
+
+static const int ReplayWidth = 320;
+static const int ReplayHeight = 180;
+static const float ReplayNearPlane = 1.0f;
+static const float ReplayFarPlane = 750.0f;
+static const int ReplayCascadeCount = 4;
+static const int ReplayFrameCount = 40;
+
+struct ReplayVector
+{
+    float x, y, z;
+};
+
+static ReplayVector operator-(const ReplayVector & a, const ReplayVector & b)
+{
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+static float dot(const ReplayVector & a, const ReplayVector & b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static ReplayVector cross(const ReplayVector & a, const ReplayVector & b)
+{
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+static ReplayVector normalize(const ReplayVector & a)
+{
+    float length = sqrtf(dot(a, a));
+    return {a.x / length, a.y / length, a.z / length};
+}
+
+// Left handed look at matrix like matrix_look_at_left_hand, column major
+static void lookAt(const ReplayVector & eye, const ReplayVector & target, const ReplayVector & up, float *matrix)
+{
+    ReplayVector z = normalize(target - eye);
+    ReplayVector x = normalize(cross(up, z));
+    ReplayVector y = cross(z, x);
+
+    const float result[16] = {
+        x.x, y.x, z.x, 0.0f,
+        x.y, y.y, z.y, 0.0f,
+        x.z, y.z, z.z, 0.0f,
+        -dot(x, eye), -dot(y, eye), -dot(z, eye), 1.0f
+    };
+
+    memcpy(matrix, result, sizeof(result));
+}
+
+struct ReplaySphere
+{
+    ReplayVector center;
+    float radius;
+};
+
+class ReplayScene
+{
+public:
+
+    ReplayScene()
+    {
+        const float fov = 65.0f * (float)M_PI / 180.0f;
+
+        m_yScale = 1.0f / tanf(0.5f * fov);
+        m_xScale = m_yScale * (float)ReplayHeight / (float)ReplayWidth;
+
+        // Spheres on a spiral, so every depth range holds some receivers
+        for (int i = 0; i < 60; i++) {
+            float angle = 2.4f * (float)i;
+            float distance = 8.0f + 12.0f * (float)(i % 10);
+
+            m_spheres.push_back({{distance * cosf(angle), -8.0f + (float)(i % 4), distance * sinf(angle)},
+                                 2.0f + (float)(i % 3)});
+        }
+    }
+
+    float tanHalfDiagonal() const
+    {
+        return sqrtf(1.0f / (m_xScale * m_xScale) + 1.0f / (m_yScale * m_yScale));
+    }
+
+    // Eye space depth of every pixel, 0 where the ray hits nothing
+    void render(const float *view, std::vector<float> & depth) const
+    {
+        float inverse[16];
+        invertRigidMatrix4x4(view, inverse);
+
+        ReplayVector eye = {inverse[12], inverse[13], inverse[14]};
+
+        depth.assign((size_t)ReplayWidth * ReplayHeight, 0.0f);
+
+        for (int y = 0; y < ReplayHeight; y++) {
+            for (int x = 0; x < ReplayWidth; x++) {
+                // Ray with a view space z of 1, so the distance along it is the eye space depth
+                float viewX = (2.0f * (float)x / ReplayWidth - 1.0f) / m_xScale;
+                float viewY = (1.0f - 2.0f * (float)y / ReplayHeight) / m_yScale;
+
+                ReplayVector direction = {
+                    inverse[0] * viewX + inverse[4] * viewY + inverse[8],
+                    inverse[1] * viewX + inverse[5] * viewY + inverse[9],
+                    inverse[2] * viewX + inverse[6] * viewY + inverse[10]
+                };
+
+                float nearest = FLT_MAX;
+
+                // Ground plane at y = -10, 300 units square
+                if (direction.y < 0.0f) {
+                    float t = (-10.0f - eye.y) / direction.y;
+
+                    if (fabsf(eye.x + t * direction.x) < 150.0f && fabsf(eye.z + t * direction.z) < 150.0f) {
+                        nearest = t;
+                    }
+                }
+
+                for (const ReplaySphere & sphere : m_spheres) {
+                    ReplayVector offset = eye - sphere.center;
+
+                    float a = dot(direction, direction);
+                    float b = 2.0f * dot(offset, direction);
+                    float c = dot(offset, offset) - sphere.radius * sphere.radius;
+                    float discriminant = b * b - 4.0f * a * c;
+
+                    if (discriminant > 0.0f) {
+                        float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+
+                        if (t > 0.1f && t < nearest) {
+                            nearest = t;
+                        }
+                    }
+                }
+
+                if (nearest < ReplayFarPlane) {
+                    depth[(size_t)y * ReplayWidth + x] = nearest;
+                }
+            }
+        }
+    }
+
+    // Histogram of a view's depth with light space bounds under a light view matrix
+    void reduce(const float *view, const float *lightView, int *histogram) const
+    {
+        std::vector<float> depth;
+        render(view, depth);
+
+        float inverse[16];
+        invertRigidMatrix4x4(view, inverse);
+
+        auto lightSpace = [&](uint32_t x, uint32_t y, float sampleDepth, float *position) {
+            float viewPosition[3] = {
+                (2.0f * (float)x / ReplayWidth - 1.0f) * sampleDepth / m_xScale,
+                (1.0f - 2.0f * (float)y / ReplayHeight) * sampleDepth / m_yScale,
+                sampleDepth
+            };
+
+            float world[3];
+
+            for (int row = 0; row < 3; row++) {
+                world[row] = inverse[row] * viewPosition[0] + inverse[4 + row] * viewPosition[1] +
+                             inverse[8 + row] * viewPosition[2] + inverse[12 + row];
+            }
+
+            for (int row = 0; row < 3; row++) {
+                position[row] = lightView[row] * world[0] + lightView[4 + row] * world[1] +
+                                lightView[8 + row] * world[2] + lightView[12 + row];
+            }
+        };
+
+        resetDepthHistogram(histogram, ReplayNearPlane, ReplayFarPlane);
+        reduceDepthHistogram(depth.data(), ReplayWidth, ReplayHeight, ReplayNearPlane, ReplayFarPlane,
+                             lightSpace, histogram);
+    }
+
+private:
+
+    std::vector<ReplaySphere> m_spheres;
+    float m_xScale;
+    float m_yScale;
+};
+
+// Camera orbiting the scene at a yaw and distance that change by a fixed step every frame
+struct ReplayPath
+{
+    const char *name;
+    float yawStep;
+    float distanceStep;
+};
+
+static void pathView(const ReplayPath & path, int frame, float *view)
+{
+    const float pitch = 0.8f;
+
+    float yaw = 0.5f + path.yawStep * (float)frame;
+    float distance = 80.0f + path.distanceStep * (float)frame;
+
+    ReplayVector eye = {distance * cosf(yaw) * sinf(pitch), distance * cosf(pitch) + 5.0f, distance * sinf(yaw) * sinf(pitch)};
+
+    lookAt(eye, {0.0f, 5.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, view);
+}
+
+struct ReplayResult
+{
+    BoundsPredictionStats stale;
+    BoundsPredictionStats predicted;
+};
+
+// Replays a path with results lagging frames behind, as the readback ring does
+static ReplayResult replay(const ReplayScene & scene, const ReplayPath & path, int lag)
+{
+    float lightView[16];
+    lookAt({10.0f, 30.0f, 5.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 1.0f}, lightView);
+
+    std::vector<std::vector<float>> views(ReplayFrameCount, std::vector<float>(16));
+    std::vector<std::vector<int>> histograms(ReplayFrameCount, std::vector<int>(DepthHistogramLength));
+
+    for (int frame = 0; frame < ReplayFrameCount; frame++) {
+        pathView(path, frame, views[frame].data());
+        scene.reduce(views[frame].data(), lightView, histograms[frame].data());
+    }
+
+    ReplayResult result;
+    CascadeBoundsPredictor predictor;
+
+    for (int frame = lag; frame < ReplayFrameCount; frame++) {
+        const int *reduced = histograms[frame - lag].data();
+        const int *current = histograms[frame].data();
+
+        float minDepth = decodeOrderedFloat(reduced[DepthHistogramMinDepth]);
+        float maxDepth = decodeOrderedFloat(reduced[DepthHistogramMaxDepth]);
+
+        // The reduced bounds used as they are
+        float ends[ReplayCascadeCount + 1];
+        float staleBoxes[6 * ReplayCascadeCount];
+        float trueBoxes[6 * ReplayCascadeCount];
+
+        logPartitioning(minDepth, maxDepth, ReplayCascadeCount, ends);
+        cascadeBoundsFromDepthHistogram(reduced, ReplayNearPlane, ReplayFarPlane, ends, ReplayCascadeCount, staleBoxes);
+        cascadeBoundsFromDepthHistogram(current, ReplayNearPlane, ReplayFarPlane, ends, ReplayCascadeCount, trueBoxes);
+
+        result.stale.addFrame(staleBoxes, trueBoxes, ReplayCascadeCount);
+
+        // The prediction, as the renderer makes it
+        CameraMotion motion = cameraMotion(views[frame - lag].data(), lightView, views[frame].data(), lightView,
+                                           scene.tanHalfDiagonal());
+
+        predictor.predictDepthRange(motion, minDepth, maxDepth, ReplayNearPlane, &minDepth, &maxDepth);
+        logPartitioning(minDepth, maxDepth, ReplayCascadeCount, ends);
+
+        DepthSlab slabs[SDSM_HISTOGRAM_BIN_COUNT];
+        int slabCount = depthSlabsFromHistogram(reduced, ReplayNearPlane, ReplayFarPlane, slabs);
+
+        float predictedBoxes[6 * ReplayCascadeCount];
+
+        for (int i = 0; i < ReplayCascadeCount; i++) {
+            float start = ends[i];
+            float end = ends[i + 1];
+
+            alignToDepthHistogramBins(ReplayNearPlane, ReplayFarPlane, &start, &end);
+            predictor.predictCascadeBounds(motion, slabs, slabCount, start, end, predictedBoxes + 6 * i);
+        }
+
+        cascadeBoundsFromDepthHistogram(current, ReplayNearPlane, ReplayFarPlane, ends, ReplayCascadeCount, trueBoxes);
+
+        result.predicted.addFrame(predictedBoxes, trueBoxes, ReplayCascadeCount);
+    }
+
+    return result;
+}
+
+static const ReplayPath ReplayPaths[] = {
+    {"still", 0.0f, 0.0f},
+    {"slow yaw", 0.01f, 0.0f},
+    {"fast yaw", 0.05f, 0.0f},
+    {"zoom in", 0.0f, -1.0f},
+    {"yaw and zoom", 0.03f, -0.8f},
+    {"whip", 0.12f, 0.0f},
+};
+
+SDSM_TEST(predictionCoversTheReplayedFrames)
+{
+    ReplayScene scene;
+
+    printf("%-5s %-14s %-28s %-28s\n", "lag", "path", "stale miss rate/mean/max", "predicted miss rate/mean/max/area");
+
+    for (int lag = 1; lag <= 2; lag++) {
+        for (const ReplayPath & path : ReplayPaths) {
+            ReplayResult result = replay(scene, path, lag);
+
+            printf("%-5d %-14s %5.1f%% %.4f %.3f          %5.1f%% %.4f %.3f %.2f\n", lag, path.name,
+                   100.0f * result.stale.missRate(), result.stale.meanMiss(), result.stale.maxMiss(),
+                   100.0f * result.predicted.missRate(), result.predicted.meanMiss(), result.predicted.maxMiss(),
+                   result.predicted.meanAreaRatio());
+
+            if (path.yawStep == 0.0f && path.distanceStep == 0.0f) {
+                // Without motion the prediction is the reduced bounds, with no margin
+                SDSM_CHECK(result.predicted.missRate() == 0.0f);
+                SDSM_CHECK(fabsf(result.predicted.meanAreaRatio() - 1.0f) < 1e-3f);
+                continue;
+            }
+
+            // A few receivers may still stick out by a small fraction of the cascade, while the
+            // reduced bounds miss nearly every frame
+            SDSM_CHECK(result.predicted.missRate() < 0.1f);
+            SDSM_CHECK(result.predicted.maxMiss() < 0.05f);
+            SDSM_CHECK(result.predicted.meanMiss() * 10.0f < result.stale.meanMiss());
+
+            // and the margins do not give away most of the resolution
+            SDSM_CHECK(result.predicted.meanAreaRatio() < 3.0f);
+        }
+    }
+}
+
+SDSM_TEST(depthRangeGrowsWithTheMotion)
+{
+    CascadeBoundsPredictor predictor;
+
+    float view[16];
+    float movedView[16];
+    lookAt({0.0f, 0.0f, -10.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, view);
+    lookAt({0.0f, 0.0f, -5.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, movedView);
+
+    float lightView[16];
+    lookAt({10.0f, 30.0f, 5.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 1.0f}, lightView);
+
+    // Moving 5 units forward brings receivers 5 units closer and keeps those that move with it
+    CameraMotion motion = cameraMotion(view, lightView, movedView, lightView, 0.5f);
+
+    SDSM_CHECK(fabsf(motion.translation - 5.0f) < 1e-4f);
+    SDSM_CHECK(fabsf(motion.rotation) < 1e-3f);
+
+    float minDepth, maxDepth;
+    predictor.predictDepthRange(motion, 20.0f, 100.0f, 1.0f, &minDepth, &maxDepth);
+
+    SDSM_CHECK(fabsf(minDepth - 15.0f) < 1e-3f);
+    SDSM_CHECK(maxDepth == 100.0f);
+
+    // and never below the near plane
+    predictor.predictDepthRange(motion, 2.0f, 100.0f, 1.0f, &minDepth, &maxDepth);
+    SDSM_CHECK(minDepth == 1.0f);
+}
+
+SDSM_TEST_MAIN()
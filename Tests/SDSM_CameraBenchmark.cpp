@@ -0,0 +1,95 @@
+//
+//  SDSM_CameraBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Per frame CPU matrix work of updateWorldState and the cascade setup with a still and a moving
+//  camera: rebuilding every matrix and inverting both view matrices for each frustum corner, as
+//  before the camera cached its matrices, against the cached matrices and closed form inverses.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "Custom/Camera.h"
+
+#include <math.h>
+
+static const int BenchmarkCascadeCount = 4;
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int iterations = quick ? 1000 : 200000;
+
+    float4 corners[8];
+    for (int i = 0; i < 8; i++) {
+        corners[i] = vector4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i < 4 ? 10.0f : 100.0f, 1.0f);
+    }
+
+    const float fov = 65.0f * (M_PI / 180.0f);
+    const float4x4 modelMatrix = matrix4x4_translation(0, -10, 0) * matrix4x4_scale(0.1, 0.1, 0.1);
+    const float4x4 modelMatrixInverse = matrix4x4_scale(10, 10, 10) * matrix4x4_translation(0, 10, 0);
+    const float4x4 shadowViewMatrix = matrix_look_at_left_hand(vector3(30.0f, 60.0f, 20.0f), vector3(0.0f, 0.0f, 0.0f),
+                                                               vector3(0.0f, 1.0f, 0.0f));
+
+    printf("%-8s %14s %14s\n", "camera", "rebuilt ns", "cached ns");
+
+    for (int moving = 0; moving < 2; moving++) {
+        int frame = 0;
+
+        double rebuilt = sdsmBenchmark([&]() {
+            float yaw = moving ? 0.5f + 1e-4f * (float)frame++ : 0.5f;
+            float3 eye = vector3(80.0f * cosf(yaw) * sinf(0.8f), 80.0f * cosf(0.8f) + 5.0f, 80.0f * sinf(yaw) * sinf(0.8f));
+
+            float4x4 view = matrix_look_at_left_hand(eye, vector3(0.0f, 5.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f));
+            float4x4 projection = matrix_perspective_left_hand(fov, 1.6f, 1.0f, 750.0f);
+            float4x4 inverseProjection = matrix_invert(projection);
+            float4x4 unproject = matrix_invert(projection * view);
+            float4x4 inverseShadowModelView = matrix_invert(shadowViewMatrix * modelMatrix);
+
+            float sum = inverseProjection.columns[0][0] + unproject.columns[1][1] + inverseShadowModelView.columns[2][2];
+
+            // Each cascade inverted both view matrices for every corner
+            for (int cascade = 0; cascade < BenchmarkCascadeCount; cascade++) {
+                for (int i = 0; i < 8; i++) {
+                    sum += (matrix_invert(view) * corners[i]).x;
+                    sum += (matrix_invert(shadowViewMatrix) * corners[i]).y;
+                }
+            }
+
+            sdsmKeep(sum);
+        }, iterations);
+
+        Camera camera;
+        camera.setAspect(1.6f);
+        camera.setNear(1.0f);
+        camera.setFar(750.0f);
+
+        const float4x4 inverseShadowViewMatrix = matrix_invert_rigid(shadowViewMatrix);
+
+        double cached = sdsmBenchmark([&]() {
+            if (moving) {
+                camera.rotateYawBy(1e-4f);
+            }
+
+            const float4x4 & inverseView = camera.inverseViewMatrix();
+            float4x4 shadowModelView = shadowViewMatrix * modelMatrix;
+            float4x4 inverseShadowModelView = modelMatrixInverse * inverseShadowViewMatrix;
+
+            float sum = camera.inverseProjMatrix().columns[0][0] + camera.inverseViewProjMatrix().columns[1][1] +
+                        shadowModelView.columns[0][0] + inverseShadowModelView.columns[2][2];
+
+            for (int cascade = 0; cascade < BenchmarkCascadeCount; cascade++) {
+                for (int i = 0; i < 8; i++) {
+                    sum += (inverseView * corners[i]).x;
+                    sum += (inverseShadowViewMatrix * corners[i]).y;
+                }
+            }
+
+            sdsmKeep(sum);
+        }, iterations);
+
+        printf("%-8s %14.1f %14.1f\n", moving ? "moving" : "still", rebuilt, cached);
+    }
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+//
+//  SDSM_CameraTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the camera's cached matrices and the closed form inverses they use: the inverses match
+//  the general 4x4 inverse, and the cache follows every change of the eye and of the projection.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "Custom/Camera.h"
+
+#include <math.h>
+
+static float maxDifference(const float4x4 & a, const float4x4 & b)
+{
+    float difference = 0.0f;
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            difference = std::max(difference, fabsf(a.columns[column][row] - b.columns[column][row]));
+        }
+    }
+
+    return difference;
+}
+
+static bool bitEqual(const float4x4 & a, const float4x4 & b)
+{
+    return memcmp(&a, &b, sizeof(float4x4)) == 0;
+}
+
+static float3 randomDirection(SDSMRandom & random)
+{
+    return vector_normalize(vector3(random.uniform(-1.0f, 1.0f), random.uniform(-1.0f, 1.0f), random.uniform(-1.0f, 1.0f)));
+}
+
+SDSM_TEST(rigidInverseMatchesTheGeneralInverse)
+{
+    SDSMRandom random(21);
+
+    for (int trial = 0; trial < 10000; trial++) {
+        float3 eye = vector3(random.uniform(-500.0f, 500.0f), random.uniform(-500.0f, 500.0f), random.uniform(-500.0f, 500.0f));
+        float3 target = eye + randomDirection(random) * random.uniform(1.0f, 100.0f);
+        float3 up = randomDirection(random);
+
+        // Degenerate up vectors give no view
+        if (vector_length(vector_cross(vector_normalize(target - eye), up)) < 0.1f) {
+            continue;
+        }
+
+        float4x4 view = matrix_look_at_left_hand(eye, target, up);
+        float4x4 inverse = matrix_invert_rigid(view);
+
+        // Errors scale with the translation
+        SDSM_CHECK_OR_BREAK(maxDifference(inverse, matrix_invert(view)) < 1e-6f * 1000.0f);
+        SDSM_CHECK_OR_BREAK(maxDifference(view * inverse, matrix4x4_identity()) < 1e-6f * 1000.0f);
+    }
+}
+
+SDSM_TEST(perspectiveInverseMatchesTheGeneralInverse)
+{
+    SDSMRandom random(22);
+
+    for (int trial = 0; trial < 10000; trial++) {
+        float fov = random.uniform(0.2f, 2.5f);
+        float aspect = random.uniform(0.5f, 3.0f);
+        float nearZ = random.uniform(0.01f, 10.0f);
+        float farZ = nearZ * random.uniform(2.0f, 10000.0f);
+
+        float4x4 projection = matrix_perspective_left_hand(fov, aspect, nearZ, farZ);
+        float4x4 inverse = matrix_invert_perspective_left_hand(projection);
+        float4x4 general = matrix_invert(projection);
+
+        // Relative to the largest entry of the inverse, the reciprocal of the near plane
+        float scale = std::max(1.0f, 1.0f / nearZ);
+
+        SDSM_CHECK_OR_BREAK(maxDifference(inverse, general) < 1e-5f * scale);
+        SDSM_CHECK_OR_BREAK(maxDifference(projection * inverse, matrix4x4_identity()) < 1e-5f);
+    }
+}
+
+SDSM_TEST(cameraMatricesMatchTheirDefinitions)
+{
+    Camera camera;
+    camera.setAspect(1.6f);
+    camera.setNear(1.0f);
+    camera.setFar(750.0f);
+
+    float4x4 view = matrix_look_at_left_hand(camera.position(), vector3(0.0f, 5.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f));
+    float4x4 projection = matrix_perspective_left_hand(camera.fov(), 1.6f, 1.0f, 750.0f);
+
+    SDSM_CHECK(maxDifference(camera.viewMatrix(), view) < 1e-5f);
+    SDSM_CHECK(bitEqual(camera.projMatrix(), projection));
+    SDSM_CHECK(bitEqual(camera.viewProjMatrix(), camera.projMatrix() * camera.viewMatrix()));
+    SDSM_CHECK(bitEqual(camera.inverseViewMatrix(), matrix_invert_rigid(camera.viewMatrix())));
+    SDSM_CHECK(bitEqual(camera.inverseProjMatrix(), matrix_invert_perspective_left_hand(camera.projMatrix())));
+    SDSM_CHECK(bitEqual(camera.inverseViewProjMatrix(), camera.inverseViewMatrix() * camera.inverseProjMatrix()));
+
+    // Clip space round trips; world space ones lose precision in the 80 unit translation
+    SDSM_CHECK(maxDifference(camera.viewProjMatrix() * camera.inverseViewProjMatrix(), matrix4x4_identity()) < 1e-4f);
+}
+
+SDSM_TEST(cacheFollowsEveryChange)
+{
+    Camera camera;
+    camera.setAspect(1.6f);
+    camera.setNear(1.0f);
+    camera.setFar(750.0f);
+
+    SDSMRandom random(23);
+
+    for (int step = 0; step < 1000; step++) {
+        float4x4 view = camera.viewMatrix();
+        float4x4 projection = camera.projMatrix();
+        float4x4 viewProjection = camera.viewProjMatrix();
+
+        // Reads without a change return the cached matrices
+        SDSM_CHECK_OR_BREAK(bitEqual(camera.viewMatrix(), view) && bitEqual(camera.viewProjMatrix(), viewProjection));
+
+        int change = random.integer(0, 5);
+
+        switch (change) {
+            case 0: camera.rotateYawBy(random.uniform(-0.1f, 0.1f)); break;
+            case 1: camera.rotatePitchBy(random.uniform(-0.1f, 0.1f)); break;
+            case 2: camera.moveCenterBy(random.uniform(-1.0f, 1.0f), random.uniform(-1.0f, 1.0f), 0.0f); break;
+            case 3: camera.changeDistanceBy(random.uniform(-1.0f, 1.0f)); break;
+            case 4: camera.setAspect(random.uniform(1.0f, 2.0f)); break;
+            case 5: camera.setFar(random.uniform(500.0f, 1000.0f)); break;
+        }
+
+        bool eyeMoved = change < 4;
+
+        // A moved eye rebuilds the view, a projection change only the projection
+        SDSM_CHECK_OR_BREAK(bitEqual(camera.projMatrix(), projection) == eyeMoved);
+        SDSM_CHECK_OR_BREAK(!eyeMoved || bitEqual(camera.inverseViewMatrix(), matrix_invert_rigid(camera.viewMatrix())));
+        SDSM_CHECK_OR_BREAK(eyeMoved || bitEqual(camera.viewMatrix(), view));
+
+        SDSM_CHECK_OR_BREAK(bitEqual(camera.viewProjMatrix(), camera.projMatrix() * camera.viewMatrix()));
+        SDSM_CHECK_OR_BREAK(bitEqual(camera.inverseViewProjMatrix(), camera.inverseViewMatrix() * camera.inverseProjMatrix()));
+    }
+}
+
+SDSM_TEST_MAIN()
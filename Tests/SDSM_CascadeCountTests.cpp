@@ -0,0 +1,114 @@
+//
+//  SDSM_CascadeCountTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of autoCascadeCount driven by reduced depth ranges: the count meets the split ratio
+//  target, stays in range on invalid input, and does not flicker on ranges near a threshold.
+//
+
+#include "SDSMTest.h"
+#include "SDSMShared.h"
+
+#include <math.h>
+
+static const float TestSplitRatio = 10.0f;
+
+SDSM_TEST(countFollowsTheDepthRange)
+{
+    SDSM_CHECK(autoCascadeCount(2.0f, 15.0f, TestSplitRatio, 1) == 1);
+    SDSM_CHECK(autoCascadeCount(2.0f, 25.0f, TestSplitRatio, 1) == 2);
+    SDSM_CHECK(autoCascadeCount(1.0f, 750.0f, TestSplitRatio, 1) == 3);
+    SDSM_CHECK(autoCascadeCount(1.0f, 20000.0f, TestSplitRatio, 1) == 5);
+
+    // Ranges that are an exact power of the target do not round up to another cascade
+    SDSM_CHECK(autoCascadeCount(1.0f, 10.0f, TestSplitRatio, 1) == 1);
+    SDSM_CHECK(autoCascadeCount(1.0f, 100.0f, TestSplitRatio, 1) == 2);
+    SDSM_CHECK(autoCascadeCount(0.5f, 500.0f, TestSplitRatio, 1) == 3);
+}
+
+SDSM_TEST(countStaysWithinTheSupportedRange)
+{
+    SDSM_CHECK(autoCascadeCount(1.0f, 1e12f, TestSplitRatio, 1) == MAX_CASCADED_SHADOW_COUNT);
+    SDSM_CHECK(autoCascadeCount(1.0f, 1e12f, TestSplitRatio, MAX_CASCADED_SHADOW_COUNT) == MAX_CASCADED_SHADOW_COUNT);
+    SDSM_CHECK(autoCascadeCount(5.0f, 5.0f, TestSplitRatio, 4) == 1);
+
+    // Empty and unread reductions, and unusable targets
+    SDSM_CHECK(autoCascadeCount(0.0f, 100.0f, TestSplitRatio, 4) == 1);
+    SDSM_CHECK(autoCascadeCount(750.0f, 1.0f, TestSplitRatio, 4) == 1);
+    SDSM_CHECK(autoCascadeCount(NAN, 100.0f, TestSplitRatio, 4) == 1);
+    SDSM_CHECK(autoCascadeCount(1.0f, NAN, TestSplitRatio, 4) == 1);
+    SDSM_CHECK(autoCascadeCount(1.0f, 100.0f, 1.0f, 4) == 1);
+    SDSM_CHECK(autoCascadeCount(1.0f, 100.0f, NAN, 4) == 1);
+
+    // A current count beyond the supported range is not kept
+    SDSM_CHECK(autoCascadeCount(1.0f, 100.0f, TestSplitRatio, MAX_CASCADED_SHADOW_COUNT + 1) == 2);
+}
+
+SDSM_TEST(countMeetsTheTarget)
+{
+    SDSMRandom random(7);
+
+    for (int trial = 0; trial < 100000; trial++) {
+        float minDepth = powf(10.0f, random.uniform(-1.0f, 2.0f));
+        float maxDepth = minDepth * powf(10.0f, random.uniform(0.0f, 6.0f));
+        int currentCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+
+        int count = autoCascadeCount(minDepth, maxDepth, TestSplitRatio, currentCount);
+
+        SDSM_CHECK_OR_BREAK(count >= 1 && count <= MAX_CASCADED_SHADOW_COUNT);
+
+        float ends[MAX_CASCADED_SHADOW_COUNT + 1];
+        logPartitioning(minDepth, maxDepth, count, ends);
+
+        // Every cascade meets the target unless the range needs more cascades than are supported
+        if (count < MAX_CASCADED_SHADOW_COUNT) {
+            for (int i = 0; i < count; i++) {
+                SDSM_CHECK_OR_BREAK(ends[i + 1] / ends[i] <= TestSplitRatio * 1.001f);
+            }
+        }
+
+        // One fewer cascade would miss the target, or is only kept off by the hysteresis
+        if (count > 1) {
+            float fewerRatio = powf(maxDepth / minDepth, 1.0f / (float)(count - 1));
+            SDSM_CHECK_OR_BREAK(fewerRatio > TestSplitRatio * 0.9f * 0.999f);
+        }
+    }
+}
+
+SDSM_TEST(countDropsOnlyWithHeadroom)
+{
+    // 99 needs 2 cascades of ratio 9.95, which is within 10% of the target, so 3 are kept
+    SDSM_CHECK(autoCascadeCount(1.0f, 99.0f, TestSplitRatio, 3) == 3);
+
+    // 80 fits 2 cascades of ratio 8.9 with headroom
+    SDSM_CHECK(autoCascadeCount(1.0f, 80.0f, TestSplitRatio, 3) == 2);
+
+    // Without headroom it keeps one cascade more than fits, even when dropping several at once
+    SDSM_CHECK(autoCascadeCount(1.0f, 9.5f, TestSplitRatio, 4) == 2);
+    SDSM_CHECK(autoCascadeCount(1.0f, 8.0f, TestSplitRatio, 4) == 1);
+
+    // Adding cascades is immediate
+    SDSM_CHECK(autoCascadeCount(1.0f, 101.0f, TestSplitRatio, 2) == 3);
+}
+
+SDSM_TEST(countDoesNotFlickerNearAThreshold)
+{
+    SDSMRandom random(8);
+
+    int count = 2;
+    int changes = 0;
+
+    // A camera hovering around a depth range of 100, with frame to frame noise of 5%
+    for (int frame = 0; frame < 10000; frame++) {
+        float maxDepth = 100.0f * random.uniform(0.95f, 1.05f);
+        int next = autoCascadeCount(1.0f, maxDepth, TestSplitRatio, count);
+
+        changes += next != count;
+        count = next;
+    }
+
+    SDSM_CHECK(changes <= 1);
+    SDSM_CHECK(count == 3);
+}
+
+SDSM_TEST_MAIN()
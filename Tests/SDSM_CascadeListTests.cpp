@@ -0,0 +1,123 @@
+//
+//  SDSM_CascadeListTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the cascade lists of layered shadow rendering: every cascade mask packs into a list
+//  whose instance count is the number of cascades, and the instances of the draw, read back the
+//  way shadow_vertex_layered does, render into exactly the cascades of the mask, lowest first.
+//
+
+#include "SDSMTest.h"
+#include "Shaders/SDSMShared.h"
+
+// Cascades the instances of a layered draw render into, as shadow_vertex_layered reads them
+static unsigned int renderedCascadeMask(unsigned int cascadeList, int instanceCount, bool & ascending)
+{
+    unsigned int mask = 0;
+    ascending = true;
+
+    for (int instance = 0; instance < instanceCount; instance++) {
+        unsigned int cascade = cascadeListEntry(cascadeList, (unsigned int)instance);
+
+        ascending = ascending && (instance == 0 || cascade > cascadeListEntry(cascadeList, (unsigned int)instance - 1));
+        mask |= 1u << cascade;
+    }
+
+    return mask;
+}
+
+SDSM_TEST(allCascadesFitTheList)
+{
+    const unsigned int allCascades = (1u << MAX_CASCADED_SHADOW_COUNT) - 1;
+
+    unsigned int cascadeList = 0;
+    int count = packCascadeList(allCascades, &cascadeList);
+
+    SDSM_CHECK(count == MAX_CASCADED_SHADOW_COUNT);
+
+    // Every entry holds its own index, including the last one in the list's top bits
+    for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        SDSM_CHECK_OR_BREAK(cascadeListEntry(cascadeList, (unsigned int)i) == (unsigned int)i);
+    }
+
+    SDSM_CHECK(MAX_CASCADED_SHADOW_COUNT - 1 < (1 << SDSM_CASCADE_LIST_BITS));
+}
+
+SDSM_TEST(emptyMaskDrawsNothing)
+{
+    unsigned int cascadeList = 0xFFFFFFFFu;
+
+    SDSM_CHECK(packCascadeList(0, &cascadeList) == 0);
+    SDSM_CHECK(cascadeList == 0);
+}
+
+SDSM_TEST(masksWithGapsKeepTheirCascades)
+{
+    struct Case
+    {
+        unsigned int mask;
+        unsigned int cascades[MAX_CASCADED_SHADOW_COUNT];
+        int count;
+    };
+
+    const Case cases[] = {
+        {0x01, {0}, 1},
+        {0x80, {7}, 1},
+        {0x81, {0, 7}, 2},
+        {0x55, {0, 2, 4, 6}, 4},
+        {0xAA, {1, 3, 5, 7}, 4},
+        {0x26, {1, 2, 5}, 3},
+        {0xF0, {4, 5, 6, 7}, 4},
+    };
+
+    for (const Case & c : cases) {
+        unsigned int cascadeList = 0;
+
+        SDSM_CHECK_OR_BREAK(packCascadeList(c.mask, &cascadeList) == c.count);
+
+        for (int instance = 0; instance < c.count; instance++) {
+            SDSM_CHECK_OR_BREAK(cascadeListEntry(cascadeList, (unsigned int)instance) == c.cascades[instance]);
+        }
+    }
+}
+
+SDSM_TEST(instancesRenderExactlyTheMaskedCascades)
+{
+    const unsigned int maskCount = 1u << MAX_CASCADED_SHADOW_COUNT;
+
+    for (unsigned int mask = 0; mask < maskCount; mask++) {
+        unsigned int cascadeList = 0;
+        int instanceCount = packCascadeList(mask, &cascadeList);
+
+        bool ascending;
+        unsigned int rendered = renderedCascadeMask(cascadeList, instanceCount, ascending);
+
+        SDSM_CHECK_OR_BREAK(instanceCount == __builtin_popcount(mask));
+        SDSM_CHECK_OR_BREAK(rendered == mask && ascending);
+
+        // Entries past the instance count are never read, and stay zero
+        SDSM_CHECK_OR_BREAK(instanceCount == MAX_CASCADED_SHADOW_COUNT ||
+                            cascadeList >> (SDSM_CASCADE_LIST_BITS * instanceCount) == 0);
+    }
+}
+
+SDSM_TEST(bitsAboveTheCascadeCountAreIgnored)
+{
+    // Culling masks come from uint32_t words; only the supported cascades may turn into instances
+    const unsigned int allCascades = (1u << MAX_CASCADED_SHADOW_COUNT) - 1;
+    SDSMRandom random(9);
+
+    for (int trial = 0; trial < 1000; trial++) {
+        unsigned int mask = random.next();
+
+        unsigned int cascadeList = 0;
+        unsigned int expectedList = 0;
+
+        int count = packCascadeList(mask, &cascadeList);
+        int expectedCount = packCascadeList(mask & allCascades, &expectedList);
+
+        SDSM_CHECK_OR_BREAK(count == expectedCount && cascadeList == expectedList);
+    }
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,335 @@
+//
+//  SDSM_CascadeMatrixTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the GPU built cascade matrices against the CPU path.  build_cascade_matrices is run
+//  on the CPU one thread at a time through the same SDSMShared.h functions the kernel calls, and
+//  its matrices are compared with those updateCascadeMatrices builds from the same histogram with
+//  cascadedShadowProjectionMatrices.  Cascades the partitioning leaves unused get zero matrices,
+//  and the near plane sits at SDSM_CASCADE_NEAR_Z.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "AAPLShaderTypes.h"
+
+using namespace simd;
+
+#include "SDSM_Utilities.h"
+#include "SDSM_Reduction.h"
+
+#include <math.h>
+
+static const float TestNearPlane = 1.0f;
+static const float TestFarPlane = 750.0f;
+static const float TestAspectRatio = 1.78f;
+static const float TestFov = 1.0f;
+
+// One thread of build_cascade_matrices, statement for statement
+static void buildCascadeMatrices(FrameData & frameData, const int *histogram, uint32_t cascade)
+{
+    if (cascade >= frameData.cascadeCount) {
+        return;
+    }
+
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+
+    uint32_t usedCount = cascadePartitioning(frameData.partitioning_mode,
+                                             decodeOrderedFloat(histogram[DepthHistogramMinDepth]),
+                                             decodeOrderedFloat(histogram[DepthHistogramMaxDepth]),
+                                             frameData.nearPlane, frameData.farPlane,
+                                             histogram,
+                                             frameData.cascadeCount, cascadeEnds);
+
+    if (cascade == 0) {
+        for (uint32_t i = 0; i < frameData.cascadeCount + 1; i++) {
+            frameData.cascadeEnds[i] = cascadeEnds[i];
+        }
+    }
+
+    if (cascade >= usedCount) {
+        memset(&frameData.shadow_mvp_matrices[cascade], 0, sizeof(float4x4));
+        memset(&frameData.shadow_mvp_xform_matrices[cascade], 0, sizeof(float4x4));
+        return;
+    }
+
+    float boundingBox[6];
+    cascadeBoundsFromDepthHistogram(histogram, frameData.nearPlane, frameData.farPlane,
+                                    cascadeEnds[cascade], cascadeEnds[cascade + 1], boundingBox);
+
+    CascadeProjection projection = cascadeOrthoProjection(boundingBox);
+
+    float4x4 shadowMVP = frameData.shadow_view_matrix * frameData.temple_model_matrix;
+    float4x4 shadowXform = shadowMVP;
+
+    applyCascadeProjection(projection, shadowMVP.columns);
+    applyCascadeProjection(cascadeTextureProjection(projection), shadowXform.columns);
+
+    frameData.shadow_mvp_matrices[cascade] = shadowMVP;
+    frameData.shadow_mvp_xform_matrices[cascade] = shadowXform;
+}
+
+// The CPU path of partitionCascades and updateCascadeMatrices for a fused reduction result, with
+// the near planes of cascades whose casters are unknown.  Returns the number of used cascades.
+static int cpuCascadeMatrices(const FrameData & frameData, const int *histogram, const float4x4 & inverseCameraView,
+                              float *cascadeEnds, float4x4 *mvpMatrices, float4x4 *xformMatrices)
+{
+    int usedCount = cascadePartitioning(frameData.partitioning_mode,
+                                        decodeOrderedFloat(histogram[DepthHistogramMinDepth]),
+                                        decodeOrderedFloat(histogram[DepthHistogramMaxDepth]),
+                                        frameData.nearPlane, frameData.farPlane,
+                                        histogram, (int)frameData.cascadeCount, cascadeEnds);
+
+    float boundingBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    cascadeBoundsFromDepthHistogram(histogram, frameData.nearPlane, frameData.farPlane,
+                                    cascadeEnds, (int)frameData.cascadeCount, boundingBoxes);
+
+    float nearZ[MAX_CASCADED_SHADOW_COUNT];
+    for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        nearZ[i] = SDSM_CASCADE_NEAR_Z;
+    }
+
+    float4x4 projections[MAX_CASCADED_SHADOW_COUNT];
+
+    withCascadeCount((int)frameData.cascadeCount, [&](auto c) {
+        cascadedShadowProjectionMatrices<decltype(c)::value>(inverseCameraView, TestAspectRatio, TestFov,
+                                                             matrix_invert_rigid(frameData.shadow_view_matrix),
+                                                             cascadeEnds, boundingBoxes, nearZ, projections,
+                                                             nullptr, nullptr);
+    });
+
+    float4x4 shadowModelView = frameData.shadow_view_matrix * frameData.temple_model_matrix;
+    float4x4 shadowTransform = matrix4x4_translation(0.5f, 0.5f, 0.0f) * matrix4x4_scale(0.5f, -0.5f, 1.0f);
+
+    for (uint32_t i = 0; i < frameData.cascadeCount; i++) {
+        mvpMatrices[i] = projections[i] * shadowModelView;
+        xformMatrices[i] = shadowTransform * mvpMatrices[i];
+    }
+
+    return usedCount;
+}
+
+// Relative to the largest element, since both paths round differently
+static bool matricesClose(const float4x4 & a, const float4x4 & b)
+{
+    float largest = 0.0f;
+    float difference = 0.0f;
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            largest = std::max(largest, std::max(fabsf(a.columns[column][row]), fabsf(b.columns[column][row])));
+            difference = std::max(difference, fabsf(a.columns[column][row] - b.columns[column][row]));
+        }
+    }
+
+    return difference <= 1e-5f * largest;
+}
+
+static bool isZero(const float4x4 & m)
+{
+    float4x4 zero;
+    memset(&zero, 0, sizeof(zero));
+
+    return memcmp(&m, &zero, sizeof(zero)) == 0;
+}
+
+struct TestScene
+{
+    FrameData frameData;
+    float4x4 inverseCameraView;
+    float4x4 inverseModel;
+    int histogram[DepthHistogramLength];
+};
+
+// A camera and light over a depth image whose samples are unprojected into light space, so each
+// cascade's box is the box of its samples.  clusterDepths, if given, puts every sample near one
+// of two depths with nothing in between.
+static void makeScene(SDSMRandom & random, PartitioningMode mode, int cascadeCount, bool clusterDepths, TestScene & scene)
+{
+    FrameData & frameData = scene.frameData;
+    memset(&frameData, 0, sizeof(frameData));
+
+    float4x4 viewMatrix = matrix_look_at_left_hand(vector3(random.uniform(-30.0f, 30.0f), random.uniform(2.0f, 30.0f), -40.0f),
+                                                   vector3(0.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f));
+    scene.inverseCameraView = matrix_invert_rigid(viewMatrix);
+
+    frameData.shadow_view_matrix = matrix_look_at_left_hand(vector3(200.0f, 300.0f, 100.0f), vector3(0.0f, 0.0f, 0.0f),
+                                                            vector3(0.0f, 1.0f, 0.0f));
+
+    // The temple is scaled and moved, so the model matrix is not rigid
+    float scale = random.uniform(0.5f, 2.0f);
+    vector_float3 offset = vector3(random.uniform(-5.0f, 5.0f), random.uniform(-5.0f, 5.0f), random.uniform(-5.0f, 5.0f));
+
+    frameData.temple_model_matrix = matrix4x4_translation(offset) * matrix4x4_scale(scale, scale, scale);
+    scene.inverseModel = matrix4x4_scale(1.0f / scale, 1.0f / scale, 1.0f / scale) * matrix4x4_translation(-offset);
+
+    frameData.cascadeCount = (uint32_t)cascadeCount;
+    frameData.nearPlane = TestNearPlane;
+    frameData.farPlane = TestFarPlane;
+    frameData.partitioning_mode = mode;
+
+    const uint32_t width = 64;
+    const uint32_t height = 36;
+
+    std::vector<float> depth((size_t)width * height);
+    float clusters[2] = {random.uniform(2.0f, 6.0f), random.uniform(200.0f, 600.0f)};
+
+    for (float & sample : depth) {
+        sample = clusterDepths ? clusters[random.integer(0, 1)] * random.uniform(0.98f, 1.02f) :
+                                 TestNearPlane * powf(TestFarPlane / TestNearPlane, random.uniform(0.05f, 0.95f));
+    }
+
+    float tanHalfVFov = tanf(TestFov / 2);
+    float tanHalfHFov = tanHalfVFov * TestAspectRatio;
+
+    float4x4 cameraToLight = frameData.shadow_view_matrix * scene.inverseCameraView;
+
+    auto toLightSpace = [&](uint32_t x, uint32_t y, float sampleDepth, float *position) {
+        float u = ((float)x + 0.5f) / (float)width * 2.0f - 1.0f;
+        float v = 1.0f - ((float)y + 0.5f) / (float)height * 2.0f;
+
+        vector_float4 light = cameraToLight * vector4(u * tanHalfHFov * sampleDepth, v * tanHalfVFov * sampleDepth,
+                                                      sampleDepth, 1.0f);
+
+        position[0] = light.x;
+        position[1] = light.y;
+        position[2] = light.z;
+    };
+
+    resetDepthHistogram(scene.histogram, TestNearPlane, TestFarPlane);
+    reduceDepthHistogram(depth.data(), width, height, TestNearPlane, TestFarPlane, toLightSpace, scene.histogram);
+}
+
+SDSM_TEST(gpuPathMatchesTheCpuPath)
+{
+    SDSMRandom random(4);
+
+    const PartitioningMode modes[] = {LOG_PARTITIONING, UNIFORM_PARTITIONING, ADAPTIVE_PARTITIONING, CLUSTERED_PARTITIONING};
+
+    for (int trial = 0; trial < 200; trial++) {
+        PartitioningMode mode = modes[trial % 4];
+        int cascadeCount = 1 + (trial / 4) % MAX_CASCADED_SHADOW_COUNT;
+
+        TestScene scene;
+        makeScene(random, mode, cascadeCount, false, scene);
+
+        // One thread per cascade slot, as dispatched
+        for (uint32_t cascade = 0; cascade < MAX_CASCADED_SHADOW_COUNT; cascade++) {
+            buildCascadeMatrices(scene.frameData, scene.histogram, cascade);
+        }
+
+        float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+        float4x4 mvpMatrices[MAX_CASCADED_SHADOW_COUNT];
+        float4x4 xformMatrices[MAX_CASCADED_SHADOW_COUNT];
+
+        int usedCount = cpuCascadeMatrices(scene.frameData, scene.histogram, scene.inverseCameraView,
+                                           cascadeEnds, mvpMatrices, xformMatrices);
+
+        SDSM_CHECK_OR_BREAK(memcmp(scene.frameData.cascadeEnds, cascadeEnds, (cascadeCount + 1) * sizeof(float)) == 0);
+
+        bool matches = true;
+
+        for (int i = 0; i < usedCount; i++) {
+            matches = matches && matricesClose(scene.frameData.shadow_mvp_matrices[i], mvpMatrices[i]);
+            matches = matches && matricesClose(scene.frameData.shadow_mvp_xform_matrices[i], xformMatrices[i]);
+        }
+
+        SDSM_CHECK_OR_BREAK(matches);
+
+        // Threads past the cascade count leave their slots alone
+        for (int i = cascadeCount; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            SDSM_CHECK_OR_BREAK(isZero(scene.frameData.shadow_mvp_matrices[i]));
+        }
+    }
+}
+
+SDSM_TEST(unusedCascadesGetZeroMatrices)
+{
+    SDSMRandom random(5);
+    int trialsWithUnused = 0;
+
+    for (int trial = 0; trial < 100; trial++) {
+        int cascadeCount = random.integer(3, MAX_CASCADED_SHADOW_COUNT);
+
+        TestScene scene;
+        makeScene(random, CLUSTERED_PARTITIONING, cascadeCount, true, scene);
+
+        // Garbage from an earlier frame, which the unused cascades must not keep
+        for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            scene.frameData.shadow_mvp_matrices[i] = matrix_identity_float4x4;
+            scene.frameData.shadow_mvp_xform_matrices[i] = matrix_identity_float4x4;
+        }
+
+        for (uint32_t cascade = 0; cascade < MAX_CASCADED_SHADOW_COUNT; cascade++) {
+            buildCascadeMatrices(scene.frameData, scene.histogram, cascade);
+        }
+
+        float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+        int usedCount = clusteredPartitioning(scene.histogram, TestNearPlane, TestFarPlane, cascadeCount, cascadeEnds);
+
+        // Two depth clusters need no more than two cascades
+        SDSM_CHECK_OR_BREAK(usedCount <= 2);
+        trialsWithUnused += usedCount < cascadeCount ? 1 : 0;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            bool zero = isZero(scene.frameData.shadow_mvp_matrices[i]) && isZero(scene.frameData.shadow_mvp_xform_matrices[i]);
+
+            SDSM_CHECK_OR_BREAK(i < usedCount ? !zero : zero);
+        }
+
+        // Slots past the cascade count keep what they held
+        for (int i = cascadeCount; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            SDSM_CHECK_OR_BREAK(memcmp(&scene.frameData.shadow_mvp_matrices[i], &matrix_identity_float4x4, sizeof(float4x4)) == 0);
+        }
+    }
+
+    SDSM_CHECK(trialsWithUnused == 100);
+}
+
+SDSM_TEST(nearPlaneIsTheFixedCasterDepth)
+{
+    SDSMRandom random(6);
+
+    for (int trial = 0; trial < 100; trial++) {
+        int cascadeCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+
+        TestScene scene;
+        makeScene(random, LOG_PARTITIONING, cascadeCount, false, scene);
+
+        for (uint32_t cascade = 0; cascade < MAX_CASCADED_SHADOW_COUNT; cascade++) {
+            buildCascadeMatrices(scene.frameData, scene.histogram, cascade);
+        }
+
+        float4x4 lightViewToModel = scene.inverseModel * matrix_invert_rigid(scene.frameData.shadow_view_matrix);
+
+        for (int i = 0; i < cascadeCount; i++) {
+            float boundingBox[6];
+            cascadeBoundsFromDepthHistogram(scene.histogram, TestNearPlane, TestFarPlane,
+                                            scene.frameData.cascadeEnds[i], scene.frameData.cascadeEnds[i + 1], boundingBox);
+
+            if (boundingBox[0] > boundingBox[3]) {
+                continue;
+            }
+
+            // The light view space corners of the box at the near plane and at its far bound
+            vector_float4 nearCorner = lightViewToModel * vector4(boundingBox[0], boundingBox[1], SDSM_CASCADE_NEAR_Z, 1.0f);
+            vector_float4 farCorner = lightViewToModel * vector4(boundingBox[3], boundingBox[4], boundingBox[5], 1.0f);
+
+            vector_float4 nearClip = scene.frameData.shadow_mvp_matrices[i] * nearCorner;
+            vector_float4 farClip = scene.frameData.shadow_mvp_matrices[i] * farCorner;
+
+            SDSM_CHECK_OR_BREAK(fabsf(nearClip.z) < 1e-4f && fabsf(farClip.z - 1.0f) < 1e-4f);
+            SDSM_CHECK_OR_BREAK(fabsf(nearClip.x + 1.0f) < 1e-4f && fabsf(nearClip.y + 1.0f) < 1e-4f);
+            SDSM_CHECK_OR_BREAK(fabsf(farClip.x - 1.0f) < 1e-4f && fabsf(farClip.y - 1.0f) < 1e-4f);
+
+            // The texture matrix maps the same corners to the texture's bottom left and top right
+            vector_float4 nearTexture = scene.frameData.shadow_mvp_xform_matrices[i] * nearCorner;
+            vector_float4 farTexture = scene.frameData.shadow_mvp_xform_matrices[i] * farCorner;
+
+            SDSM_CHECK_OR_BREAK(fabsf(nearTexture.x) < 1e-4f && fabsf(nearTexture.y - 1.0f) < 1e-4f);
+            SDSM_CHECK_OR_BREAK(fabsf(farTexture.x - 1.0f) < 1e-4f && fabsf(farTexture.y) < 1e-4f);
+        }
+    }
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,293 @@
+//
+//  SDSM_CascadeSchedulerTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the cascade update scheduler: its policy on single frames, and a simulation that
+//  drives it together with the shadow cache through a scripted camera path and checks that every
+//  cascade's matrix covers its receivers on every frame while far cascades skip passes.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_CascadeScheduler.h"
+#include "SDSM_ShadowCache.h"
+
+#include <math.h>
+
+static const int SimulatedCascadeCount = 4;
+static const int SimulatedDrawsPerCascade = 10;
+
+// Orthographic matrix mapping a light view box to clip space, depth to [0, 1]
+static void orthoMatrix(const float *box, float *matrix)
+{
+    memset(matrix, 0, 16 * sizeof(float));
+
+    matrix[0] = 2.0f / (box[3] - box[0]);
+    matrix[5] = 2.0f / (box[4] - box[1]);
+    matrix[10] = 1.0f / (box[5] - box[2]);
+    matrix[12] = (box[0] + box[3]) / (box[0] - box[3]);
+    matrix[13] = (box[1] + box[4]) / (box[1] - box[4]);
+    matrix[14] = box[2] / (box[2] - box[5]);
+    matrix[15] = 1.0f;
+}
+
+static CascadeUpdateRequest request(bool changed, bool reusable, int drawCount = SimulatedDrawsPerCascade)
+{
+    return {changed, reusable, drawCount};
+}
+
+SDSM_TEST(intervalsDoubleUpToTheMaximum)
+{
+    CascadeUpdateScheduler scheduler(8);
+
+    SDSM_CHECK(scheduler.interval(0) == 1);
+    SDSM_CHECK(scheduler.interval(1) == 2);
+    SDSM_CHECK(scheduler.interval(2) == 4);
+    SDSM_CHECK(scheduler.interval(3) == 8);
+    SDSM_CHECK(scheduler.interval(7) == 8);
+}
+
+SDSM_TEST(unchangedCascadesAreNotRendered)
+{
+    CascadeUpdateScheduler scheduler;
+
+    const CascadeUpdateRequest requests[3] = {request(false, false), request(false, false), request(false, false)};
+
+    SDSM_CHECK(scheduler.schedule(requests, 3) == 0);
+    SDSM_CHECK(scheduler.skippedLastFrame() == 0);
+    SDSM_CHECK(scheduler.drawsLastFrame() == 0);
+}
+
+SDSM_TEST(nearAndUnusableCascadesAlwaysRender)
+{
+    // A budget too small for any refresh
+    CascadeUpdateScheduler scheduler(8, 1);
+
+    const CascadeUpdateRequest requests[3] = {request(true, true), request(true, false), request(true, true)};
+
+    for (int frame = 0; frame < 10; frame++) {
+        SDSM_CHECK_OR_BREAK((scheduler.schedule(requests, 3) & 3) == 3);
+    }
+
+    // Mandatory renders count against the budget but are not limited by it
+    SDSM_CHECK(scheduler.drawsLastFrame() == 2 * SimulatedDrawsPerCascade);
+    SDSM_CHECK(scheduler.skippedLastFrame() == 1);
+}
+
+SDSM_TEST(refreshesAreStaggered)
+{
+    CascadeUpdateScheduler scheduler(8, INT_MAX, 1);
+
+    const CascadeUpdateRequest requests[4] = {request(true, true), request(true, true), request(true, true), request(true, true)};
+
+    int refreshes[4] = {};
+
+    for (int frame = 0; frame < 64; frame++) {
+        uint32_t mask = scheduler.schedule(requests, 4);
+
+        SDSM_CHECK_OR_BREAK(mask & 1);
+
+        // One stale cascade per frame on top of cascade 0
+        SDSM_CHECK_OR_BREAK(__builtin_popcount(mask & ~1u) <= 1);
+
+        for (int i = 0; i < 4; i++) {
+            refreshes[i] += (mask >> i) & 1;
+        }
+    }
+
+    // Farther cascades refresh less often
+    SDSM_CHECK(refreshes[0] == 64);
+    SDSM_CHECK(refreshes[1] > refreshes[2] && refreshes[2] > refreshes[3] && refreshes[3] > 0);
+    SDSM_CHECK(scheduler.passesTotal() + scheduler.skippedTotal() == 4 * 64);
+}
+
+SDSM_TEST(budgetLimitsRefreshes)
+{
+    CascadeUpdateScheduler scheduler(8, 25, 4);
+
+    const CascadeUpdateRequest requests[4] = {request(true, true, 10), request(true, true, 10),
+                                              request(true, true, 10), request(true, true, 10)};
+
+    for (int frame = 0; frame < 64; frame++) {
+        scheduler.schedule(requests, 4);
+
+        SDSM_CHECK_OR_BREAK(scheduler.drawsLastFrame() <= 25);
+    }
+
+    // Raising the budget lets every due cascade through, each once per interval
+    scheduler.setDrawBudget(INT_MAX);
+    scheduler.reset();
+
+    for (int frame = 0; frame < 16; frame++) {
+        uint32_t mask = scheduler.schedule(requests, 4);
+
+        for (int i = 0; i < 4; i++) {
+            bool due = i == 0 || (frame > 0 && frame % scheduler.interval(i) == 0);
+
+            SDSM_CHECK_OR_BREAK(((mask >> i) & 1) == (uint32_t)due);
+        }
+    }
+}
+
+SDSM_TEST(staleCoverageFollowsTheReceivers)
+{
+    const float box[6] = {-10.0f, -10.0f, 0.0f, 10.0f, 10.0f, 100.0f};
+    float matrix[16];
+    orthoMatrix(box, matrix);
+
+    const float inside[6] = {-5.0f, -5.0f, 10.0f, 5.0f, 5.0f, 90.0f};
+    const float edge[6] = {-10.0f, -10.0f, 0.0f, 10.0f, 10.0f, 100.0f};
+    const float outsideX[6] = {5.0f, -5.0f, 10.0f, 11.0f, 5.0f, 90.0f};
+    const float outsideDepth[6] = {-5.0f, -5.0f, 10.0f, 5.0f, 5.0f, 101.0f};
+    const float empty[6] = {FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    SDSM_CHECK(staleCascadeCoversReceivers(matrix, inside));
+    SDSM_CHECK(staleCascadeCoversReceivers(matrix, edge));
+    SDSM_CHECK(!staleCascadeCoversReceivers(matrix, outsideX));
+    SDSM_CHECK(!staleCascadeCoversReceivers(matrix, outsideDepth));
+    SDSM_CHECK(staleCascadeCoversReceivers(matrix, empty));
+
+    // Padding grows x, y and the far side, so a matrix fitted to it covers receivers that drift
+    float padded[6];
+    memcpy(padded, box, sizeof(padded));
+    padCascadeBounds(padded, 0.1f);
+
+    SDSM_CHECK(padded[0] == -12.0f && padded[1] == -12.0f && padded[2] == 0.0f);
+    SDSM_CHECK(padded[3] == 12.0f && padded[4] == 12.0f && padded[5] == 110.0f);
+
+    float emptyPadded[6];
+    memcpy(emptyPadded, empty, sizeof(empty));
+    padCascadeBounds(emptyPadded, 0.1f);
+
+    SDSM_CHECK(memcmp(emptyPadded, empty, sizeof(empty)) == 0);
+}
+
+// Counts of a run of the simulation
+struct SimulationResult
+{
+    int rendered[SimulatedCascadeCount];
+    int violations;
+    int maxStaleFrames[SimulatedCascadeCount];
+    uint64_t skipped;
+    uint64_t passes;
+};
+
+// Runs the renderer's loop of cache and scheduler over a scripted camera path: still, a slow
+// pan, a fast diagonal pan, a teleport and still again.  Cascade i covers a square 5 * 3^i units
+// wide around the camera; cascades beyond the first are fitted to padded bounds.
+static SimulationResult simulateCameraPath(int drawBudget, int maxRefreshesPerFrame)
+{
+    ShadowCascadeCache cache;
+    CascadeUpdateScheduler scheduler(8, drawBudget, maxRefreshesPerFrame);
+
+    SimulationResult result = {};
+
+    int staleFrames[SimulatedCascadeCount] = {};
+    float cameraX = 0.0f;
+    float cameraY = 0.0f;
+
+    for (int frame = 0; frame < 240; frame++) {
+        if (frame >= 30 && frame < 90) {
+            cameraX += 0.05f;
+        } else if (frame >= 90 && frame < 150) {
+            cameraX += 0.5f;
+            cameraY += 0.2f;
+        } else if (frame == 150) {
+            cameraX += 100.0f;
+        }
+
+        float receivers[6 * SimulatedCascadeCount];
+        float matrices[SimulatedCascadeCount][16];
+        CascadeUpdateRequest requests[SimulatedCascadeCount];
+
+        for (int i = 0; i < SimulatedCascadeCount; i++) {
+            float halfSize = 5.0f * powf(3.0f, (float)i);
+            float *box = receivers + 6 * i;
+
+            const float bounds[6] = {cameraX - halfSize, cameraY - halfSize, 0.0f,
+                                     cameraX + halfSize, cameraY + halfSize, 10.0f * halfSize};
+            memcpy(box, bounds, sizeof(bounds));
+
+            float padded[6];
+            memcpy(padded, box, sizeof(padded));
+
+            if (i > 0) {
+                padCascadeBounds(padded, 0.1f);
+            }
+
+            orthoMatrix(padded, matrices[i]);
+
+            ShadowCacheRect region = {i, 0, 0, 1024, 1024};
+
+            requests[i].changed = !cache.matches(i, matrices[i], region);
+            requests[i].reusable = requests[i].changed && cache.isValid(i) &&
+                                   staleCascadeCoversReceivers(cache.matrix(i), box);
+            requests[i].drawCount = SimulatedDrawsPerCascade;
+        }
+
+        uint32_t mask = scheduler.schedule(requests, SimulatedCascadeCount);
+
+        for (int i = 0; i < SimulatedCascadeCount; i++) {
+            if (mask & (1u << i)) {
+                cache.updateCascade(i, matrices[i], {i, 0, 0, 1024, 1024});
+            }
+
+            if (cache.isDirty(i)) {
+                result.rendered[i]++;
+                cache.markRendered(i);
+            }
+
+            staleFrames[i] = requests[i].changed && !(mask & (1u << i)) ? staleFrames[i] + 1 : 0;
+            result.maxStaleFrames[i] = std::max(result.maxStaleFrames[i], staleFrames[i]);
+
+            // Receivers are sampled with the cached matrix, which must still cover them
+            if (!staleCascadeCoversReceivers(cache.matrix(i), receivers + 6 * i)) {
+                result.violations++;
+            }
+        }
+    }
+
+    result.skipped = scheduler.skippedTotal();
+    result.passes = scheduler.passesTotal();
+
+    return result;
+}
+
+SDSM_TEST(cameraPathKeepsReceiversCovered)
+{
+    SimulationResult result = simulateCameraPath(INT_MAX, 1);
+
+    SDSM_CHECK(result.violations == 0);
+
+    // Cascade 0 follows every frame the camera moves; the far cascades skip passes
+    SDSM_CHECK(result.maxStaleFrames[0] == 0);
+    SDSM_CHECK(result.skipped > 0);
+    SDSM_CHECK(result.rendered[0] > result.rendered[1]);
+    SDSM_CHECK(result.rendered[1] >= result.rendered[2] && result.rendered[2] >= result.rendered[3]);
+
+    // Without the scheduler every changed cascade would render every frame
+    SDSM_CHECK(result.passes + result.skipped > result.passes * 3 / 2);
+}
+
+SDSM_TEST(cameraPathStaysWithinTheIntervals)
+{
+    // With every due cascade refreshed, no cascade stays stale longer than its interval
+    SimulationResult result = simulateCameraPath(INT_MAX, SimulatedCascadeCount);
+    CascadeUpdateScheduler scheduler(8);
+
+    SDSM_CHECK(result.violations == 0);
+
+    for (int i = 0; i < SimulatedCascadeCount; i++) {
+        SDSM_CHECK(result.maxStaleFrames[i] < scheduler.interval(i));
+    }
+}
+
+SDSM_TEST(cameraPathWithinABudget)
+{
+    // Room for cascade 0 and one refresh per frame
+    SimulationResult result = simulateCameraPath(2 * SimulatedDrawsPerCascade, SimulatedCascadeCount);
+
+    SDSM_CHECK(result.violations == 0);
+    SDSM_CHECK(result.skipped > 0);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,152 @@
+//
+//  SDSM_CascadeSetupBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Per frame cost of the cascade setup and shadow MVPs for each cascade count, with the frustum
+//  visualization on and locked: a runtime count loop that builds one cascade at a time into
+//  staging arrays, as the renderer did before, against the setup specialized on the count.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "AAPLShaderTypes.h"
+
+using namespace simd;
+
+#include "SDSM_Utilities.h"
+
+#include <math.h>
+
+// One cascade of the runtime count setup: its slice of the view frustum, its light frustum and
+// its projection
+static float4x4 cascadeSetup(const float4x4 & inverseCameraViewMatrix, float aspectRatio, float fov,
+                             const float4x4 & inverseShadowViewMatrix, const float *cascadeEnds, int index,
+                             int cascadeCount, FrustumVertex *viewFrustumVertices, FrustumVertex *lightFrustumVertices,
+                             const float *lightFrustumBoundingBoxes, float nearZ)
+{
+    float tanHalfHFov = tanf(fov / 2) * aspectRatio;
+    float tanHalfVFov = tanf(fov / 2);
+
+    float xn = cascadeEnds[index] * tanHalfHFov;
+    float xf = cascadeEnds[index + 1] * tanHalfHFov;
+    float yn = cascadeEnds[index] * tanHalfVFov;
+    float yf = cascadeEnds[index + 1] * tanHalfVFov;
+
+    float cornerX[8] = {xn, -xn, -xn, xn, xf, -xf, -xf, xf};
+    float cornerY[8] = {yn, yn, -yn, -yn, yf, yf, -yf, -yf};
+    float cornerZ[8] = {cascadeEnds[index], cascadeEnds[index], cascadeEnds[index], cascadeEnds[index],
+                        cascadeEnds[index + 1], cascadeEnds[index + 1], cascadeEnds[index + 1], cascadeEnds[index + 1]};
+    soa_float3 corners = {cornerX, cornerY, cornerZ};
+
+    matrix_transform_points(inverseCameraViewMatrix, corners, corners, 8);
+
+    // Only the last cascade shows its far rectangle
+    int viewCornerCount = index == cascadeCount - 1 ? 8 : 4;
+
+    for (int j = 0; j < viewCornerCount; j++) {
+        viewFrustumVertices[index * 4 + j] = {{cornerX[j], cornerY[j], cornerZ[j]}, {1.0f, 1.0f, 1.0f}};
+    }
+
+    const float *box = lightFrustumBoundingBoxes + 6 * index;
+
+    float lightX[8], lightY[8], lightZ[8];
+    for (int j = 0; j < 8; j++) {
+        lightX[j] = box[(j + 1) % 4 < 2 ? BoundingBoxMinX : BoundingBoxMaxX];
+        lightY[j] = box[j % 4 < 2 ? BoundingBoxMinY : BoundingBoxMaxY];
+        lightZ[j] = box[j < 4 ? BoundingBoxMinZ : BoundingBoxMaxZ];
+    }
+
+    soa_float3 lightCorners = {lightX, lightY, lightZ};
+    matrix_transform_points(inverseShadowViewMatrix, lightCorners, lightCorners, 8);
+
+    for (int j = 0; j < 8; j++) {
+        lightFrustumVertices[index * 8 + j] = {{lightX[j], lightY[j], lightZ[j]}, {0.0f, 1.0f, 0.0f}};
+    }
+
+    float4x4 projection = matrix_identity_float4x4;
+    applyCascadeProjection(cascadeOrthoProjection(box, nearZ), projection.columns);
+
+    return projection;
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int iterations = quick ? 1000 : 200000;
+
+    const float4x4 inverseCameraView = matrix_invert_rigid(matrix_look_at_left_hand(
+        vector3(3.0f, 8.0f, -20.0f), vector3(0.0f, 5.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f)));
+    const float4x4 shadowView = matrix_look_at_left_hand(vector3(50.0f, 80.0f, 30.0f), vector3(0.0f, 0.0f, 0.0f),
+                                                         vector3(0.0f, 1.0f, 0.0f));
+    const float4x4 inverseShadowView = matrix_invert_rigid(shadowView);
+
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+    float boundingBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    float nearZ[MAX_CASCADED_SHADOW_COUNT];
+
+    cascadeEnds[0] = 0.5f;
+
+    for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        cascadeEnds[i + 1] = cascadeEnds[i] * 3.0f;
+
+        for (int axis = 0; axis < 3; axis++) {
+            boundingBoxes[6 * i + axis] = -10.0f * (i + 1);
+            boundingBoxes[6 * i + axis + 3] = 10.0f * (i + 1);
+        }
+
+        nearZ[i] = -100.0f;
+    }
+
+    FrustumVertex viewVertices[4 * (MAX_CASCADED_SHADOW_COUNT + 1)];
+    FrustumVertex lightVertices[8 * MAX_CASCADED_SHADOW_COUNT];
+    float4x4 projections[MAX_CASCADED_SHADOW_COUNT];
+    float4x4 mvps[MAX_CASCADED_SHADOW_COUNT];
+
+    printf("%-9s %-14s %12s %14s\n", "cascades", "visualization", "runtime ns", "specialized ns");
+
+    for (int count = 1; count <= MAX_CASCADED_SHADOW_COUNT; count++) {
+        for (int locked = 0; locked < 2; locked++) {
+            double runtime = sdsmBenchmark([&]() {
+                FrustumVertex stagedView[4 * (MAX_CASCADED_SHADOW_COUNT + 1)];
+                FrustumVertex stagedLight[8 * MAX_CASCADED_SHADOW_COUNT];
+
+                for (int i = 0; i < count; i++) {
+                    projections[i] = cascadeSetup(inverseCameraView, 1.78f, 1.0f, inverseShadowView, cascadeEnds, i, count,
+                                                  stagedView, stagedLight, boundingBoxes, nearZ[i]);
+                }
+
+                for (int i = 0; i < count; i++) {
+                    mvps[i] = projections[i] * shadowView;
+                }
+
+                if (!locked) {
+                    memcpy(viewVertices, stagedView, (4 * count + 4) * sizeof(FrustumVertex));
+                    memcpy(lightVertices, stagedLight, 8 * count * sizeof(FrustumVertex));
+                }
+
+                sdsmKeep(mvps[count - 1].columns[0].x);
+                sdsmKeep(viewVertices[0].position.x);
+            }, iterations);
+
+            double specialized = sdsmBenchmark([&]() {
+                withCascadeCount(count, [&](auto c) {
+                    cascadedShadowProjectionMatrices<decltype(c)::value>(inverseCameraView, 1.78f, 1.0f, inverseShadowView,
+                                                                         cascadeEnds, boundingBoxes, nearZ, projections,
+                                                                         locked ? nullptr : viewVertices,
+                                                                         locked ? nullptr : lightVertices);
+                });
+
+                for (int i = 0; i < count; i++) {
+                    mvps[i] = projections[i] * shadowView;
+                }
+
+                sdsmKeep(mvps[count - 1].columns[0].x);
+                sdsmKeep(viewVertices[0].position.x);
+            }, iterations);
+
+            printf("%-9d %-14s %12.1f %14.1f\n", count, locked ? "locked" : "on", runtime, specialized);
+        }
+    }
+
+    return 0;
+}
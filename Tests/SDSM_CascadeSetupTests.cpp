@@ -0,0 +1,213 @@
+//
+//  SDSM_CascadeSetupTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the cascade setup specialized on the cascade count: withCascadeCount dispatches every
+//  supported count, the constexpr index tables draw the expected lines, and the projections and
+//  frustum vertices match a per corner reference for every count.
+//
+
+#include "SDSMTest.h"
+#include "AAPLMathUtilities.h"
+#include "AAPLShaderTypes.h"
+
+using namespace simd;
+
+#include "SDSM_Utilities.h"
+
+#include <math.h>
+
+static const float TestAspectRatio = 1.78f;
+static const float TestFov = 1.0f;
+
+// Camera and light of a frame with random splits and light view bounding boxes
+struct TestFrame
+{
+    float4x4 inverseCameraView;
+    float4x4 inverseShadowView;
+    float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+    float boundingBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    float nearZ[MAX_CASCADED_SHADOW_COUNT];
+};
+
+static TestFrame randomFrame(SDSMRandom & random, int cascadeCount)
+{
+    TestFrame frame;
+
+    frame.inverseCameraView = matrix_invert_rigid(matrix_look_at_left_hand(
+        vector3(random.uniform(-20.0f, 20.0f), random.uniform(1.0f, 20.0f), random.uniform(-20.0f, 20.0f)),
+        vector3(0.0f, 5.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f)));
+    frame.inverseShadowView = matrix_invert_rigid(matrix_look_at_left_hand(
+        vector3(50.0f, 80.0f, 30.0f), vector3(0.0f, 0.0f, 0.0f), vector3(0.0f, 1.0f, 0.0f)));
+
+    frame.cascadeEnds[0] = random.uniform(0.1f, 2.0f);
+
+    for (int i = 0; i < cascadeCount; i++) {
+        frame.cascadeEnds[i + 1] = frame.cascadeEnds[i] * random.uniform(1.2f, 4.0f);
+
+        for (int axis = 0; axis < 3; axis++) {
+            float min = random.uniform(-50.0f, 50.0f);
+
+            frame.boundingBoxes[6 * i + axis] = min;
+            frame.boundingBoxes[6 * i + axis + 3] = min + random.uniform(0.0f, 30.0f);
+        }
+
+        frame.nearZ[i] = frame.boundingBoxes[6 * i + 2] - random.uniform(0.0f, 20.0f);
+    }
+
+    return frame;
+}
+
+static bool positionEqual(const FrustumVertex & vertex, vector_float4 expected)
+{
+    return memcmp(&vertex.position.x, &expected.x, sizeof(float)) == 0 &&
+           memcmp(&vertex.position.y, &expected.y, sizeof(float)) == 0 &&
+           memcmp(&vertex.position.z, &expected.z, sizeof(float)) == 0;
+}
+
+SDSM_TEST(everySupportedCountIsDispatched)
+{
+    for (int count = -1; count <= MAX_CASCADED_SHADOW_COUNT + 1; count++) {
+        int dispatched = 0;
+
+        withCascadeCount(count, [&](auto c) {
+            dispatched = decltype(c)::value;
+        });
+
+        bool supported = count >= 1 && count <= MAX_CASCADED_SHADOW_COUNT;
+
+        SDSM_CHECK(dispatched == (supported ? count : 0));
+    }
+}
+
+template <int CascadeCount>
+static void checkIndexTables()
+{
+    static constexpr auto view = viewFrustumIndexTable<CascadeCount>();
+    static constexpr auto light = lightFrustumIndexTable<CascadeCount>();
+
+    const int viewLineCount = (int)(sizeof(view.indices) / sizeof(int)) / 2;
+    const int lightLineCount = (int)(sizeof(light.indices) / sizeof(int)) / 2;
+
+    // A rectangle per split, and the four edges from the first to the last
+    SDSM_CHECK(viewLineCount == 4 * (CascadeCount + 1) + 4);
+    SDSM_CHECK(lightLineCount == 12 * CascadeCount);
+
+    for (int line = 0; line < viewLineCount; line++) {
+        int a = view.indices[2 * line];
+        int b = view.indices[2 * line + 1];
+
+        SDSM_CHECK_OR_BREAK(a >= 0 && a < 4 * (CascadeCount + 1) && b >= 0 && b < 4 * (CascadeCount + 1) && a != b);
+
+        // Rectangle edges join corners of one split, the long edges the first and last splits
+        SDSM_CHECK_OR_BREAK(line < 4 * (CascadeCount + 1) ? a / 4 == b / 4 : a / 4 == 0 && b / 4 == CascadeCount);
+    }
+
+    for (int line = 0; line < lightLineCount; line++) {
+        int a = light.indices[2 * line];
+        int b = light.indices[2 * line + 1];
+
+        // Each edge joins two corners of one box that differ in exactly one coordinate
+        SDSM_CHECK_OR_BREAK(a / 8 == b / 8 && a / 8 == line / 12);
+
+        int cornerA = a % 8;
+        int cornerB = b % 8;
+        bool sameFace = cornerA / 4 == cornerB / 4;
+
+        SDSM_CHECK_OR_BREAK(sameFace ? (cornerA + 1) % 4 == cornerB % 4 : cornerA % 4 == cornerB % 4);
+    }
+}
+
+SDSM_TEST(indexTablesDrawTheFrustumEdges)
+{
+    for (int count = 1; count <= MAX_CASCADED_SHADOW_COUNT; count++) {
+        withCascadeCount(count, [&](auto c) {
+            checkIndexTables<decltype(c)::value>();
+        });
+    }
+}
+
+SDSM_TEST(setupMatchesThePerCornerReference)
+{
+    SDSMRandom random(24);
+
+    for (int trial = 0; trial < 2000; trial++) {
+        int count = 1 + trial % MAX_CASCADED_SHADOW_COUNT;
+        TestFrame frame = randomFrame(random, count);
+
+        float4x4 projections[MAX_CASCADED_SHADOW_COUNT];
+        FrustumVertex viewVertices[4 * (MAX_CASCADED_SHADOW_COUNT + 1)];
+        FrustumVertex lightVertices[8 * MAX_CASCADED_SHADOW_COUNT];
+
+        withCascadeCount(count, [&](auto c) {
+            cascadedShadowProjectionMatrices<decltype(c)::value>(frame.inverseCameraView, TestAspectRatio, TestFov,
+                                                                 frame.inverseShadowView, frame.cascadeEnds,
+                                                                 frame.boundingBoxes, frame.nearZ, projections,
+                                                                 viewVertices, lightVertices);
+        });
+
+        float tanHalfVFov = tanf(TestFov / 2);
+        float tanHalfHFov = tanHalfVFov * TestAspectRatio;
+
+        // The rectangle of every split, counterclockwise from the top right
+        for (int i = 0; i <= count; i++) {
+            float halfWidth = frame.cascadeEnds[i] * tanHalfHFov;
+            float halfHeight = frame.cascadeEnds[i] * tanHalfVFov;
+
+            const float cornerX[4] = {halfWidth, -halfWidth, -halfWidth, halfWidth};
+            const float cornerY[4] = {halfHeight, halfHeight, -halfHeight, -halfHeight};
+
+            for (int j = 0; j < 4; j++) {
+                vector_float4 expected = frame.inverseCameraView * vector4(cornerX[j], cornerY[j], frame.cascadeEnds[i], 1.0f);
+
+                SDSM_CHECK_OR_BREAK(positionEqual(viewVertices[4 * i + j], expected));
+            }
+        }
+
+        for (int i = 0; i < count; i++) {
+            const float *box = frame.boundingBoxes + 6 * i;
+
+            for (int j = 0; j < 8; j++) {
+                vector_float4 corner = vector4(box[(j + 1) % 4 < 2 ? BoundingBoxMinX : BoundingBoxMaxX],
+                                               box[j % 4 < 2 ? BoundingBoxMinY : BoundingBoxMaxY],
+                                               box[j < 4 ? BoundingBoxMinZ : BoundingBoxMaxZ], 1.0f);
+
+                SDSM_CHECK_OR_BREAK(positionEqual(lightVertices[8 * i + j], frame.inverseShadowView * corner));
+            }
+
+            float4x4 expected = matrix_identity_float4x4;
+            applyCascadeProjection(cascadeOrthoProjection(box, frame.nearZ[i]), expected.columns);
+
+            SDSM_CHECK_OR_BREAK(memcmp(&projections[i], &expected, sizeof(expected)) == 0);
+        }
+    }
+}
+
+SDSM_TEST(lockedVisualizationOnlyBuildsProjections)
+{
+    SDSMRandom random(25);
+
+    for (int count = 1; count <= MAX_CASCADED_SHADOW_COUNT; count++) {
+        TestFrame frame = randomFrame(random, count);
+
+        float4x4 projections[MAX_CASCADED_SHADOW_COUNT];
+        float4x4 lockedProjections[MAX_CASCADED_SHADOW_COUNT];
+        FrustumVertex viewVertices[4 * (MAX_CASCADED_SHADOW_COUNT + 1)];
+        FrustumVertex lightVertices[8 * MAX_CASCADED_SHADOW_COUNT];
+
+        withCascadeCount(count, [&](auto c) {
+            const int n = decltype(c)::value;
+
+            cascadedShadowProjectionMatrices<n>(frame.inverseCameraView, TestAspectRatio, TestFov, frame.inverseShadowView,
+                                                frame.cascadeEnds, frame.boundingBoxes, frame.nearZ, projections,
+                                                viewVertices, lightVertices);
+            cascadedShadowProjectionMatrices<n>(frame.inverseCameraView, TestAspectRatio, TestFov, frame.inverseShadowView,
+                                                frame.cascadeEnds, frame.boundingBoxes, frame.nearZ, lockedProjections,
+                                                nullptr, nullptr);
+        });
+
+        SDSM_CHECK(memcmp(projections, lockedProjections, count * sizeof(float4x4)) == 0);
+    }
+}
+
+SDSM_TEST_MAIN()
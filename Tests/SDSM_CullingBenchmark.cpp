@@ -0,0 +1,121 @@
+//
+//  SDSM_CullingBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Culling throughput for 100k shadow casters against 1 to 8 cascades: the box transform alone,
+//  cullShadowCasters, fitCascadeNearPlanes, and a scalar per caster, per cascade loop over the
+//  eight transformed corners of every box for comparison.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Culling.h"
+#include "AAPLConfig.h"
+
+static uint32_t scalarCascadeMask(const float *matrix, const AxisAlignedBox & box,
+                                  const AxisAlignedBox *volumes, int cascadeCount)
+{
+    float lightMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float lightMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    for (int corner = 0; corner < 8; corner++) {
+        float x = corner & 1 ? box.max[0] : box.min[0];
+        float y = corner & 2 ? box.max[1] : box.min[1];
+        float z = corner & 4 ? box.max[2] : box.min[2];
+
+        for (int row = 0; row < 3; row++) {
+            float value = matrix[12 + row] + matrix[row] * x + matrix[4 + row] * y + matrix[8 + row] * z;
+
+            lightMin[row] = fminf(lightMin[row], value);
+            lightMax[row] = fmaxf(lightMax[row], value);
+        }
+    }
+
+    uint32_t mask = 0;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        bool overlaps = true;
+
+        for (int axis = 0; axis < 3; axis++) {
+            overlaps = overlaps && lightMin[axis] <= volumes[i].max[axis] && volumes[i].min[axis] <= lightMax[axis];
+        }
+
+        mask |= overlaps ? 1u << i : 0u;
+    }
+
+    return mask;
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int casterCount = quick ? 1000 : 100000;
+    const int iterations = quick ? 1 : 20;
+
+    SDSMRandom random(8);
+
+    std::vector<AxisAlignedBox> casters(casterCount);
+    std::vector<uint32_t> masks(casterCount);
+
+    for (AxisAlignedBox & caster : casters) {
+        float x = random.uniform(-500.0f, 500.0f), y = random.uniform(-500.0f, 500.0f), z = random.uniform(-500.0f, 500.0f);
+        caster = makeAxisAlignedBox(x, y, z, x + random.uniform(1.0f, 10.0f), y + random.uniform(1.0f, 10.0f), z + random.uniform(1.0f, 10.0f));
+    }
+
+    // A sun 45 degrees above the horizon
+    const float matrix[16] = {1, 0, 0, 0,  0, 0.7071f, 0.7071f, 0,  0, -0.7071f, 0.7071f, 0,  0, 0, 0, 1};
+
+    double transformTime = sdsmBenchmark([&]() {
+        for (const AxisAlignedBox & caster : casters) {
+            sdsmKeep(transformAxisAlignedBox(matrix, caster));
+        }
+    }, iterations);
+
+    printf("%d casters, transform %.2f ns per caster\n\n", casterCount, transformTime / casterCount);
+    printf("%-9s %14s %14s %14s %10s\n", "cascades", "cull ns", "fit ns", "scalar ns", "kept");
+
+    for (int cascadeCount = 1; cascadeCount <= MAX_CASCADED_SHADOW_COUNT; cascadeCount++) {
+        // Nested cascades growing away from the camera, like log partitioned ones
+        AxisAlignedBox volumes[MAX_CASCADED_SHADOW_COUNT];
+        float receivers[6 * MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < cascadeCount; i++) {
+            float size = 400.0f * powf(2.0f, (float)(i + 1 - cascadeCount));
+
+            volumes[i] = makeAxisAlignedBox(-size, -size, -FLT_MAX, size, size, size);
+
+            memcpy(receivers + 6 * i, volumes[i].min, 3 * sizeof(float));
+            memcpy(receivers + 6 * i + 3, volumes[i].max, 3 * sizeof(float));
+            receivers[6 * i + 2] = -size;
+        }
+
+        double cullTime = sdsmBenchmark([&]() {
+            cullShadowCasters(matrix, casters.data(), casterCount, volumes, cascadeCount, masks.data());
+            sdsmKeep(masks[0]);
+        }, iterations);
+
+        float nearZ[MAX_CASCADED_SHADOW_COUNT];
+
+        double fitTime = sdsmBenchmark([&]() {
+            fitCascadeNearPlanes(matrix, casters.data(), casterCount, receivers, cascadeCount, masks.data(), nearZ);
+            sdsmKeep(nearZ[0]);
+        }, iterations);
+
+        double scalarTime = sdsmBenchmark([&]() {
+            for (int i = 0; i < casterCount; i++) {
+                masks[i] = scalarCascadeMask(matrix, casters[i], volumes, cascadeCount);
+            }
+            sdsmKeep(masks[0]);
+        }, iterations);
+
+        int kept = 0;
+
+        for (uint32_t mask : masks) {
+            kept += mask != 0;
+        }
+
+        printf("%-9d %14.2f %14.2f %14.2f %10d\n", cascadeCount,
+               cullTime / casterCount, fitTime / casterCount, scalarTime / casterCount, kept);
+    }
+
+    return 0;
+}
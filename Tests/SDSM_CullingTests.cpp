@@ -0,0 +1,260 @@
+//
+//  SDSM_CullingTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the shadow caster culling library against straightforward scalar references: box
+//  transforms against the bounds of the eight transformed corners, the vectorized overlap test
+//  against a per axis comparison, and the culling and near plane fit against a per caster,
+//  per cascade loop.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Culling.h"
+#include "AAPLConfig.h"
+
+// Bounds of the eight corners of a box after an affine, column major transform
+static AxisAlignedBox referenceTransformAxisAlignedBox(const float *matrix, const AxisAlignedBox & box)
+{
+    AxisAlignedBox result = emptyAxisAlignedBox();
+
+    for (int corner = 0; corner < 8; corner++) {
+        float point[3] = {
+            corner & 1 ? box.max[0] : box.min[0],
+            corner & 2 ? box.max[1] : box.min[1],
+            corner & 4 ? box.max[2] : box.min[2]
+        };
+
+        float transformed[3];
+
+        for (int row = 0; row < 3; row++) {
+            transformed[row] = matrix[12 + row] + matrix[row] * point[0] + matrix[4 + row] * point[1] + matrix[8 + row] * point[2];
+        }
+
+        expandAxisAlignedBox(result, transformed);
+    }
+
+    return result;
+}
+
+static bool referenceBoxesOverlap(const AxisAlignedBox & a, const AxisAlignedBox & b)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        if (a.min[axis] > b.max[axis] || b.min[axis] > a.max[axis]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Affine transform with a random rotation, scale and translation
+static void randomAffineMatrix(SDSMRandom & random, float *matrix)
+{
+    for (int i = 0; i < 12; i++) {
+        matrix[i] = random.uniform(-2.0f, 2.0f);
+    }
+
+    matrix[3] = matrix[7] = matrix[11] = 0.0f;
+
+    matrix[12] = random.uniform(-100.0f, 100.0f);
+    matrix[13] = random.uniform(-100.0f, 100.0f);
+    matrix[14] = random.uniform(-100.0f, 100.0f);
+    matrix[15] = 1.0f;
+}
+
+static AxisAlignedBox randomBox(SDSMRandom & random, float range, float size)
+{
+    float x = random.uniform(-range, range), y = random.uniform(-range, range), z = random.uniform(-range, range);
+
+    return makeAxisAlignedBox(x, y, z,
+                              x + random.uniform(0.0f, size), y + random.uniform(0.0f, size), z + random.uniform(0.0f, size));
+}
+
+SDSM_TEST(transformMatchesTransformedCorners)
+{
+    SDSMRandom random(8);
+
+    for (int trial = 0; trial < 100000; trial++) {
+        float matrix[16];
+        randomAffineMatrix(random, matrix);
+
+        AxisAlignedBox box = randomBox(random, 100.0f, 20.0f);
+        AxisAlignedBox result = transformAxisAlignedBox(matrix, box);
+        AxisAlignedBox reference = referenceTransformAxisAlignedBox(matrix, box);
+
+        // The center and extent form rounds differently from the corners, by a few ulps of the
+        // largest term
+        for (int axis = 0; axis < 3; axis++) {
+            SDSM_CHECK_OR_BREAK(fabsf(result.min[axis] - reference.min[axis]) <= 1e-3f);
+            SDSM_CHECK_OR_BREAK(fabsf(result.max[axis] - reference.max[axis]) <= 1e-3f);
+        }
+    }
+}
+
+SDSM_TEST(transformIsExactOnAxisAlignedMatrices)
+{
+    // Axis permutations and power of two scales keep every operation exact
+    const float matrix[16] = {0, 2, 0, 0,  0, 0, -0.5f, 0,  4, 0, 0, 0,  8, -16, 32, 1};
+    AxisAlignedBox box = makeAxisAlignedBox(-1, 2, 3, 5, 6, 9);
+
+    AxisAlignedBox result = transformAxisAlignedBox(matrix, box);
+    AxisAlignedBox reference = referenceTransformAxisAlignedBox(matrix, box);
+
+    SDSM_CHECK(memcmp(result.min, reference.min, 3 * sizeof(float)) == 0);
+    SDSM_CHECK(memcmp(result.max, reference.max, 3 * sizeof(float)) == 0);
+}
+
+SDSM_TEST(overlapMatchesScalarReference)
+{
+    SDSMRandom random(9);
+
+    for (int trial = 0; trial < 1000000; trial++) {
+        // Integer coordinates make touching boxes common
+        AxisAlignedBox a, b;
+
+        for (int axis = 0; axis < 3; axis++) {
+            a.min[axis] = (float)random.integer(-4, 4);
+            a.max[axis] = a.min[axis] + (float)random.integer(-1, 3);
+            b.min[axis] = (float)random.integer(-4, 4);
+            b.max[axis] = b.min[axis] + (float)random.integer(-1, 3);
+        }
+
+        // The unused lanes must not affect the result
+        a.min[3] = random.uniform(-1.0f, 1.0f);
+        a.max[3] = random.uniform(-1.0f, 1.0f);
+        b.min[3] = random.uniform(-1.0f, 1.0f);
+        b.max[3] = random.uniform(-1.0f, 1.0f);
+
+        SDSM_CHECK_OR_BREAK(axisAlignedBoxesOverlap(a, b) == referenceBoxesOverlap(a, b));
+    }
+}
+
+SDSM_TEST(infiniteAndEmptyBoxes)
+{
+    AxisAlignedBox box = makeAxisAlignedBox(0, 0, 0, 1, 1, 1);
+
+    SDSM_CHECK(axisAlignedBoxesOverlap(infiniteAxisAlignedBox(), box));
+    SDSM_CHECK(!axisAlignedBoxesOverlap(emptyAxisAlignedBox(), box));
+
+    // A cascade without receivers rejects every caster
+    float noReceivers[6];
+    memcpy(noReceivers, emptyAxisAlignedBox().min, 3 * sizeof(float));
+    memcpy(noReceivers + 3, emptyAxisAlignedBox().max, 3 * sizeof(float));
+
+    AxisAlignedBox volume = cascadeCasterVolume(noReceivers, -FLT_MAX);
+
+    SDSM_CHECK(!axisAlignedBoxesOverlap(infiniteAxisAlignedBox(), volume));
+}
+
+SDSM_TEST(cullingMatchesPerCascadeReference)
+{
+    SDSMRandom random(10);
+
+    const int casterCount = 10000;
+
+    std::vector<AxisAlignedBox> casters(casterCount);
+    std::vector<uint32_t> masks(casterCount);
+
+    for (int trial = 0; trial < 20; trial++) {
+        float matrix[16];
+        randomAffineMatrix(random, matrix);
+
+        int cascadeCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        AxisAlignedBox volumes[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < cascadeCount; i++) {
+            volumes[i] = randomBox(random, 200.0f, 200.0f);
+        }
+
+        for (AxisAlignedBox & caster : casters) {
+            caster = randomBox(random, 300.0f, 10.0f);
+        }
+
+        cullShadowCasters(matrix, casters.data(), casterCount, volumes, cascadeCount, masks.data());
+
+        for (int i = 0; i < casterCount; i++) {
+            AxisAlignedBox lightBox = transformAxisAlignedBox(matrix, casters[i]);
+            AxisAlignedBox exactBox = referenceTransformAxisAlignedBox(matrix, casters[i]);
+
+            uint32_t referenceMask = 0;
+
+            for (int cascade = 0; cascade < cascadeCount; cascade++) {
+                referenceMask |= referenceBoxesOverlap(lightBox, volumes[cascade]) ? 1u << cascade : 0u;
+
+                // Conservative: a caster whose corners clearly reach into a volume is kept
+                AxisAlignedBox shrunk = exactBox;
+
+                for (int axis = 0; axis < 3; axis++) {
+                    shrunk.min[axis] += 1e-2f;
+                    shrunk.max[axis] -= 1e-2f;
+                }
+
+                if (referenceBoxesOverlap(shrunk, volumes[cascade])) {
+                    SDSM_CHECK_OR_BREAK(masks[i] & (1u << cascade));
+                }
+            }
+
+            SDSM_CHECK_OR_BREAK(masks[i] == referenceMask);
+        }
+    }
+}
+
+SDSM_TEST(nearPlanesFitTheSurvivingCasters)
+{
+    SDSMRandom random(11);
+
+    const int casterCount = 1000;
+
+    std::vector<AxisAlignedBox> casters(casterCount);
+    std::vector<uint32_t> masks(casterCount);
+
+    for (int trial = 0; trial < 100; trial++) {
+        float matrix[16];
+        randomAffineMatrix(random, matrix);
+
+        int cascadeCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        float receivers[6 * MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < cascadeCount; i++) {
+            AxisAlignedBox box = randomBox(random, 200.0f, 200.0f);
+
+            memcpy(receivers + 6 * i, box.min, 3 * sizeof(float));
+            memcpy(receivers + 6 * i + 3, box.max, 3 * sizeof(float));
+        }
+
+        for (AxisAlignedBox & caster : casters) {
+            caster = randomBox(random, 300.0f, 10.0f);
+        }
+
+        // One caster without known bounds, which is drawn into every cascade but moves no plane
+        casters[random.integer(0, casterCount - 1)] = infiniteAxisAlignedBox();
+
+        float nearZ[MAX_CASCADED_SHADOW_COUNT];
+
+        fitCascadeNearPlanes(matrix, casters.data(), casterCount, receivers, cascadeCount, masks.data(), nearZ);
+
+        // Reference: the closer of the receivers' near bound and the nearest overlapping caster
+        for (int cascade = 0; cascade < cascadeCount; cascade++) {
+            const float *receiver = receivers + 6 * cascade;
+            float expected = fminf(receiver[2], receiver[5] - 1.0f);
+
+            AxisAlignedBox volume = makeAxisAlignedBox(receiver[0], receiver[1], -FLT_MAX,
+                                                       receiver[3], receiver[4], receiver[5]);
+
+            for (int i = 0; i < casterCount; i++) {
+                AxisAlignedBox lightBox = transformAxisAlignedBox(matrix, casters[i]);
+                bool overlaps = referenceBoxesOverlap(lightBox, volume);
+
+                SDSM_CHECK_OR_BREAK(((masks[i] >> cascade) & 1) == (overlaps ? 1u : 0u));
+
+                if (overlaps && lightBox.min[2] > -FLT_MAX) {
+                    expected = fminf(expected, lightBox.min[2]);
+                }
+            }
+
+            SDSM_CHECK(nearZ[cascade] == expected);
+        }
+    }
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,169 @@
+//
+//  SDSM_DepthPyramidTests.cpp
+//  DeferredLighting C++
+//
+//  Tests that the CPU depth pyramid matches build_depth_pyramid_base and build_depth_pyramid_level
+//  bit for bit.  The reference below evaluates every texel the way the kernels do, one thread per
+//  texel with clamped reads and the same order of operations, so the vectorized and threaded
+//  builder has to agree with it exactly for every size, thread count and kind of depth image.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_DepthPyramid.h"
+
+static std::vector<DepthPyramidLevel> referenceDepthPyramid(const float *depth, int width, int height)
+{
+    std::vector<DepthPyramidLevel> levels(depthPyramidLevelCount(width, height));
+
+    for (size_t level = 0; level < levels.size(); level++) {
+        int sourceWidth = level == 0 ? width : levels[level - 1].width;
+        int sourceHeight = level == 0 ? height : levels[level - 1].height;
+
+        DepthPyramidLevel & result = levels[level];
+
+        result.width = depthPyramidLevelSize(sourceWidth);
+        result.height = depthPyramidLevelSize(sourceHeight);
+        result.texels.resize((size_t)2 * result.width * result.height);
+
+        for (int y = 0; y < result.height; y++) {
+            for (int x = 0; x < result.width; x++) {
+                int firstX = 2 * x, firstY = 2 * y;
+                int secondX = std::min(firstX + 1, sourceWidth - 1);
+                int secondY = std::min(firstY + 1, sourceHeight - 1);
+
+                float *texel = &result.texels[(size_t)2 * (y * result.width + x)];
+
+                if (level == 0) {
+                    float d00 = depth[(size_t)firstY * width + firstX];
+                    float d10 = depth[(size_t)firstY * width + secondX];
+                    float d01 = depth[(size_t)secondY * width + firstX];
+                    float d11 = depth[(size_t)secondY * width + secondX];
+
+                    texel[0] = depthPyramidMin(depthPyramidMin(depthPyramidMinSample(d00), depthPyramidMinSample(d10)),
+                                               depthPyramidMin(depthPyramidMinSample(d01), depthPyramidMinSample(d11)));
+                    texel[1] = depthPyramidMax(depthPyramidMax(d00, d10), depthPyramidMax(d01, d11));
+                } else {
+                    const float *source = levels[level - 1].texels.data();
+
+                    const float *t00 = source + (size_t)2 * (firstY * sourceWidth + firstX);
+                    const float *t10 = source + (size_t)2 * (firstY * sourceWidth + secondX);
+                    const float *t01 = source + (size_t)2 * (secondY * sourceWidth + firstX);
+                    const float *t11 = source + (size_t)2 * (secondY * sourceWidth + secondX);
+
+                    texel[0] = depthPyramidMin(depthPyramidMin(t00[0], t10[0]), depthPyramidMin(t01[0], t11[0]));
+                    texel[1] = depthPyramidMax(depthPyramidMax(t00[1], t10[1]), depthPyramidMax(t01[1], t11[1]));
+                }
+            }
+        }
+    }
+
+    return levels;
+}
+
+static bool samePyramids(const std::vector<DepthPyramidLevel> & a, const std::vector<DepthPyramidLevel> & b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (size_t level = 0; level < a.size(); level++) {
+        if (a[level].width != b[level].width || a[level].height != b[level].height ||
+            memcmp(a[level].texels.data(), b[level].texels.data(), a[level].texels.size() * sizeof(float)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+enum DepthImageKind
+{
+    DepthImageFull,
+    DepthImageSparse,
+    DepthImageEmpty,
+    DepthImageExtremes,
+    DepthImageKindCount
+};
+
+static std::vector<float> depthImage(DepthImageKind kind, int width, int height, SDSMRandom & random)
+{
+    std::vector<float> depth((size_t)width * height);
+
+    for (float & value : depth) {
+        switch (kind) {
+            case DepthImageFull:
+                value = random.uniform(1.0f, 750.0f);
+                break;
+            case DepthImageSparse:
+                value = random.integer(0, 3) == 0 ? random.uniform(1.0f, 750.0f) : 0.0f;
+                break;
+            case DepthImageEmpty:
+                value = 0.0f;
+                break;
+            default: {
+                // Values where a min or max that does not return one of its arguments would differ
+                const float extremes[] = {0.0f, FLT_MIN, 1e-40f, 1.0f, FLT_MAX, INFINITY};
+                value = extremes[random.integer(0, 5)];
+                break;
+            }
+        }
+    }
+
+    return depth;
+}
+
+SDSM_TEST(levelSizesHalveDownToOneTexel)
+{
+    SDSM_CHECK(depthPyramidLevelCount(1, 1) == 1);
+    SDSM_CHECK(depthPyramidLevelCount(2, 2) == 1);
+    SDSM_CHECK(depthPyramidLevelCount(3, 1) == 2);
+    SDSM_CHECK(depthPyramidLevelCount(1920, 1080) == 11);
+
+    std::vector<float> depth(37 * 5, 1.0f);
+    std::vector<DepthPyramidLevel> levels = buildDepthPyramid(depth.data(), 37, 5);
+
+    SDSM_CHECK(levels.front().width == 19 && levels.front().height == 3);
+    SDSM_CHECK(levels.back().width == 1 && levels.back().height == 1);
+}
+
+SDSM_TEST(pyramidMatchesTheKernelsBitForBit)
+{
+    // Odd sizes exercise the clamped edges, widths below and above the vector widths both the
+    // vector loops and their scalar tails
+    const int sizes[][2] = {{1, 1}, {2, 1}, {1, 7}, {7, 3}, {8, 8}, {9, 17}, {33, 65},
+                            {4, 300}, {300, 4}, {640, 480}, {1917, 1081}};
+
+    SDSMRandom random(16);
+
+    for (const auto & size : sizes) {
+        for (int kind = 0; kind < DepthImageKindCount; kind++) {
+            std::vector<float> depth = depthImage((DepthImageKind)kind, size[0], size[1], random);
+            std::vector<DepthPyramidLevel> reference = referenceDepthPyramid(depth.data(), size[0], size[1]);
+
+            for (int threadCount : {1, 3, 8}) {
+                bool same = samePyramids(buildDepthPyramid(depth.data(), size[0], size[1], threadCount), reference);
+
+                if (!same) {
+                    fprintf(stderr, "%d x %d, kind %d, %d threads\n", size[0], size[1], kind, threadCount);
+                }
+
+                SDSM_CHECK(same);
+            }
+        }
+    }
+}
+
+SDSM_TEST(emptyPixelsDoNotLowerTheMinimum)
+{
+    const float depth[4] = {0.0f, 5.0f, 0.0f, 0.0f};
+
+    std::vector<DepthPyramidLevel> levels = buildDepthPyramid(depth, 2, 2, 1);
+    SDSM_CHECK(levels[0].texels[0] == 5.0f && levels[0].texels[1] == 5.0f);
+
+    const float empty[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    levels = buildDepthPyramid(empty, 2, 2, 1);
+    SDSM_CHECK(levels[0].texels[0] == FLT_MAX && levels[0].texels[1] == 0.0f);
+}
+
+SDSM_TEST_MAIN()
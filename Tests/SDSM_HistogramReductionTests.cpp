@@ -0,0 +1,239 @@
+//
+//  SDSM_HistogramReductionTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the CPU reference of the fused reduce_depth_histogram against the two passes it
+//  replaces: it finds the same depth range as reduce_min_max_depth, the cascade boxes derived from
+//  its bins equal reduce_light_frustum's when no bin straddles a split and contain them otherwise,
+//  and its bins count every sample once.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+static const float TestNearPlane = 1.0f;
+static const float TestFarPlane = 750.0f;
+
+// Light space position of a sample, an arbitrary function of the pixel and its depth that gives
+// every sample its own coordinates, negative ones included
+static void testLightSpace(uint32_t x, uint32_t y, float depth, float *position)
+{
+    position[0] = (float)x * 0.37f - depth * 0.2f;
+    position[1] = depth * 0.9f - (float)y * 0.11f;
+    position[2] = (float)(x ^ y) * 0.05f - 3.0f;
+}
+
+// Depth at a fraction of the way through a histogram bin
+static float depthInBin(int bin, float fraction)
+{
+    return TestNearPlane * powf(TestFarPlane / TestNearPlane, ((float)bin + fraction) / (float)SDSM_HISTOGRAM_BIN_COUNT);
+}
+
+// Random splits on histogram bin edges between the near and far planes
+static void makeCascadeEnds(SDSMRandom & random, int cascadeCount, int *splitBins, float *cascadeEnds)
+{
+    cascadeEnds[0] = TestNearPlane;
+    cascadeEnds[cascadeCount] = TestFarPlane;
+
+    int previous = 0;
+
+    for (int i = 1; i < cascadeCount; i++) {
+        int remaining = cascadeCount - i;
+
+        // At least three bins per cascade, so every cascade keeps bins away from its splits
+        splitBins[i] = random.integer(previous + 3, SDSM_HISTOGRAM_BIN_COUNT - 3 * remaining);
+        cascadeEnds[i] = depthHistogramBinStart(splitBins[i], TestNearPlane, TestFarPlane);
+        previous = splitBins[i];
+    }
+}
+
+// Depth image with holes of empty pixels.  With splitBins, samples avoid the bins on either side
+// of every split and stay clear of bin edges.
+static std::vector<float> makeDepthImage(uint32_t width, uint32_t height, float emptyFraction, SDSMRandom & random,
+                                         const int *splitBins = nullptr, int cascadeCount = 0)
+{
+    std::vector<float> depth((size_t)width * height);
+
+    for (float & sample : depth) {
+        if (random.uniform(0.0f, 1.0f) < emptyFraction) {
+            sample = 0.0f;
+            continue;
+        }
+
+        if (!splitBins) {
+            sample = depthInBin(0, random.uniform(0.001f, (float)SDSM_HISTOGRAM_BIN_COUNT - 0.001f));
+            continue;
+        }
+
+        int bin;
+        bool nearSplit;
+
+        do {
+            bin = random.integer(0, SDSM_HISTOGRAM_BIN_COUNT - 1);
+            nearSplit = false;
+
+            for (int i = 1; i < cascadeCount; i++) {
+                nearSplit = nearSplit || bin == splitBins[i] || bin == splitBins[i] - 1;
+            }
+        } while (nearSplit);
+
+        sample = depthInBin(bin, random.uniform(0.1f, 0.9f));
+    }
+
+    return depth;
+}
+
+struct FusedAndSeparate
+{
+    int histogram[DepthHistogramLength];
+    uint64_t histogramAtomicCount;
+
+    DepthReductionResult depthRange;
+
+    float histogramBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    float lightFrustumBoxes[6 * MAX_CASCADED_SHADOW_COUNT];
+};
+
+// Reduces an image once with the fused pass and once with the min/max and light frustum passes
+static void reduceBoth(const std::vector<float> & depth, uint32_t width, uint32_t height,
+                       const float *cascadeEnds, int cascadeCount, FusedAndSeparate & result)
+{
+    resetDepthHistogram(result.histogram, TestNearPlane, TestFarPlane);
+    result.histogramAtomicCount = reduceDepthHistogram(depth.data(), width, height, TestNearPlane, TestFarPlane,
+                                                       testLightSpace, result.histogram);
+
+    cascadeBoundsFromDepthHistogram(result.histogram, TestNearPlane, TestFarPlane, cascadeEnds, cascadeCount,
+                                    result.histogramBoxes);
+
+    result.depthRange = reduceMinMaxDepthAtomic(depth.data(), width, height,
+                                                encodeOrderedFloat(TestFarPlane), encodeOrderedFloat(TestNearPlane));
+
+    int boxes[6 * MAX_CASCADED_SHADOW_COUNT];
+    for (int i = 0; i < cascadeCount; i++) {
+        resetBoundingBox(boxes + 6 * i);
+    }
+
+    reduceLightFrustum(depth.data(), width, height, cascadeEnds, cascadeCount, testLightSpace, boxes);
+
+    for (int i = 0; i < cascadeCount; i++) {
+        decodeBoundingBox(boxes + 6 * i, result.lightFrustumBoxes + 6 * i);
+    }
+}
+
+SDSM_TEST(fusedPassFindsTheSameDepthRange)
+{
+    SDSMRandom random(2);
+    FusedAndSeparate result;
+    const float cascadeEnds[2] = {TestNearPlane, TestFarPlane};
+
+    for (int trial = 0; trial < 200; trial++) {
+        uint32_t width = (uint32_t)random.integer(1, 80);
+        uint32_t height = (uint32_t)random.integer(1, 80);
+        std::vector<float> depth = makeDepthImage(width, height, random.uniform(0.0f, 1.0f), random);
+
+        reduceBoth(depth, width, height, cascadeEnds, 1, result);
+
+        SDSM_CHECK_OR_BREAK(result.histogram[DepthHistogramMinDepth] == result.depthRange.minDepth);
+        SDSM_CHECK_OR_BREAK(result.histogram[DepthHistogramMaxDepth] == result.depthRange.maxDepth);
+    }
+}
+
+SDSM_TEST(cascadeBoxesMatchTheLightFrustumPass)
+{
+    SDSMRandom random(3);
+    FusedAndSeparate result;
+
+    for (int trial = 0; trial < 300; trial++) {
+        int cascadeCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        int splitBins[MAX_CASCADED_SHADOW_COUNT];
+        float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+
+        makeCascadeEnds(random, cascadeCount, splitBins, cascadeEnds);
+
+        uint32_t width = (uint32_t)random.integer(1, 64);
+        uint32_t height = (uint32_t)random.integer(1, 64);
+        std::vector<float> depth = makeDepthImage(width, height, random.uniform(0.0f, 0.9f), random,
+                                                  splitBins, cascadeCount);
+
+        reduceBoth(depth, width, height, cascadeEnds, cascadeCount, result);
+
+        // Empty cascades stay inverted on both paths, so the whole arrays compare equal
+        SDSM_CHECK_OR_BREAK(memcmp(result.histogramBoxes, result.lightFrustumBoxes,
+                                   6 * cascadeCount * sizeof(float)) == 0);
+    }
+}
+
+SDSM_TEST(cascadeBoxesContainTheLightFrustumPassAtAnySplit)
+{
+    SDSMRandom random(4);
+    FusedAndSeparate result;
+
+    for (int trial = 0; trial < 300; trial++) {
+        int cascadeCount = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+
+        // Splits anywhere, so bins straddle them
+        cascadeEnds[0] = TestNearPlane;
+        for (int i = 1; i <= cascadeCount; i++) {
+            cascadeEnds[i] = cascadeEnds[i - 1] * powf(TestFarPlane / cascadeEnds[i - 1], random.uniform(0.1f, 0.9f));
+        }
+        cascadeEnds[cascadeCount] = TestFarPlane;
+
+        uint32_t width = (uint32_t)random.integer(1, 64);
+        uint32_t height = (uint32_t)random.integer(1, 64);
+        std::vector<float> depth = makeDepthImage(width, height, random.uniform(0.0f, 0.9f), random);
+
+        reduceBoth(depth, width, height, cascadeEnds, cascadeCount, result);
+
+        for (int i = 0; i < 6 * cascadeCount; i++) {
+            bool isMin = i % 6 < 3;
+            float histogramValue = result.histogramBoxes[i];
+            float lightFrustumValue = result.lightFrustumBoxes[i];
+
+            SDSM_CHECK_OR_BREAK(isMin ? histogramValue <= lightFrustumValue : histogramValue >= lightFrustumValue);
+        }
+    }
+}
+
+SDSM_TEST(binsCountEverySampleOnce)
+{
+    SDSMRandom random(5);
+    FusedAndSeparate result;
+    const float cascadeEnds[2] = {TestNearPlane, TestFarPlane};
+
+    for (int trial = 0; trial < 100; trial++) {
+        uint32_t width = (uint32_t)random.integer(1, 100);
+        uint32_t height = (uint32_t)random.integer(1, 100);
+        std::vector<float> depth = makeDepthImage(width, height, random.uniform(0.0f, 1.0f), random);
+
+        reduceBoth(depth, width, height, cascadeEnds, 1, result);
+
+        int expectedCounts[SDSM_HISTOGRAM_BIN_COUNT] = {};
+        int sampleCount = 0;
+
+        for (float sample : depth) {
+            if (sample > 0.0f) {
+                expectedCounts[depthHistogramBin(sample, TestNearPlane, TestFarPlane)]++;
+                sampleCount++;
+            }
+        }
+
+        int total = 0;
+        bool countsMatch = true;
+
+        for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+            int count = result.histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+
+            countsMatch = countsMatch && count == expectedCounts[bin];
+            total += count;
+        }
+
+        SDSM_CHECK_OR_BREAK(countsMatch);
+        SDSM_CHECK_OR_BREAK(total == sampleCount);
+
+        // Min, max, count and six box entries per sample
+        SDSM_CHECK_OR_BREAK(result.histogramAtomicCount == 9ull * (uint64_t)sampleCount);
+    }
+}
+
+SDSM_TEST_MAIN()
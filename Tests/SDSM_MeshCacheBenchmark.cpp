@@ -0,0 +1,216 @@
+//
+//  SDSM_MeshCacheBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Startup cost of loading the temple from its OBJ file against loading it from the mesh cache.
+//  The OBJ path here only parses, welds and relayouts the vertices; the app also generates tangents
+//  through ModelIO, so the real gap is wider.  The cache is timed both copying its data into a new
+//  allocation and aliasing the mapping, touching each page as the GPU would.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_MeshCache.h"
+
+#include <map>
+#include <unordered_map>
+
+static const char *TempleSourcePath = SDSM_ASSETS_DIR "/Meshes/Temple.obj";
+static const char *TempleCachePath = "SDSM_MeshCacheBenchmark.meshcache";
+
+static const uint32_t BenchmarkLayoutSignature = 1;
+
+// Vertices laid out as the renderer's descriptor: packed positions, then texture coordinate,
+// normal, tangent and bitangent in a 32 byte generic stream
+struct ParsedModel
+{
+    uint32_t vertexCount = 0;
+    std::vector<float> positions;
+    std::vector<uint8_t> generics;
+    std::map<std::string, std::vector<uint32_t>> indicesByMaterial;
+    AxisAlignedBox bounds = emptyAxisAlignedBox();
+};
+
+static std::string readSource(const char *path)
+{
+    std::string text;
+    FILE *file = fopen(path, "rb");
+
+    if (!file) {
+        return text;
+    }
+
+    fseek(file, 0, SEEK_END);
+    text.resize((size_t)ftell(file));
+    fseek(file, 0, SEEK_SET);
+
+    if (fread(&text[0], 1, text.size(), file) != text.size()) {
+        text.clear();
+    }
+
+    fclose(file);
+
+    return text;
+}
+
+static ParsedModel parseObj(const std::string & text)
+{
+    ParsedModel model;
+
+    std::vector<float> positions;
+    std::vector<float> textureCoordinates;
+    std::unordered_map<std::string, uint32_t> vertexIndices;
+    std::string material = "default";
+
+    const char *line = text.c_str();
+    const char *end = line + text.size();
+
+    while (line < end) {
+        const char *lineEnd = (const char *)memchr(line, '\n', (size_t)(end - line));
+        lineEnd = lineEnd ? lineEnd : end;
+
+        char *next;
+
+        if (line[0] == 'v' && line[1] == ' ') {
+            for (int i = 0; i < 3; i++) {
+                positions.push_back(strtof(i == 0 ? line + 2 : next, &next));
+            }
+        } else if (line[0] == 'v' && line[1] == 't') {
+            for (int i = 0; i < 2; i++) {
+                textureCoordinates.push_back(strtof(i == 0 ? line + 3 : next, &next));
+            }
+        } else if (strncmp(line, "usemtl ", 7) == 0) {
+            material.assign(line + 7, lineEnd);
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            uint32_t face[16];
+            int cornerCount = 0;
+            const char *corner = line + 2;
+
+            while (corner < lineEnd && cornerCount < 16) {
+                while (corner < lineEnd && (*corner == ' ' || *corner == '\r')) {
+                    corner++;
+                }
+
+                const char *cornerEnd = corner;
+
+                while (cornerEnd < lineEnd && *cornerEnd != ' ' && *cornerEnd != '\r') {
+                    cornerEnd++;
+                }
+
+                if (corner == cornerEnd) {
+                    break;
+                }
+
+                std::string key(corner, cornerEnd);
+                auto found = vertexIndices.find(key);
+
+                if (found == vertexIndices.end()) {
+                    int position = 0;
+                    int textureCoordinate = 0;
+                    sscanf(key.c_str(), "%d/%d", &position, &textureCoordinate);
+
+                    const float *xyz = &positions[3 * (size_t)(position - 1)];
+                    model.positions.insert(model.positions.end(), xyz, xyz + 3);
+                    expandAxisAlignedBox(model.bounds, xyz);
+
+                    uint8_t generic[32] = {};
+
+                    if (textureCoordinate > 0) {
+                        memcpy(generic, &textureCoordinates[2 * (size_t)(textureCoordinate - 1)], 2 * sizeof(float));
+                    }
+
+                    model.generics.insert(model.generics.end(), generic, generic + sizeof(generic));
+
+                    found = vertexIndices.emplace(key, model.vertexCount++).first;
+                }
+
+                face[cornerCount++] = found->second;
+                corner = cornerEnd;
+            }
+
+            std::vector<uint32_t> & indices = model.indicesByMaterial[material];
+
+            for (int i = 2; i < cornerCount; i++) {
+                indices.insert(indices.end(), {face[0], face[i - 1], face[i]});
+            }
+        }
+
+        line = lineEnd + 1;
+    }
+
+    return model;
+}
+
+static bool writeCache(const ParsedModel & model, const char *path, uint64_t sourceSize, int64_t sourceModificationTime)
+{
+    MeshCacheWriter writer(BenchmarkLayoutSignature, sourceSize, sourceModificationTime);
+
+    writer.beginMesh(model.vertexCount, model.bounds);
+    writer.addVertexStream(0, 12, model.positions.data(), model.positions.size() * sizeof(float));
+    writer.addVertexStream(1, 32, model.generics.data(), model.generics.size());
+
+    for (const auto & group : model.indicesByMaterial) {
+        const std::string paths[MeshCacheTexturesPerMaterial] = {group.first + "_albedo.png", group.first + "_specular.png", ""};
+        const std::string names[MeshCacheTexturesPerMaterial] = {group.first, group.first, ""};
+
+        writer.addSubmesh(3, MeshCacheIndexTypeUInt32, (uint32_t)group.second.size(), writer.addMaterial(paths, names),
+                          group.second.data(), group.second.size() * sizeof(uint32_t), model.bounds);
+    }
+
+    return writer.write(path);
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int repetitions = quick ? 1 : 10;
+
+    uint64_t sourceSize;
+    int64_t sourceModificationTime;
+
+    if (!meshCacheSourceStamp(TempleSourcePath, sourceSize, sourceModificationTime)) {
+        fprintf(stderr, "cannot find %s\n", TempleSourcePath);
+        return 1;
+    }
+
+    ParsedModel model = parseObj(readSource(TempleSourcePath));
+
+    if (!writeCache(model, TempleCachePath, sourceSize, sourceModificationTime)) {
+        fprintf(stderr, "cannot write %s\n", TempleCachePath);
+        return 1;
+    }
+
+    double parseTime = sdsmBenchmark([&]() {
+        ParsedModel parsed = parseObj(readSource(TempleSourcePath));
+        sdsmKeep(parsed.vertexCount);
+    }, 1, repetitions);
+
+    double copyTime = sdsmBenchmark([&]() {
+        MeshCacheFile cache;
+
+        if (cache.open(TempleCachePath, BenchmarkLayoutSignature, sourceSize, sourceModificationTime)) {
+            std::vector<uint8_t> buffer(cache.data(), cache.data() + cache.dataLength());
+            sdsmKeep(buffer[buffer.size() / 2]);
+        }
+    }, 1, repetitions);
+
+    double aliasTime = sdsmBenchmark([&]() {
+        MeshCacheFile cache;
+
+        if (cache.open(TempleCachePath, BenchmarkLayoutSignature, sourceSize, sourceModificationTime)) {
+            uint8_t sum = 0;
+
+            for (uint64_t offset = 0; offset < cache.dataLength(); offset += 4096) {
+                sum += cache.data()[offset];
+            }
+
+            sdsmKeep(sum);
+        }
+    }, 1, repetitions);
+
+    printf("%u vertices, %zu submeshes\n", model.vertexCount, model.indicesByMaterial.size());
+    printf("%-28s %10.3f ms\n", "parse OBJ", parseTime * 1e-6);
+    printf("%-28s %10.3f ms\n", "open cache and copy", copyTime * 1e-6);
+    printf("%-28s %10.3f ms\n", "open cache and alias", aliasTime * 1e-6);
+
+    return 0;
+}
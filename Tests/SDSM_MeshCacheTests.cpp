@@ -0,0 +1,275 @@
+//
+//  SDSM_MeshCacheTests.cpp
+//  DeferredLighting C++
+//
+//  Round trip of the binary mesh cache through the writer and the mapped reader, and the reader's
+//  rejection of stale, truncated and corrupted files.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_MeshCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+static const char *TestCachePath = "SDSM_MeshCacheTests.meshcache";
+static const char *CorruptCachePath = "SDSM_MeshCacheTests.corrupt.meshcache";
+
+static const uint32_t TestLayoutSignature = 0x5D5A1234u;
+static const uint64_t TestSourceSize = 2177555;
+static const int64_t TestSourceModificationTime = 1639000000;
+
+static const uint32_t TestPrimitiveTypeTriangle = 3;
+
+// Two meshes with a position and a generic stream each, and submeshes of both index types
+struct TestMesh
+{
+    uint32_t vertexCount;
+    std::vector<float> positions;
+    std::vector<uint8_t> generics;
+    std::vector<uint16_t> shortIndices;
+    std::vector<uint32_t> indices;
+    AxisAlignedBox bounds;
+};
+
+static std::vector<TestMesh> makeTestMeshes()
+{
+    SDSMRandom random(25);
+    std::vector<TestMesh> meshes(2);
+
+    for (size_t m = 0; m < meshes.size(); m++) {
+        TestMesh & mesh = meshes[m];
+
+        mesh.vertexCount = m == 0 ? 1000 : 70000;
+        mesh.bounds = emptyAxisAlignedBox();
+
+        for (uint32_t i = 0; i < mesh.vertexCount; i++) {
+            float position[3] = {random.uniform(-10.0f, 10.0f), random.uniform(0.0f, 5.0f), random.uniform(-10.0f, 10.0f)};
+
+            mesh.positions.insert(mesh.positions.end(), position, position + 3);
+            expandAxisAlignedBox(mesh.bounds, position);
+        }
+
+        for (uint32_t i = 0; i < mesh.vertexCount * 32; i++) {
+            mesh.generics.push_back((uint8_t)random.next());
+        }
+
+        for (int i = 0; i < 3 * 500; i++) {
+            mesh.shortIndices.push_back((uint16_t)random.integer(0, (int)std::min(mesh.vertexCount, 65536u) - 1));
+        }
+
+        for (int i = 0; i < 3 * 20000; i++) {
+            mesh.indices.push_back((uint32_t)random.integer(0, (int)mesh.vertexCount - 1));
+        }
+    }
+
+    return meshes;
+}
+
+static bool writeTestCache(const std::vector<TestMesh> & meshes, const char *path)
+{
+    MeshCacheWriter writer(TestLayoutSignature, TestSourceSize, TestSourceModificationTime);
+
+    const std::string paths[MeshCacheTexturesPerMaterial] = {"Textures/Stone_albedo.png", "Textures/Stone_specular.png", ""};
+    const std::string names[MeshCacheTexturesPerMaterial] = {"Stone_albedo", "Stone_specular", "Stone_normal"};
+    const std::string otherNames[MeshCacheTexturesPerMaterial] = {"Wood_albedo", "", ""};
+
+    for (const TestMesh & mesh : meshes) {
+        writer.beginMesh(mesh.vertexCount, mesh.bounds);
+        writer.addVertexStream(0, 12, mesh.positions.data(), mesh.positions.size() * sizeof(float));
+        writer.addVertexStream(1, 32, mesh.generics.data(), mesh.generics.size());
+
+        writer.addSubmesh(TestPrimitiveTypeTriangle, MeshCacheIndexTypeUInt16, (uint32_t)mesh.shortIndices.size(),
+                          writer.addMaterial(paths, names),
+                          mesh.shortIndices.data(), mesh.shortIndices.size() * sizeof(uint16_t), mesh.bounds);
+
+        writer.addSubmesh(TestPrimitiveTypeTriangle, MeshCacheIndexTypeUInt32, (uint32_t)mesh.indices.size(),
+                          writer.addMaterial(paths, otherNames),
+                          mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), mesh.bounds);
+    }
+
+    return writer.write(path);
+}
+
+static std::string readFile(const char *path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const char *path, const std::string & bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), (std::streamsize)bytes.size());
+}
+
+static bool openTestCache(MeshCacheFile & cache, const char *path)
+{
+    return cache.open(path, TestLayoutSignature, TestSourceSize, TestSourceModificationTime);
+}
+
+// Opens a copy of the cache with the value at an offset overwritten
+template <class T>
+static bool opensWithValue(const std::string & bytes, size_t offset, T value)
+{
+    std::string corrupt = bytes;
+    memcpy(&corrupt[offset], &value, sizeof(value));
+    writeFile(CorruptCachePath, corrupt);
+
+    MeshCacheFile cache;
+    return openTestCache(cache, CorruptCachePath);
+}
+
+SDSM_TEST(roundTripsMeshes)
+{
+    std::vector<TestMesh> meshes = makeTestMeshes();
+
+    SDSM_CHECK(writeTestCache(meshes, TestCachePath));
+
+    MeshCacheFile cache;
+
+    SDSM_CHECK(openTestCache(cache, TestCachePath));
+    SDSM_CHECK(cache.header().meshCount == 2);
+    SDSM_CHECK(cache.header().submeshCount == 4);
+
+    // Identical materials are shared between meshes
+    SDSM_CHECK(cache.header().materialCount == 2);
+
+    // The data can back a buffer without a copy
+    SDSM_CHECK((uintptr_t)cache.data() % (uintptr_t)getpagesize() == 0);
+    SDSM_CHECK(cache.dataLength() % MeshCacheDataAlignment == 0);
+
+    for (uint32_t m = 0; m < 2; m++) {
+        const MeshCacheMesh & cached = cache.meshes()[m];
+        const TestMesh & mesh = meshes[m];
+
+        SDSM_CHECK(cached.vertexCount == mesh.vertexCount);
+        SDSM_CHECK(cached.streamCount == 2);
+        SDSM_CHECK(memcmp(&cached.bounds, &mesh.bounds, sizeof(AxisAlignedBox)) == 0);
+
+        SDSM_CHECK(cached.streams[0].offset % MeshCacheStreamAlignment == 0);
+        SDSM_CHECK(cached.streams[1].offset % MeshCacheStreamAlignment == 0);
+        SDSM_CHECK(cached.streams[1].argumentIndex == 1 && cached.streams[1].stride == 32);
+        SDSM_CHECK(memcmp(cache.data() + cached.streams[0].offset, mesh.positions.data(), cached.streams[0].length) == 0);
+        SDSM_CHECK(memcmp(cache.data() + cached.streams[1].offset, mesh.generics.data(), cached.streams[1].length) == 0);
+
+        SDSM_CHECK(cached.firstSubmesh == 2 * m && cached.submeshCount == 2);
+
+        const MeshCacheSubmesh & shortSubmesh = cache.submeshes()[cached.firstSubmesh];
+        const MeshCacheSubmesh & submesh = cache.submeshes()[cached.firstSubmesh + 1];
+
+        SDSM_CHECK(shortSubmesh.indexType == MeshCacheIndexTypeUInt16);
+        SDSM_CHECK(shortSubmesh.indexCount == mesh.shortIndices.size());
+        SDSM_CHECK(shortSubmesh.indexOffset % MeshCacheStreamAlignment == 0);
+        SDSM_CHECK(memcmp(cache.data() + shortSubmesh.indexOffset, mesh.shortIndices.data(), shortSubmesh.indexLength) == 0);
+
+        SDSM_CHECK(submesh.indexType == MeshCacheIndexTypeUInt32);
+        SDSM_CHECK(submesh.primitiveType == TestPrimitiveTypeTriangle);
+        SDSM_CHECK(submesh.indexCount == mesh.indices.size());
+        SDSM_CHECK(submesh.indexOffset % MeshCacheStreamAlignment == 0);
+        SDSM_CHECK(memcmp(cache.data() + submesh.indexOffset, mesh.indices.data(), submesh.indexLength) == 0);
+
+        const MeshCacheMaterial & material = cache.materials()[shortSubmesh.materialIndex];
+        const MeshCacheMaterial & otherMaterial = cache.materials()[submesh.materialIndex];
+
+        SDSM_CHECK(strcmp(cache.string(material.textures[0].pathOffset), "Textures/Stone_albedo.png") == 0);
+        SDSM_CHECK(strcmp(cache.string(material.textures[2].pathOffset), "") == 0);
+        SDSM_CHECK(strcmp(cache.string(material.textures[2].nameOffset), "Stone_normal") == 0);
+        SDSM_CHECK(strcmp(cache.string(otherMaterial.textures[0].nameOffset), "Wood_albedo") == 0);
+    }
+}
+
+SDSM_TEST(rejectsStaleCaches)
+{
+    SDSM_CHECK(writeTestCache(makeTestMeshes(), TestCachePath));
+
+    MeshCacheFile cache;
+
+    SDSM_CHECK(!cache.open(TestCachePath, TestLayoutSignature + 1, TestSourceSize, TestSourceModificationTime));
+    SDSM_CHECK(!cache.open(TestCachePath, TestLayoutSignature, TestSourceSize + 1, TestSourceModificationTime));
+    SDSM_CHECK(!cache.open(TestCachePath, TestLayoutSignature, TestSourceSize, TestSourceModificationTime + 1));
+    SDSM_CHECK(!cache.open("SDSM_MeshCacheTests.missing.meshcache", TestLayoutSignature, TestSourceSize, TestSourceModificationTime));
+
+    SDSM_CHECK(openTestCache(cache, TestCachePath));
+}
+
+SDSM_TEST(rejectsTruncatedCaches)
+{
+    SDSM_CHECK(writeTestCache(makeTestMeshes(), TestCachePath));
+
+    std::string bytes = readFile(TestCachePath);
+    const size_t lengths[] = {0, sizeof(MeshCacheHeader) - 1, sizeof(MeshCacheHeader), 4096, bytes.size() - 1};
+
+    for (size_t length : lengths) {
+        writeFile(CorruptCachePath, bytes.substr(0, length));
+
+        MeshCacheFile cache;
+        SDSM_CHECK(!openTestCache(cache, CorruptCachePath));
+    }
+}
+
+SDSM_TEST(rejectsCorruptTables)
+{
+    SDSM_CHECK(writeTestCache(makeTestMeshes(), TestCachePath));
+
+    std::string bytes = readFile(TestCachePath);
+
+    MeshCacheHeader header;
+    memcpy(&header, bytes.data(), sizeof(header));
+
+    const size_t meshOffset = sizeof(MeshCacheHeader);
+    const size_t submeshOffset = meshOffset + header.meshCount * sizeof(MeshCacheMesh);
+    const size_t materialOffset = submeshOffset + header.submeshCount * sizeof(MeshCacheSubmesh);
+    const size_t stringOffset = materialOffset + header.materialCount * sizeof(MeshCacheMaterial);
+    const size_t streamOffset = meshOffset + offsetof(MeshCacheMesh, streams);
+
+    // The unmodified copy opens, so each rejection below is down to the field it changes
+    SDSM_CHECK(opensWithValue(bytes, 0, header.magic[0]));
+
+    SDSM_CHECK(!opensWithValue(bytes, 0, 'X'));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, version), MeshCacheVersion + 1));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, meshCount), 1000000u));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, stringLength), 1u << 30));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, stringLength), 0u));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, dataOffset), header.dataOffset + 1));
+    SDSM_CHECK(!opensWithValue(bytes, offsetof(MeshCacheHeader, dataLength), header.dataLength + MeshCacheDataAlignment));
+
+    SDSM_CHECK(!opensWithValue(bytes, meshOffset + offsetof(MeshCacheMesh, firstSubmesh), header.submeshCount));
+    SDSM_CHECK(!opensWithValue(bytes, meshOffset + offsetof(MeshCacheMesh, submeshCount), 999u));
+    SDSM_CHECK(!opensWithValue(bytes, meshOffset + offsetof(MeshCacheMesh, streamCount), MeshCacheMaxVertexStreams + 1));
+    SDSM_CHECK(!opensWithValue(bytes, meshOffset + offsetof(MeshCacheMesh, vertexCount), 1u << 28));
+    SDSM_CHECK(!opensWithValue(bytes, streamOffset + offsetof(MeshCacheStream, offset), ~0ull - 10));
+    SDSM_CHECK(!opensWithValue(bytes, streamOffset + offsetof(MeshCacheStream, length), header.dataLength + 1));
+
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, materialIndex), header.materialCount));
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexLength), 1ull << 40));
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexOffset), header.dataLength));
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, primitiveType), MeshCachePrimitiveTypeTriangleStrip + 1));
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexType), 2u));
+
+    // More indices than the index stream holds, and 16 bit indices reread as 32 bit ones
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexCount), 1501u));
+    SDSM_CHECK(!opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexType), MeshCacheIndexTypeUInt32));
+    SDSM_CHECK(opensWithValue(bytes, submeshOffset + offsetof(MeshCacheSubmesh, indexCount), 1499u));
+
+    SDSM_CHECK(!opensWithValue(bytes, materialOffset + offsetof(MeshCacheTexture, pathOffset), header.stringLength));
+    SDSM_CHECK(!opensWithValue(bytes, materialOffset + offsetof(MeshCacheTexture, nameOffset), ~0u));
+
+    // The string table must end in a terminator
+    SDSM_CHECK(!opensWithValue(bytes, stringOffset + header.stringLength - 1, 'x'));
+}
+
+SDSM_TEST(abandonedCachesAreNotWritten)
+{
+    unlink(CorruptCachePath);
+
+    MeshCacheWriter writer(TestLayoutSignature, TestSourceSize, TestSourceModificationTime);
+    writer.beginMesh(0, emptyAxisAlignedBox());
+    writer.abandon();
+
+    SDSM_CHECK(!writer.write(CorruptCachePath));
+    SDSM_CHECK(access(CorruptCachePath, F_OK) != 0);
+}
+
+SDSM_TEST_MAIN()
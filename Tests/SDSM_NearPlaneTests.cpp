@@ -0,0 +1,182 @@
+//
+//  SDSM_NearPlaneTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the cascade near plane fit on small synthetic scenes: a ground plane with trees and
+//  towers under an overhead and a low sun, flat receivers, empty cascades, and the depth range
+//  the fitted planes leave a 16 bit shadow map compared to the fixed SDSM_CASCADE_NEAR_Z.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Culling.h"
+#include "SDSMShared.h"
+
+#include <math.h>
+
+// Light view of a sun straight overhead, 50 units up: x and z of the world map to x and y, and
+// depth grows downwards from the light
+static const float OverheadLight[16] = {
+    1.0f, 0.0f,  0.0f, 0.0f,
+    0.0f, 0.0f, -1.0f, 0.0f,
+    0.0f, 1.0f,  0.0f, 0.0f,
+    0.0f, 0.0f, 50.0f, 1.0f,
+};
+
+// Light view of a sun 45 degrees up, shining towards +z
+static const float LowLight[16] = {
+    1.0f, 0.0f,       0.0f,       0.0f,
+    0.0f, M_SQRT1_2, -M_SQRT1_2,  0.0f,
+    0.0f, M_SQRT1_2,  M_SQRT1_2,  0.0f,
+    0.0f, 0.0f,       50.0f,      1.0f,
+};
+
+// Light view receiver box of a cascade, as the reduction reports it
+static void receiverBox(const float *lightMatrix, const AxisAlignedBox & worldBox, float *receivers)
+{
+    AxisAlignedBox lightBox = transformAxisAlignedBox(lightMatrix, worldBox);
+
+    memcpy(receivers, lightBox.min, 3 * sizeof(float));
+    memcpy(receivers + 3, lightBox.max, 3 * sizeof(float));
+}
+
+SDSM_TEST(overheadSunFitsEachCascadeToItsCasters)
+{
+    // The near cascade sees a patch of ground around a tree, the far one a wider patch with a tower
+    float receivers[12];
+    receiverBox(OverheadLight, makeAxisAlignedBox(-10.0f, 0.0f, -10.0f, 10.0f, 0.5f, 10.0f), receivers);
+    receiverBox(OverheadLight, makeAxisAlignedBox(-50.0f, 0.0f, -50.0f, 50.0f, 0.5f, 50.0f), receivers + 6);
+
+    const AxisAlignedBox casters[] = {
+        makeAxisAlignedBox(4.0f, 0.0f, 4.0f, 6.0f, 8.0f, 6.0f),           // tree
+        makeAxisAlignedBox(28.0f, 0.0f, 28.0f, 32.0f, 20.0f, 32.0f),      // tower
+        makeAxisAlignedBox(500.0f, 0.0f, 500.0f, 510.0f, 100.0f, 510.0f), // distant mountain
+    };
+
+    uint32_t masks[3];
+    float nearZ[2];
+
+    fitCascadeNearPlanes(OverheadLight, casters, 3, receivers, 2, masks, nearZ);
+
+    SDSM_CHECK(masks[0] == 3);
+    SDSM_CHECK(masks[1] == 2);
+    SDSM_CHECK(masks[2] == 0);
+
+    // The tree's top is 42 units below the light, the tower's 30
+    SDSM_CHECK(nearZ[0] == 42.0f);
+    SDSM_CHECK(nearZ[1] == 30.0f);
+}
+
+SDSM_TEST(lowSunCountsCastersOutsideTheReceivers)
+{
+    float receivers[6];
+    receiverBox(LowLight, makeAxisAlignedBox(-5.0f, 0.0f, -5.0f, 5.0f, 0.1f, 5.0f), receivers);
+
+    // A pole towards the sun shades the receivers, one on the far side of them does not
+    const AxisAlignedBox casters[] = {
+        makeAxisAlignedBox(-0.5f, 0.0f, -10.5f, 0.5f, 10.0f, -9.5f),
+        makeAxisAlignedBox(-0.5f, 0.0f, 19.5f, 0.5f, 10.0f, 20.5f),
+    };
+
+    uint32_t masks[2];
+    float nearZ[1];
+
+    fitCascadeNearPlanes(LowLight, casters, 2, receivers, 1, masks, nearZ);
+
+    SDSM_CHECK(masks[0] == 1);
+    SDSM_CHECK(masks[1] == 0);
+    SDSM_CHECK(nearZ[0] == transformAxisAlignedBox(LowLight, casters[0]).min[2]);
+    SDSM_CHECK(nearZ[0] < receivers[2]);
+}
+
+SDSM_TEST(castersBehindTheReceiversDoNotMoveThePlane)
+{
+    float receivers[6];
+    receiverBox(OverheadLight, makeAxisAlignedBox(-10.0f, 0.0f, -10.0f, 10.0f, 2.0f, 10.0f), receivers);
+
+    // A basement under the ground, and a caster without known bounds
+    const AxisAlignedBox casters[] = {
+        makeAxisAlignedBox(-5.0f, -10.0f, -5.0f, 5.0f, -3.0f, 5.0f),
+        infiniteAxisAlignedBox(),
+    };
+
+    uint32_t masks[2];
+    float nearZ[1];
+
+    fitCascadeNearPlanes(OverheadLight, casters, 2, receivers, 1, masks, nearZ);
+
+    SDSM_CHECK(masks[0] == 0);
+    SDSM_CHECK(masks[1] == 1);
+    SDSM_CHECK(nearZ[0] == 48.0f);
+}
+
+SDSM_TEST(flatReceiversKeepADepthRange)
+{
+    // Receivers with no extent in light view depth and no casters
+    float receivers[6] = {-10.0f, -10.0f, 50.0f, 10.0f, 10.0f, 50.0f};
+    float nearZ[1];
+
+    resetCascadeNearPlanes(receivers, 1, nearZ);
+    SDSM_CHECK(nearZ[0] == 49.0f);
+
+    resetCascadeNearPlanes(receivers, 1, nearZ, 4.0f);
+    SDSM_CHECK(nearZ[0] == 46.0f);
+
+    // The projection stays finite
+    CascadeProjection projection = cascadeOrthoProjection(receivers, nearZ[0]);
+    SDSM_CHECK(isfinite(projection.scale[2]) && isfinite(projection.offset[2]));
+}
+
+SDSM_TEST(emptyCascadesDrawNothing)
+{
+    float receivers[12];
+    receiverBox(OverheadLight, makeAxisAlignedBox(-10.0f, 0.0f, -10.0f, 10.0f, 0.5f, 10.0f), receivers);
+
+    // A cascade no sample fell into keeps the reset, inverted box
+    const float inverted[6] = {FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    memcpy(receivers + 6, inverted, sizeof(inverted));
+
+    const AxisAlignedBox casters[] = {
+        makeAxisAlignedBox(4.0f, 0.0f, 4.0f, 6.0f, 8.0f, 6.0f),
+        infiniteAxisAlignedBox(),
+    };
+
+    uint32_t masks[2];
+    float nearZ[2];
+
+    fitCascadeNearPlanes(OverheadLight, casters, 2, receivers, 2, masks, nearZ);
+
+    SDSM_CHECK(masks[0] == 1);
+    SDSM_CHECK(masks[1] == 1);
+    SDSM_CHECK(nearZ[0] == 42.0f);
+    SDSM_CHECK(nearZ[1] == FLT_MAX);
+}
+
+SDSM_TEST(fittedPlanesTightenTheDepthRange)
+{
+    float receivers[6];
+    receiverBox(OverheadLight, makeAxisAlignedBox(-10.0f, 0.0f, -10.0f, 10.0f, 0.5f, 10.0f), receivers);
+
+    const AxisAlignedBox tree = makeAxisAlignedBox(4.0f, 0.0f, 4.0f, 6.0f, 8.0f, 6.0f);
+
+    uint32_t mask;
+    float nearZ;
+
+    fitCascadeNearPlanes(OverheadLight, &tree, 1, receivers, 1, &mask, &nearZ);
+
+    CascadeProjection fitted = cascadeOrthoProjection(receivers, nearZ);
+    CascadeProjection fixed = cascadeOrthoProjection(receivers);
+
+    // The near plane and the receivers' far bound map to the ends of the depth range
+    SDSM_CHECK(fabsf(fitted.scale[2] * nearZ + fitted.offset[2]) < 1e-6f);
+    SDSM_CHECK(fabsf(fitted.scale[2] * receivers[5] + fitted.offset[2] - 1.0f) < 1e-6f);
+
+    // One step of a 16 bit depth buffer covers under a millimeter instead of over two
+    float fittedStep = 1.0f / (fitted.scale[2] * 65535.0f);
+    float fixedStep = 1.0f / (fixed.scale[2] * 65535.0f);
+
+    SDSM_CHECK(fittedStep < 0.001f);
+    SDSM_CHECK(fixedStep > 0.002f);
+    SDSM_CHECK(fixedStep / fittedStep > 15.0f);
+}
+
+SDSM_TEST_MAIN()
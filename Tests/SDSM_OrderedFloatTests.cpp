@@ -0,0 +1,80 @@
+//
+//  SDSM_OrderedFloatTests.cpp
+//  DeferredLighting C++
+//
+//  Exhaustive tests of the ordered float encoding the reductions use for atomic min and max:
+//  every one of the 2^32 bit patterns round trips, and integer order matches float order.
+//
+
+#include "SDSMTest.h"
+#include "SDSMShared.h"
+
+#include <math.h>
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bitsFloat(uint32_t bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+SDSM_TEST(everyBitPatternRoundTrips)
+{
+    uint32_t bits = 0;
+
+    do {
+        // Compared as bits, so NaN payloads and the sign of zero must survive too
+        SDSM_CHECK_OR_BREAK(floatBits(decodeOrderedFloat(encodeOrderedFloat(bitsFloat(bits)))) == bits);
+    } while (++bits != 0);
+}
+
+SDSM_TEST(integerOrderMatchesFloatOrder)
+{
+    // Walks every encoding in integer order, so each float is compared with the next larger one
+    int32_t encoded = INT32_MIN;
+    float previous = NAN;
+
+    while (true) {
+        float value = decodeOrderedFloat(encoded);
+
+        if (!isnan(value)) {
+            if (!isnan(previous)) {
+                // -0 encodes just below +0, which compare equal as floats
+                bool zeros = previous == 0.0f && value == 0.0f && signbit(previous) && !signbit(value);
+
+                SDSM_CHECK_OR_BREAK(previous < value || zeros);
+            }
+
+            previous = value;
+        }
+
+        if (encoded == INT32_MAX) {
+            break;
+        }
+
+        encoded++;
+    }
+
+    SDSM_CHECK(previous == INFINITY);
+}
+
+SDSM_TEST(nansFallOutsideTheInfinities)
+{
+    // Why the reductions must not feed in NaNs: they win every atomic min or max
+    int lowest = encodeOrderedFloat(-INFINITY);
+    int highest = encodeOrderedFloat(INFINITY);
+
+    SDSM_CHECK(encodeOrderedFloat(NAN) > highest);
+    SDSM_CHECK(encodeOrderedFloat(-NAN) < lowest);
+    SDSM_CHECK(encodeOrderedFloat(-FLT_MAX) > lowest);
+    SDSM_CHECK(encodeOrderedFloat(FLT_MAX) < highest);
+}
+
+SDSM_TEST_MAIN()
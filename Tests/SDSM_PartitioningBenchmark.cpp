@@ -0,0 +1,102 @@
+//
+//  SDSM_PartitioningBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Compares the partitioning modes on synthetic depth captures: the mean perspective aliasing of
+//  their splits over the capture's samples, and what computing the splits from the reduced
+//  histogram costs per frame.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+#include <vector>
+
+static const float BenchmarkNearPlane = 1.0f;
+static const float BenchmarkFarPlane = 750.0f;
+
+// An object covering a rectangle of the screen with depths in [nearDepth, farDepth].  Later
+// objects are drawn over earlier ones.
+struct CaptureObject
+{
+    float left, top, right, bottom;
+    float nearDepth, farDepth;
+};
+
+struct Capture
+{
+    const char *name;
+    std::vector<CaptureObject> objects;
+};
+
+static std::vector<float> renderCapture(const Capture & capture, uint32_t width, uint32_t height, SDSMRandom & random)
+{
+    std::vector<float> depth((size_t)width * height, 0.0f);
+
+    for (const CaptureObject & object : capture.objects) {
+        for (uint32_t y = (uint32_t)(object.top * height); y < (uint32_t)(object.bottom * height); y++) {
+            for (uint32_t x = (uint32_t)(object.left * width); x < (uint32_t)(object.right * width); x++) {
+                depth[(size_t)y * width + x] = object.nearDepth * powf(object.farDepth / object.nearDepth, random.uniform(0.0f, 1.0f));
+            }
+        }
+    }
+
+    return depth;
+}
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const uint32_t width = quick ? 480 : 1920;
+    const uint32_t height = quick ? 270 : 1080;
+    const int iterations = quick ? 100 : 20000;
+    const int cascadeCount = 4;
+
+    const Capture captures[] = {
+        {"ground to horizon", {{0.0f, 0.5f, 1.0f, 1.0f, 1.5f, 700.0f}}},
+        {"close-up on backdrop", {{0.0f, 0.0f, 1.0f, 0.6f, 500.0f, 700.0f}, {0.3f, 0.3f, 0.7f, 1.0f, 2.0f, 3.0f}}},
+        {"sparse foreground", {{0.0f, 0.0f, 1.0f, 1.0f, 550.0f, 650.0f}, {0.1f, 0.8f, 0.15f, 0.9f, 1.5f, 2.0f},
+                               {0.6f, 0.5f, 0.7f, 0.7f, 20.0f, 25.0f}}},
+        {"interior", {{0.0f, 0.0f, 1.0f, 1.0f, 8.0f, 30.0f}, {0.2f, 0.4f, 0.5f, 1.0f, 3.0f, 6.0f}}},
+    };
+
+    const struct
+    {
+        const char *name;
+        PartitioningMode mode;
+    } modes[] = {
+        {"log", LOG_PARTITIONING},
+        {"uniform", UNIFORM_PARTITIONING},
+        {"adaptive", ADAPTIVE_PARTITIONING},
+        {"clustered", CLUSTERED_PARTITIONING},
+    };
+
+    SDSMRandom random(5);
+
+    printf("%-22s %-10s %10s %10s\n", "capture", "mode", "aliasing", "ns");
+
+    for (const Capture & capture : captures) {
+        std::vector<float> depth = renderCapture(capture, width, height, random);
+
+        int histogram[DepthHistogramLength];
+        depthHistogramFromImage(depth.data(), width, height, BenchmarkNearPlane, BenchmarkFarPlane, histogram);
+
+        float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+        float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+
+        for (const auto & mode : modes) {
+            float ends[MAX_CASCADED_SHADOW_COUNT + 1];
+
+            double time = sdsmBenchmark([&]() {
+                cascadePartitioning(mode.mode, min, max, BenchmarkNearPlane, BenchmarkFarPlane, histogram, cascadeCount, ends);
+                sdsmKeep(ends[1]);
+            }, iterations);
+
+            float error = partitioningAliasingError(histogram, BenchmarkNearPlane, BenchmarkFarPlane, ends, cascadeCount);
+
+            printf("%-22s %-10s %10.2f %10.1f\n", capture.name, mode.name, error, time);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+//
+//  SDSM_PartitioningTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the cascade partitioning modes over a corpus of synthetic depth distributions.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+#include <math.h>
+#include <vector>
+
+static const float TestNearPlane = 1.0f;
+static const float TestFarPlane = 750.0f;
+
+// Histogram of the fused reduction for a set of eye space depths, with every sample at the origin
+// of light space
+static void buildHistogram(const std::vector<float> & depths, int *histogram)
+{
+    for (int i = 0; i < DepthHistogramLength; i++) {
+        histogram[i] = depthHistogramResetValue(i, TestNearPlane, TestFarPlane);
+    }
+
+    for (float depth : depths) {
+        int *bin = histogram + DepthHistogramBins +
+            depthHistogramBin(depth, TestNearPlane, TestFarPlane) * DepthHistogramBinStride;
+
+        histogram[DepthHistogramMinDepth] = SDSM_MIN(histogram[DepthHistogramMinDepth], encodeOrderedFloat(depth));
+        histogram[DepthHistogramMaxDepth] = SDSM_MAX(histogram[DepthHistogramMaxDepth], encodeOrderedFloat(depth));
+
+        bin[DepthHistogramBinCount]++;
+
+        for (int axis = 0; axis < 3; axis++) {
+            bin[DepthHistogramBinBoundingBox + axis] = SDSM_MIN(bin[DepthHistogramBinBoundingBox + axis], encodeOrderedFloat(0.0f));
+            bin[DepthHistogramBinBoundingBox + axis + 3] = SDSM_MAX(bin[DepthHistogramBinBoundingBox + axis + 3], encodeOrderedFloat(0.0f));
+        }
+    }
+}
+
+// Adds count samples spread evenly in log depth over [start, end]
+static void addCluster(std::vector<float> & depths, float start, float end, int count)
+{
+    for (int i = 0; i < count; i++) {
+        depths.push_back(start * powf(end / start, ((float)i + 0.5f) / (float)count));
+    }
+}
+
+// Objects separated by empty depth ranges, each as the depth range it covers and its sample count
+struct DepthCorpusEntry
+{
+    const char *name;
+    std::vector<float> objects;
+    std::vector<int> counts;
+};
+
+static std::vector<DepthCorpusEntry> depthCorpus()
+{
+    return {
+        {"single object", {20.0f, 24.0f}, {1000}},
+        {"foreground and backdrop", {2.0f, 3.0f, 400.0f, 700.0f}, {50, 100000}},
+        {"three separated objects", {2.0f, 2.5f, 30.0f, 35.0f, 500.0f, 600.0f}, {2000, 2000, 2000}},
+        {"thin objects", {5.0f, 5.0f, 300.0f, 300.0f}, {2, 1}},
+        {"spread out", {1.5f, 700.0f}, {100000}},
+        {"many objects", {1.5f, 1.6f, 4.0f, 4.2f, 12.0f, 13.0f, 40.0f, 41.0f, 150.0f, 160.0f, 600.0f, 650.0f},
+                         {10, 100, 1000, 10, 100, 1000}},
+    };
+}
+
+static std::vector<float> corpusDepths(const DepthCorpusEntry & entry)
+{
+    std::vector<float> depths;
+
+    for (size_t i = 0; i < entry.counts.size(); i++) {
+        addCluster(depths, entry.objects[2 * i], entry.objects[2 * i + 1], entry.counts[i]);
+    }
+
+    return depths;
+}
+
+static int occupiedBins(const int *histogram)
+{
+    int count = 0;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        count += histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount] > 0;
+    }
+
+    return count;
+}
+
+// Total aliasing adaptivePartitioning minimizes, for splits on bin edges: every sample costs the
+// cascade's far split over its bin's nominal depth, both limited to the reduced depth range
+static double adaptiveCost(const int *histogram, const float *ends, int count)
+{
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+    double cost = 0.0;
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        int binCount = histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount];
+
+        if (binCount == 0) {
+            continue;
+        }
+
+        float center = TestNearPlane * powf(TestFarPlane / TestNearPlane, ((float)bin + 0.5f) / (float)SDSM_HISTOGRAM_BIN_COUNT);
+        float depth = std::min(std::max(center, min), max);
+        int cascade = 0;
+
+        while (cascade < count - 1 && depth > ends[cascade + 1]) {
+            cascade++;
+        }
+
+        cost += (double)ends[cascade + 1] * ((double)binCount / depth);
+    }
+
+    return cost;
+}
+
+// Lowest adaptiveCost of any placement of the remaining splits on the edges after firstEdge and
+// before lastEdge
+static double bruteForceAdaptiveCost(const int *histogram, float *ends, int split, int count, int firstEdge, int lastEdge)
+{
+    if (split == count) {
+        return adaptiveCost(histogram, ends, count);
+    }
+
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+    double best = 1e30;
+
+    for (int edge = firstEdge + 1; edge <= lastEdge - (count - split); edge++) {
+        ends[split] = depthHistogramEdge(edge, TestNearPlane, TestFarPlane, min, max);
+        best = std::min(best, bruteForceAdaptiveCost(histogram, ends, split + 1, count, edge, lastEdge));
+    }
+
+    return best;
+}
+
+static bool nondecreasing(const float *ends, int count)
+{
+    for (int i = 0; i < count; i++) {
+        if (!(ends[i + 1] >= ends[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+SDSM_TEST(clusteredPartitioningOfTheCorpus)
+{
+    int histogram[DepthHistogramLength];
+
+    for (const DepthCorpusEntry & entry : depthCorpus()) {
+        std::vector<float> depths = corpusDepths(entry);
+        buildHistogram(depths, histogram);
+
+        int objectCount = (int)entry.counts.size();
+
+        for (int count = 1; count <= MAX_CASCADED_SHADOW_COUNT; count++) {
+            float ends[MAX_CASCADED_SHADOW_COUNT + 1];
+
+            int usedCount = clusteredPartitioning(histogram, TestNearPlane, TestFarPlane, count, ends);
+
+            // Every cluster holds at least one occupied bin
+            SDSM_CHECK(usedCount >= 1 && usedCount <= count && usedCount <= occupiedBins(histogram));
+            SDSM_CHECK(nondecreasing(ends, count));
+            SDSM_CHECK(ends[0] == decodeOrderedFloat(histogram[DepthHistogramMinDepth]));
+            SDSM_CHECK(ends[count] == decodeOrderedFloat(histogram[DepthHistogramMaxDepth]));
+
+            // Used cascades have width and the rest are empty at the far end
+            for (int i = 0; i < count; i++) {
+                SDSM_CHECK(i < usedCount ? ends[i + 1] > ends[i] : ends[i + 1] == ends[i]);
+            }
+
+            // With a cascade for every object, each gap between objects holds a split
+            if (count >= objectCount) {
+                SDSM_CHECK(usedCount >= objectCount);
+
+                for (int object = 1; object < objectCount; object++) {
+                    float gapStart = entry.objects[2 * object - 1];
+                    float gapEnd = entry.objects[2 * object];
+                    bool split = false;
+
+                    for (int i = 1; i < usedCount; i++) {
+                        split = split || (ends[i] > gapStart && ends[i] < gapEnd);
+                    }
+
+                    if (!split) {
+                        fprintf(stderr, "%s: no split between %g and %g with %d cascades\n",
+                                entry.name, gapStart, gapEnd, count);
+                    }
+
+                    SDSM_CHECK(split);
+                }
+            }
+        }
+    }
+}
+
+SDSM_TEST(clusteredSplitsFallBetweenClusters)
+{
+    std::vector<float> depths;
+    addCluster(depths, 2.0f, 2.5f, 2000);
+    addCluster(depths, 30.0f, 35.0f, 2000);
+    addCluster(depths, 500.0f, 600.0f, 2000);
+
+    int histogram[DepthHistogramLength];
+    buildHistogram(depths, histogram);
+
+    float ends[4];
+    SDSM_CHECK(clusteredPartitioning(histogram, TestNearPlane, TestFarPlane, 3, ends) == 3);
+
+    SDSM_CHECK(ends[1] > 2.5f && ends[1] < 30.0f);
+    SDSM_CHECK(ends[2] > 35.0f && ends[2] < 500.0f);
+}
+
+SDSM_TEST(cascadePartitioningReturnsTheCountInUse)
+{
+    std::vector<float> depths;
+    addCluster(depths, 2.0f, 3.0f, 50);
+    addCluster(depths, 400.0f, 700.0f, 100000);
+
+    int histogram[DepthHistogramLength];
+    buildHistogram(depths, histogram);
+
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+    float ends[MAX_CASCADED_SHADOW_COUNT + 1];
+
+    SDSM_CHECK(cascadePartitioning(CLUSTERED_PARTITIONING, min, max, TestNearPlane, TestFarPlane,
+                                   histogram, 4, ends) == 2);
+
+    // Without a histogram clustered partitioning falls back to log partitioning of every cascade
+    SDSM_CHECK(cascadePartitioning(CLUSTERED_PARTITIONING, min, max, TestNearPlane, TestFarPlane,
+                                   nullptr, 4, ends) == 4);
+
+    const PartitioningMode modes[] = {LOG_PARTITIONING, UNIFORM_PARTITIONING, ADAPTIVE_PARTITIONING, FEEDBACK_PARTITIONING};
+
+    for (PartitioningMode mode : modes) {
+        SDSM_CHECK(cascadePartitioning(mode, min, max, TestNearPlane, TestFarPlane, histogram, 4, ends) == 4);
+        SDSM_CHECK(nondecreasing(ends, 4));
+    }
+}
+
+SDSM_TEST(clusteredFallsBackWithoutSamples)
+{
+    int histogram[DepthHistogramLength];
+    buildHistogram({}, histogram);
+
+    // A reset histogram has an inverted depth range, so every cascade is kept
+    float ends[4];
+    SDSM_CHECK(clusteredPartitioning(histogram, TestNearPlane, TestFarPlane, 3, ends) == 3);
+}
+
+SDSM_TEST(adaptivePartitioningIsOptimal)
+{
+    int histogram[DepthHistogramLength];
+
+    for (const DepthCorpusEntry & entry : depthCorpus()) {
+        buildHistogram(corpusDepths(entry), histogram);
+
+        int firstBin = SDSM_HISTOGRAM_BIN_COUNT;
+        int lastBin = -1;
+
+        for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+            if (histogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount] > 0) {
+                firstBin = std::min(firstBin, bin);
+                lastBin = bin;
+            }
+        }
+
+        for (int count = 1; count <= 4 && count <= lastBin + 1 - firstBin; count++) {
+            float ends[MAX_CASCADED_SHADOW_COUNT + 1];
+            adaptivePartitioning(histogram, TestNearPlane, TestFarPlane, count, ends);
+
+            float candidate[MAX_CASCADED_SHADOW_COUNT + 1];
+            candidate[0] = ends[0];
+            candidate[count] = ends[count];
+
+            double best = bruteForceAdaptiveCost(histogram, candidate, 1, count, firstBin, lastBin + 1);
+            double cost = adaptiveCost(histogram, ends, count);
+
+            SDSM_CHECK(nondecreasing(ends, count));
+            SDSM_CHECK(ends[0] == decodeOrderedFloat(histogram[DepthHistogramMinDepth]));
+            SDSM_CHECK(ends[count] == decodeOrderedFloat(histogram[DepthHistogramMaxDepth]));
+
+            if (!(cost <= best * 1.0001)) {
+                fprintf(stderr, "%s: %d cascades cost %g, best %g\n", entry.name, count, cost, best);
+            }
+
+            SDSM_CHECK(cost <= best * 1.0001);
+        }
+    }
+}
+
+SDSM_TEST(adaptivePartitioningSkipsEmptyDepthRanges)
+{
+    std::vector<float> depths;
+    addCluster(depths, 2.0f, 3.0f, 5000);
+    addCluster(depths, 600.0f, 650.0f, 100000);
+
+    int histogram[DepthHistogramLength];
+    buildHistogram(depths, histogram);
+
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+
+    float adaptive[4];
+    float log[4];
+    float uniform[4];
+
+    cascadePartitioning(ADAPTIVE_PARTITIONING, min, max, TestNearPlane, TestFarPlane, histogram, 3, adaptive);
+    cascadePartitioning(LOG_PARTITIONING, min, max, TestNearPlane, TestFarPlane, histogram, 3, log);
+    cascadePartitioning(UNIFORM_PARTITIONING, min, max, TestNearPlane, TestFarPlane, histogram, 3, uniform);
+
+    // A split lies between the foreground and the backdrop, and the backdrop gets its own cascade
+    SDSM_CHECK(adaptive[1] >= 3.0f && adaptive[1] <= 600.0f);
+    SDSM_CHECK(adaptive[2] >= 3.0f && adaptive[2] <= 600.0f * 1.1f);
+
+    float adaptiveError = partitioningAliasingError(histogram, TestNearPlane, TestFarPlane, adaptive, 3);
+    float logError = partitioningAliasingError(histogram, TestNearPlane, TestFarPlane, log, 3);
+    float uniformError = partitioningAliasingError(histogram, TestNearPlane, TestFarPlane, uniform, 3);
+
+    SDSM_CHECK(adaptiveError < logError && logError < uniformError);
+}
+
+SDSM_TEST(adaptiveFallsBackToLogPartitioning)
+{
+    int histogram[DepthHistogramLength];
+
+    // Fewer occupied bins than cascades
+    std::vector<float> depths;
+    addCluster(depths, 20.0f, 20.5f, 100);
+    buildHistogram(depths, histogram);
+
+    float min = decodeOrderedFloat(histogram[DepthHistogramMinDepth]);
+    float max = decodeOrderedFloat(histogram[DepthHistogramMaxDepth]);
+
+    float adaptive[5];
+    float log[5];
+
+    adaptivePartitioning(histogram, TestNearPlane, TestFarPlane, 4, adaptive);
+    logPartitioning(min, max, 4, log);
+
+    SDSM_CHECK(memcmp(adaptive, log, sizeof(log)) == 0);
+
+    // Without a histogram
+    cascadePartitioning(ADAPTIVE_PARTITIONING, 2.0f, 500.0f, TestNearPlane, TestFarPlane, nullptr, 4, adaptive);
+    logPartitioning(2.0f, 500.0f, 4, log);
+
+    SDSM_CHECK(memcmp(adaptive, log, sizeof(log)) == 0);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,327 @@
+//
+//  SDSM_QueueGraphTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the queue graph against a mock device.  Mock command buffers record the waits,
+//  signals and work encoded into them, and the device runs the committed command buffers of
+//  every queue in order, interleaving the queues at random and blocking a queue on a wait until
+//  its event reaches the value.  The frames submitted follow the renderer's: the G-buffer pass
+//  signals the graphics queue, the reduction waits for it, and GPU driven cascades wait for the
+//  newest reduction before the shadow pass.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_QueueGraph.h"
+
+#include <deque>
+
+enum MockQueue
+{
+    MockQueueGraphics,
+    MockQueueReduction,
+    MockQueueCount
+};
+
+struct MockEvent
+{
+    int index;
+};
+
+enum MockOperationType
+{
+    MockOperationWait,
+    MockOperationSignal,
+    MockOperationWork
+};
+
+struct MockOperation
+{
+    MockOperationType type;
+    int event;
+    uint64_t value;
+
+    // Work is identified by a pass and the frame it belongs to
+    int pass;
+    int frame;
+};
+
+struct MockCommandBuffer
+{
+    std::vector<MockOperation> operations;
+
+    void encodeWaitForEvent(const MockEvent & event, uint64_t value)
+    {
+        operations.push_back({MockOperationWait, event.index, value, 0, 0});
+    }
+
+    void encodeSignalEvent(const MockEvent & event, uint64_t value)
+    {
+        operations.push_back({MockOperationSignal, event.index, value, 0, 0});
+    }
+
+    void encodeWork(int pass, int frame)
+    {
+        operations.push_back({MockOperationWork, 0, 0, pass, frame});
+    }
+};
+
+typedef QueueGraph<MockCommandBuffer, MockEvent, MockQueueCount> MockQueueGraph;
+
+enum MockPass
+{
+    MockPassCascades,
+    MockPassShadow,
+    MockPassGBuffer,
+    MockPassReduction,
+    MockPassLighting,
+    MockPassCount
+};
+
+static const int MockMaxFrames = 64;
+
+// Runs committed command buffers like a GPU with one engine per queue
+class MockDevice
+{
+public:
+
+    MockDevice()
+    : m_time(0)
+    {
+        for (int i = 0; i < MockQueueCount; i++) {
+            m_eventValues[i] = 0;
+        }
+
+        for (int pass = 0; pass < MockPassCount; pass++) {
+            for (int frame = 0; frame < MockMaxFrames; frame++) {
+                m_completionTimes[pass][frame] = -1;
+            }
+        }
+    }
+
+    void commit(int queue, const MockCommandBuffer & commandBuffer)
+    {
+        m_queues[queue].push_back(commandBuffer.operations);
+    }
+
+    // Runs one operation of a queue picked at random among those not blocked.  Returns false if
+    // every queue is idle or blocked.
+    bool step(SDSMRandom & random)
+    {
+        int runnable[MockQueueCount];
+        int runnableCount = 0;
+
+        for (int queue = 0; queue < MockQueueCount; queue++) {
+            if (!m_queues[queue].empty() && !blocked(queue)) {
+                runnable[runnableCount++] = queue;
+            }
+        }
+
+        if (runnableCount == 0) {
+            return false;
+        }
+
+        std::deque<std::vector<MockOperation>> & queue = m_queues[runnable[random.integer(0, runnableCount - 1)]];
+        std::vector<MockOperation> & operations = queue.front();
+
+        if (!operations.empty()) {
+            MockOperation operation = operations.front();
+            operations.erase(operations.begin());
+
+            if (operation.type == MockOperationSignal) {
+                m_eventValues[operation.event] = operation.value;
+            } else if (operation.type == MockOperationWork) {
+                m_completionTimes[operation.pass][operation.frame] = m_time++;
+            }
+        }
+
+        if (operations.empty()) {
+            queue.pop_front();
+        }
+
+        return true;
+    }
+
+    // Runs until nothing can run, and returns whether every command buffer completed
+    bool run(SDSMRandom & random)
+    {
+        while (step(random)) {
+        }
+
+        for (int queue = 0; queue < MockQueueCount; queue++) {
+            if (!m_queues[queue].empty()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Order in which a pass of a frame completed, or -1 if it has not
+    int64_t completionTime(int pass, int frame) const
+    {
+        return m_completionTimes[pass][frame];
+    }
+
+    uint64_t eventValue(int event) const
+    {
+        return m_eventValues[event];
+    }
+
+private:
+
+    bool blocked(int queue) const
+    {
+        const std::vector<MockOperation> & operations = m_queues[queue].front();
+
+        return !operations.empty() && operations.front().type == MockOperationWait &&
+            m_eventValues[operations.front().event] < operations.front().value;
+    }
+
+    std::deque<std::vector<MockOperation>> m_queues[MockQueueCount];
+    uint64_t m_eventValues[MockQueueCount];
+
+    int64_t m_completionTimes[MockPassCount][MockMaxFrames];
+    int64_t m_time;
+};
+
+static void setUpGraph(MockQueueGraph & graph)
+{
+    graph.setQueueEvent(MockQueueGraphics, {MockQueueGraphics});
+    graph.setQueueEvent(MockQueueReduction, {MockQueueReduction});
+}
+
+// Encodes and commits a frame the way the renderer does
+static void submitFrame(MockQueueGraph & graph, MockDevice & device, int frame, bool gpuDrivenCascades)
+{
+    MockCommandBuffer commandBuffer;
+
+    if (gpuDrivenCascades) {
+        graph.wait(commandBuffer, MockQueueGraphics, graph.lastSignaled(MockQueueReduction));
+        commandBuffer.encodeWork(MockPassCascades, frame);
+    }
+
+    commandBuffer.encodeWork(MockPassShadow, frame);
+    commandBuffer.encodeWork(MockPassGBuffer, frame);
+
+    MockQueueGraph::Submission graphicsSubmission = graph.begin(MockQueueGraphics);
+    graph.signal(commandBuffer, graphicsSubmission);
+
+    MockCommandBuffer reductionCommandBuffer;
+    MockQueueGraph::Submission reductionSubmission = graph.begin(MockQueueReduction);
+    graph.wait(reductionCommandBuffer, MockQueueReduction, graphicsSubmission);
+
+    reductionCommandBuffer.encodeWork(MockPassReduction, frame);
+    graph.signal(reductionCommandBuffer, reductionSubmission);
+
+    device.commit(MockQueueGraphics, commandBuffer);
+    device.commit(MockQueueReduction, reductionCommandBuffer);
+
+    // The drawable's command buffer is outside the graph
+    MockCommandBuffer drawableCommandBuffer;
+    drawableCommandBuffer.encodeWork(MockPassLighting, frame);
+
+    device.commit(MockQueueGraphics, drawableCommandBuffer);
+}
+
+SDSM_TEST(framesRunInDependencyOrderUnderAnyInterleaving)
+{
+    SDSMRandom random(18);
+
+    for (int trial = 0; trial < 2000; trial++) {
+        MockQueueGraph graph;
+        setUpGraph(graph);
+
+        MockDevice device;
+
+        const int frameCount = random.integer(1, MockMaxFrames);
+        bool gpuDriven[MockMaxFrames];
+
+        for (int frame = 0; frame < frameCount; frame++) {
+            gpuDriven[frame] = random.integer(0, 1) == 1;
+
+            submitFrame(graph, device, frame, gpuDriven[frame]);
+
+            // Like frames in flight: the CPU runs ahead of the GPU by a few frames at most
+            if (random.integer(0, 2) == 0) {
+                for (int steps = random.integer(0, 20); steps > 0 && device.step(random); steps--) {
+                }
+            }
+        }
+
+        SDSM_CHECK_OR_BREAK(device.run(random));
+
+        for (int frame = 0; frame < frameCount; frame++) {
+            // The reduction reads the frame's G-buffer depth
+            SDSM_CHECK_OR_BREAK(device.completionTime(MockPassReduction, frame) >
+                                device.completionTime(MockPassGBuffer, frame));
+
+            // GPU driven cascades are built from the histogram of the newest reduction submitted
+            // before them, which is the previous frame's
+            if (gpuDriven[frame] && frame > 0) {
+                SDSM_CHECK_OR_BREAK(device.completionTime(MockPassCascades, frame) >
+                                    device.completionTime(MockPassReduction, frame - 1));
+            }
+        }
+
+        SDSM_CHECK_OR_BREAK(device.eventValue(MockQueueGraphics) == (uint64_t)frameCount);
+        SDSM_CHECK_OR_BREAK(device.eventValue(MockQueueReduction) == (uint64_t)frameCount);
+    }
+}
+
+SDSM_TEST(redundantWaitsAreNotEncoded)
+{
+    MockQueueGraph graph;
+    setUpGraph(graph);
+
+    MockCommandBuffer commandBuffer;
+
+    // Nothing to wait for before the first submission, and never for the queue's own work
+    SDSM_CHECK(!graph.wait(commandBuffer, MockQueueGraphics, graph.lastSignaled(MockQueueReduction)));
+    SDSM_CHECK(!graph.wait(commandBuffer, MockQueueGraphics, MockQueueGraph::none(MockQueueReduction)));
+
+    MockQueueGraph::Submission graphics = graph.begin(MockQueueGraphics);
+    graph.signal(commandBuffer, graphics);
+
+    SDSM_CHECK(!graph.wait(commandBuffer, MockQueueGraphics, graphics));
+
+    MockCommandBuffer reductionCommandBuffer;
+    MockQueueGraph::Submission reduction = graph.begin(MockQueueReduction);
+
+    SDSM_CHECK(graph.wait(reductionCommandBuffer, MockQueueReduction, graphics));
+    SDSM_CHECK(!graph.wait(reductionCommandBuffer, MockQueueReduction, graphics));
+
+    graph.signal(reductionCommandBuffer, reduction);
+
+    // The first wait for the reduction is encoded, a second one for the same value is covered
+    SDSM_CHECK(graph.wait(commandBuffer, MockQueueGraphics, graph.lastSignaled(MockQueueReduction)));
+    SDSM_CHECK(!graph.wait(commandBuffer, MockQueueGraphics, graph.lastSignaled(MockQueueReduction)));
+
+    SDSM_CHECK(graph.waitCount() == 2);
+
+    // Each command buffer holds its operations in encoding order
+    SDSM_CHECK(commandBuffer.operations.size() == 2);
+    SDSM_CHECK(commandBuffer.operations[0].type == MockOperationSignal && commandBuffer.operations[0].value == 1);
+    SDSM_CHECK(commandBuffer.operations[1].type == MockOperationWait &&
+               commandBuffer.operations[1].event == MockQueueReduction && commandBuffer.operations[1].value == 1);
+}
+
+SDSM_TEST(onlyGpuDrivenFramesWaitForTheReduction)
+{
+    MockQueueGraph graph;
+    setUpGraph(graph);
+
+    MockDevice device;
+
+    // One wait on the reduction queue per frame, and one on the graphics queue per GPU driven frame
+    // after the first reduction
+    for (int frame = 0; frame < 10; frame++) {
+        submitFrame(graph, device, frame, frame >= 5);
+    }
+
+    SDSM_CHECK(graph.waitCount() == 10 + 5);
+
+    SDSMRandom random(19);
+    SDSM_CHECK(device.run(random));
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,212 @@
+//
+//  SDSM_ReadbackRingTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the readback ring: the newest completed frame is found whatever order completed
+//  handlers run in, a reused slot never reports the frame that used it before, and the age of a
+//  result counts the frames since it was written.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_ReadbackRing.h"
+
+#include <thread>
+
+// Same as the renderer's, which lives in a header that needs Metal
+static const size_t MaxFramesInFlight = 3;
+
+typedef ReadbackRing<MaxFramesInFlight> TestRing;
+
+SDSM_TEST(nothingCompletedBeforeTheFirstFrame)
+{
+    TestRing ring;
+    uint64_t serial = 1234;
+
+    SDSM_CHECK(!ring.newestCompleted(serial));
+    SDSM_CHECK(serial == 0);
+
+    // Claiming slots alone does not make anything readable
+    for (size_t i = 0; i < MaxFramesInFlight; i++) {
+        ring.beginWrite();
+    }
+
+    SDSM_CHECK(!ring.newestCompleted(serial));
+}
+
+SDSM_TEST(slotsWrapAtFramesInFlight)
+{
+    TestRing ring;
+
+    SDSM_CHECK(ring.nextSerial() == 1);
+
+    for (uint64_t frame = 1; frame <= 4 * MaxFramesInFlight; frame++) {
+        uint64_t serial = ring.beginWrite();
+
+        SDSM_CHECK_OR_BREAK(serial == frame);
+        SDSM_CHECK_OR_BREAK(TestRing::slot(serial) == frame % MaxFramesInFlight);
+        SDSM_CHECK_OR_BREAK(TestRing::slot(serial + MaxFramesInFlight) == TestRing::slot(serial));
+        SDSM_CHECK_OR_BREAK(ring.nextSerial() == serial + 1);
+    }
+}
+
+SDSM_TEST(outOfOrderCompletionsYieldTheNewest)
+{
+    // Every order the completed handlers of the frames in flight can run in
+    const int orders[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+    for (const int *order : orders) {
+        TestRing ring;
+        uint64_t serials[MaxFramesInFlight];
+
+        for (size_t i = 0; i < MaxFramesInFlight; i++) {
+            serials[i] = ring.beginWrite();
+        }
+
+        uint64_t highest = 0;
+
+        for (size_t i = 0; i < MaxFramesInFlight; i++) {
+            uint64_t completed = serials[order[i]];
+            highest = completed > highest ? completed : highest;
+
+            ring.complete(completed);
+
+            uint64_t serial = 0;
+            SDSM_CHECK(ring.newestCompleted(serial));
+            SDSM_CHECK(serial == highest);
+        }
+    }
+}
+
+SDSM_TEST(reusedSlotsNeverReportTheirPreviousFrame)
+{
+    TestRing ring;
+    SDSMRandom random(3);
+
+    // Frames complete in random order with a random lag, but the frame that last used a slot always
+    // completes before the slot is claimed again, as the in flight semaphore guarantees
+    std::vector<uint64_t> pending;
+
+    for (int frame = 0; frame < 10000; frame++) {
+        uint64_t next = ring.nextSerial();
+
+        for (size_t i = 0; i < pending.size();) {
+            if (pending[i] + MaxFramesInFlight <= next || random.integer(0, 2) == 0) {
+                ring.complete(pending[i]);
+                pending.erase(pending.begin() + i);
+            } else {
+                i++;
+            }
+        }
+
+        uint64_t serial = ring.beginWrite();
+        pending.push_back(serial);
+
+        // The slot just claimed last held serial - MaxFramesInFlight, which must no longer be found
+        uint64_t found = 0;
+
+        if (ring.newestCompleted(found)) {
+            SDSM_CHECK_OR_BREAK(found != serial - MaxFramesInFlight);
+            SDSM_CHECK_OR_BREAK(found + MaxFramesInFlight > serial && found < serial);
+        }
+    }
+}
+
+SDSM_TEST(staleSerialIsClearedWhenItsSlotIsClaimed)
+{
+    TestRing ring;
+
+    uint64_t first = ring.beginWrite();
+    ring.complete(first);
+
+    // Claim every other slot without completing it, then wrap around onto the first slot
+    for (size_t i = 1; i < MaxFramesInFlight; i++) {
+        ring.beginWrite();
+    }
+
+    uint64_t serial = 0;
+    SDSM_CHECK(ring.newestCompleted(serial) && serial == first);
+
+    uint64_t reused = ring.beginWrite();
+
+    SDSM_CHECK(TestRing::slot(reused) == TestRing::slot(first));
+    SDSM_CHECK(!ring.newestCompleted(serial));
+}
+
+SDSM_TEST(ageCountsFramesSinceTheResult)
+{
+    TestRing ring;
+
+    for (int frame = 0; frame < 20; frame++) {
+        uint64_t serial = ring.beginWrite();
+        ring.complete(serial);
+
+        uint64_t newest = 0;
+        SDSM_CHECK_OR_BREAK(ring.newestCompleted(newest) && newest == serial);
+
+        // The frame being encoded next reads a result one frame old
+        SDSM_CHECK_OR_BREAK(ring.age(newest) == 1);
+        SDSM_CHECK_OR_BREAK(ring.age(newest) == ring.nextSerial() - newest);
+
+        for (uint64_t older = 1; older <= serial; older++) {
+            SDSM_CHECK_OR_BREAK(ring.age(older) == ring.nextSerial() - older);
+        }
+    }
+
+    // Results get older while frames are claimed but not completed
+    uint64_t newest = 0;
+    ring.newestCompleted(newest);
+
+    for (uint64_t lag = 1; lag < MaxFramesInFlight; lag++) {
+        ring.beginWrite();
+        SDSM_CHECK(ring.age(newest) == lag + 1);
+    }
+}
+
+SDSM_TEST(completionsFromAnotherThreadAreSeenInOrder)
+{
+    TestRing ring;
+    const uint64_t frameCount = 20000;
+
+    std::atomic<uint64_t> claimed(0);
+
+    // Completed handlers run on their own thread, each frame completing after it was claimed
+    std::thread handlers([&]() {
+        for (uint64_t serial = 1; serial <= frameCount; serial++) {
+            while (claimed.load(std::memory_order_acquire) < serial) {
+                std::this_thread::yield();
+            }
+
+            ring.complete(serial);
+        }
+    });
+
+    uint64_t previous = 0;
+
+    for (uint64_t frame = 1; frame <= frameCount; frame++) {
+        // The in flight semaphore: never claim a slot whose frame is still running
+        if (frame > MaxFramesInFlight) {
+            uint64_t serial = 0;
+
+            while (!ring.newestCompleted(serial) || serial < frame - MaxFramesInFlight) {
+                std::this_thread::yield();
+            }
+        }
+
+        ring.beginWrite();
+        claimed.store(frame, std::memory_order_release);
+
+        uint64_t serial = 0;
+
+        if (ring.newestCompleted(serial)) {
+            // Never older than a result already seen, nor older than the semaphore allows
+            SDSM_CHECK_OR_BREAK(serial >= previous && serial + MaxFramesInFlight >= frame && serial <= frame);
+            previous = serial;
+        }
+    }
+
+    // Releases the handlers if a check stopped the frames early
+    claimed.store(frameCount, std::memory_order_release);
+    handlers.join();
+}
+
+SDSM_TEST_MAIN()
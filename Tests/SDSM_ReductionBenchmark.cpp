@@ -0,0 +1,59 @@
+//
+//  SDSM_ReductionBenchmark.cpp
+//  DeferredLighting C++
+//
+//  CPU time and global atomic count of the per-pixel and hierarchical min-max depth reductions at
+//  the drawable sizes the app runs at.  The CPU time only tracks the work of the references; the
+//  atomic counts are what the kernels contend on.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+
+    struct Resolution
+    {
+        const char *name;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    const Resolution resolutions[] = {{"1080p", 1920, 1080}, {"1440p", 2560, 1440}, {"4K", 3840, 2160}};
+
+    SDSMRandom random(1);
+
+    printf("%-7s %14s %14s %16s %16s\n", "size", "atomic ms", "hierarch. ms", "atomic ops", "hierarch. ops");
+
+    for (const Resolution & resolution : resolutions) {
+        uint32_t width = quick ? resolution.width / 8 : resolution.width;
+        uint32_t height = quick ? resolution.height / 8 : resolution.height;
+
+        // A tenth of the pixels are sky
+        std::vector<float> depth((size_t)width * height);
+
+        for (float & sample : depth) {
+            sample = random.uniform(0.0f, 1.0f) < 0.1f ? 0.0f : random.uniform(1.0f, 750.0f);
+        }
+
+        DepthReductionResult atomic;
+        DepthReductionResult hierarchical;
+
+        double atomicTime = sdsmBenchmark([&]() {
+            atomic = reduceMinMaxDepthAtomic(depth.data(), width, height, INT_MAX, INT_MIN);
+            sdsmKeep(atomic.minDepth);
+        }, 1);
+
+        double hierarchicalTime = sdsmBenchmark([&]() {
+            hierarchical = reduceMinMaxDepthHierarchical(depth.data(), width, height, INT_MAX, INT_MIN);
+            sdsmKeep(hierarchical.minDepth);
+        }, 1);
+
+        printf("%-7s %14.3f %14.3f %16llu %16llu\n", resolution.name, atomicTime * 1e-6, hierarchicalTime * 1e-6,
+               (unsigned long long)atomic.atomicCount, (unsigned long long)hierarchical.atomicCount);
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+//
+//  SDSM_ReductionTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the CPU references of reduce_min_max_depth and reduce_min_max_depth_hierarchical: both
+//  find the depth range of the image for every size and tile alignment, and the hierarchical one
+//  issues one or two global atomics per threadgroup instead of per pixel.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+static const float TestNearPlane = 1.0f;
+static const float TestFarPlane = 750.0f;
+
+// Depth image of a scene with holes of empty pixels, as m_depth_GBuffer holds it
+static std::vector<float> makeDepthImage(uint32_t width, uint32_t height, float emptyFraction, SDSMRandom & random)
+{
+    std::vector<float> depth((size_t)width * height);
+
+    for (float & sample : depth) {
+        sample = random.uniform(0.0f, 1.0f) < emptyFraction ? 0.0f : random.uniform(TestNearPlane, TestFarPlane);
+    }
+
+    return depth;
+}
+
+static DepthReductionResult expectedReduction(const std::vector<float> & depth)
+{
+    DepthReductionResult expected = {encodeOrderedFloat(TestFarPlane), encodeOrderedFloat(TestNearPlane), 0};
+
+    for (float sample : depth) {
+        expected.maxDepth = std::max(expected.maxDepth, encodeOrderedFloat(sample));
+
+        if (sample > 0.0f) {
+            expected.minDepth = std::min(expected.minDepth, encodeOrderedFloat(sample));
+        }
+    }
+
+    return expected;
+}
+
+SDSM_TEST(bothReductionsFindTheDepthRange)
+{
+    SDSMRandom random(1);
+
+    const int initialMin = encodeOrderedFloat(TestFarPlane);
+    const int initialMax = encodeOrderedFloat(TestNearPlane);
+
+    for (int trial = 0; trial < 200; trial++) {
+        // Sizes on and off the threadgroup grid, down to a single pixel
+        uint32_t width = (uint32_t)random.integer(1, 100);
+        uint32_t height = (uint32_t)random.integer(1, 100);
+        float emptyFraction = random.uniform(0.0f, 1.0f);
+
+        std::vector<float> depth = makeDepthImage(width, height, emptyFraction, random);
+        DepthReductionResult expected = expectedReduction(depth);
+
+        DepthReductionResult atomic = reduceMinMaxDepthAtomic(depth.data(), width, height, initialMin, initialMax);
+        DepthReductionResult hierarchical = reduceMinMaxDepthHierarchical(depth.data(), width, height, initialMin, initialMax);
+
+        SDSM_CHECK_OR_BREAK(atomic.minDepth == expected.minDepth && atomic.maxDepth == expected.maxDepth);
+        SDSM_CHECK_OR_BREAK(hierarchical.minDepth == expected.minDepth && hierarchical.maxDepth == expected.maxDepth);
+    }
+}
+
+SDSM_TEST(emptyImagesKeepTheInitialRange)
+{
+    std::vector<float> depth(64 * 48, 0.0f);
+
+    const int initialMin = encodeOrderedFloat(TestFarPlane);
+    const int initialMax = encodeOrderedFloat(TestNearPlane);
+
+    DepthReductionResult atomic = reduceMinMaxDepthAtomic(depth.data(), 64, 48, initialMin, initialMax);
+    DepthReductionResult hierarchical = reduceMinMaxDepthHierarchical(depth.data(), 64, 48, initialMin, initialMax);
+
+    SDSM_CHECK(atomic.minDepth == initialMin && atomic.maxDepth == initialMax);
+    SDSM_CHECK(hierarchical.minDepth == initialMin && hierarchical.maxDepth == initialMax);
+
+    // Only the max of every pixel or tile is issued
+    SDSM_CHECK(atomic.atomicCount == 64 * 48);
+    SDSM_CHECK(hierarchical.atomicCount == 4 * 3);
+}
+
+SDSM_TEST(atomicCountsPerPixelAndPerThreadgroup)
+{
+    SDSMRandom random(2);
+
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    const uint32_t tileCount = ((width + SDSM_REDUCTION_THREADGROUP_SIZE - 1) / SDSM_REDUCTION_THREADGROUP_SIZE) *
+                               ((height + SDSM_REDUCTION_THREADGROUP_SIZE - 1) / SDSM_REDUCTION_THREADGROUP_SIZE);
+
+    std::vector<float> depth = makeDepthImage(width, height, 0.0f, random);
+
+    DepthReductionResult atomic = reduceMinMaxDepthAtomic(depth.data(), width, height, INT_MAX, INT_MIN);
+    DepthReductionResult hierarchical = reduceMinMaxDepthHierarchical(depth.data(), width, height, INT_MAX, INT_MIN);
+
+    SDSM_CHECK(atomic.atomicCount == 2ull * width * height);
+    SDSM_CHECK(hierarchical.atomicCount == 2ull * tileCount);
+
+    // Empty tiles issue only their max
+    std::fill(depth.begin(), depth.begin() + (size_t)width * SDSM_REDUCTION_THREADGROUP_SIZE, 0.0f);
+
+    hierarchical = reduceMinMaxDepthHierarchical(depth.data(), width, height, INT_MAX, INT_MIN);
+
+    SDSM_CHECK(hierarchical.atomicCount == 2ull * tileCount - width / SDSM_REDUCTION_THREADGROUP_SIZE);
+}
+
+SDSM_TEST(threadgroupSizeDoesNotChangeTheResult)
+{
+    SDSMRandom random(3);
+
+    std::vector<float> depth = makeDepthImage(333, 177, 0.3f, random);
+    DepthReductionResult expected = expectedReduction(depth);
+
+    for (uint32_t size = 1; size <= 64; size *= 2) {
+        DepthReductionResult result = reduceMinMaxDepthHierarchical(depth.data(), 333, 177,
+                                                                    encodeOrderedFloat(TestFarPlane),
+                                                                    encodeOrderedFloat(TestNearPlane), size);
+
+        SDSM_CHECK_OR_BREAK(result.minDepth == expected.minDepth && result.maxDepth == expected.maxDepth);
+    }
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,74 @@
+//
+//  SDSM_ShadowAtlasBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Per-frame cost of sizing and packing the shadow atlas for every cascade count: the weights from
+//  a depth histogram, the budget solver and packer on their own, and the allocator's update with
+//  changing weights, which repacks whenever the sizes drift past the hysteresis.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_ShadowAtlas.h"
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int iterations = quick ? 100 : 200000;
+
+    const float nearPlane = 1.0f;
+    const float farPlane = 750.0f;
+
+    SDSMRandom random(10);
+
+    int histogram[DepthHistogramLength] = {};
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        histogram[DepthHistogramBins + bin * DepthHistogramBinStride] = random.integer(0, 100000);
+    }
+
+    // Sets of weights cycled through by the allocator benchmark, different enough to repack often
+    const int weightSetCount = 64;
+    float weightSets[weightSetCount][MAX_CASCADED_SHADOW_COUNT];
+
+    for (int set = 0; set < weightSetCount; set++) {
+        for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+            weightSets[set][i] = powf(10.0f, random.uniform(-2.0f, 2.0f));
+        }
+    }
+
+    printf("%-9s %12s %12s %12s %12s\n", "cascades", "weights ns", "solve ns", "pack ns", "update ns");
+
+    for (int count = 1; count <= MAX_CASCADED_SHADOW_COUNT; count++) {
+        float cascadeEnds[MAX_CASCADED_SHADOW_COUNT + 1];
+        cascadePartitioning(LOG_PARTITIONING, nearPlane, farPlane, nearPlane, farPlane, nullptr, count, cascadeEnds);
+
+        float weights[MAX_CASCADED_SHADOW_COUNT];
+        int sizes[MAX_CASCADED_SHADOW_COUNT];
+        ShadowAtlasRect rects[MAX_CASCADED_SHADOW_COUNT];
+
+        double weightTime = sdsmBenchmark([&]() {
+            shadowAtlasWeights(histogram, nearPlane, farPlane, cascadeEnds, count, weights);
+            sdsmKeep(weights[0]);
+        }, iterations);
+
+        double solveTime = sdsmBenchmark([&]() {
+            solveShadowAtlasSizes(weights, count, 3.0f * 512.0f * 512.0f, 64, 1024, 32, sizes);
+            sdsmKeep(sizes[0]);
+        }, iterations);
+
+        double packTime = sdsmBenchmark([&]() {
+            sdsmKeep(packShadowAtlas(sizes, count, 1024, rects));
+        }, iterations);
+
+        ShadowAtlasAllocator allocator(1024, 3.0f * 512.0f * 512.0f);
+        int frame = 0;
+
+        double updateTime = sdsmBenchmark([&]() {
+            sdsmKeep(allocator.update(weightSets[frame++ % weightSetCount], count));
+        }, iterations);
+
+        printf("%-9d %12.1f %12.1f %12.1f %12.1f\n", count, weightTime, solveTime, packTime, updateTime);
+    }
+
+    return 0;
+}
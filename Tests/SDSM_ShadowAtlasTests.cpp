@@ -0,0 +1,268 @@
+//
+//  SDSM_ShadowAtlasTests.cpp
+//  DeferredLighting C++
+//
+//  Deterministic tests of the shadow atlas budget solver, shelf packer and allocator.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_ShadowAtlas.h"
+
+static bool rectsOverlap(const ShadowAtlasRect & a, const ShadowAtlasRect & b)
+{
+    return a.x < b.x + b.size && b.x < a.x + a.size &&
+           a.y < b.y + b.size && b.y < a.y + a.size;
+}
+
+// Every rect lies inside the atlas and no two overlap
+static bool validLayout(const ShadowAtlasRect *rects, const int *sizes, int count, int atlasSize)
+{
+    for (int i = 0; i < count; i++) {
+        if (rects[i].size != sizes[i] || rects[i].x < 0 || rects[i].y < 0 ||
+            rects[i].x + rects[i].size > atlasSize || rects[i].y + rects[i].size > atlasSize) {
+            return false;
+        }
+
+        for (int j = 0; j < i; j++) {
+            if (rectsOverlap(rects[i], rects[j])) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+SDSM_TEST(solverSizesFollowCubeRootOfWeights)
+{
+    const float weights[3] = {1.0f, 8.0f, 27.0f};
+    int sizes[3];
+
+    // norm = 1 + 4 + 9, so sizes are 1, 2 and 3 times sqrt(budget / 14), less the rounding down
+    solveShadowAtlasSizes(weights, 3, 14.0f * 128.0f * 128.0f, 1, 4096, 1, sizes);
+
+    SDSM_CHECK(sizes[0] >= 127 && sizes[0] <= 128);
+    SDSM_CHECK(sizes[1] >= 255 && sizes[1] <= 256);
+    SDSM_CHECK(sizes[2] >= 383 && sizes[2] <= 384);
+}
+
+SDSM_TEST(solverStaysWithinBudget)
+{
+    SDSMRandom random(10);
+
+    for (int trial = 0; trial < 1000; trial++) {
+        int count = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        float weights[MAX_CASCADED_SHADOW_COUNT];
+        int sizes[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < count; i++) {
+            weights[i] = random.uniform(0.0f, 10.0f);
+        }
+
+        float budget = random.uniform(256.0f * 256.0f, 2048.0f * 2048.0f);
+
+        solveShadowAtlasSizes(weights, count, budget, 32, 1 << 20, 32, sizes);
+
+        float area = 0.0f;
+
+        for (int i = 0; i < count; i++) {
+            SDSM_CHECK_OR_BREAK(sizes[i] % 32 == 0);
+            area += (float)sizes[i] * (float)sizes[i];
+        }
+
+        SDSM_CHECK_OR_BREAK(area <= budget * 1.0001f);
+    }
+}
+
+SDSM_TEST(solverSnapsAndClamps)
+{
+    const float weights[4] = {0.0001f, 1.0f, 1.0f, 1000.0f};
+    int sizes[4];
+
+    solveShadowAtlasSizes(weights, 4, 1024.0f * 1024.0f, 64, 512, 32, sizes);
+
+    SDSM_CHECK(sizes[0] == 64);
+    SDSM_CHECK(sizes[1] == sizes[2]);
+    SDSM_CHECK(sizes[1] % 32 == 0);
+    SDSM_CHECK(sizes[3] == 512);
+}
+
+SDSM_TEST(solverSplitsEvenlyWithoutWeights)
+{
+    const float weights[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int sizes[4];
+
+    solveShadowAtlasSizes(weights, 4, 4.0f * 300.0f * 300.0f, 1, 4096, 32, sizes);
+
+    for (int i = 0; i < 4; i++) {
+        SDSM_CHECK(sizes[i] == 288);
+    }
+}
+
+SDSM_TEST(packerProducesKnownLayout)
+{
+    const int sizes[4] = {256, 512, 256, 128};
+    ShadowAtlasRect rects[4];
+
+    SDSM_CHECK(packShadowAtlas(sizes, 4, 1024, rects));
+
+    // Largest first on the first shelf, then ties in cascade order
+    SDSM_CHECK(rects[1].x == 0 && rects[1].y == 0);
+    SDSM_CHECK(rects[0].x == 512 && rects[0].y == 0);
+    SDSM_CHECK(rects[2].x == 768 && rects[2].y == 0);
+    SDSM_CHECK(rects[3].x == 0 && rects[3].y == 512);
+}
+
+SDSM_TEST(packerStartsNewShelfWhenRowIsFull)
+{
+    const int sizes[3] = {600, 400, 300};
+    ShadowAtlasRect rects[3];
+
+    SDSM_CHECK(packShadowAtlas(sizes, 3, 1024, rects));
+
+    SDSM_CHECK(rects[0].x == 0 && rects[0].y == 0);
+    SDSM_CHECK(rects[1].x == 600 && rects[1].y == 0);
+    SDSM_CHECK(rects[2].x == 0 && rects[2].y == 600);
+}
+
+SDSM_TEST(packerRejectsWhatDoesNotFit)
+{
+    const int tooWide[1] = {1025};
+    const int tooTall[3] = {600, 600, 600};
+    ShadowAtlasRect rects[3];
+
+    SDSM_CHECK(!packShadowAtlas(tooWide, 1, 1024, rects));
+    SDSM_CHECK(!packShadowAtlas(tooTall, 3, 1024, rects));
+}
+
+SDSM_TEST(packerLayoutsAreValid)
+{
+    SDSMRandom random(11);
+
+    for (int trial = 0; trial < 10000; trial++) {
+        int count = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        int sizes[MAX_CASCADED_SHADOW_COUNT];
+        ShadowAtlasRect rects[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < count; i++) {
+            sizes[i] = 32 * random.integer(1, 16);
+        }
+
+        if (packShadowAtlas(sizes, count, 1024, rects)) {
+            SDSM_CHECK_OR_BREAK(validLayout(rects, sizes, count, 1024));
+        }
+    }
+}
+
+SDSM_TEST(weightsWithoutHistogramFollowAliasingError)
+{
+    const float cascadeEnds[3] = {1.0f, 10.0f, 100.0f};
+    float weights[2];
+
+    shadowAtlasWeights(nullptr, 1.0f, 100.0f, cascadeEnds, 2, weights);
+
+    SDSM_CHECK(weights[0] == 0.5f * 9.0f / 1.0f);
+    SDSM_CHECK(weights[1] == 0.5f * 90.0f / 10.0f);
+}
+
+SDSM_TEST(weightsFollowHistogramCoverage)
+{
+    const float nearPlane = 1.0f;
+    const float farPlane = 100.0f;
+    const float cascadeEnds[3] = {1.0f, 10.0f, 100.0f};
+
+    int histogram[DepthHistogramLength] = {};
+
+    // Three samples near the camera for each one far away
+    histogram[DepthHistogramBins + depthHistogramBin(2.0f, nearPlane, farPlane) * DepthHistogramBinStride] = 300;
+    histogram[DepthHistogramBins + depthHistogramBin(50.0f, nearPlane, farPlane) * DepthHistogramBinStride] = 100;
+
+    float weights[2];
+
+    shadowAtlasWeights(histogram, nearPlane, farPlane, cascadeEnds, 2, weights);
+
+    SDSM_CHECK(weights[0] == 0.75f * 9.0f);
+    SDSM_CHECK(weights[1] == 0.25f * 9.0f);
+}
+
+SDSM_TEST(allocatorKeepsLayoutWithinHysteresis)
+{
+    ShadowAtlasAllocator allocator(1024, 3.0f * 512.0f * 512.0f);
+
+    const float weights[3] = {4.0f, 2.0f, 1.0f};
+    const float nudged[3] = {4.2f, 1.9f, 1.05f};
+    const float moved[3] = {1.0f, 2.0f, 4.0f};
+
+    SDSM_CHECK(allocator.update(weights, 3));
+
+    ShadowAtlasRect before[3];
+
+    for (int i = 0; i < 3; i++) {
+        before[i] = allocator.rect(i);
+    }
+
+    SDSM_CHECK(!allocator.update(nudged, 3));
+
+    for (int i = 0; i < 3; i++) {
+        SDSM_CHECK(memcmp(&before[i], &allocator.rect(i), sizeof(ShadowAtlasRect)) == 0);
+    }
+
+    SDSM_CHECK(allocator.update(moved, 3));
+    SDSM_CHECK(allocator.rect(2).size > allocator.rect(0).size);
+
+    // A new cascade count always repacks
+    SDSM_CHECK(allocator.update(moved, 2));
+}
+
+SDSM_TEST(allocatorAlwaysPacks)
+{
+    SDSMRandom random(12);
+
+    ShadowAtlasAllocator allocator(1024, 3.0f * 512.0f * 512.0f);
+
+    for (int frame = 0; frame < 10000; frame++) {
+        int count = random.integer(1, MAX_CASCADED_SHADOW_COUNT);
+        float weights[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < count; i++) {
+            // Spans many orders of magnitude, as the aliasing metric does
+            weights[i] = powf(10.0f, random.uniform(-4.0f, 4.0f));
+        }
+
+        allocator.update(weights, count);
+
+        ShadowAtlasRect rects[MAX_CASCADED_SHADOW_COUNT];
+        int sizes[MAX_CASCADED_SHADOW_COUNT];
+
+        for (int i = 0; i < count; i++) {
+            rects[i] = allocator.rect(i);
+            sizes[i] = rects[i].size;
+        }
+
+        SDSM_CHECK_OR_BREAK(validLayout(rects, sizes, count, 1024));
+    }
+}
+
+SDSM_TEST(allocatorIsDeterministic)
+{
+    ShadowAtlasAllocator first(1024, 3.0f * 512.0f * 512.0f);
+    ShadowAtlasAllocator second(1024, 3.0f * 512.0f * 512.0f);
+
+    SDSMRandom random(13);
+
+    for (int frame = 0; frame < 1000; frame++) {
+        float weights[4];
+
+        for (int i = 0; i < 4; i++) {
+            weights[i] = random.uniform(0.1f, 10.0f);
+        }
+
+        SDSM_CHECK_OR_BREAK(first.update(weights, 4) == second.update(weights, 4));
+
+        for (int i = 0; i < 4; i++) {
+            SDSM_CHECK_OR_BREAK(memcmp(&first.rect(i), &second.rect(i), sizeof(ShadowAtlasRect)) == 0);
+        }
+    }
+}
+
+SDSM_TEST_MAIN()
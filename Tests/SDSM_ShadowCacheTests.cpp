@@ -0,0 +1,284 @@
+//
+//  SDSM_ShadowCacheTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the shadow cascade cache's invalidation: a still light and camera re-render nothing,
+//  light and camera motion re-render the cascades whose matrices changed, and moving casters
+//  dirty only the texels they cover before and after the move.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_ShadowCache.h"
+#include "SDSMShared.h"
+
+#include <math.h>
+
+static const int TestCascadeCount = 3;
+
+// Matrix of a cascade as the renderer builds it: a light view rotated by the light's angles,
+// followed by an orthographic projection fitted to the cascade's light view bounds
+static void cascadeMatrix(float phi, float theta, const float *lightBounds, float *matrix)
+{
+    float view[4][4] = {
+        {cosf(phi), sinf(phi) * sinf(theta), -sinf(phi) * cosf(theta), 0.0f},
+        {0.0f, cosf(theta), sinf(theta), 0.0f},
+        {sinf(phi), -cosf(phi) * sinf(theta), cosf(phi) * cosf(theta), 0.0f},
+        {0.0f, 0.0f, 100.0f, 1.0f},
+    };
+
+    applyCascadeProjection(cascadeOrthoProjection(lightBounds), view);
+
+    memcpy(matrix, view, sizeof(view));
+}
+
+// Light view bounds of each cascade for a camera at a position along x
+static void cameraBounds(float cameraX, float *bounds)
+{
+    for (int i = 0; i < TestCascadeCount; i++) {
+        float size = 10.0f * powf(4.0f, (float)i);
+
+        const float box[6] = {cameraX - size, -size, 50.0f, cameraX + size, size, 150.0f};
+        memcpy(bounds + 6 * i, box, sizeof(box));
+    }
+}
+
+static ShadowCacheRect cascadeRegion(int cascade)
+{
+    return {cascade, 0, 0, 1024, 1024};
+}
+
+// Updates every cascade for a light and camera and returns a mask of the dirty ones
+static uint32_t updateFrame(ShadowCascadeCache & cache, float phi, float theta, float cameraX)
+{
+    float bounds[6 * TestCascadeCount];
+    cameraBounds(cameraX, bounds);
+
+    uint32_t dirty = 0;
+
+    for (int i = 0; i < TestCascadeCount; i++) {
+        float matrix[16];
+        cascadeMatrix(phi, theta, bounds + 6 * i, matrix);
+
+        cache.updateCascade(i, matrix, cascadeRegion(i));
+
+        dirty |= cache.isDirty(i) ? 1u << i : 0u;
+    }
+
+    return dirty;
+}
+
+static void markAllRendered(ShadowCascadeCache & cache)
+{
+    for (int i = 0; i < TestCascadeCount; i++) {
+        cache.markRendered(i);
+    }
+}
+
+// Whether the dirty rect contains every texel a box projects to, allowing for the rounding out
+// to whole texels
+static bool dirtyRectCovers(const ShadowCascadeCache & cache, int cascade, const AxisAlignedBox & box)
+{
+    const ShadowCacheRect & dirty = cache.dirtyRect(cascade);
+    const ShadowCacheRect & region = cache.region(cascade);
+    const float *matrix = cache.matrix(cascade);
+
+    for (int corner = 0; corner < 8; corner++) {
+        float point[3] = {
+            corner & 1 ? box.max[0] : box.min[0],
+            corner & 2 ? box.max[1] : box.min[1],
+            corner & 4 ? box.max[2] : box.min[2]
+        };
+
+        float clipX = matrix[12] + matrix[0] * point[0] + matrix[4] * point[1] + matrix[8] * point[2];
+        float clipY = matrix[13] + matrix[1] * point[0] + matrix[5] * point[1] + matrix[9] * point[2];
+
+        float x = std::min(std::max(region.x + (clipX * 0.5f + 0.5f) * region.width, (float)region.x),
+                           (float)(region.x + region.width));
+        float y = std::min(std::max(region.y + (0.5f - clipY * 0.5f) * region.height, (float)region.y),
+                           (float)(region.y + region.height));
+
+        if (x < dirty.x || x > dirty.x + dirty.width || y < dirty.y || y > dirty.y + dirty.height) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+SDSM_TEST(stillSceneRendersOnce)
+{
+    ShadowCascadeCache cache;
+
+    SDSM_CHECK(updateFrame(cache, 0.3f, 0.9f, 0.0f) == 7);
+
+    for (int i = 0; i < TestCascadeCount; i++) {
+        SDSM_CHECK(cache.isValid(i) && cache.isFullyDirty(i));
+    }
+
+    markAllRendered(cache);
+
+    for (int frame = 0; frame < 100; frame++) {
+        SDSM_CHECK_OR_BREAK(updateFrame(cache, 0.3f, 0.9f, 0.0f) == 0);
+    }
+}
+
+SDSM_TEST(lightMotionRerendersEveryCascade)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    SDSM_CHECK(updateFrame(cache, 0.31f, 0.9f, 0.0f) == 7);
+    markAllRendered(cache);
+
+    SDSM_CHECK(updateFrame(cache, 0.31f, 0.89f, 0.0f) == 7);
+
+    for (int i = 0; i < TestCascadeCount; i++) {
+        SDSM_CHECK(cache.isFullyDirty(i));
+    }
+}
+
+SDSM_TEST(floatNoiseKeepsTheCachedMatrix)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    float cached[16];
+    memcpy(cached, cache.matrix(0), sizeof(cached));
+
+    // Angles recomputed with rounding noise leave the cascades and their matrices untouched
+    SDSM_CHECK(updateFrame(cache, 0.3f + 1e-7f, 0.9f - 1e-7f, 1e-6f) == 0);
+    SDSM_CHECK(memcmp(cache.matrix(0), cached, sizeof(cached)) == 0);
+}
+
+SDSM_TEST(cameraMotionRerendersTheCascadesItMoves)
+{
+    // A tolerance that absorbs the far cascades' small matrix changes
+    ShadowCascadeCache cache(1e-3f);
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    // Moving the camera slides every cascade's bounds, which moves the near cascade's matrix most
+    uint32_t dirty = updateFrame(cache, 0.3f, 0.9f, 0.02f);
+
+    SDSM_CHECK(dirty == 1);
+    SDSM_CHECK(cache.isFullyDirty(0));
+
+    markAllRendered(cache);
+
+    SDSM_CHECK(updateFrame(cache, 0.3f, 0.9f, 2.0f) == 7);
+}
+
+SDSM_TEST(regionChangesRerenderTheCascade)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    float matrix[16];
+    memcpy(matrix, cache.matrix(1), sizeof(matrix));
+
+    // The atlas moved the cascade to another place of its slice
+    cache.updateCascade(1, matrix, {1, 512, 0, 512, 512});
+
+    SDSM_CHECK(!cache.isDirty(0) && cache.isFullyDirty(1) && !cache.isDirty(2));
+    SDSM_CHECK(cache.region(1) == (ShadowCacheRect{1, 512, 0, 512, 512}));
+}
+
+SDSM_TEST(movingCastersDirtyOnlyTheirTexels)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    SDSMRandom random(14);
+
+    for (int trial = 0; trial < 1000; trial++) {
+        float center[3] = {random.uniform(-20.0f, 20.0f), random.uniform(0.0f, 5.0f), random.uniform(-20.0f, 20.0f)};
+        float size = random.uniform(0.1f, 2.0f);
+        float step[3] = {random.uniform(-1.0f, 1.0f), 0.0f, random.uniform(-1.0f, 1.0f)};
+
+        AxisAlignedBox before = makeAxisAlignedBox(center[0] - size, center[1], center[2] - size,
+                                                   center[0] + size, center[1] + size, center[2] + size);
+        AxisAlignedBox after = makeAxisAlignedBox(before.min[0] + step[0], before.min[1], before.min[2] + step[2],
+                                                  before.max[0] + step[0], before.max[1], before.max[2] + step[2]);
+
+        // Unchanged light and camera
+        SDSM_CHECK_OR_BREAK(updateFrame(cache, 0.3f, 0.9f, 0.0f) == 0);
+
+        // The bounds before the move, then the union with the bounds after it
+        ShadowCacheRect dirtyBefore[TestCascadeCount];
+
+        cache.invalidateCaster(before);
+
+        for (int i = 0; i < TestCascadeCount; i++) {
+            dirtyBefore[i] = cache.dirtyRect(i);
+
+            SDSM_CHECK_OR_BREAK(!cache.isDirty(i) || dirtyRectCovers(cache, i, before));
+        }
+
+        cache.invalidateCaster(after);
+
+        for (int i = 0; i < TestCascadeCount; i++) {
+            if (!cache.isDirty(i)) {
+                continue;
+            }
+
+            const ShadowCacheRect & dirty = cache.dirtyRect(i);
+
+            SDSM_CHECK_OR_BREAK(unionShadowCacheRects(dirty, dirtyBefore[i]) == dirty);
+            SDSM_CHECK_OR_BREAK(dirty == dirtyBefore[i] || dirtyRectCovers(cache, i, after));
+
+            // A caster a few units wide dirties a small part of the cascade
+            SDSM_CHECK_OR_BREAK(!cache.isFullyDirty(i) && dirty.width * dirty.height < 1024 * 1024 / 4);
+            SDSM_CHECK_OR_BREAK(dirty.slice == i);
+        }
+
+        // Every caster near the camera lies in the widest cascade
+        SDSM_CHECK_OR_BREAK(cache.isDirty(TestCascadeCount - 1));
+
+        markAllRendered(cache);
+    }
+}
+
+SDSM_TEST(castersOutsideTheCascadesLeaveThemClean)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    cache.invalidateCaster(makeAxisAlignedBox(5000.0f, 0.0f, 5000.0f, 5010.0f, 10.0f, 5010.0f));
+
+    for (int i = 0; i < TestCascadeCount; i++) {
+        SDSM_CHECK(!cache.isDirty(i));
+    }
+}
+
+SDSM_TEST(invalidateForgetsEveryCascade)
+{
+    ShadowCascadeCache cache;
+
+    updateFrame(cache, 0.3f, 0.9f, 0.0f);
+    markAllRendered(cache);
+
+    cache.invalidate();
+
+    for (int i = 0; i < MAX_CASCADED_SHADOW_COUNT; i++) {
+        SDSM_CHECK(!cache.isValid(i) && !cache.isDirty(i));
+    }
+
+    // Casters do not dirty cascades without contents
+    cache.invalidateCaster(makeAxisAlignedBox(-1.0f, 0.0f, -1.0f, 1.0f, 1.0f, 1.0f));
+    SDSM_CHECK(!cache.isDirty(0));
+
+    SDSM_CHECK(updateFrame(cache, 0.3f, 0.9f, 0.0f) == 7);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,123 @@
+//
+//  SDSM_SimdBenchmark.cpp
+//  DeferredLighting C++
+//
+//  Time per call of the portable SIMD operations the renderer uses most, for the backend the
+//  compiler targets against the scalar reference.  Both sides store their whole result, as the
+//  renderer does; summing one lane lets the compiler drop the rest of the scalar reference.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Simd.h"
+
+#include <vector>
+
+using namespace SDSMSimd;
+
+static const int BenchmarkMatrixCount = 4096;
+
+int main(int argc, char **argv)
+{
+    const bool quick = sdsmQuickBenchmark(argc, argv);
+    const int iterations = quick ? 2 : 200;
+
+    SDSMRandom random(22);
+
+    std::vector<matrix_float4x4> matrices(BenchmarkMatrixCount);
+    std::vector<vector_float4> vectors(BenchmarkMatrixCount);
+    std::vector<vector_float3> directions(BenchmarkMatrixCount);
+    std::vector<matrix_float4x4> matrixResults(BenchmarkMatrixCount);
+    std::vector<vector_float4> vectorResults(BenchmarkMatrixCount);
+
+    // Diagonally dominant, so every matrix is invertible
+    for (matrix_float4x4 & m : matrices) {
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                m.columns[column][row] = random.uniform(-2.0f, 2.0f) + (column == row ? 4.0f : 0.0f);
+            }
+        }
+    }
+
+    for (vector_float4 & v : vectors) {
+        v = vector4(random.uniform(-2.0f, 2.0f), random.uniform(-2.0f, 2.0f), random.uniform(-2.0f, 2.0f), 1.0f);
+    }
+
+    for (int i = 0; i < BenchmarkMatrixCount; i++) {
+        directions[i] = vector3(vectors[i].x, vectors[i].y, vectors[i].z);
+    }
+
+    const int n = BenchmarkMatrixCount;
+
+    printf("%-20s %10s %10s\n", "operation", "native ns", "scalar ns");
+
+    double native = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            matrixResults[i] = matrices[i] * matrices[(i * 7) & (n - 1)];
+        }
+        sdsmKeep(matrixResults[n - 1].columns[3].w);
+    }, iterations) / n;
+
+    double scalar = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            multiply<ScalarBackend, 4>(matrices[i].columns[0].elements, matrices[(i * 7) & (n - 1)].columns[0].elements,
+                                       matrixResults[i].columns[0].elements);
+        }
+        sdsmKeep(matrixResults[n - 1].columns[3].w);
+    }, iterations) / n;
+
+    printf("%-20s %10.2f %10.2f\n", "4x4 * 4x4", native, scalar);
+
+    native = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            vectorResults[i] = matrices[i] * vectors[i];
+        }
+        sdsmKeep(vectorResults[n - 1].w);
+    }, iterations) / n;
+
+    scalar = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            transform<ScalarBackend, 4>(matrices[i].columns[0].elements, vectors[i].elements, vectorResults[i].elements);
+        }
+        sdsmKeep(vectorResults[n - 1].w);
+    }, iterations) / n;
+
+    printf("%-20s %10.2f %10.2f\n", "4x4 * vector", native, scalar);
+
+    native = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            matrixResults[i] = matrix_invert(matrices[i]);
+        }
+        sdsmKeep(matrixResults[n - 1].columns[2].z);
+    }, iterations) / n;
+
+    scalar = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            invert4x4<ScalarBackend>(matrices[i].columns[0].elements, matrixResults[i].columns[0].elements);
+        }
+        sdsmKeep(matrixResults[n - 1].columns[2].z);
+    }, iterations) / n;
+
+    printf("%-20s %10.2f %10.2f\n", "4x4 inverse", native, scalar);
+
+    native = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            vector_float3 c = vector_normalize(vector_cross(directions[i], directions[(i + 1) & (n - 1)]));
+            memcpy(vectorResults[i].elements, c.elements, sizeof(c.elements));
+        }
+        sdsmKeep(vectorResults[n - 1].x);
+    }, iterations) / n;
+
+    scalar = sdsmBenchmark([&]() {
+        for (int i = 0; i < n; i++) {
+            typedef ScalarBackend::Lanes Lanes;
+            Lanes c = cross<ScalarBackend>(ScalarBackend::load3(directions[i].elements),
+                                           ScalarBackend::load3(directions[(i + 1) & (n - 1)].elements));
+            ScalarBackend::store(vectorResults[i].elements, ScalarBackend::div(c, ScalarBackend::splat(sqrtf(dot3<ScalarBackend>(c, c)))));
+        }
+        sdsmKeep(vectorResults[n - 1].x);
+    }, iterations) / n;
+
+    printf("%-20s %10.2f %10.2f\n", "normalize(cross)", native, scalar);
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+//
+//  SDSM_SimdTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the portable SIMD backend: every vector and matrix operation of the backend the
+//  compiler targets matches the scalar reference bit for bit, the 4x4 inverse is as accurate as a
+//  pivoted float inverse, and the half conversions match their reference for every half.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Simd.h"
+
+#include <math.h>
+
+using namespace SDSMSimd;
+
+static bool bitEqual(const float *a, const float *b, int count)
+{
+    return memcmp(a, b, count * sizeof(float)) == 0;
+}
+
+// Whether the first three lanes of each of three columns match, ignoring the padding lanes
+static bool bitEqual3x3(const float *a, const float *b)
+{
+    return bitEqual(a, b, 3) && bitEqual(a + 4, b + 4, 3) && bitEqual(a + 8, b + 8, 3);
+}
+
+static matrix_float4x4 randomMatrix(SDSMRandom & random, bool affine)
+{
+    matrix_float4x4 m;
+
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            m.columns[column][row] = random.uniform(-4.0f, 4.0f);
+        }
+    }
+
+    if (affine) {
+        m.columns[0][3] = m.columns[1][3] = m.columns[2][3] = 0.0f;
+        m.columns[3][3] = 1.0f;
+    }
+
+    return m;
+}
+
+static matrix_float3x3 upperLeft(const matrix_float4x4 & m)
+{
+    matrix_float3x3 r;
+
+    for (int column = 0; column < 3; column++) {
+        r.columns[column] = vector3(m.columns[column][0], m.columns[column][1], m.columns[column][2]);
+    }
+
+    return r;
+}
+
+SDSM_TEST(matrixOperationsMatchTheScalarReference)
+{
+    SDSMRandom random(22);
+
+    for (int trial = 0; trial < 200000; trial++) {
+        matrix_float4x4 a = randomMatrix(random, trial % 3 == 0);
+        matrix_float4x4 b = randomMatrix(random, false);
+        vector_float4 v = vector4(random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f),
+                                  random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f));
+
+        float reference[16];
+
+        matrix_float4x4 product = a * b;
+        multiply<ScalarBackend, 4>(a.columns[0].elements, b.columns[0].elements, reference);
+        SDSM_CHECK_OR_BREAK(bitEqual(product.columns[0].elements, reference, 16));
+
+        vector_float4 transformed = a * v;
+        transform<ScalarBackend, 4>(a.columns[0].elements, v.elements, reference);
+        SDSM_CHECK_OR_BREAK(bitEqual(transformed.elements, reference, 4));
+
+        matrix_float4x4 inverse = matrix_invert(a);
+        invert4x4<ScalarBackend>(a.columns[0].elements, reference);
+        SDSM_CHECK_OR_BREAK(bitEqual(inverse.columns[0].elements, reference, 16));
+
+        matrix_float4x4 transposed = matrix_transpose(a);
+        SDSM_CHECK_OR_BREAK(transposed.columns[1][2] == a.columns[2][1] && transposed.columns[3][0] == a.columns[0][3]);
+
+        matrix_float3x3 a3 = upperLeft(a);
+        matrix_float3x3 b3 = upperLeft(b);
+
+        matrix_float3x3 product3 = a3 * b3;
+        multiply<ScalarBackend, 3>(a3.columns[0].elements, b3.columns[0].elements, reference);
+        SDSM_CHECK_OR_BREAK(bitEqual3x3(product3.columns[0].elements, reference));
+
+        matrix_float3x3 inverse3 = matrix_invert(a3);
+        invert3x3<ScalarBackend>(a3.columns[0].elements, reference);
+        SDSM_CHECK_OR_BREAK(bitEqual3x3(inverse3.columns[0].elements, reference));
+    }
+}
+
+SDSM_TEST(vectorOperationsMatchTheScalarReference)
+{
+    SDSMRandom random(23);
+
+    for (int trial = 0; trial < 200000; trial++) {
+        vector_float4 a = vector4(random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f),
+                                  random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f));
+        vector_float4 b = vector4(random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f),
+                                  random.uniform(-4.0f, 4.0f), random.uniform(-4.0f, 4.0f));
+        vector_float3 a3 = vector3(a.x, a.y, a.z);
+        vector_float3 b3 = vector3(b.x, b.y, b.z);
+
+        SDSM_CHECK_OR_BREAK(vector_dot(a, b) == (dot<ScalarBackend, 4>(a.elements, b.elements)));
+        SDSM_CHECK_OR_BREAK(vector_dot(a3, b3) == (dot<ScalarBackend, 3>(a3.elements, b3.elements)));
+
+        float reference[4];
+        ScalarBackend::store(reference, cross<ScalarBackend>(ScalarBackend::load3(a3.elements), ScalarBackend::load3(b3.elements)));
+
+        vector_float3 crossed = vector_cross(a3, b3);
+        SDSM_CHECK_OR_BREAK(bitEqual(crossed.elements, reference, 3));
+
+        // The same IEEE operations as dividing by vector_length, with the length kept in lanes
+        normalize<ScalarBackend, 3>(a3.elements, reference);
+        vector_float3 normalized3 = vector_normalize(a3);
+        float length3 = vector_length(a3);
+        float divided3[3] = { a3.x / length3, a3.y / length3, a3.z / length3 };
+        SDSM_CHECK_OR_BREAK(bitEqual(normalized3.elements, reference, 3) && bitEqual(reference, divided3, 3));
+
+        normalize<ScalarBackend, 4>(a.elements, reference);
+        vector_float4 normalized = vector_normalize(a);
+        float length = vector_length(a);
+        float divided[4] = { a.x / length, a.y / length, a.z / length, a.w / length };
+        SDSM_CHECK_OR_BREAK(bitEqual(normalized.elements, reference, 4) && bitEqual(reference, divided, 4));
+    }
+}
+
+// Inverse of a column major 4x4 matrix in double by Gauss-Jordan with partial pivoting, or false
+// for a singular one
+static bool referenceInverse(const matrix_float4x4 & m, double *result)
+{
+    double a[4][8];
+
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            a[row][column] = m.columns[column][row];
+            a[row][4 + column] = row == column;
+        }
+    }
+
+    for (int column = 0; column < 4; column++) {
+        int pivot = column;
+
+        for (int row = column + 1; row < 4; row++) {
+            pivot = fabs(a[row][column]) > fabs(a[pivot][column]) ? row : pivot;
+        }
+
+        if (fabs(a[pivot][column]) < 1e-12) {
+            return false;
+        }
+
+        for (int j = 0; j < 8; j++) {
+            std::swap(a[column][j], a[pivot][j]);
+        }
+
+        double divisor = a[column][column];
+
+        for (int j = 0; j < 8; j++) {
+            a[column][j] /= divisor;
+        }
+
+        for (int row = 0; row < 4; row++) {
+            double factor = a[row][column];
+
+            for (int j = 0; row != column && j < 8; j++) {
+                a[row][j] -= factor * a[column][j];
+            }
+        }
+    }
+
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            result[4 * column + row] = a[row][4 + column];
+        }
+    }
+
+    return true;
+}
+
+SDSM_TEST(inverseIsAccurate)
+{
+    SDSMRandom random(24);
+
+    double errorSum = 0.0;
+    double worstError = 0.0;
+    int count = 0;
+
+    for (int trial = 0; trial < 100000; trial++) {
+        matrix_float4x4 m = randomMatrix(random, false);
+
+        double reference[16];
+        if (!referenceInverse(m, reference)) {
+            continue;
+        }
+
+        // Well conditioned matrices only, whose inverse has no large entries
+        double norm = 0.0;
+        for (double entry : reference) {
+            norm = std::max(norm, fabs(entry));
+        }
+
+        if (norm > 20.0) {
+            continue;
+        }
+
+        matrix_float4x4 inverse = matrix_invert(m);
+        double error = 0.0;
+
+        for (int i = 0; i < 16; i++) {
+            error = std::max(error, fabs(inverse.columns[i / 4][i % 4] - reference[i]) / norm);
+        }
+
+        errorSum += error;
+        worstError = std::max(worstError, error);
+        count++;
+    }
+
+    SDSM_CHECK(count > 10000);
+    SDSM_CHECK(errorSum / count < 1e-6);
+    SDSM_CHECK(worstError < 1e-4);
+}
+
+SDSM_TEST(halfConversionsMatchTheReference)
+{
+    for (uint32_t h = 0; h < 65536; h++) {
+        float converted = halfToFloat((uint16_t)h);
+        float reference = halfToFloatReference((uint16_t)h);
+
+        SDSM_CHECK_OR_BREAK(bitEqual(&converted, &reference, 1));
+
+        // Every half but a NaN survives the round trip; NaNs stay NaNs
+        bool nan = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+        uint16_t roundTrip = floatToHalfReference(reference);
+
+        SDSM_CHECK_OR_BREAK(nan ? isnan(halfToFloatReference(roundTrip)) : roundTrip == h);
+    }
+
+    // A spread of float bit patterns, covering every exponent
+    for (uint64_t bits = 0; bits < (1ull << 32); bits += 65521) {
+        uint32_t pattern = (uint32_t)bits;
+        float f;
+        memcpy(&f, &pattern, sizeof(f));
+
+        SDSM_CHECK_OR_BREAK(floatToHalf(f) == floatToHalfReference(f));
+    }
+
+    // Rounding to nearest even
+    SDSM_CHECK(floatToHalfReference(1.0f + 1.0f / 2048.0f) == 0x3c00);
+    SDSM_CHECK(floatToHalfReference(1.0f + 3.0f / 2048.0f) == 0x3c02);
+    SDSM_CHECK(floatToHalfReference(65520.0f) == 0x7c00);
+    SDSM_CHECK(floatToHalfReference(65519.0f) == 0x7bff);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,301 @@
+//
+//  SDSM_SparseReductionTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the sparse light frustum reduction against the full rate one on a ray traced scene of
+//  a ground plane and spheres: the offsets visit every pixel of a cell, the bounds accumulated over
+//  a rotation miss no sample of a still view and very few of a moving one, and the reduction
+//  issues a 1/stride^2 share of the atomics.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+#include "SDSM_BoundsHistory.h"
+
+#include <math.h>
+
+static const uint32_t TestWidth = 320;
+static const uint32_t TestHeight = 180;
+static const int TestCascadeCount = 4;
+static const float TestCascadeEnds[TestCascadeCount + 1] = {0.1f, 6.0f, 15.0f, 40.0f, 200.0f};
+
+// Angles of the light view rotation
+static const float LightAlpha = 0.7f;
+static const float LightBeta = 0.4f;
+
+struct TestCamera
+{
+    float position[3];
+    float scaleX, scaleY;
+};
+
+static TestCamera makeCamera(float x, float z)
+{
+    TestCamera camera = {{x, 0.0f, z}, 0.0f, 0.0f};
+
+    camera.scaleY = 1.0f / tanf(0.5f);
+    camera.scaleX = camera.scaleY * (float)TestHeight / (float)TestWidth;
+
+    return camera;
+}
+
+static void lightRotation(float *rotation)
+{
+    const float r[9] = {
+        cosf(LightAlpha), 0.0f, -sinf(LightAlpha),
+        sinf(LightAlpha) * sinf(LightBeta), cosf(LightBeta), cosf(LightAlpha) * sinf(LightBeta),
+        sinf(LightAlpha) * cosf(LightBeta), -sinf(LightBeta), cosf(LightAlpha) * cosf(LightBeta),
+    };
+
+    memcpy(rotation, r, sizeof(r));
+}
+
+// View depth of every pixel looking down +z at a ground plane and a grid of spheres, 0 for sky
+static std::vector<float> renderScene(const TestCamera & camera)
+{
+    std::vector<float> depth((size_t)TestWidth * TestHeight, 0.0f);
+
+    for (uint32_t y = 0; y < TestHeight; y++) {
+        for (uint32_t x = 0; x < TestWidth; x++) {
+            float direction[3] = {(2.0f * x / TestWidth - 1.0f) / camera.scaleX,
+                                  (1.0f - 2.0f * y / TestHeight) / camera.scaleY, 1.0f};
+            float nearest = FLT_MAX;
+
+            if (direction[1] < 0.0f) {
+                float t = (-2.0f - camera.position[1]) / direction[1];
+                nearest = t > 0.1f ? t : nearest;
+            }
+
+            for (int i = 0; i < 30; i++) {
+                float center[3] = {(float)(i % 6) * 6.0f - 15.0f, 0.0f, (float)(i / 6) * 10.0f + 5.0f};
+                float radius = 1.2f + 0.3f * (float)(i % 3);
+                float offset[3] = {camera.position[0] - center[0], camera.position[1] - center[1],
+                                   camera.position[2] - center[2]};
+
+                float a = direction[0] * direction[0] + direction[1] * direction[1] + 1.0f;
+                float b = 2.0f * (offset[0] * direction[0] + offset[1] * direction[1] + offset[2]);
+                float c = offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2] - radius * radius;
+                float discriminant = b * b - 4.0f * a * c;
+
+                if (discriminant > 0.0f) {
+                    float t = (-b - sqrtf(discriminant)) / (2.0f * a);
+                    nearest = t > 0.1f ? std::min(nearest, t) : nearest;
+                }
+            }
+
+            // The direction has a z of 1, so the ray parameter is the view depth
+            depth[(size_t)y * TestWidth + x] = nearest < 200.0f ? nearest : 0.0f;
+        }
+    }
+
+    return depth;
+}
+
+// Light space position of a pixel, as the kernels compute it from the inverse view projection
+static auto lightSpaceTransform(const TestCamera & camera)
+{
+    float rotation[9];
+    lightRotation(rotation);
+
+    return [camera, rotation](uint32_t x, uint32_t y, float depth, float *position) {
+        float world[3] = {
+            (2.0f * x / TestWidth - 1.0f) * depth / camera.scaleX + camera.position[0],
+            (1.0f - 2.0f * y / TestHeight) * depth / camera.scaleY + camera.position[1],
+            depth + camera.position[2],
+        };
+
+        for (int row = 0; row < 3; row++) {
+            position[row] = rotation[3 * row] * world[0] + rotation[3 * row + 1] * world[1] + rotation[3 * row + 2] * world[2];
+        }
+    };
+}
+
+static float pixelSize(const TestCamera & camera)
+{
+    return std::max(2.0f / (camera.scaleX * TestWidth), 2.0f / (camera.scaleY * TestHeight));
+}
+
+// Counts of a run of frames
+struct SparseRun
+{
+    SparseBoundsCoverage singleFrame;
+    SparseBoundsCoverage accumulated;
+    uint64_t fullAtomics;
+    uint64_t sparseAtomics;
+};
+
+// Reduces frameCount frames of a camera moving by speed units per frame, at full rate and
+// sparsely, and checks both the sparse bounds of each frame and their union over the rotation
+// against every sample.  Frames before the first full rotation are not counted.
+static SparseRun runSparseReduction(int stride, float speed, bool padded, int frameCount)
+{
+    SparseRun run = {};
+    SparseBoundsHistory history;
+
+    float lightView[16] = {};
+    lightRotation(lightView);
+
+    for (int frame = 0; frame < frameCount; frame++) {
+        TestCamera camera = makeCamera(0.3f * speed * frame, -5.0f + speed * frame);
+        std::vector<float> depth = renderScene(camera);
+        auto toLightSpace = lightSpaceTransform(camera);
+
+        int full[6 * TestCascadeCount];
+        int sparse[6 * TestCascadeCount];
+
+        for (int i = 0; i < TestCascadeCount; i++) {
+            resetBoundingBox(full + 6 * i);
+            resetBoundingBox(sparse + 6 * i);
+        }
+
+        SparseReductionParams params;
+        params.stride = stride;
+        params.padding = padded ? sparseReductionPadding(stride, pixelSize(camera)) : 0.0f;
+        sparseReductionOffset((unsigned int)frame, stride, &params.offsetX, &params.offsetY);
+
+        uint64_t fullAtomics = reduceLightFrustum(depth.data(), TestWidth, TestHeight, TestCascadeEnds,
+                                                  TestCascadeCount, toLightSpace, full);
+        uint64_t sparseAtomics = reduceLightFrustumSparse(depth.data(), TestWidth, TestHeight, TestCascadeEnds,
+                                                          TestCascadeCount, params, toLightSpace, sparse);
+
+        float boxes[6 * TestCascadeCount];
+        for (int i = 0; i < TestCascadeCount; i++) {
+            decodeBoundingBox(sparse + 6 * i, boxes + 6 * i);
+        }
+
+        SparseBoundsCoverage singleFrame = sparseBoundsCoverage(depth.data(), TestWidth, TestHeight, TestCascadeEnds,
+                                                                TestCascadeCount, toLightSpace, boxes);
+
+        history.accumulate((uint64_t)frame, boxes, TestCascadeCount, stride * stride, lightView);
+
+        if (frame < stride * stride) {
+            continue;
+        }
+
+        SparseBoundsCoverage accumulated = sparseBoundsCoverage(depth.data(), TestWidth, TestHeight, TestCascadeEnds,
+                                                                TestCascadeCount, toLightSpace, boxes);
+
+        run.singleFrame.sampleCount += singleFrame.sampleCount;
+        run.singleFrame.missCount += singleFrame.missCount;
+        run.accumulated.sampleCount += accumulated.sampleCount;
+        run.accumulated.missCount += accumulated.missCount;
+        run.fullAtomics += fullAtomics;
+        run.sparseAtomics += sparseAtomics;
+    }
+
+    return run;
+}
+
+static double missRate(const SparseBoundsCoverage & coverage)
+{
+    return coverage.sampleCount > 0 ? (double)coverage.missCount / (double)coverage.sampleCount : 0.0;
+}
+
+SDSM_TEST(offsetsVisitEveryPixelOfACell)
+{
+    for (int stride = 1; stride <= 4; stride *= 2) {
+        bool visited[4][4] = {};
+        int quadrants = 0;
+
+        for (int frame = 0; frame < stride * stride; frame++) {
+            int x, y;
+            sparseReductionOffset((unsigned int)frame, stride, &x, &y);
+
+            SDSM_CHECK_OR_BREAK(x >= 0 && x < stride && y >= 0 && y < stride);
+            SDSM_CHECK_OR_BREAK(!visited[y][x]);
+            visited[y][x] = true;
+
+            // The first four frames read one pixel of each quadrant of the cell
+            if (frame < 4 && stride > 1) {
+                quadrants |= 1 << ((x >= stride / 2) + 2 * (y >= stride / 2));
+            }
+        }
+
+        SDSM_CHECK(stride == 1 || quadrants == 15);
+
+        // The rotation repeats
+        int x, y;
+        sparseReductionOffset((unsigned int)(stride * stride), stride, &x, &y);
+        SDSM_CHECK(x == 0 && y == 0);
+    }
+}
+
+SDSM_TEST(accumulatedBoundsCoverAStillView)
+{
+    for (int stride = 2; stride <= 4; stride *= 2) {
+        SparseRun run = runSparseReduction(stride, 0.0f, true, stride * stride + 4);
+
+        SDSM_CHECK(run.accumulated.sampleCount > 0);
+        SDSM_CHECK(run.accumulated.missCount == 0);
+
+        // A single frame misses a few silhouette samples
+        SDSM_CHECK(missRate(run.singleFrame) < 0.01);
+    }
+}
+
+SDSM_TEST(accumulatedBoundsRarelyMissAMovingView)
+{
+    for (int stride = 2; stride <= 4; stride *= 2) {
+        SparseRun padded = runSparseReduction(stride, 0.2f, true, 48);
+        SparseRun unpadded = runSparseReduction(stride, 0.2f, false, 48);
+
+        SDSM_CHECK(missRate(padded.accumulated) < 0.0005);
+        SDSM_CHECK(missRate(padded.accumulated) <= missRate(unpadded.accumulated));
+        SDSM_CHECK(missRate(padded.singleFrame) < missRate(unpadded.singleFrame));
+    }
+}
+
+SDSM_TEST(sparseReductionIssuesAShareOfTheAtomics)
+{
+    for (int stride = 2; stride <= 4; stride *= 2) {
+        SparseRun run = runSparseReduction(stride, 0.05f, true, stride * stride + 4);
+        double share = (double)run.sparseAtomics / (double)run.fullAtomics;
+
+        // Padded samples near a split go into both cascades
+        SDSM_CHECK(share >= 0.9 / (stride * stride) && share < 1.1 / (stride * stride));
+    }
+}
+
+SDSM_TEST(historyAddsEachResultOnce)
+{
+    SparseBoundsHistory history;
+    float lightView[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+    float first[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    history.accumulate(1, first, 1, 4, lightView);
+    SDSM_CHECK(history.count() == 1);
+
+    // The same result read again by the next frame
+    float again[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    history.accumulate(1, again, 1, 4, lightView);
+    SDSM_CHECK(history.count() == 1);
+
+    // Empty boxes drop out of the union
+    float empty[6] = {FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    history.accumulate(2, empty, 1, 4, lightView);
+    SDSM_CHECK(history.count() == 2);
+    SDSM_CHECK(empty[0] == 0.0f && empty[3] == 1.0f);
+
+    float second[6] = {-1.0f, 0.5f, 0.5f, 0.5f, 2.0f, 0.5f};
+    history.accumulate(3, second, 1, 4, lightView);
+    SDSM_CHECK(second[0] == -1.0f && second[1] == 0.0f && second[4] == 2.0f && second[5] == 1.0f);
+
+    // Results older than the rotation are forgotten
+    for (uint64_t serial = 4; serial < 8; serial++) {
+        float box[6] = {5.0f, 5.0f, 5.0f, 6.0f, 6.0f, 6.0f};
+        history.accumulate(serial, box, 1, 4, lightView);
+    }
+
+    float last[6] = {5.0f, 5.0f, 5.0f, 6.0f, 6.0f, 6.0f};
+    history.accumulate(7, last, 1, 4, lightView);
+    SDSM_CHECK(history.count() == 4 && last[0] == 5.0f && last[3] == 6.0f);
+
+    // A light change starts over
+    lightView[12] = 1.0f;
+
+    float moved[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    history.accumulate(8, moved, 1, 4, lightView);
+    SDSM_CHECK(history.count() == 1 && moved[0] == 0.0f && moved[3] == 1.0f);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,274 @@
+//
+//  SDSM_SplitOptimizerTests.cpp
+//  DeferredLighting C++
+//
+//  Convergence tests of the feedback split optimizer.  Each frame partitions the depth range with
+//  the optimizer's shares, measures the aliasing error of every cascade with an error model, and
+//  feeds the measurement of a frame lag frames back, as the readback ring does.  The models range
+//  from a closed form of the error to the 95th percentile of the GPU's error histogram.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_SplitOptimizer.h"
+#include "SDSMShared.h"
+
+#include <functional>
+#include <vector>
+
+typedef std::function<void(const float *ends, int cascadeCount, float *errors)> ErrorModel;
+
+static const float TestNearDepth = 1.0f;
+static const float TestFarDepth = 750.0f;
+
+// Relative resolution of each cascade, so the balanced splits are not the log splits
+static const float CascadeResolutions[MAX_CASCADED_SHADOW_COUNT] = {1.0f, 1.6f, 0.7f, 1.3f, 2.0f, 0.5f, 1.0f, 1.2f};
+
+// Largest over smallest error of the cascades with samples
+static float errorSpread(const float *errors, int cascadeCount)
+{
+    float lowest = INFINITY;
+    float highest = 0.0f;
+
+    for (int i = 0; i < cascadeCount; i++) {
+        if (errors[i] > 0.0f) {
+            lowest = std::min(lowest, errors[i]);
+            highest = std::max(highest, errors[i]);
+        }
+    }
+
+    return highest > 0.0f ? highest / lowest : 1.0f;
+}
+
+struct ConvergenceResult
+{
+    float initialSpread;
+    float finalSpread;
+
+    // First frame whose spread was within the tolerance, or -1
+    int convergedFrame;
+
+    // Whether every frame's splits covered the depth range in order
+    bool validSplits;
+};
+
+static ConvergenceResult runOptimizer(const ErrorModel & model, int cascadeCount, int lag, float noise,
+                                      float tolerance, int frameCount = 200)
+{
+    AliasingSplitOptimizer optimizer;
+    SDSMRandom random((uint64_t)(cascadeCount * 10 + lag));
+
+    std::vector<std::vector<float>> ends(frameCount, std::vector<float>(cascadeCount + 1));
+    std::vector<std::vector<float>> errors(frameCount, std::vector<float>(cascadeCount));
+
+    ConvergenceResult result = {0.0f, 0.0f, -1, true};
+
+    for (int frame = 0; frame < frameCount; frame++) {
+        float *frameEnds = ends[frame].data();
+        float *frameErrors = errors[frame].data();
+
+        optimizer.partition(TestNearDepth, TestFarDepth, cascadeCount, frameEnds);
+
+        result.validSplits = result.validSplits &&
+            frameEnds[0] == TestNearDepth && frameEnds[cascadeCount] == TestFarDepth;
+
+        for (int i = 0; i < cascadeCount; i++) {
+            result.validSplits = result.validSplits && frameEnds[i + 1] >= frameEnds[i];
+        }
+
+        model(frameEnds, cascadeCount, frameErrors);
+
+        for (int i = 0; i < cascadeCount; i++) {
+            frameErrors[i] *= 1.0f + noise * random.uniform(-1.0f, 1.0f);
+        }
+
+        float spread = errorSpread(frameErrors, cascadeCount);
+
+        if (frame == 0) {
+            result.initialSpread = spread;
+        }
+
+        result.finalSpread = spread;
+
+        if (result.convergedFrame < 0 && spread < tolerance) {
+            result.convergedFrame = frame;
+        }
+
+        // The newest measurement completed before the next frame
+        int measuredFrame = frame - lag + 1;
+
+        if (measuredFrame >= 0) {
+            optimizer.update(ends[measuredFrame].data(), errors[measuredFrame].data(), cascadeCount);
+        }
+    }
+
+    return result;
+}
+
+// Error proportional to a cascade's log depth extent over its resolution, as for samples spread
+// over the whole depth range
+static void texelShareErrors(const float *ends, int cascadeCount, float *errors)
+{
+    for (int i = 0; i < cascadeCount; i++) {
+        errors[i] = CascadeResolutions[i] * (ends[i + 1] - ends[i]) / ends[i];
+    }
+}
+
+// Samples only beyond depth 20; cascades in front of them measure no error
+static void distantSampleErrors(const float *ends, int cascadeCount, float *errors)
+{
+    for (int i = 0; i < cascadeCount; i++) {
+        errors[i] = ends[i + 1] <= 20.0f ? 0.0f : (ends[i + 1] - ends[i]) / std::max(ends[i], 20.0f);
+    }
+}
+
+// 95th percentile of samples spread evenly in log depth, through the histogram reduce_aliasing_error
+// writes and the percentile the renderer reads from it
+static void percentileErrors(const float *ends, int cascadeCount, float *errors)
+{
+    int aliasingErrors[AliasingErrorLength];
+    resetAliasingErrors(aliasingErrors);
+
+    const int sampleCount = 4000;
+
+    for (int sample = 0; sample < sampleCount; sample++) {
+        float depth = TestNearDepth * powf(TestFarDepth / TestNearDepth, ((float)sample + 0.5f) / (float)sampleCount);
+
+        for (int i = 0; i < cascadeCount; i++) {
+            if (depth >= ends[i] && depth < ends[i + 1]) {
+                float error = shadowAliasingError(depth, ends[i], ends[i + 1], 0.5f, 1920.0f,
+                                                  512.0f * sqrtf(CascadeResolutions[i]));
+
+                int *cascadeErrors = aliasingErrors + i * AliasingErrorCascadeStride;
+
+                cascadeErrors[AliasingErrorMax] = std::max(cascadeErrors[AliasingErrorMax], encodeOrderedFloat(error));
+                cascadeErrors[AliasingErrorBins + aliasingErrorBin(error)]++;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < cascadeCount; i++) {
+        errors[i] = aliasingErrorPercentile(aliasingErrors, i, 0.95f);
+    }
+}
+
+static void checkConvergence(const char *name, const ErrorModel & model, int cascadeCount, int lag,
+                             float noise, float tolerance, int maxFrames)
+{
+    ConvergenceResult result = runOptimizer(model, cascadeCount, lag, noise, tolerance);
+
+    printf("%-22s %d cascades, lag %d, noise %.2f: spread %.2f -> %.3f, within %.2f at frame %d\n",
+           name, cascadeCount, lag, noise, result.initialSpread, result.finalSpread, tolerance, result.convergedFrame);
+
+    SDSM_CHECK(result.validSplits);
+    SDSM_CHECK(result.convergedFrame >= 0 && result.convergedFrame <= maxFrames);
+    SDSM_CHECK(result.finalSpread < tolerance);
+}
+
+SDSM_TEST(convergesForEveryCascadeCountAndLag)
+{
+    for (int cascadeCount : {2, 4, 8}) {
+        for (int lag = 1; lag <= 3; lag++) {
+            // A lag of n frames moves the splits once every n frames
+            checkConvergence("texel shares", texelShareErrors, cascadeCount, lag, 0.0f, 1.05f, 10 * lag);
+        }
+    }
+}
+
+SDSM_TEST(convergesWithCascadesWithoutSamples)
+{
+    for (int cascadeCount : {4, 8}) {
+        checkConvergence("distant samples", distantSampleErrors, cascadeCount, 2, 0.0f, 1.05f, 20);
+    }
+}
+
+SDSM_TEST(staysBalancedUnderMeasurementNoise)
+{
+    // The spread of noisy errors cannot drop below the noise, but must not grow from it
+    checkConvergence("texel shares, noisy", texelShareErrors, 4, 2, 0.05f, 1.05f + 2.0f * 0.05f, 20);
+}
+
+SDSM_TEST(convergesOnTheErrorHistogramPercentile)
+{
+    for (int cascadeCount : {4, 8}) {
+        checkConvergence("95th percentile", percentileErrors, cascadeCount, 2, 0.0f, 1.05f, 20);
+    }
+}
+
+SDSM_TEST(startsFromLogPartitioning)
+{
+    AliasingSplitOptimizer optimizer;
+
+    float ends[5];
+    float logEnds[5];
+
+    optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+    logPartitioning(TestNearDepth, TestFarDepth, 4, logEnds);
+
+    for (int i = 0; i <= 4; i++) {
+        SDSM_CHECK(fabsf(ends[i] - logEnds[i]) <= 1e-4f * logEnds[i]);
+    }
+
+    // Shares learned for one cascade count do not apply to another, and reset forgets them
+    const float errors[4] = {4.0f, 1.0f, 1.0f, 1.0f};
+    optimizer.update(ends, errors, 4);
+
+    optimizer.partition(TestNearDepth, TestFarDepth, 3, ends);
+    logPartitioning(TestNearDepth, TestFarDepth, 3, logEnds);
+
+    for (int i = 0; i <= 3; i++) {
+        SDSM_CHECK(fabsf(ends[i] - logEnds[i]) <= 1e-4f * logEnds[i]);
+    }
+
+    optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+    SDSM_CHECK(ends[1] < logEnds[1]);
+
+    optimizer.reset();
+    optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+    logPartitioning(TestNearDepth, TestFarDepth, 4, logEnds);
+
+    SDSM_CHECK(fabsf(ends[1] - logEnds[1]) <= 1e-4f * logEnds[1]);
+}
+
+SDSM_TEST(sharesKeepTheirMinimum)
+{
+    AliasingSplitOptimizer optimizer(0.5f, 0.02f);
+
+    float ends[5];
+    const float errors[4] = {1000.0f, 1.0f, 1.0f, 1.0f};
+
+    // A cascade with a far larger error than the others keeps shrinking down to its minimum share
+    for (int frame = 0; frame < 100; frame++) {
+        optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+        optimizer.update(ends, errors, 4);
+    }
+
+    optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+
+    float share = logf(ends[1] / ends[0]) / logf(TestFarDepth / TestNearDepth);
+
+    SDSM_CHECK(share >= 0.02f * 0.99f && share < 0.03f);
+    SDSM_CHECK(optimizer.errorSpread() == 1000.0f);
+}
+
+SDSM_TEST(ignoresInvalidMeasurements)
+{
+    AliasingSplitOptimizer optimizer;
+
+    const float errors[4] = {4.0f, 1.0f, 1.0f, 1.0f};
+    const float emptyRange[5] = {10.0f, 10.0f, 10.0f, 10.0f, 10.0f};
+    const float noRange[5] = {0.0f, 1.0f, 2.0f, 3.0f, 4.0f};
+
+    optimizer.update(emptyRange, errors, 4);
+    optimizer.update(noRange, errors, 4);
+
+    float ends[5];
+    float logEnds[5];
+
+    optimizer.partition(TestNearDepth, TestFarDepth, 4, ends);
+    logPartitioning(TestNearDepth, TestFarDepth, 4, logEnds);
+
+    SDSM_CHECK(fabsf(ends[1] - logEnds[1]) <= 1e-4f * logEnds[1]);
+}
+
+SDSM_TEST_MAIN()
@@ -0,0 +1,212 @@
+//
+//  SDSM_TileReductionTests.cpp
+//  DeferredLighting C++
+//
+//  Tests of the CPU reference of reduce_depth_histogram_tile: reducing per tile and merging the
+//  partial histograms gives the frame histogram of reduceDepthHistogram bit for bit for any image
+//  size and tile size, tiles without samples merge nothing, and a tile issues one device atomic
+//  per histogram entry its samples reached.
+//
+
+#include "SDSMTest.h"
+#include "SDSM_Reduction.h"
+
+static const float TestNearPlane = 1.0f;
+static const float TestFarPlane = 750.0f;
+
+// Light space position of a sample, an arbitrary function of the pixel and its depth that gives
+// every sample its own coordinates, negative ones included
+static void testLightSpace(uint32_t x, uint32_t y, float depth, float *position)
+{
+    position[0] = (float)x * 0.37f - depth * 0.2f;
+    position[1] = depth * 0.9f - (float)y * 0.11f;
+    position[2] = (float)(x ^ y) * 0.05f - 3.0f;
+}
+
+// Depth image with holes of empty pixels and samples strictly between the near and far planes
+static std::vector<float> makeDepthImage(uint32_t width, uint32_t height, float emptyFraction, SDSMRandom & random)
+{
+    std::vector<float> depth((size_t)width * height);
+
+    for (float & sample : depth) {
+        float t = random.uniform(0.001f, 0.999f);
+
+        sample = random.uniform(0.0f, 1.0f) < emptyFraction ? 0.0f : TestNearPlane * powf(TestFarPlane / TestNearPlane, t);
+    }
+
+    return depth;
+}
+
+static void reduceBoth(const std::vector<float> & depth, uint32_t width, uint32_t height, uint32_t tileSize,
+                       int *histogram, int *tiledHistogram, uint64_t *tiledAtomicCount)
+{
+    resetDepthHistogram(histogram, TestNearPlane, TestFarPlane);
+    resetDepthHistogram(tiledHistogram, TestNearPlane, TestFarPlane);
+
+    reduceDepthHistogram(depth.data(), width, height, TestNearPlane, TestFarPlane, testLightSpace, histogram);
+
+    *tiledAtomicCount = reduceDepthHistogramTiled(depth.data(), width, height, TestNearPlane, TestFarPlane,
+                                                  testLightSpace, tiledHistogram, tileSize);
+}
+
+SDSM_TEST(tiledReductionMatchesTheFullRateHistogram)
+{
+    SDSMRandom random(11);
+
+    int histogram[DepthHistogramLength];
+    int tiledHistogram[DepthHistogramLength];
+
+    for (int trial = 0; trial < 300; trial++) {
+        // Sizes on and off the tile grid, down to a single pixel
+        uint32_t width = (uint32_t)random.integer(1, 70);
+        uint32_t height = (uint32_t)random.integer(1, 70);
+        uint32_t tileSize = trial % 3 == 0 ? (uint32_t)random.integer(1, 40) : SDSM_REDUCTION_TILE_SIZE;
+        float emptyFraction = random.uniform(0.0f, 1.0f);
+
+        std::vector<float> depth = makeDepthImage(width, height, emptyFraction, random);
+
+        uint64_t atomicCount;
+        reduceBoth(depth, width, height, tileSize, histogram, tiledHistogram, &atomicCount);
+
+        SDSM_CHECK_OR_BREAK(memcmp(histogram, tiledHistogram, sizeof(histogram)) == 0);
+    }
+}
+
+SDSM_TEST(mergeCombinesEachEntryByItsOp)
+{
+    // Bin counts add up and the depth range and boxes only widen, whatever the partial holds
+    int histogram[DepthHistogramLength];
+    int partial[DepthHistogramLength];
+
+    resetDepthHistogram(histogram, TestNearPlane, TestFarPlane);
+    resetDepthHistogram(partial, TestNearPlane, TestFarPlane);
+
+    SDSM_CHECK(mergeDepthHistogram(partial, TestNearPlane, TestFarPlane, histogram) == 0);
+
+    for (int i = 0; i < DepthHistogramLength; i++) {
+        histogram[i] = 10 + i;
+        partial[i] = i % 2 == 0 ? 5 + i : 20 + i;
+    }
+
+    int merged[DepthHistogramLength];
+    memcpy(merged, histogram, sizeof(merged));
+
+    SDSM_CHECK(mergeDepthHistogram(partial, TestNearPlane, TestFarPlane, merged) == DepthHistogramLength);
+
+    for (int i = 0; i < DepthHistogramLength; i++) {
+        int expected = 0;
+
+        switch (depthHistogramMergeOp(i)) {
+            case DepthHistogramMergeMin: expected = std::min(histogram[i], partial[i]); break;
+            case DepthHistogramMergeMax: expected = std::max(histogram[i], partial[i]); break;
+            case DepthHistogramMergeAdd: expected = histogram[i] + partial[i]; break;
+        }
+
+        SDSM_CHECK_OR_BREAK(merged[i] == expected);
+    }
+
+    SDSM_CHECK(depthHistogramMergeOp(DepthHistogramMinDepth) == DepthHistogramMergeMin);
+    SDSM_CHECK(depthHistogramMergeOp(DepthHistogramMaxDepth) == DepthHistogramMergeMax);
+
+    for (int bin = 0; bin < SDSM_HISTOGRAM_BIN_COUNT; bin++) {
+        int index = DepthHistogramBins + bin * DepthHistogramBinStride;
+
+        SDSM_CHECK_OR_BREAK(depthHistogramMergeOp(index + DepthHistogramBinCount) == DepthHistogramMergeAdd);
+
+        for (int axis = 0; axis < 3; axis++) {
+            SDSM_CHECK_OR_BREAK(depthHistogramMergeOp(index + DepthHistogramBinBoundingBox + axis) == DepthHistogramMergeMin);
+            SDSM_CHECK_OR_BREAK(depthHistogramMergeOp(index + DepthHistogramBinBoundingBox + axis + 3) == DepthHistogramMergeMax);
+        }
+    }
+}
+
+SDSM_TEST(emptyTilesMergeNothing)
+{
+    const uint32_t width = 5 * SDSM_REDUCTION_TILE_SIZE + 3;
+    const uint32_t height = 3 * SDSM_REDUCTION_TILE_SIZE + 7;
+
+    int histogram[DepthHistogramLength];
+    int tiledHistogram[DepthHistogramLength];
+    uint64_t atomicCount;
+
+    // All sky: nothing changes and no tile issues an atomic
+    std::vector<float> depth((size_t)width * height, 0.0f);
+    reduceBoth(depth, width, height, SDSM_REDUCTION_TILE_SIZE, histogram, tiledHistogram, &atomicCount);
+
+    int reset[DepthHistogramLength];
+    resetDepthHistogram(reset, TestNearPlane, TestFarPlane);
+
+    SDSM_CHECK(memcmp(tiledHistogram, reset, sizeof(reset)) == 0);
+    SDSM_CHECK(memcmp(histogram, reset, sizeof(reset)) == 0);
+    SDSM_CHECK(atomicCount == 0);
+
+    // One sample in the last, partial tile: only that tile merges, and the result still matches
+    depth[(size_t)(height - 1) * width + width - 1] = 42.0f;
+    reduceBoth(depth, width, height, SDSM_REDUCTION_TILE_SIZE, histogram, tiledHistogram, &atomicCount);
+
+    SDSM_CHECK(memcmp(histogram, tiledHistogram, sizeof(histogram)) == 0);
+
+    // The depth range, the bin count and the six box entries of the sample's bin
+    SDSM_CHECK(atomicCount == 2 + DepthHistogramBinStride);
+
+    int bin = depthHistogramBin(42.0f, TestNearPlane, TestFarPlane);
+    SDSM_CHECK(tiledHistogram[DepthHistogramBins + bin * DepthHistogramBinStride + DepthHistogramBinCount] == 1);
+    SDSM_CHECK(tiledHistogram[DepthHistogramMinDepth] == encodeOrderedFloat(42.0f));
+    SDSM_CHECK(tiledHistogram[DepthHistogramMaxDepth] == encodeOrderedFloat(42.0f));
+}
+
+SDSM_TEST(atomicsPerTileFollowTheOccupiedBins)
+{
+    SDSMRandom random(12);
+
+    int histogram[DepthHistogramLength];
+    int tiledHistogram[DepthHistogramLength];
+
+    for (int trial = 0; trial < 50; trial++) {
+        uint32_t width = (uint32_t)random.integer(1, 120);
+        uint32_t height = (uint32_t)random.integer(1, 120);
+        std::vector<float> depth = makeDepthImage(width, height, random.uniform(0.0f, 1.0f), random);
+
+        uint64_t atomicCount;
+        reduceBoth(depth, width, height, SDSM_REDUCTION_TILE_SIZE, histogram, tiledHistogram, &atomicCount);
+
+        // A tile with samples merges its depth range plus the count and box of each bin it reached
+        uint64_t expected = 0;
+
+        for (uint32_t tileY = 0; tileY < height; tileY += SDSM_REDUCTION_TILE_SIZE) {
+            for (uint32_t tileX = 0; tileX < width; tileX += SDSM_REDUCTION_TILE_SIZE) {
+                bool occupied[SDSM_HISTOGRAM_BIN_COUNT] = {};
+                bool any = false;
+
+                for (uint32_t y = tileY; y < std::min(tileY + SDSM_REDUCTION_TILE_SIZE, height); y++) {
+                    for (uint32_t x = tileX; x < std::min(tileX + SDSM_REDUCTION_TILE_SIZE, width); x++) {
+                        float sample = depth[y * width + x];
+
+                        if (sample > 0.0f) {
+                            occupied[depthHistogramBin(sample, TestNearPlane, TestFarPlane)] = true;
+                            any = true;
+                        }
+                    }
+                }
+
+                expected += any ? 2 : 0;
+
+                for (bool binOccupied : occupied) {
+                    expected += binOccupied ? DepthHistogramBinStride : 0;
+                }
+            }
+        }
+
+        SDSM_CHECK_OR_BREAK(atomicCount == expected);
+
+        // Never more than the full rate reduction's 9 per sample
+        uint64_t sampleCount = 0;
+        for (float sample : depth) {
+            sampleCount += sample > 0.0f ? 1 : 0;
+        }
+
+        SDSM_CHECK_OR_BREAK(atomicCount <= 9 * sampleCount);
+    }
+}
+
+SDSM_TEST_MAIN()